@@ -0,0 +1,141 @@
+#include "admin.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MAX_ADMIN_COMMANDS 32
+#define MAX_ADMIN_LINE 256
+#define ADMIN_IDLE_TIMEOUT_S 15     // sessions servies une à une : une session sans commande est fermée
+
+typedef struct AdminCommand {
+    const char *name;
+    const char *help;
+    AdminHandler handler;
+} AdminCommand;
+
+static AdminCommand commands[MAX_ADMIN_COMMANDS];
+static int command_count = 0;
+static int admin_socket = -1;
+
+int admin_register(const char *command, const char *help, const AdminHandler handler) {
+    if (command_count >= MAX_ADMIN_COMMANDS) {
+        return -1;
+    }
+    commands[command_count++] = (AdminCommand){command, help, handler};
+    return 0;
+}
+
+static void print_help(FILE *out) {
+    fprintf(out, "Available commands:\n");
+    for (int i = 0; i < command_count; ++i) {
+        fprintf(out, "  %-12s %s\n", commands[i].name, commands[i].help);
+    }
+    fprintf(out, "  %-12s %s\n", "help", "show this help message");
+    fprintf(out, "  %-12s %s\n", "quit", "close the admin session");
+}
+
+// Exécute une ligne de commande ; renvoie 0 pour terminer la session
+static int run_command(FILE *out, char *line) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *args = line + strcspn(line, " ");
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+
+    if (line[0] == '\0') {
+        return 1;
+    }
+    if (strcmp(line, "quit") == 0) {
+        return 0;
+    }
+    if (strcmp(line, "help") == 0) {
+        print_help(out);
+        return 1;
+    }
+    for (int i = 0; i < command_count; ++i) {
+        if (strcmp(line, commands[i].name) == 0) {
+            commands[i].handler(out, args);
+            return 1;
+        }
+    }
+    fprintf(out, "Unknown command '%s' (try 'help')\n", line);
+    return 1;
+}
+
+static void handle_session(const int socket) {
+    // Lectures et écritures bornées : un client inactif ou qui ne lit plus est déconnecté
+    const struct timeval timeout = {ADMIN_IDLE_TIMEOUT_S, 0};
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Deux flux distincts pour la lecture et l'écriture sur la même socket
+    FILE *in = fdopen(dup(socket), "r");
+    FILE *out = fdopen(socket, "w");
+    if (!in || !out) {
+        if (in) fclose(in);
+        if (out) fclose(out); else close(socket);
+        return;
+    }
+
+    char line[MAX_ADMIN_LINE];
+    while (fgets(line, sizeof(line), in)) {
+        const int keep_going = run_command(out, line);
+        fflush(out);
+        if (!keep_going) {
+            break;
+        }
+    }
+    if (ferror(in) && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        fprintf(out, "Session closed after %d s without a command\n", ADMIN_IDLE_TIMEOUT_S);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+static void *admin_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        const int socket = accept(admin_socket, NULL, NULL);
+        if (socket < 0) {
+            continue;
+        }
+        handle_session(socket);
+    }
+    return NULL;
+}
+
+int admin_start(const int port) {
+    admin_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (admin_socket < 0) {
+        return -1;
+    }
+
+    const int reuse = 1;
+    setsockopt(admin_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = {0};
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+
+    if (bind(admin_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(admin_socket, 4) < 0) {
+        close(admin_socket);
+        admin_socket = -1;
+        return -1;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, admin_thread, NULL) != 0) {
+        close(admin_socket);
+        admin_socket = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef CHAT_ADMIN_H
+#define CHAT_ADMIN_H
+
+#include <stdio.h>
+
+// Interface d'administration : un thread écoute sur 127.0.0.1:<port> et
+// exécute des commandes texte, une par ligne (ex. `echo locks | nc 127.0.0.1 30002`).
+// Les sessions sont servies une à une ; une session inactive 15 s est fermée.
+// Chaque module enregistre ses propres commandes avec admin_register().
+
+typedef void (*AdminHandler)(FILE *out, const char *args);
+
+// À appeler avant admin_start() ; renvoie -1 si la table est pleine
+int admin_register(const char *command, const char *help, AdminHandler handler);
+
+// Démarre le thread d'administration ; renvoie -1 en cas d'erreur
+int admin_start(int port);
+
+#endif
@@ -0,0 +1,206 @@
+// Benchmark de diffusion : coût de la boucle de distribution par destinataire.
+// Ouvre N membres inactifs (ils ne lisent pas), fait envoyer M messages par un
+// dernier membre, puis lit les compteurs de la commande d'admin « broadcast »
+// avant et après pour en déduire les cycles par destinataire.
+//
+//   ./server -n -r 0 -R 0 -u 100000 -i 3600000 &
+//   make bench && ./bench/fanout_bench [-c 10000] [-m 200]
+//
+// Comme pour idle_bench, les connexions partent de plusieurs adresses source au-delà
+// de 25 000 et le banc d'essai comme le serveur doivent pouvoir ouvrir N descripteurs.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+#define SERVER_PORT 30001
+#define DEFAULT_ADMIN_PORT 30002
+#define CONNECTIONS_PER_SOURCE 25000
+#define MESSAGE_LEN 64
+
+typedef struct BroadcastCounters {
+    unsigned long long messages;
+    unsigned long long recipients;
+    unsigned long long cycles;
+} BroadcastCounters;
+
+static int open_member(const size_t index) {
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in source = {0};
+    source.sin_family = AF_INET;
+    source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + (uint32_t)(index / CONNECTIONS_PER_SOURCE));
+    struct sockaddr_in server = {0};
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.sin_port = htons(SERVER_PORT);
+
+    if (bind(sock, (struct sockaddr *)&source, sizeof(source)) < 0 ||
+        connect(sock, (struct sockaddr *)&server, sizeof(server)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    char name[PROTOCOL_NAME_LEN] = {0};
+    snprintf(name, sizeof(name), "member%zu", index);
+    if (send_all(sock, name, sizeof(name)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Somme des compteurs de tous les workers
+static int read_counters(const int admin_port, BroadcastCounters *counters) {
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    struct sockaddr_in admin = {0};
+    admin.sin_family = AF_INET;
+    admin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    admin.sin_port = htons((uint16_t)admin_port);
+    const char request[] = "broadcast\nquit\n";
+    if (connect(sock, (struct sockaddr *)&admin, sizeof(admin)) < 0 ||
+        send_all(sock, request, sizeof(request) - 1) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    FILE *reply = fdopen(sock, "r");
+    if (!reply) {
+        close(sock);
+        return -1;
+    }
+    memset(counters, 0, sizeof(*counters));
+    char line[256];
+    while (fgets(line, sizeof(line), reply)) {
+        int worker;
+        size_t members;
+        BroadcastCounters row;
+        if (sscanf(line, "worker %d: %zu members, %llu messages, %llu recipients, %llu cycles", &worker, &members,
+                   &row.messages, &row.recipients, &row.cycles) == 5) {
+            counters->messages += row.messages;
+            counters->recipients += row.recipients;
+            counters->cycles += row.cycles;
+        }
+    }
+    fclose(reply);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = 10000;
+    size_t messages = 200;
+    int admin_port = DEFAULT_ADMIN_PORT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:m:a:")) != -1) {
+        switch (opt) {
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                messages = strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                admin_port = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c members] [-m messages] [-a admin_port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (count == 0 || messages == 0) {
+        fprintf(stderr, "Usage: %s [-c members] [-m messages] [-a admin_port]\n", argv[0]);
+        return 1;
+    }
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < count + 16) {
+            fprintf(stderr, "warning: descriptor limit %llu is below %zu connections\n",
+                    (unsigned long long)limit.rlim_cur, count);
+        }
+    }
+
+    int *sockets = malloc(count * sizeof(int));
+    if (!sockets) {
+        perror("malloc");
+        return 1;
+    }
+    size_t opened = 0;
+    for (; opened < count; ++opened) {
+        sockets[opened] = open_member(opened);
+        if (sockets[opened] < 0) {
+            fprintf(stderr, "stopped after %zu connections: %s\n", opened, strerror(errno));
+            break;
+        }
+    }
+    if (opened < 2) {
+        fprintf(stderr, "not enough members\n");
+        return 1;
+    }
+    // Laisse le serveur terminer les poignées de main
+    sleep(2);
+
+    BroadcastCounters before, after;
+    if (read_counters(admin_port, &before) < 0) {
+        perror("Error reading the admin interface");
+        return 1;
+    }
+
+    // Le dernier membre parle, tous reçoivent (lui compris)
+    const int sender = sockets[opened - 1];
+    char payload[MESSAGE_LEN];
+    memset(payload, 'x', sizeof(payload));
+    for (size_t i = 0; i < messages; ++i) {
+        uint8_t frame[sizeof(FrameHeader) + MESSAGE_LEN];
+        const size_t length = encode_frame(frame, FRAME_CHAT, 0, payload, sizeof(payload));
+        if (send_all(sender, frame, length) < 0) {
+            perror("Error sending a message");
+            break;
+        }
+        // Un message par itération du serveur : on mesure la boucle, pas le regroupement
+        usleep(2000);
+    }
+
+    // Avec beaucoup de membres, le serveur peut avoir du retard : on attend la distribution
+    for (int wait = 0; wait < 30; ++wait) {
+        sleep(1);
+        if (read_counters(admin_port, &after) < 0) {
+            perror("Error reading the admin interface");
+            return 1;
+        }
+        if (after.messages - before.messages >= messages) {
+            break;
+        }
+    }
+    const unsigned long long recipients = after.recipients - before.recipients;
+    printf("members         %zu\n", opened);
+    printf("messages        %llu\n", after.messages - before.messages);
+    printf("recipients      %llu\n", recipients);
+    if (recipients > 0) {
+        printf("per recipient   %.1f cycles\n", (double)(after.cycles - before.cycles) / (double)recipients);
+    }
+
+    for (size_t i = 0; i < opened; ++i) {
+        close(sockets[i]);
+    }
+    free(sockets);
+    return 0;
+}
@@ -0,0 +1,320 @@
+// Benchmark de fédération : débit agrégé du salon réparti sur N serveurs reliés.
+// Sur chaque serveur, c membres dont un émetteur ; chaque émetteur envoie m messages
+// (au plus W sans avoir reçu leur écho) et chaque membre doit recevoir les messages de
+// tous les émetteurs, dans l'ordre de chacun. Le débit compté est celui des livraisons
+// (messages × membres) ; l'ordre par émetteur et les pertes sont vérifiés.
+//
+//   ./server -n -r 0 -R 0 -a 0 -u 1000 -p 30001 -f 31001 &
+//   ./server -n -r 0 -R 0 -a 0 -u 1000 -p 30011 -f 31011 -F 31001 &
+//   ./server -n -r 0 -R 0 -a 0 -u 1000 -p 30021 -F 31001 -F 31011 &
+//   make bench && ./bench/federation_bench -p 30001,30011,30021 [-c members] [-m messages] [-W window]
+//
+// Comparer avec un seul serveur (-p 30001) à charge égale par serveur : chaque serveur
+// ne distribue qu'à ses propres membres et reçoit une trame par message distant.
+//
+// Passerelles (chat_gateway) devant un seul serveur : les ports sont ceux des passerelles,
+// comparer le temps CPU du serveur avec les mêmes membres connectés directement
+// (-p 30011,30011 ; server -P au-delà de 100 membres pour qu'ils reçoivent « ready »).
+//
+//   ./server -n -r 0 -R 0 -s 0 -u 10000 -p 30011 -f 31001 &
+//   ./chat_gateway -n -r 0 -R 0 -s 0 -p 30101 -b 31001 &
+//   ./chat_gateway -n -r 0 -R 0 -s 0 -p 30201 -b 31001 &
+//   ./bench/federation_bench -p 30101,30201 -c 200 -m 5000
+
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+#define MAX_SERVERS 16
+#define MAX_MEMBERS 4096
+#define READ_SIZE 65536
+#define READY_TIMEOUT_MS 10000
+#define STALL_TIMEOUT_MS 10000
+
+typedef struct Member {
+    int sock;
+    int server;
+    char *in;
+    size_t in_len;
+    uint64_t *next;             // prochain numéro attendu de chaque émetteur
+    uint64_t received;          // messages chronométrés reçus
+    uint64_t ready;             // annonces « ready » reçues
+} Member;
+
+typedef struct Run {
+    Member members[MAX_MEMBERS];
+    size_t member_count;
+    int senders[MAX_SERVERS];   // indice du membre émetteur de chaque serveur
+    uint64_t sent[MAX_SERVERS];
+    size_t server_count;
+    uint64_t out_of_order;
+} Run;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int open_member(const int port, const char *name) {
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    struct sockaddr_in server = {.sin_family = AF_INET, .sin_port = htons((uint16_t)port)};
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int enable = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    char nom[PROTOCOL_NAME_LEN] = {0};
+    snprintf(nom, sizeof(nom), "%s", name);
+    if (connect(sock, (struct sockaddr *)&server, sizeof(server)) < 0 || send_all(sock, nom, sizeof(nom)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Ligne « sK : texte » d'un émetteur ; -1 pour les autres lignes
+static int parse_line(const Run *run, const char *text, const size_t length, uint64_t *number, int *ready) {
+    char line[128];
+    const size_t n = length < sizeof(line) - 1 ? length : sizeof(line) - 1;
+    memcpy(line, text, n);
+    line[n] = '\0';
+    unsigned sender;
+    char word[32];
+    if (sscanf(line, "s%u : %31s", &sender, word) != 2 || sender >= run->server_count) {
+        return -1;
+    }
+    *ready = strcmp(word, "ready") == 0;
+    *number = strtoull(word, NULL, 10);
+    return (int)sender;
+}
+
+static void handle_text(Run *run, Member *member, const char *text, const size_t length) {
+    uint64_t number;
+    int ready;
+    const int sender = parse_line(run, text, length, &number, &ready);
+    if (sender < 0) {
+        return;
+    }
+    if (ready) {
+        member->ready++;
+        return;
+    }
+    if (number != member->next[sender]) {
+        run->out_of_order++;
+    }
+    member->next[sender] = number + 1;
+    member->received++;
+}
+
+// Lit ce qui est disponible ; -1 si la connexion est perdue
+static int member_read(Run *run, Member *member) {
+    const ssize_t received = recv(member->sock, member->in + member->in_len, READ_SIZE - member->in_len, MSG_DONTWAIT);
+    if (received <= 0) {
+        return received < 0 && (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    member->in_len += (size_t)received;
+    size_t offset = 0;
+    while (member->in_len - offset >= sizeof(FrameHeader)) {
+        FrameHeader header;
+        memcpy(&header, member->in + offset, sizeof(header));
+        header.length = ntohl(header.length);
+        if (header.length > MAX_FRAME_PAYLOAD) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (member->in_len - offset < sizeof(header) + header.length) {
+            break;
+        }
+        if (header.type == FRAME_TEXT) {
+            handle_text(run, member, member->in + offset + sizeof(header), header.length);
+        }
+        offset += sizeof(header) + header.length;
+    }
+    memmove(member->in, member->in + offset, member->in_len - offset);
+    member->in_len -= offset;
+    return 0;
+}
+
+static int send_text(const int sock, const char *text) {
+    return send_frame(sock, FRAME_CHAT, 0, text, strlen(text));
+}
+
+// Lit tous les membres pendant au plus timeout_ms ; -1 si une connexion est perdue
+static int poll_members(Run *run, struct pollfd *fds, const int timeout_ms) {
+    const int ready = poll(fds, run->member_count, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (size_t i = 0; i < run->member_count && ready > 0; ++i) {
+        if (fds[i].revents && member_read(run, &run->members[i]) < 0) {
+            fprintf(stderr, "member %zu on server %d: connection lost\n", i, run->members[i].server);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int ports[MAX_SERVERS];
+    size_t server_count = 0;
+    size_t members = 10;
+    uint64_t messages = 20000;
+    uint64_t window = 64;
+    const char *port_list = "30001";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:m:W:")) != -1) {
+        switch (opt) {
+            case 'p':
+                port_list = optarg;
+                break;
+            case 'c':
+                members = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                messages = strtoull(optarg, NULL, 10);
+                break;
+            case 'W':
+                window = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-p port,port...] [-c members per server] [-m messages per sender] [-W window]\n", argv[0]);
+                return 1;
+        }
+    }
+    for (const char *cursor = port_list; *cursor && server_count < MAX_SERVERS;) {
+        char *end;
+        ports[server_count++] = (int)strtol(cursor, &end, 10);
+        cursor = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            server_count = 0;
+            break;
+        }
+    }
+    if (server_count == 0 || members == 0 || members * server_count > MAX_MEMBERS || messages == 0 || window == 0) {
+        fprintf(stderr, "Usage: %s [-p port,port...] [-c members per server] [-m messages per sender] [-W window]\n", argv[0]);
+        return 1;
+    }
+
+    Run *run = calloc(1, sizeof(Run));
+    struct pollfd *fds = calloc(MAX_MEMBERS, sizeof(struct pollfd));
+    if (!run || !fds) {
+        perror("calloc");
+        return 1;
+    }
+    run->server_count = server_count;
+    for (size_t s = 0; s < server_count; ++s) {
+        for (size_t k = 0; k < members; ++k) {
+            char name[32];
+            // Le premier membre de chaque serveur est son émetteur
+            if (k == 0) {
+                snprintf(name, sizeof(name), "s%zu", s);
+            } else {
+                snprintf(name, sizeof(name), "m%zu_%zu", s, k);
+            }
+            Member *member = &run->members[run->member_count];
+            member->server = (int)s;
+            member->sock = open_member(ports[s], name);
+            member->in = malloc(READ_SIZE);
+            member->next = calloc(server_count, sizeof(uint64_t));
+            if (member->sock < 0 || !member->in || !member->next) {
+                fprintf(stderr, "server on port %d: connection failed: %s\n", ports[s], strerror(errno));
+                return 1;
+            }
+            if (k == 0) {
+                run->senders[s] = (int)run->member_count;
+            }
+            fds[run->member_count] = (struct pollfd){.fd = member->sock, .events = POLLIN};
+            run->member_count++;
+        }
+    }
+
+    // Les liens de fédération sont établis quand chaque membre a reçu l'annonce de
+    // chaque émetteur
+    for (size_t s = 0; s < server_count; ++s) {
+        if (send_text(run->members[run->senders[s]].sock, "ready") < 0) {
+            perror("Error sending a message");
+            return 1;
+        }
+    }
+    const uint64_t ready_deadline = now_ms() + READY_TIMEOUT_MS;
+    for (;;) {
+        size_t waiting = 0;
+        for (size_t i = 0; i < run->member_count; ++i) {
+            waiting += run->members[i].ready < server_count;
+        }
+        if (waiting == 0) {
+            break;
+        }
+        if (now_ms() > ready_deadline) {
+            fprintf(stderr, "%zu members did not hear from every server: are the federation links up?\n", waiting);
+            return 1;
+        }
+        if (poll_members(run, fds, 100) < 0) {
+            return 1;
+        }
+    }
+
+    const uint64_t expected = messages * server_count;
+    const uint64_t start = now_ms();
+    uint64_t last_progress = start;
+    uint64_t last_total = 0;
+    for (;;) {
+        // Chaque émetteur garde au plus window messages sans écho
+        for (size_t s = 0; s < server_count; ++s) {
+            const Member *sender = &run->members[run->senders[s]];
+            const uint64_t echoed = sender->next[s];
+            char text[32];
+            while (run->sent[s] < messages && run->sent[s] - echoed < window) {
+                snprintf(text, sizeof(text), "%llu", (unsigned long long)run->sent[s]);
+                if (send_text(sender->sock, text) < 0) {
+                    perror("Error sending a message");
+                    return 1;
+                }
+                run->sent[s]++;
+            }
+        }
+        uint64_t total = 0;
+        size_t done = 0;
+        for (size_t i = 0; i < run->member_count; ++i) {
+            total += run->members[i].received;
+            done += run->members[i].received >= expected;
+        }
+        if (done == run->member_count) {
+            break;
+        }
+        const uint64_t now = now_ms();
+        if (total != last_total) {
+            last_total = total;
+            last_progress = now;
+        } else if (now - last_progress > STALL_TIMEOUT_MS) {
+            fprintf(stderr, "no progress for %d s: %llu of %llu deliveries\n", STALL_TIMEOUT_MS / 1000,
+                    (unsigned long long)total, (unsigned long long)(expected * run->member_count));
+            return 1;
+        }
+        if (poll_members(run, fds, 100) < 0) {
+            return 1;
+        }
+    }
+    const double elapsed = (double)(now_ms() - start) / 1e3;
+    const double deliveries = (double)expected * (double)run->member_count;
+
+    printf("servers         %zu\n", server_count);
+    printf("members         %zu (%zu per server, one sender each)\n", run->member_count, members);
+    printf("messages        %llu (%llu per sender)\n", (unsigned long long)expected, (unsigned long long)messages);
+    printf("elapsed         %.2f s\n", elapsed);
+    printf("published       %.0f messages/s\n", (double)expected / elapsed);
+    printf("delivered       %.0f messages/s\n", deliveries / elapsed);
+    printf("out of order    %llu\n", (unsigned long long)run->out_of_order);
+    return run->out_of_order ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+// Benchmark de l'anneau de hachage cohérent : coût d'une recherche, équilibre des
+// clés entre les nœuds et part des clés déplacées quand un nœud arrive ou part
+// (idéalement 1/(N+1) et 1/N, et seulement vers ou depuis ce nœud).
+//
+//   make bench && ./bench/hashring_bench [-n nodes] [-k keys] [-l lookups]
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashring.h"
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void node_name(char *name, const size_t size, const int node) {
+    snprintf(name, size, "127.0.0.1:%d", 31001 + 10 * node);
+}
+
+static void key_name(char *name, const size_t size, const size_t key) {
+    snprintf(name, size, "room-%zu", key);
+}
+
+// Indice du nœud propriétaire de chaque clé (nom de la forme node_name)
+static void place_keys(const HashRing *ring, int *owners, const size_t keys) {
+    char key[32];
+    for (size_t k = 0; k < keys; ++k) {
+        key_name(key, sizeof(key), k);
+        const char *node = hashring_lookup(ring, key, strlen(key));
+        owners[k] = (atoi(strrchr(node, ':') + 1) - 31001) / 10;
+    }
+}
+
+// Clés qui ont changé de nœud ; celles qui ne partent pas de (ou vers) node sont en trop
+static void report_moves(const char *what, const int *before, const int *after, const size_t keys, const int node,
+                         const double ideal) {
+    size_t moved = 0;
+    size_t stray = 0;
+    for (size_t k = 0; k < keys; ++k) {
+        if (before[k] != after[k]) {
+            moved++;
+            stray += before[k] != node && after[k] != node;
+        }
+    }
+    printf("%-14s %5.2f%% of keys moved (ideal %.2f%%), %zu between other nodes\n", what,
+           100.0 * (double)moved / (double)keys, 100.0 * ideal, stray);
+}
+
+int main(int argc, char *argv[]) {
+    int nodes = 8;
+    size_t keys = 100000;
+    size_t lookups = 10000000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:k:l:")) != -1) {
+        switch (opt) {
+            case 'n':
+                nodes = atoi(optarg);
+                break;
+            case 'k':
+                keys = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                lookups = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n nodes] [-k keys] [-l lookups]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (nodes < 2 || nodes >= HASHRING_MAX_NODES || keys == 0 || lookups == 0) {
+        fprintf(stderr, "Usage: %s [-n nodes (2..%d)] [-k keys] [-l lookups]\n", argv[0], HASHRING_MAX_NODES - 1);
+        return 1;
+    }
+
+    HashRing *ring = hashring_create();
+    int *before = malloc(keys * sizeof(int));
+    int *after = malloc(keys * sizeof(int));
+    size_t *load = calloc((size_t)nodes + 1, sizeof(size_t));
+    if (!ring || !before || !after || !load) {
+        perror("malloc");
+        return 1;
+    }
+    char name[HASHRING_NAME_LEN];
+    for (int i = 0; i < nodes; ++i) {
+        node_name(name, sizeof(name), i);
+        hashring_add(ring, name);
+    }
+
+    // Recherche : une clé parmi 1024 noms préparés, pour ne pas mesurer snprintf
+    char (*names)[32] = malloc(1024 * sizeof(*names));
+    if (!names) {
+        perror("malloc");
+        return 1;
+    }
+    for (size_t k = 0; k < 1024; ++k) {
+        key_name(names[k], sizeof(names[k]), k);
+    }
+    size_t checksum = 0;
+    const double start = now_s();
+    for (size_t i = 0; i < lookups; ++i) {
+        const char *key = names[i & 1023];
+        checksum += (size_t)hashring_lookup(ring, key, strlen(key))[10];
+    }
+    const double elapsed = now_s() - start;
+
+    place_keys(ring, before, keys);
+    for (size_t k = 0; k < keys; ++k) {
+        load[before[k]]++;
+    }
+    size_t min = keys;
+    size_t max = 0;
+    for (int i = 0; i < nodes; ++i) {
+        min = load[i] < min ? load[i] : min;
+        max = load[i] > max ? load[i] : max;
+    }
+    const double mean = (double)keys / nodes;
+
+    printf("nodes          %d (%d points each)\n", nodes, HASHRING_REPLICAS);
+    printf("keys           %zu\n", keys);
+    printf("lookup         %.1f ns (checksum %zu)\n", elapsed * 1e9 / (double)lookups, checksum & 0xff);
+    printf("balance        min %.2f, max %.2f of the mean load\n", (double)min / mean, (double)max / mean);
+
+    node_name(name, sizeof(name), nodes);
+    hashring_add(ring, name);
+    place_keys(ring, after, keys);
+    report_moves("node added", before, after, keys, nodes, 1.0 / (nodes + 1));
+
+    hashring_remove(ring, name);
+    node_name(name, sizeof(name), 0);
+    hashring_remove(ring, name);
+    place_keys(ring, after, keys);
+    report_moves("node removed", before, after, keys, 0, 1.0 / nodes);
+
+    hashring_destroy(ring);
+    free(names);
+    free(load);
+    free(after);
+    free(before);
+    return 0;
+}
@@ -0,0 +1,225 @@
+// Benchmark de l'historique : compression, mémoire par message et débit de relecture
+// sur un corpus synthétique de messages de discussion (mots courants, longueurs
+// variées). Compare les blocs compressés aux stockages précédents :
+//  - 50 cases fixes de 1000 octets et leur numéro ;
+//  - anneau de références vers les trames diffusées (trame en classe slab + case) ;
+//  - arène en clair avec un index de 16 octets par message.
+//
+//   make bench && ./bench/history_bench [-b budget_kb] [-n messages]
+//
+// Chaque message relu est comparé au texte stocké : code de sortie 1 au moindre écart.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "history.h"
+#include "protocol.h"
+
+#define FIXED_SLOT (1000 + sizeof(uint64_t))
+#define MESSAGE_HEADER 32           // Message sans la trame (refs, seq, trace_id, length)
+#define REFERENCE_SLOT 24           // HistorySlot : version, seq, pointeur
+#define CORPUS_STRIDE 512
+#define PLAIN_INDEX 16              // entrée d'index de l'arène en clair
+#define RANDOM_READS 10000
+
+static const char *words[] = {
+    "ok", "oui", "non", "je", "tu", "on", "le", "la", "les", "un", "une", "de", "des", "et", "est", "pas",
+    "ça", "bien", "merci", "salut", "demain", "ce", "soir", "serveur", "message", "quelqu'un", "sait",
+    "pourquoi", "marche", "plus", "depuis", "hier", "regarde", "lien", "https://example.org/a/b", "lol",
+    "d'accord", "réunion", "à", "quelle", "heure", "vraiment", "bizarre", "redémarre", "essaie",
+};
+
+// Comme dans le serveur, chaque message est préfixé par le nom de son auteur
+static const char *names[] = {
+    "alice", "bob", "carole", "david", "emma", "farid", "gaelle", "hugo", "ines", "jules", "karim", "lea",
+    "manon", "nathan", "oceane", "paul", "quentin", "rose", "samir", "theo",
+};
+
+static unsigned long long xorshift(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Surtout des messages courts, quelques longs : une dizaine de mots en moyenne
+static size_t make_message(char *out, const size_t capacity, unsigned long long *rng) {
+    size_t count = 1 + xorshift(rng) % 8;
+    if (xorshift(rng) % 10 == 0) {
+        count += 10 + xorshift(rng) % 40;
+    }
+    const char *name = names[xorshift(rng) % (sizeof(names) / sizeof(names[0]))];
+    size_t length = (size_t)snprintf(out, capacity, "%s :", name);
+    for (size_t i = 0; i < count; ++i) {
+        const char *word = words[xorshift(rng) % (sizeof(words) / sizeof(words[0]))];
+        const size_t word_len = strlen(word);
+        if (length + word_len + 1 > capacity) {
+            break;
+        }
+        out[length++] = ' ';
+        memcpy(out + length, word, word_len);
+        length += word_len;
+    }
+    return length;
+}
+
+// Taille de la classe slab d'une trame (16 par 16 jusqu'à 128, puis 8 classes par doublement)
+static size_t slab_class(const size_t size) {
+    size_t class_size = 0;
+    size_t step = 16;
+    while (class_size < size) {
+        if (class_size >= 128 && (class_size & (class_size - 1)) == 0) {
+            step = class_size / 8;
+        }
+        class_size += step;
+    }
+    return class_size;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+    size_t budget_kb = 1024;
+    size_t messages = 1000000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:n:")) != -1) {
+        switch (opt) {
+            case 'b':
+                budget_kb = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                messages = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-b budget_kb] [-n messages]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (messages == 0) {
+        fprintf(stderr, "Usage: %s [-b budget_kb] [-n messages]\n", argv[0]);
+        return 1;
+    }
+
+    History history;
+    if (history_init(&history, budget_kb << 10) < 0) {
+        perror("history_init");
+        return 1;
+    }
+
+    // Corpus généré d'avance : on ne mesure que l'ajout
+    char *corpus = malloc(messages * CORPUS_STRIDE);
+    size_t *lengths = malloc(messages * sizeof(size_t));
+    if (!corpus || !lengths) {
+        perror("malloc");
+        return 1;
+    }
+    unsigned long long rng = 0x9e3779b97f4a7c15ull;
+    size_t text_bytes = 0;
+    size_t reference_bytes = 0;
+    for (size_t i = 0; i < messages; ++i) {
+        lengths[i] = make_message(corpus + i * CORPUS_STRIDE, CORPUS_STRIDE, &rng);
+        text_bytes += lengths[i];
+        reference_bytes += slab_class(MESSAGE_HEADER + sizeof(FrameHeader) + lengths[i]) + REFERENCE_SLOT;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < messages; ++i) {
+        history_append(&history, i + 1, corpus + i * CORPUS_STRIDE, lengths[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double append_ns = elapsed_ns(&start, &end) / (double)messages;
+
+    const uint64_t first = history_first(&history);
+    const size_t retained = messages - first + 1;
+
+    // Relecture séquentielle de tout l'historique retenu (rejeu, recherche), chaque
+    // texte comparé à celui du corpus : le codec doit rendre les octets stockés
+    HistoryCursor *cursor = malloc(sizeof(HistoryCursor));
+    if (!cursor) {
+        perror("malloc");
+        return 1;
+    }
+    history_cursor_init(cursor);
+    size_t read_bytes = 0;
+    size_t read_count = 0;
+    size_t mismatches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t seq = first; seq <= messages; ++seq) {
+        size_t length;
+        const char *text = history_get(&history, cursor, seq, &length);
+        if (!text || length != lengths[seq - 1] || memcmp(text, corpus + (seq - 1) * CORPUS_STRIDE, length) != 0) {
+            mismatches++;
+            continue;
+        }
+        read_bytes += length;
+        read_count++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double read_ns = elapsed_ns(&start, &end);
+
+    // Lectures isolées : un bloc décodé par message
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < RANDOM_READS; ++i) {
+        size_t length;
+        history_cursor_init(cursor);
+        const uint64_t seq = first + xorshift(&rng) % retained;
+        const char *text = history_get(&history, cursor, seq, &length);
+        if (!text || length != lengths[seq - 1] || memcmp(text, corpus + (seq - 1) * CORPUS_STRIDE, length) != 0) {
+            mismatches++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double random_ns = elapsed_ns(&start, &end) / RANDOM_READS;
+
+    // Même corpus par blocs, sans dictionnaire, pour mesurer ce qu'il apporte
+    char *block = malloc(HISTORY_BLOCK_SIZE);
+    uint32_t *table = malloc(LZ_HASH_SIZE * sizeof(uint32_t));
+    size_t plain_raw = 0;
+    size_t plain_packed = 0;
+    size_t used = 0;
+    for (size_t i = first - 1; block && table && i < messages; ++i) {
+        if (used + 2 + lengths[i] > HISTORY_BLOCK_SIZE) {
+            const size_t size = lz_compress(block, 0, used, cursor->window, HISTORY_BLOCK_SIZE, table);
+            plain_raw += used;
+            plain_packed += size ? size : used;
+            used = 0;
+        }
+        const uint16_t length = (uint16_t)lengths[i];
+        memcpy(block + used, &length, sizeof(length));
+        memcpy(block + used + 2, corpus + i * CORPUS_STRIDE, lengths[i]);
+        used += 2 + lengths[i];
+    }
+
+    const size_t stored = history_used(&history);
+    printf("corpus          %zu messages, %.1f bytes of text on average\n", messages,
+           (double)text_bytes / (double)messages);
+    printf("budget          %zu KB, %zu messages retained\n", history_reserved(&history) >> 10, retained);
+    printf("compression     %.2fx with dictionary, %.2fx without\n", (double)history_raw(&history) / (double)stored,
+           plain_packed ? (double)plain_raw / (double)plain_packed : 0.0);
+    printf("bytes/message   fixed slots %zu, frame references %.1f, plain arena %.1f, compressed %.1f\n",
+           FIXED_SLOT, (double)reference_bytes / (double)messages,
+           (double)(text_bytes + messages * (2 + PLAIN_INDEX)) / (double)messages,
+           (double)history_reserved(&history) / (double)retained);
+    printf("append          %.1f ns/message (compression included)\n", append_ns);
+    printf("replay          %.1f ns/message, %.0f MB/s of text\n", read_ns / (double)read_count,
+           (double)read_bytes / read_ns * 1e3);
+    printf("single read     %.1f us (one block decoded)\n", random_ns / 1e3);
+    if (mismatches) {
+        fprintf(stderr, "round trip      %zu messages missing or different from the stored text\n", mismatches);
+    }
+
+    free(table);
+    free(block);
+    free(cursor);
+    history_free(&history);
+    free(lengths);
+    free(corpus);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+// Benchmark mémoire : coût résident d'une connexion inactive sur le serveur.
+// Ouvre N connexions, envoie un nom sur chacune puis ne fait plus rien, et
+// compare la mémoire résidente (VmRSS) du serveur avant et après.
+//
+//   ./server -n -u 100000 -i 3600000 &
+//   make bench && ./bench/idle_bench -p $(pidof server) [-c 100000]
+//
+// Au-delà d'environ 28 000 connexions, les ports éphémères d'une seule adresse
+// source sont épuisés : les connexions partent de 127.0.0.2, 127.0.0.3, etc.
+// Le serveur comme le banc d'essai doivent pouvoir ouvrir N descripteurs
+// (ulimit -n).
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+#define SERVER_PORT 30001
+#define CONNECTIONS_PER_SOURCE 25000
+
+// Mémoire résidente d'un processus en Ko, -1 si illisible
+static long read_rss_kb(const int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *status = fopen(path, "r");
+    if (!status) {
+        return -1;
+    }
+    char line[256];
+    long rss = -1;
+    while (fgets(line, sizeof(line), status)) {
+        if (sscanf(line, "VmRSS: %ld kB", &rss) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+    return rss;
+}
+
+static int open_idle_connection(const size_t index) {
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in source = {0};
+    source.sin_family = AF_INET;
+    source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + (uint32_t)(index / CONNECTIONS_PER_SOURCE));
+    struct sockaddr_in server = {0};
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.sin_port = htons(SERVER_PORT);
+
+    if (bind(sock, (struct sockaddr *)&source, sizeof(source)) < 0 ||
+        connect(sock, (struct sockaddr *)&server, sizeof(server)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    char name[PROTOCOL_NAME_LEN] = {0};
+    snprintf(name, sizeof(name), "idle%zu", index);
+    if (send_all(sock, name, sizeof(name)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = 100000;
+    int pid = 0;
+    unsigned settle_s = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:s:")) != -1) {
+        switch (opt) {
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                pid = atoi(optarg);
+                break;
+            case 's':
+                settle_s = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s -p server_pid [-c connections] [-s settle_seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (pid <= 0 || count == 0) {
+        fprintf(stderr, "Usage: %s -p server_pid [-c connections] [-s settle_seconds]\n", argv[0]);
+        return 1;
+    }
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < count + 16) {
+            fprintf(stderr, "warning: descriptor limit %llu is below %zu connections\n",
+                    (unsigned long long)limit.rlim_cur, count);
+        }
+    }
+
+    int *sockets = malloc(count * sizeof(int));
+    if (!sockets) {
+        perror("malloc");
+        return 1;
+    }
+
+    const long before_kb = read_rss_kb(pid);
+    if (before_kb < 0) {
+        perror("Error reading the server memory");
+        return 1;
+    }
+
+    size_t opened = 0;
+    for (; opened < count; ++opened) {
+        sockets[opened] = open_idle_connection(opened);
+        if (sockets[opened] < 0) {
+            fprintf(stderr, "stopped after %zu connections: %s\n", opened, strerror(errno));
+            break;
+        }
+    }
+
+    // Laisse le serveur terminer les poignées de main
+    sleep(settle_s);
+    const long after_kb = read_rss_kb(pid);
+
+    printf("connections     %zu\n", opened);
+    printf("server RSS      %ld KB -> %ld KB\n", before_kb, after_kb);
+    if (opened > 0) {
+        printf("per connection  %.0f bytes\n", (double)(after_kb - before_kb) * 1024.0 / (double)opened);
+    }
+
+    for (size_t i = 0; i < opened; ++i) {
+        close(sockets[i]);
+    }
+    free(sockets);
+    return 0;
+}
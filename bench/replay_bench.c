@@ -0,0 +1,296 @@
+// Benchmark du replay depuis le journal sur disque : N arrivants simultanés reçoivent
+// chacun les M derniers messages, envoyés soit par sendfile (plages du journal telles
+// que le serveur les met en file), soit par pread dans un tampon puis send, comme le
+// ferait un replay en espace utilisateur.
+// Les arrivants sont des connexions TCP locales vidées par un second thread ; on
+// mesure la durée et le temps processeur du thread émetteur.
+//
+//   make bench && ./bench/replay_bench [-n messages] [-c joiners] [-s segment_kb]
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "histlog.h"
+#include "protocol.h"
+
+#define CHUNK (64 * 1024)
+#define MAX_EVENTS 256
+
+static const char *words[] = {
+    "ok", "oui", "non", "je", "tu", "on", "le", "la", "les", "un", "une", "de", "des", "et", "est", "pas",
+    "bien", "merci", "salut", "demain", "ce", "soir", "serveur", "message", "quelqu'un", "sait", "pourquoi",
+    "marche", "plus", "depuis", "hier", "regarde", "lien", "https://example.org/a/b", "lol", "d'accord",
+};
+
+typedef struct Joiner {
+    int sender;
+    int receiver;
+    size_t sent;
+    size_t received;
+} Joiner;
+
+static Joiner *joiners;
+static size_t joiner_count;
+static LogRange ranges[HISTLOG_SEGMENTS];
+static size_t range_count;
+static size_t replay_bytes;
+static char *expected;              // contenu attendu, pour vérifier le premier arrivant
+static int mismatch;
+
+static unsigned long long xorshift(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_s(double *user, double *sys) {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    *user = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6;
+    *sys = (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+    return *user + *sys;
+}
+
+// Vide les connexions des arrivants jusqu'à ce que chacun ait reçu tout le replay
+static void *receive_all(void *arg) {
+    (void)arg;
+    const int epoll_fd = epoll_create1(0);
+    for (size_t i = 0; i < joiner_count; ++i) {
+        struct epoll_event event = {.events = EPOLLIN, .data.u64 = i};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, joiners[i].receiver, &event);
+    }
+    static char buffer[CHUNK];
+    size_t finished = 0;
+    while (finished < joiner_count) {
+        struct epoll_event events[MAX_EVENTS];
+        const int count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        for (int e = 0; e < count; ++e) {
+            Joiner *joiner = &joiners[events[e].data.u64];
+            const ssize_t n = recv(joiner->receiver, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n <= 0) {
+                continue;
+            }
+            if (joiner == &joiners[0] && memcmp(buffer, expected + joiner->received, (size_t)n) != 0) {
+                mismatch = 1;
+            }
+            joiner->received += (size_t)n;
+            if (joiner->received == replay_bytes) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, joiner->receiver, NULL);
+                finished++;
+            }
+        }
+    }
+    close(epoll_fd);
+    return NULL;
+}
+
+// Envoie la suite du replay ; 1 quand tout est parti, 0 si la socket est pleine
+static int send_more(Joiner *joiner, const int use_sendfile, char *buffer) {
+    while (joiner->sent < replay_bytes) {
+        size_t position = joiner->sent;
+        size_t r = 0;
+        while (position >= ranges[r].length) {
+            position -= ranges[r++].length;
+        }
+        size_t length = ranges[r].length - position;
+        if (length > CHUNK) {
+            length = CHUNK;
+        }
+        off_t offset = (off_t)(ranges[r].offset + position);
+        const int fd = histlog_fd(ranges[r].segment);
+        ssize_t n;
+        if (use_sendfile) {
+            n = sendfile(joiner->sender, fd, &offset, length);
+        } else {
+            const ssize_t read_len = pread(fd, buffer, length, offset);
+            n = read_len <= 0 ? -1 : send(joiner->sender, buffer, (size_t)read_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            perror("replay");
+            exit(EXIT_FAILURE);
+        }
+        joiner->sent += (size_t)n;
+    }
+    return 1;
+}
+
+static void run(const char *name, const int use_sendfile) {
+    for (size_t i = 0; i < joiner_count; ++i) {
+        joiners[i].sent = 0;
+        joiners[i].received = 0;
+    }
+    mismatch = 0;
+    pthread_t receiver;
+    pthread_create(&receiver, NULL, receive_all, NULL);
+
+    static char buffer[CHUNK];
+    const int epoll_fd = epoll_create1(0);
+    double user0, sys0, user1, sys1;
+    const double cpu0 = thread_cpu_s(&user0, &sys0);
+    const double start = now_s();
+    size_t finished = 0;
+    for (size_t i = 0; i < joiner_count; ++i) {
+        if (send_more(&joiners[i], use_sendfile, buffer)) {
+            finished++;
+            continue;
+        }
+        struct epoll_event event = {.events = EPOLLOUT, .data.u64 = i};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, joiners[i].sender, &event);
+    }
+    while (finished < joiner_count) {
+        struct epoll_event events[MAX_EVENTS];
+        const int count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        for (int e = 0; e < count; ++e) {
+            Joiner *joiner = &joiners[events[e].data.u64];
+            if (send_more(joiner, use_sendfile, buffer)) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, joiner->sender, NULL);
+                finished++;
+            }
+        }
+    }
+    const double cpu1 = thread_cpu_s(&user1, &sys1);
+    pthread_join(receiver, NULL);
+    const double elapsed = now_s() - start;
+    close(epoll_fd);
+
+    const double total = (double)replay_bytes * (double)joiner_count;
+    printf("%-15s %.2f s, %.0f MB/s, sender CPU %.2f s (user %.2f, sys %.2f), %.2f us per joiner-KB%s\n", name,
+           elapsed, total / elapsed / 1e6, cpu1 - cpu0, user1 - user0, sys1 - sys0,
+           (cpu1 - cpu0) * 1e6 / (total / 1024), mismatch ? ", CONTENT MISMATCH" : "");
+}
+
+int main(int argc, char *argv[]) {
+    size_t messages = 10000;
+    size_t segment_kb = 64 * 1024;
+    joiner_count = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                messages = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                joiner_count = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                segment_kb = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n messages] [-c joiners] [-s segment_kb]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (messages == 0 || messages > HISTLOG_INDEX || joiner_count == 0) {
+        fprintf(stderr, "Usage: %s [-n messages (max %d)] [-c joiners] [-s segment_kb]\n", argv[0], HISTLOG_INDEX);
+        return EXIT_FAILURE;
+    }
+
+    char directory[] = "/tmp/replay_bench.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    char path[sizeof(directory) + 8];
+    snprintf(path, sizeof(path), "%s/log", directory);
+    HistoryLog *log = histlog_open(path, segment_kb << 10);
+    if (!log) {
+        perror("histlog_open");
+        return EXIT_FAILURE;
+    }
+    unsigned long long state = 88172645463325252ull;
+    char text[MAX_FRAME_PAYLOAD];
+    for (size_t seq = 1; seq <= messages; ++seq) {
+        size_t length = (size_t)snprintf(text, sizeof(text), "user%llu :", xorshift(&state) % 50);
+        const size_t count = 3 + xorshift(&state) % 15;
+        for (size_t w = 0; w < count; ++w) {
+            length += (size_t)snprintf(text + length, sizeof(text) - length, " %s",
+                                       words[xorshift(&state) % (sizeof(words) / sizeof(words[0]))]);
+        }
+        histlog_append(log, seq, text, length);
+    }
+    histlog_sync(log);
+    range_count = histlog_ranges(log, 1, messages, ranges, HISTLOG_SEGMENTS);
+    for (size_t r = 0; r < range_count; ++r) {
+        replay_bytes += ranges[r].length;
+    }
+    if (range_count == 0 || ranges[0].first_seq != 1 || ranges[range_count - 1].last_seq != messages) {
+        fprintf(stderr, "the log does not hold the %zu messages (segments too small?)\n", messages);
+        return EXIT_FAILURE;
+    }
+    expected = malloc(replay_bytes);
+    size_t filled = 0;
+    for (size_t r = 0; r < range_count; ++r) {
+        if (pread(histlog_fd(ranges[r].segment), expected + filled, ranges[r].length, (off_t)ranges[r].offset) !=
+            (ssize_t)ranges[r].length) {
+            perror("pread");
+            return EXIT_FAILURE;
+        }
+        filled += ranges[r].length;
+    }
+
+    // Paires de connexions locales : l'émetteur joue le serveur, le récepteur l'arrivant
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_len = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listener, 4096) < 0 || getsockname(listener, (struct sockaddr *)&address, &address_len) < 0) {
+        perror("listener");
+        return EXIT_FAILURE;
+    }
+    joiners = calloc(joiner_count, sizeof(Joiner));
+    for (size_t i = 0; i < joiner_count; ++i) {
+        joiners[i].receiver = socket(AF_INET, SOCK_STREAM, 0);
+        if (joiners[i].receiver < 0 ||
+            connect(joiners[i].receiver, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            (joiners[i].sender = accept4(listener, NULL, NULL, SOCK_NONBLOCK)) < 0) {
+            fprintf(stderr, "stopped after %zu joiners: %s\n", i, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("log             %zu messages, %.1f bytes per frame, %zu range%s (segments of %zu KB)\n", messages,
+           (double)replay_bytes / (double)messages, range_count, range_count == 1 ? "" : "s", segment_kb);
+    printf("joiners         %zu, %.1f MB replayed to each\n", joiner_count, (double)replay_bytes / 1e6);
+    run("sendfile", 1);
+    run("read+send", 0);
+
+    for (size_t r = 0; r < range_count; ++r) {
+        histlog_release(ranges[r].segment);
+    }
+    histlog_close(log);
+    for (size_t segment = 1; segment <= 64; ++segment) {
+        snprintf(text, sizeof(text), "%s.%zu", path, segment);
+        unlink(text);
+    }
+    rmdir(directory);
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Benchmark de la recherche plein texte : indexe N messages synthétiques (auteurs
+// et vocabulaire suivant une loi de Zipf, comme une vraie discussion) par passages
+// successifs comme le thread d'indexation, puis mesure la latence de requêtes types :
+// mot fréquent, mot rare, auteur + mot, deux mots moyens, conjonction sans réponse.
+//
+//   make bench && ./bench/search_bench [-n messages] [-p messages_per_pass] [-q repetitions]
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "search.h"
+
+#define VOCABULARY 20000
+#define AUTHORS 500
+#define RESULTS 20
+
+static char words[VOCABULARY][16];
+static char authors[AUTHORS][16];
+static double word_cdf[VOCABULARY];
+
+static unsigned long long xorshift(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Mots prononçables de 1 à 4 syllabes, tous distincts (suffixe numérique au besoin)
+static void build_vocabulary(unsigned long long *rng) {
+    static const char *syllables[] = {"ba", "ko", "ri", "ne", "tu", "sa", "mo", "li", "pe", "da", "chi", "ven",
+                                      "lor", "mi", "su", "ta", "ga", "fe", "no", "ju"};
+    const size_t count = sizeof(syllables) / sizeof(syllables[0]);
+    for (size_t i = 0; i < VOCABULARY; ++i) {
+        size_t length = 0;
+        const size_t parts = 1 + i * 4 / VOCABULARY;
+        for (size_t j = 0; j < parts; ++j) {
+            length += (size_t)snprintf(words[i] + length, sizeof(words[i]) - length, "%s",
+                                       syllables[xorshift(rng) % count]);
+        }
+        snprintf(words[i] + length, sizeof(words[i]) - length, "%zu", i);
+    }
+    for (size_t i = 0; i < AUTHORS; ++i) {
+        snprintf(authors[i], sizeof(authors[i]), "user%zu", i);
+    }
+    // Zipf (s = 1) : le mot de rang r revient en 1/r
+    double total = 0;
+    for (size_t i = 0; i < VOCABULARY; ++i) {
+        total += 1.0 / (double)(i + 1);
+        word_cdf[i] = total;
+    }
+    for (size_t i = 0; i < VOCABULARY; ++i) {
+        word_cdf[i] /= total;
+    }
+}
+
+static size_t pick_word(unsigned long long *rng) {
+    const double u = (double)(xorshift(rng) >> 11) / 9007199254740992.0;
+    size_t low = 0;
+    size_t high = VOCABULARY - 1;
+    while (low < high) {
+        const size_t middle = (low + high) / 2;
+        if (word_cdf[middle] < u) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static size_t make_message(char *out, const size_t capacity, unsigned long long *rng) {
+    size_t length = (size_t)snprintf(out, capacity, "%s :", authors[xorshift(rng) % AUTHORS]);
+    const size_t count = 2 + xorshift(rng) % 12;
+    for (size_t i = 0; i < count && length + 20 < capacity; ++i) {
+        length += (size_t)snprintf(out + length, capacity - length, " %s", words[pick_word(rng)]);
+    }
+    return length;
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e3 + (double)(end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    size_t messages = 10000000;
+    size_t per_pass = 4096;
+    int repetitions = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:q:")) != -1) {
+        switch (opt) {
+            case 'n':
+                messages = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                per_pass = strtoul(optarg, NULL, 10);
+                break;
+            case 'q':
+                repetitions = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n messages] [-p messages_per_pass] [-q repetitions]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (messages == 0 || per_pass == 0 || repetitions <= 0) {
+        fprintf(stderr, "Usage: %s [-n messages] [-p messages_per_pass] [-q repetitions]\n", argv[0]);
+        return 1;
+    }
+
+    unsigned long long rng = 0x9e3779b97f4a7c15ull;
+    build_vocabulary(&rng);
+    SearchIndex *index = search_create();
+    if (!index) {
+        perror("search_create");
+        return 1;
+    }
+
+    char text[512];
+    size_t text_bytes = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t seq = 1; seq <= messages; ++seq) {
+        const size_t length = make_message(text, sizeof(text), &rng);
+        text_bytes += length;
+        search_add(index, seq, text, length);
+        if (seq % per_pass == 0) {
+            search_commit(index);
+        }
+    }
+    search_commit(index);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double index_ms = elapsed_ms(&start, &end);
+
+    printf("indexed         %zu messages (%.1f MB of text) in %.1f s, %.0f messages/s\n", messages,
+           (double)text_bytes / 1e6, index_ms / 1e3, (double)messages / index_ms * 1e3);
+    printf("index           %.1f MB, %.1f bytes per message\n", (double)search_memory(index) / 1e6,
+           (double)search_memory(index) / (double)messages);
+    search_dump(index, stdout);
+
+    // Requêtes types (mots de rang connu dans la loi de Zipf)
+    char queries[6][64];
+    const char *labels[6] = {"frequent word", "rare word", "author + word", "two mid words", "author + rare",
+                             "no match"};
+    snprintf(queries[0], sizeof(queries[0]), "%s", words[0]);
+    snprintf(queries[1], sizeof(queries[1]), "%s", words[VOCABULARY - 1]);
+    snprintf(queries[2], sizeof(queries[2]), "%s %s", authors[7], words[50]);
+    snprintf(queries[3], sizeof(queries[3]), "%s %s", words[300], words[400]);
+    snprintf(queries[4], sizeof(queries[4]), "%s %s", authors[7], words[VOCABULARY / 2]);
+    snprintf(queries[5], sizeof(queries[5]), "%s %s %s", words[VOCABULARY - 1], words[VOCABULARY - 2],
+             words[VOCABULARY - 3]);
+
+    printf("\n%-15s %8s %10s %10s\n", "query", "results", "mean ms", "max ms");
+    uint64_t seqs[RESULTS];
+    for (int q = 0; q < 6; ++q) {
+        double total = 0;
+        double worst = 0;
+        ssize_t found = 0;
+        for (int i = 0; i < repetitions; ++i) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            found = search_query(index, queries[q], strlen(queries[q]), seqs, RESULTS);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            const double ms = elapsed_ms(&start, &end);
+            total += ms;
+            worst = ms > worst ? ms : worst;
+        }
+        printf("%-15s %8zd %10.3f %10.3f\n", labels[q], found, total / repetitions, worst);
+    }
+    search_stop(index);
+    return 0;
+}
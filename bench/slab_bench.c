@@ -0,0 +1,258 @@
+// Benchmark de l'allocateur slab face à malloc (glibc), sur les deux profils du
+// serveur :
+//  - churn : connexions qui arrivent et repartent (structure de connexion, tampon
+//    d'entrée, nœuds de file), libérées par le thread qui les a allouées ;
+//  - diffusion : chaque worker crée des trames partagées avec tous les autres, qui
+//    les mettent en file puis les relâchent ; la dernière référence libère la trame
+//    depuis un autre thread que son créateur.
+//
+//   make bench && ./bench/slab_bench [-t threads] [-n operations] [-c live_connections]
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "slab.h"
+
+// Tailles réelles des objets du serveur
+#define CONNECTION_SIZE 656
+#define IN_BUFFER_SIZE 1008
+#define OUT_NODE_SIZE 16
+#define MESSAGE_HEADER 32
+#define MAX_THREADS 16
+#define RING_SIZE 1024
+
+typedef struct Allocator {
+    const char *name;
+    void *(*alloc)(size_t size);
+    void (*release)(void *ptr);
+} Allocator;
+
+static void *malloc_alloc(const size_t size) {
+    return malloc(size);
+}
+
+static const Allocator allocators[] = {
+    {"malloc", malloc_alloc, free},
+    {"slab", slab_alloc, slab_free},
+};
+
+typedef struct Frame {
+    _Atomic int refs;
+    size_t length;
+} Frame;
+
+// File à un producteur et un consommateur entre deux workers
+typedef struct Ring {
+    Frame *slots[RING_SIZE];
+    _Atomic size_t head;
+    char pad[64];
+    _Atomic size_t tail;
+} Ring;
+
+typedef struct FanoutThread {
+    pthread_t thread;
+    int index;
+    const Allocator *allocator;
+    size_t frames;
+} FanoutThread;
+
+static int thread_count = 4;
+static Ring rings[MAX_THREADS][MAX_THREADS];     // [émetteur][destinataire]
+static pthread_barrier_t start_barrier;
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static unsigned long long xorshift(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Un emplacement de connexion : remplacé par une nouvelle connexion au hasard
+typedef struct Slot {
+    void *conn;
+    void *in;
+    void *nodes[4];
+} Slot;
+
+static void slot_open(Slot *slot, const Allocator *allocator, unsigned long long *rng) {
+    slot->conn = allocator->alloc(CONNECTION_SIZE);
+    memset(slot->conn, 0, CONNECTION_SIZE);
+    // Une connexion sur quatre a une trame incomplète en attente
+    slot->in = xorshift(rng) % 4 == 0 ? allocator->alloc(IN_BUFFER_SIZE) : NULL;
+    for (int i = 0; i < 4; ++i) {
+        slot->nodes[i] = allocator->alloc(OUT_NODE_SIZE);
+    }
+}
+
+static void slot_close(Slot *slot, const Allocator *allocator) {
+    for (int i = 0; i < 4; ++i) {
+        allocator->release(slot->nodes[i]);
+    }
+    allocator->release(slot->in);
+    allocator->release(slot->conn);
+}
+
+static double run_churn(const Allocator *allocator, const size_t live, const size_t operations) {
+    Slot *slots = calloc(live, sizeof(Slot));
+    if (!slots) {
+        return -1;
+    }
+    unsigned long long rng = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < live; ++i) {
+        slot_open(&slots[i], allocator, &rng);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < operations; ++i) {
+        Slot *slot = &slots[xorshift(&rng) % live];
+        slot_close(slot, allocator);
+        slot_open(slot, allocator, &rng);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (size_t i = 0; i < live; ++i) {
+        slot_close(&slots[i], allocator);
+    }
+    free(slots);
+    return elapsed_ns(&start, &end) / (double)operations;
+}
+
+static void frame_release(const Allocator *allocator, Frame *frame) {
+    if (atomic_fetch_sub_explicit(&frame->refs, 1, memory_order_acq_rel) == 1) {
+        allocator->release(frame);
+    }
+}
+
+// Met en file puis écrit (relâche) les trames reçues des autres workers
+static size_t drain_rings(FanoutThread *self) {
+    size_t drained = 0;
+    for (int from = 0; from < thread_count; ++from) {
+        Ring *ring = &rings[from][self->index];
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            Frame *frame = ring->slots[tail % RING_SIZE];
+            void *node = self->allocator->alloc(OUT_NODE_SIZE);
+            *(Frame **)node = frame;
+            self->allocator->release(node);
+            frame_release(self->allocator, frame);
+            tail++;
+            drained++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return drained;
+}
+
+static void *fanout_main(void *arg) {
+    FanoutThread *self = arg;
+    unsigned long long rng = 0x9e3779b97f4a7c15ull + (unsigned long long)self->index;
+    const size_t expected = self->frames * (size_t)(thread_count - 1);
+    size_t received = 0;
+
+    pthread_barrier_wait(&start_barrier);
+    for (size_t sent = 0; sent < self->frames; ++sent) {
+        const size_t length = 16 + xorshift(&rng) % 1000;
+        Frame *frame = self->allocator->alloc(MESSAGE_HEADER + length);
+        frame->length = length;
+        atomic_init(&frame->refs, thread_count - 1);
+        for (int to = 0; to < thread_count; ++to) {
+            if (to == self->index) {
+                continue;
+            }
+            Ring *ring = &rings[self->index][to];
+            const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+            // File pleine : on vide les nôtres pour ne pas s'interbloquer
+            while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= RING_SIZE) {
+                const size_t drained = drain_rings(self);
+                received += drained;
+                if (drained == 0) {
+                    sched_yield();
+                }
+            }
+            ring->slots[head % RING_SIZE] = frame;
+            atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        }
+        received += drain_rings(self);
+    }
+    while (received < expected) {
+        const size_t drained = drain_rings(self);
+        received += drained;
+        if (drained == 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double run_fanout(const Allocator *allocator, const size_t frames) {
+    FanoutThread threads[MAX_THREADS];
+    memset(rings, 0, sizeof(rings));
+    pthread_barrier_init(&start_barrier, NULL, (unsigned)thread_count + 1);
+    for (int i = 0; i < thread_count; ++i) {
+        threads[i].index = i;
+        threads[i].allocator = allocator;
+        threads[i].frames = frames;
+        pthread_create(&threads[i].thread, NULL, fanout_main, &threads[i]);
+    }
+
+    struct timespec start, end;
+    pthread_barrier_wait(&start_barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < thread_count; ++i) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_barrier_destroy(&start_barrier);
+
+    // Par trame livrée : une allocation de nœud, sa libération et une référence relâchée
+    return elapsed_ns(&start, &end) / ((double)frames * thread_count * (thread_count - 1));
+}
+
+int main(int argc, char *argv[]) {
+    size_t operations = 2000000;
+    size_t live = 10000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:c:")) != -1) {
+        switch (opt) {
+            case 't':
+                thread_count = atoi(optarg);
+                break;
+            case 'n':
+                operations = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                live = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t threads] [-n operations] [-c live_connections]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (thread_count < 2 || thread_count > MAX_THREADS || operations == 0 || live == 0) {
+        fprintf(stderr, "Usage: %s [-t threads (2-%d)] [-n operations] [-c live_connections]\n", argv[0],
+                MAX_THREADS);
+        return 1;
+    }
+    slab_init(0);
+
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); ++i) {
+        const double churn = run_churn(&allocators[i], live, operations);
+        const double fanout = run_fanout(&allocators[i], operations / (size_t)thread_count);
+        printf("%-6s  churn %8.1f ns/connection   fan-out %6.1f ns/delivery (%d threads)\n", allocators[i].name,
+               churn, fanout, thread_count);
+    }
+    return 0;
+}
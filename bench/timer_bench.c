@@ -0,0 +1,94 @@
+// Benchmark de la roue de temporisation : churn de minuteries à grande échelle.
+// Simule N connexions ayant chacune une minuterie d'inactivité réarmée à chaque
+// message reçu, puis mesure le coût de armement / annulation / expiration.
+//
+//   make bench && ./bench/timer_bench [connections] [rearms]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "timerwheel.h"
+
+static unsigned long long fired = 0;
+
+static void on_expire(Timer *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    fired++;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static unsigned long long xorshift(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t connections = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    const size_t rearms = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+
+    TimerWheel *wheel = malloc(sizeof(TimerWheel));
+    Timer *timers = malloc(connections * sizeof(Timer));
+    if (!wheel || !timers || connections == 0) {
+        fprintf(stderr, "allocation failed\n");
+        return 1;
+    }
+    timer_wheel_init(wheel, 0);
+    unsigned long long rng = 0x9e3779b97f4a7c15ull;
+    struct timespec start, end;
+
+    // Armement initial : délais entre 1 s et 60 s (inactivité, poignée de main, ping)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < connections; ++i) {
+        timer_init(&timers[i], on_expire, NULL);
+        timer_schedule(wheel, &timers[i], 1000 + xorshift(&rng) % 59000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("schedule  %9zu timers   %8.1f ns/op\n", connections, elapsed_ns(&start, &end) / (double)connections);
+
+    // Réarmement : chaque message reçu repousse l'échéance d'une connexion au hasard
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < rearms; ++i) {
+        Timer *timer = &timers[xorshift(&rng) % connections];
+        timer_schedule(wheel, timer, 1000 + xorshift(&rng) % 59000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("rearm     %9zu ops      %8.1f ns/op\n", rearms, elapsed_ns(&start, &end) / (double)rearms);
+
+    // Annulation puis réarmement (déconnexion / reconnexion)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < connections; ++i) {
+        timer_cancel(wheel, &timers[i]);
+        timer_schedule(wheel, &timers[i], 1000 + xorshift(&rng) % 59000);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("cancel+schedule %9zu  %8.1f ns/op\n", connections, elapsed_ns(&start, &end) / (double)connections);
+
+    // Avance milliseconde par milliseconde jusqu'à expiration de toutes les minuteries
+    const size_t armed = wheel->count;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t now = 0;
+    size_t ticks = 0;
+    while (wheel->count > 0) {
+        now++;
+        ticks++;
+        timer_wheel_advance(wheel, now);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("expire    %9zu timers   %8.1f ns/timer (%zu ticks, %.1f ns/tick)\n", armed,
+           elapsed_ns(&start, &end) / (double)armed, ticks, elapsed_ns(&start, &end) / (double)ticks);
+
+    if (fired != armed) {
+        fprintf(stderr, "expected %zu expirations, got %llu\n", armed, fired);
+        return 1;
+    }
+    free(timers);
+    free(wheel);
+    return 0;
+}
@@ -0,0 +1,252 @@
+// Benchmark des transports : TCP sur la boucle locale, socket Unix et, avec -S,
+// anneaux en mémoire partagée (shmclient.h), face au même serveur. Pour chacun, une
+// connexion mesure
+//   - la latence : allers-retours ping/pong un par un (moyenne, p50, p99) ;
+//   - le débit : messages de chat envoyés par fenêtres, relus dans la diffusion qui
+//     revient à l'émetteur.
+//
+//   ./server -n -r 0 -R 0 -U /tmp/chat.sock -S /tmp/chat.shm &
+//   make bench && ./bench/transport_bench [-U /tmp/chat.sock] [-S /tmp/chat.shm] [-p pings] [-m messages]
+//                                         [-s bytes] [-W window]
+//
+// Le serveur fait le même travail dans tous les cas : l'écart mesuré est celui de la
+// pile réseau (TCP, IP et boucle locale) que la socket Unix court-circuite, puis celui
+// des appels système que la mémoire partagée évite (sauf sonnettes quand un côté dort).
+
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "shmclient.h"
+
+#define MAX_WINDOW 1024
+#define MAX_MESSAGE 512       // sous la limite de longueur du serveur, nom compris
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Connexion par socket, ou par mémoire partagée (shm non NULL)
+typedef struct Client {
+    int sock;
+    ShmClient *shm;
+} Client;
+
+static int client_send(const Client *client, const uint8_t type, const void *payload, const size_t len) {
+    return client->shm ? shm_client_send(client->shm, type, payload, len)
+                       : send_frame(client->sock, type, 0, payload, len);
+}
+
+// Lit jusqu'à une trame du type voulu ; les autres (pings du serveur...) sont ignorées
+static int wait_frame(const Client *client, const uint8_t type, char *payload) {
+    for (;;) {
+        FrameHeader header;
+        const int status = client->shm ? shm_client_recv(client->shm, &header, payload, MAX_FRAME_PAYLOAD)
+                                       : recv_frame(client->sock, &header, payload, MAX_FRAME_PAYLOAD);
+        if (status <= 0) {
+            if (status == 0) {
+                errno = ECONNRESET;
+            }
+            return -1;
+        }
+        if (header.type == type) {
+            return 0;
+        }
+    }
+}
+
+// Connexion, nom, puis fin du replay d'arrivée
+static int open_client(Client *client, const char *unix_path, const char *shm_path) {
+    char name[PROTOCOL_NAME_LEN] = {0};
+    snprintf(name, sizeof(name), "bench%d", (int)getpid());
+    char payload[MAX_FRAME_PAYLOAD];
+    client->sock = -1;
+    client->shm = NULL;
+    if (shm_path) {
+        client->shm = shm_client_open(shm_path, name);
+        if (!client->shm) {
+            return -1;
+        }
+        if (wait_frame(client, FRAME_HISTORY_END, payload) < 0) {
+            shm_client_close(client->shm);
+            return -1;
+        }
+        return 0;
+    }
+
+    const int sock = proto_connect(unix_path);
+    if (sock < 0) {
+        return -1;
+    }
+    // Sans TCP_NODELAY, Nagle et l'accusé différé bloquent ~40 ms à chaque fenêtre :
+    // on mesurerait la temporisation, pas le transport
+    const int enable = 1;
+    if (!unix_path) {
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+    client->sock = sock;
+    if (send_all(sock, name, sizeof(name)) < 0 || wait_frame(client, FRAME_HISTORY_END, payload) < 0) {
+        close(sock);
+        return -1;
+    }
+    return 0;
+}
+
+static void close_client(const Client *client) {
+    if (client->shm) {
+        shm_client_close(client->shm);
+    } else {
+        close(client->sock);
+    }
+}
+
+static int measure_latency(const Client *client, const size_t pings) {
+    uint64_t *samples = malloc(pings * sizeof(uint64_t));
+    if (!samples) {
+        return -1;
+    }
+    char payload[MAX_FRAME_PAYLOAD];
+    uint64_t total = 0;
+    for (size_t i = 0; i < pings; ++i) {
+        const uint64_t start = now_ns();
+        PingPayload ping = {.origin_ns = proto_hton64(start), .reply_ns = 0};
+        if (client_send(client, FRAME_PING, &ping, sizeof(ping)) < 0 || wait_frame(client, FRAME_PONG, payload) < 0) {
+            free(samples);
+            return -1;
+        }
+        samples[i] = now_ns() - start;
+        total += samples[i];
+    }
+    qsort(samples, pings, sizeof(uint64_t), compare_u64);
+    printf("  latency     avg %.1f us, p50 %.1f us, p99 %.1f us (%zu round trips)\n",
+           (double)total / (double)pings / 1e3, (double)samples[pings / 2] / 1e3,
+           (double)samples[pings * 99 / 100] / 1e3, pings);
+    free(samples);
+    return 0;
+}
+
+static int measure_throughput(const Client *client, const size_t messages, const size_t size, const size_t window) {
+    char text[MAX_FRAME_PAYLOAD];
+    memset(text, 'x', size);
+    char *frames = malloc(window * (sizeof(FrameHeader) + size));
+    if (!frames) {
+        return -1;
+    }
+    size_t frame_len = 0;
+    for (size_t k = 0; k < window; ++k) {
+        frame_len = encode_frame(frames + k * (sizeof(FrameHeader) + size), FRAME_CHAT, 0, text, size);
+    }
+
+    char payload[MAX_FRAME_PAYLOAD];
+    uint64_t received_bytes = 0;
+    const uint64_t start = now_ns();
+    for (size_t sent = 0; sent < messages; sent += window) {
+        const size_t count = messages - sent < window ? messages - sent : window;
+        // Sur socket, toute la fenêtre en un appel ; en mémoire partagée, une copie par trame
+        int status = 0;
+        if (client->shm) {
+            for (size_t k = 0; k < count && status == 0; ++k) {
+                status = shm_client_send(client->shm, FRAME_CHAT, text, size);
+            }
+        } else {
+            status = send_all(client->sock, frames, count * frame_len);
+        }
+        if (status < 0) {
+            free(frames);
+            return -1;
+        }
+        // Chaque message revient à l'émetteur, préfixé du nom
+        for (size_t k = 0; k < count; ++k) {
+            if (wait_frame(client, FRAME_TEXT, payload) < 0) {
+                free(frames);
+                return -1;
+            }
+            received_bytes += frame_len;
+        }
+    }
+    const double elapsed = (double)(now_ns() - start) / 1e9;
+    printf("  throughput  %.0f messages/s, %.1f MB/s sent, %.2f s for %zu messages of %zu bytes\n",
+           (double)messages / elapsed, (double)received_bytes / elapsed / 1e6, elapsed, messages, size);
+    free(frames);
+    return 0;
+}
+
+static int run(const char *name, const char *unix_path, const char *shm_path, const size_t pings,
+               const size_t messages, const size_t size, const size_t window) {
+    Client client;
+    if (open_client(&client, unix_path, shm_path) < 0) {
+        fprintf(stderr, "%s: connection failed: %s\n", name, strerror(errno));
+        return -1;
+    }
+    printf("%s\n", name);
+    const int status =
+        measure_latency(&client, pings) < 0 || measure_throughput(&client, messages, size, window) < 0 ? -1 : 0;
+    if (status < 0) {
+        fprintf(stderr, "%s: connection lost\n", name);
+    }
+    close_client(&client);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    const char *unix_path = "/tmp/chat.sock";
+    const char *shm_path = NULL;
+    size_t pings = 20000;
+    size_t messages = 200000;
+    size_t size = 64;
+    size_t window = 64;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "U:S:p:m:s:W:")) != -1) {
+        switch (opt) {
+            case 'U':
+                unix_path = optarg;
+                break;
+            case 'S':
+                shm_path = optarg;
+                break;
+            case 'p':
+                pings = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                messages = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                size = strtoul(optarg, NULL, 10);
+                break;
+            case 'W':
+                window = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-U unix_path] [-S shm_path] [-p pings] [-m messages] [-s bytes] [-W window]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (pings == 0 || messages == 0 || size == 0 || size > MAX_MESSAGE || window == 0 ||
+        window > MAX_WINDOW) {
+        fprintf(stderr, "Usage: %s [-U unix_path] [-S shm_path] [-p pings] [-m messages] [-s bytes (max %d)] [-W window (max %d)]\n",
+                argv[0], MAX_MESSAGE, MAX_WINDOW);
+        return 1;
+    }
+
+    if (run("tcp 127.0.0.1", NULL, NULL, pings, messages, size, window) < 0 ||
+        run(unix_path, unix_path, NULL, pings, messages, size, window) < 0 ||
+        (shm_path && run(shm_path, NULL, shm_path, pings, messages, size, window) < 0)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,283 @@
+// Benchmark de MSG_ZEROCOPY : temps processeur d'une diffusion, envoyée par copie ou
+// sans copie. Comme dans le serveur, une même trame partagée part vers N connexions,
+// regroupée par lots dans un seul sendmsg par connexion ; en mode zero-copy, les
+// notifications de la file d'erreurs sont relevées au fil de l'eau (là où le serveur
+// libérerait ses références).
+//
+//   make bench && ./bench/zerocopy_bench [-c recipients] [-m broadcasts] [-s frame_bytes] [-b batch]
+//
+// Les connexions sont locales : sur la boucle locale le noyau finit par copier les
+// pages à la réception (notifications « copied »), le gain attendu sur une vraie carte
+// réseau n'apparaît donc qu'en partie ; le coût du suivi, lui, est entièrement mesuré.
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_BATCH 64
+#define MAX_EVENTS 256
+#define DRAIN_BUFFER (256 * 1024)
+
+typedef struct Recipient {
+    int sender;
+    int receiver;
+    uint32_t next_id;           // prochain appel MSG_ZEROCOPY
+    uint32_t completed;         // appels notifiés
+} Recipient;
+
+static Recipient *recipients;
+static size_t recipient_count;
+static size_t expected_bytes;       // par destinataire et par passe
+static _Atomic size_t finished;
+
+static unsigned long long copied_calls;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double cpu_s(const int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    return (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6 +
+           (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+}
+
+// Vide toutes les connexions jusqu'à ce que chacune ait reçu la passe complète
+static void *receive_all(void *arg) {
+    (void)arg;
+    const int epoll_fd = epoll_create1(0);
+    size_t *received = calloc(recipient_count, sizeof(size_t));
+    for (size_t i = 0; i < recipient_count; ++i) {
+        struct epoll_event event = {.events = EPOLLIN, .data.u64 = i};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, recipients[i].receiver, &event);
+    }
+    static char buffer[DRAIN_BUFFER];
+    while (finished < recipient_count) {
+        struct epoll_event events[MAX_EVENTS];
+        const int count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        for (int e = 0; e < count; ++e) {
+            const size_t i = events[e].data.u64;
+            const ssize_t n = recv(recipients[i].receiver, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n <= 0) {
+                continue;
+            }
+            received[i] += (size_t)n;
+            if (received[i] == expected_bytes) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, recipients[i].receiver, NULL);
+                finished++;
+            }
+        }
+    }
+    free(received);
+    close(epoll_fd);
+    return NULL;
+}
+
+// Relève les notifications en attente ; renvoie le nombre d'appels terminés
+static uint32_t reap(Recipient *recipient) {
+    uint32_t done = 0;
+    for (;;) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+        if (recvmsg(recipient->sender, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return done;
+        }
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            struct sock_extended_err err;
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            const uint32_t calls = err.ee_data - err.ee_info + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                copied_calls += calls;
+            }
+            recipient->completed += calls;
+            done += calls;
+        }
+    }
+}
+
+static void run(const char *name, const int zerocopy, char *frames, const size_t frame_bytes,
+                const size_t broadcasts, const size_t batch) {
+    finished = 0;
+    copied_calls = 0;
+    for (size_t i = 0; i < recipient_count; ++i) {
+        recipients[i].next_id = 0;
+        recipients[i].completed = 0;
+    }
+    pthread_t receiver;
+    pthread_create(&receiver, NULL, receive_all, NULL);
+
+    unsigned long long fallbacks = 0;
+    const double cpu0 = cpu_s(RUSAGE_THREAD);
+    const double process0 = cpu_s(RUSAGE_SELF);
+    const double start = now_s();
+    for (size_t sent = 0; sent < broadcasts; sent += batch) {
+        struct iovec iov[MAX_BATCH];
+        const size_t count = broadcasts - sent < batch ? broadcasts - sent : batch;
+        for (size_t k = 0; k < count; ++k) {
+            iov[k].iov_base = frames + ((sent + k) % MAX_BATCH) * frame_bytes;
+            iov[k].iov_len = frame_bytes;
+        }
+        for (size_t i = 0; i < recipient_count; ++i) {
+            Recipient *recipient = &recipients[i];
+            struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+            size_t remaining = count * frame_bytes;
+            // Envoi bloquant jusqu'au bout : les notifications sont relevées entre deux appels
+            while (remaining > 0) {
+                int flags = MSG_NOSIGNAL;
+                if (zerocopy) {
+                    flags |= MSG_ZEROCOPY;
+                }
+                ssize_t n = sendmsg(recipient->sender, &msg, flags);
+                if (n < 0 && zerocopy && errno == ENOBUFS) {
+                    fallbacks++;
+                    reap(recipient);
+                    n = sendmsg(recipient->sender, &msg, MSG_NOSIGNAL);
+                } else if (n >= 0 && zerocopy) {
+                    recipient->next_id++;
+                }
+                if (n < 0) {
+                    perror("sendmsg");
+                    exit(EXIT_FAILURE);
+                }
+                remaining -= (size_t)n;
+                // Suite d'un envoi partiel : on avance dans les iovec
+                while (n > 0 && msg.msg_iovlen > 0) {
+                    if ((size_t)n >= msg.msg_iov->iov_len) {
+                        n -= (ssize_t)msg.msg_iov->iov_len;
+                        msg.msg_iov++;
+                        msg.msg_iovlen--;
+                    } else {
+                        msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+                        msg.msg_iov->iov_len -= (size_t)n;
+                        n = 0;
+                    }
+                }
+            }
+            if (zerocopy) {
+                reap(recipient);
+            }
+            // Les iovec ont pu être avancés : on repart des trames du lot
+            for (size_t k = 0; k < count; ++k) {
+                iov[k].iov_base = frames + ((sent + k) % MAX_BATCH) * frame_bytes;
+                iov[k].iov_len = frame_bytes;
+            }
+        }
+    }
+    // Toutes les notifications : les trames pourraient alors être libérées
+    for (size_t i = 0; zerocopy && i < recipient_count; ++i) {
+        while (recipients[i].completed != recipients[i].next_id) {
+            struct pollfd pfd = {.fd = recipients[i].sender, .events = 0};
+            poll(&pfd, 1, 100);
+            reap(&recipients[i]);
+        }
+    }
+    const double sender_cpu = cpu_s(RUSAGE_THREAD) - cpu0;
+    pthread_join(receiver, NULL);
+    const double elapsed = now_s() - start;
+    const double process_cpu = cpu_s(RUSAGE_SELF) - process0;
+
+    unsigned long long calls = 0;
+    for (size_t i = 0; i < recipient_count; ++i) {
+        calls += recipients[i].next_id;
+    }
+    printf("%-10s %.2f s, sender CPU %.1f us per broadcast (%.2f s), all threads %.1f us per broadcast",
+           name, elapsed, sender_cpu * 1e6 / (double)broadcasts, sender_cpu, process_cpu * 1e6 / (double)broadcasts);
+    if (zerocopy) {
+        printf(", %llu zero-copy calls, %llu copied by the kernel, %llu ENOBUFS", calls, copied_calls, fallbacks);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    size_t broadcasts = 2000;
+    size_t frame_bytes = 1024;
+    size_t batch = 16;
+    recipient_count = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:m:s:b:")) != -1) {
+        switch (opt) {
+            case 'c':
+                recipient_count = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                broadcasts = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                frame_bytes = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                batch = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-c recipients] [-m broadcasts] [-s frame_bytes] [-b batch]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (recipient_count == 0 || broadcasts == 0 || frame_bytes == 0 || batch == 0 || batch > MAX_BATCH) {
+        fprintf(stderr, "Usage: %s [-c recipients] [-m broadcasts] [-s frame_bytes] [-b batch (max %d)]\n", argv[0],
+                MAX_BATCH);
+        return EXIT_FAILURE;
+    }
+
+    char *frames = malloc(MAX_BATCH * frame_bytes);
+    for (size_t i = 0; i < MAX_BATCH * frame_bytes; ++i) {
+        frames[i] = (char)('a' + i % 26);
+    }
+
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t address_len = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listener, 4096) < 0 || getsockname(listener, (struct sockaddr *)&address, &address_len) < 0) {
+        perror("listener");
+        return EXIT_FAILURE;
+    }
+    recipients = calloc(recipient_count, sizeof(Recipient));
+    const int enable = 1;
+    for (size_t i = 0; i < recipient_count; ++i) {
+        recipients[i].receiver = socket(AF_INET, SOCK_STREAM, 0);
+        if (recipients[i].receiver < 0 ||
+            connect(recipients[i].receiver, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            (recipients[i].sender = accept(listener, NULL, NULL)) < 0) {
+            fprintf(stderr, "stopped after %zu recipients: %s\n", i, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (setsockopt(recipients[i].sender, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) < 0) {
+            perror("SO_ZEROCOPY");
+            return EXIT_FAILURE;
+        }
+    }
+    expected_bytes = broadcasts * frame_bytes;
+
+    printf("recipients %zu, %zu broadcasts of %zu bytes, %zu per sendmsg (%zu KB)\n", recipient_count, broadcasts,
+           frame_bytes, batch, batch * frame_bytes >> 10);
+    run("copy", 0, frames, frame_bytes, broadcasts, batch);
+    run("zero-copy", 1, frames, frame_bytes, broadcasts, batch);
+    return 0;
+}
@@ -7,15 +7,26 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <termios.h>
+#include <time.h>
+
+#include "protocol.h"
+#include "rtt.h"
+#include "util.h"
 
 #define MAX_LEN 1000
 char bufferCurrentMessage[MAX_LEN] = {0}; // Stocke le message en cours de saisie
 int bufferLength = 0; // Longueur actuelle du message
 int socketClient;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // Mutex pour synchronisation
+RttStats rtt_stats = {0}; // Temps aller-retour vers le serveur (protégé par mutex)
+uint64_t history_before = 0; // Prochaine page : messages antérieurs à ce numéro (protégé par mutex)
+int history_done = 0; // Début de l'historique atteint
+int history_pending = 0; // Page demandée par /history en cours de réception
+
+#define HISTORY_PAGE 20
 
 typedef struct User {
-    char nom[100];
+    char nom[PROTOCOL_NAME_LEN];
 } User;
 
 // Fonction pour effacer la ligne courante
@@ -35,26 +46,141 @@ void set_non_canonical_mode() {
 
 // Fonction pour écouter les messages du serveur
 void *listen_to_server() {
-    char buffer[MAX_LEN];
+    char buffer[MAX_FRAME_PAYLOAD + 1];
     while (1) {
-        const ssize_t reception = recv(socketClient, buffer, sizeof(buffer) - 1, 0);
-        if (reception <= 0) {
+        FrameHeader header;
+        if (recv_frame(socketClient, &header, buffer, sizeof(buffer) - 1) <= 0) {
             clear_line();
             printf("\nDisconnected from the server.\n");
             break;
         }
-        buffer[reception] = '\0';
+        if (header.type == FRAME_PING || header.type == FRAME_PONG) {
+            PingPayload ping;
+            if (header.length != sizeof(ping)) {
+                continue;
+            }
+            memcpy(&ping, buffer, sizeof(ping));
+            pthread_mutex_lock(&mutex);
+            if (header.type == FRAME_PING) {
+                // Le serveur mesure lui aussi le temps aller-retour
+                ping.reply_ns = proto_hton64(rtt_clock_ns());
+                send_frame(socketClient, FRAME_PONG, 0, &ping, sizeof(ping));
+            } else {
+                rtt_add(&rtt_stats, rtt_clock_ns() - proto_ntoh64(ping.origin_ns));
+            }
+            pthread_mutex_unlock(&mutex);
+            continue;
+        }
+        if (header.type == FRAME_BUSY && header.length == sizeof(BusyPayload)) {
+            BusyPayload busy;
+            memcpy(&busy, buffer, sizeof(busy));
+            pthread_mutex_lock(&mutex);
+            clear_line();
+            printf("Server overloaded, try again in %u s.\n", (ntohl(busy.retry_after_ms) + 999) / 1000);
+            fflush(stdout);
+            pthread_mutex_unlock(&mutex);
+            continue;
+        }
+        if (header.type == FRAME_HISTORY && header.length >= sizeof(uint64_t)) {
+            uint64_t seq;
+            memcpy(&seq, buffer, sizeof(seq));
+            buffer[header.length] = '\0';
+            pthread_mutex_lock(&mutex);
+            clear_line();
+            printf("\033[2m#%llu\033[0m %s\n", (unsigned long long)proto_ntoh64(seq), buffer + sizeof(seq));
+            printf("> %s", bufferCurrentMessage);
+            fflush(stdout);
+            pthread_mutex_unlock(&mutex);
+            continue;
+        }
+        if (header.type == FRAME_HISTORY_END && header.length == sizeof(HistoryEnd)) {
+            HistoryEnd end;
+            memcpy(&end, buffer, sizeof(end));
+            const uint64_t oldest = proto_ntoh64(end.oldest_seq);
+            pthread_mutex_lock(&mutex);
+            history_before = proto_ntoh64(end.first_seq);
+            history_done = oldest == 0 || history_before <= oldest;
+            if (history_pending) {
+                history_pending = 0;
+                clear_line();
+                printf("\033[2m-- %s --\033[0m\n", history_done ? "start of history" : "/history for older messages");
+                printf("> %s", bufferCurrentMessage);
+                fflush(stdout);
+            }
+            pthread_mutex_unlock(&mutex);
+            continue;
+        }
+        if (header.type != FRAME_TEXT) {
+            continue;
+        }
+        buffer[header.length] = '\0';
+
+        // Message tracé : l'identifiant précède le texte
+        const char *text = buffer;
+        uint64_t trace_id = 0;
+        if ((header.flags & FRAME_FLAG_TRACED) && header.length >= sizeof(trace_id)) {
+            memcpy(&trace_id, buffer, sizeof(trace_id));
+            text = buffer + sizeof(trace_id);
+        }
 
         pthread_mutex_lock(&mutex);
         clear_line(); // Efface la ligne courante (prompt)
-        printf("%s\n", buffer); // Affiche le message reçu
+        printf("%s\n", text); // Affiche le message reçu
         printf("> %s", bufferCurrentMessage); // Réaffiche le prompt et le message en cours
         fflush(stdout);
+        if (trace_id) {
+            const TraceDisplay display = {trace_id, proto_hton64(realtime_ns())};
+            send_frame(socketClient, FRAME_TRACE, 0, &display, sizeof(display));
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+// Fonction pour sonder périodiquement le temps aller-retour vers le serveur
+void *probe_rtt() {
+    const struct timespec interval = {RTT_PROBE_INTERVAL_MS / 1000, (RTT_PROBE_INTERVAL_MS % 1000) * 1000000L};
+    while (1) {
+        const PingPayload ping = {proto_hton64(rtt_clock_ns()), 0};
+        pthread_mutex_lock(&mutex);
+        const int status = send_frame(socketClient, FRAME_PING, 0, &ping, sizeof(ping));
         pthread_mutex_unlock(&mutex);
+        if (status < 0) {
+            break;
+        }
+        nanosleep(&interval, NULL);
     }
     return NULL;
 }
 
+// Affiche le temps aller-retour (commande /rtt), appelée avec mutex verrouillé
+void print_rtt() {
+    RttSummary summary;
+    char line[160];
+    rtt_summary(&rtt_stats, &summary);
+    rtt_format(&summary, line, sizeof(line));
+    clear_line();
+    printf("RTT to server: %s\n", line);
+}
+
+// Demande la page précédant les messages déjà affichés (commande /history [n]),
+// appelée avec mutex verrouillé
+void request_history(const char *args) {
+    if (history_done) {
+        clear_line();
+        printf("\033[2m-- start of history --\033[0m\n");
+        return;
+    }
+    const unsigned long count = *args ? strtoul(args, NULL, 10) : HISTORY_PAGE;
+    const HistoryRequest request = {proto_hton64(history_before), htonl((uint32_t)(count ? count : HISTORY_PAGE)), 0};
+    if (send_frame(socketClient, FRAME_HISTORY_REQUEST, 0, &request, sizeof(request)) < 0) {
+        perror("Error requesting history");
+        return;
+    }
+    history_pending = 1;
+    clear_line();
+}
+
 // Fonction principale pour gérer l'entrée utilisateur
 void handle_user_input() {
     while (1) {
@@ -64,8 +190,17 @@ void handle_user_input() {
         pthread_mutex_lock(&mutex);
         if (ch == '\n') { // Si l'utilisateur appuie sur Entrée
             bufferCurrentMessage[bufferLength] = '\0'; // Terminer le message
-            if (bufferLength > 0) {
-                if (send(socketClient, bufferCurrentMessage, bufferLength, 0) < 0) {
+            if (strcmp(bufferCurrentMessage, "/rtt") == 0) { // Commande locale, non envoyée
+                print_rtt();
+                bufferLength = 0;
+                memset(bufferCurrentMessage, 0, sizeof(bufferCurrentMessage));
+            } else if (strncmp(bufferCurrentMessage, "/history", 8) == 0 &&
+                       (bufferCurrentMessage[8] == '\0' || bufferCurrentMessage[8] == ' ')) {
+                request_history(bufferCurrentMessage + 8);
+                bufferLength = 0;
+                memset(bufferCurrentMessage, 0, sizeof(bufferCurrentMessage));
+            } else if (bufferLength > 0) {
+                if (send_frame(socketClient, FRAME_CHAT, 0, bufferCurrentMessage, bufferLength) < 0) {
                     perror("Error sending message");
                 }
                 bufferLength = 0; // Réinitialiser le buffer
@@ -100,32 +235,30 @@ void saisie_nom(User *user) {
     user->nom[strcspn(user->nom, "\n")] = '\0'; // Retirer le \n final
 }
 
-int main() {
-    User user;
-    saisie_nom(&user);
-
-    // Création du socket
-    socketClient = socket(AF_INET, SOCK_STREAM, 0);
-    if (socketClient < 0) {
-        perror("Error creating the socket");
-        exit(EXIT_FAILURE);
+int main(int argc, char *argv[]) {
+    // -U : socket Unix du serveur (même machine), TCP sur 127.0.0.1 sinon
+    const char *unix_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "U:")) != -1) {
+        if (opt != 'U') {
+            fprintf(stderr, "Usage: %s [-U unix_socket_path]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        unix_path = optarg;
     }
 
-    // Configuration de l'adresse du serveur
-    struct sockaddr_in addrClient = {0};
-    addrClient.sin_addr.s_addr = inet_addr("127.0.0.1");
-    addrClient.sin_family = AF_INET;
-    addrClient.sin_port = htons(30001);
+    User user;
+    saisie_nom(&user);
 
     // Connexion au serveur
-    if (connect(socketClient, (struct sockaddr *)&addrClient, sizeof(addrClient)) < 0) {
+    socketClient = proto_connect(unix_path);
+    if (socketClient < 0) {
         perror("Connection Error");
-        close(socketClient);
         exit(EXIT_FAILURE);
     }
 
     // Envoi du nom d'utilisateur au serveur
-    if (send(socketClient, &user, sizeof(user), 0) < 0) {
+    if (send_all(socketClient, &user, sizeof(user)) < 0) {
         perror("Error sending the user's name");
         close(socketClient);
         exit(EXIT_FAILURE);
@@ -142,6 +275,12 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
+    // Création du thread de mesure du temps aller-retour
+    pthread_t probe_thread;
+    if (pthread_create(&probe_thread, NULL, probe_rtt, NULL) == 0) {
+        pthread_detach(probe_thread);
+    }
+
     // Gestion des entrées utilisateur
     handle_user_input();
 
@@ -6,10 +6,16 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <time.h>
 #include <raylib.h>
 
+#include "lockprof.h"
+#include "protocol.h"
+#include "rtt.h"
+
 #define MAX_LEN 1000
 #define MAX_MESSAGES 100
+#define HISTORY_PAGE 20
 #define MAX_MESSAGE_LENGTH 1000
 #define SCREEN_WIDTH 900
 #define SCREEN_HEIGHT 1000
@@ -21,7 +27,7 @@
 #define RESET_CODE "\033[0m"
 
 typedef struct User {
-    char name[100];
+    char name[PROTOCOL_NAME_LEN];
 } User;
 
 typedef struct {
@@ -29,6 +35,7 @@ typedef struct {
     bool isOwn;  // True if message is from current user
     Color color;
     bool isServerMessage;
+    uint64_t traceId; // Non-zero until a traced message has been rendered once (network byte order)
     struct ChatMessage* next;
 } ChatMessage;
 
@@ -55,12 +62,20 @@ User user;  // Store the current user globally
 
 // Network / Thread related
 int socketClient; // Stores the socket connection identifier for client-server connection
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // Mutex for thread-safe access
+ProfMutex mutex = PROF_MUTEX_INITIALIZER("gui_mutex"); // Mutex for thread-safe access (instrumented with PROFILE=1)
 pthread_t listen_thread; // Listening thread
+pthread_mutex_t sendMutex = PTHREAD_MUTEX_INITIALIZER; // Serializes frames written by the UI and listening threads
+
+// Round-trip time to the server (protected by mutex)
+RttStats rttStats = {0};
+double lastRttProbe = 0;
 
 // Message storage
 ChatMessage** messages;// Array storing chat history
 int messageCount = 0; // Number of stored messages
+uint64_t historyBefore = 0; // Next history page: messages older than this seq (protected by mutex)
+bool historyDone = false; // The oldest retained message has been received
+int historyInsert = -1; // Where the page being received is inserted, -1 when no page is pending
 InputBuffer* inputBuffer;
 
 // GUI Layout
@@ -167,25 +182,8 @@ void backspaceCharacter() {
     }
 }
 
-// Function to add a new message to the chat
-void addMessage(const char* text, const bool isOwn) {
-    if (!messages) {
-        return;
-    }
-
-    // Lock the mutex for thread safety
-    pthread_mutex_lock(&mutex);
-
-    // While message buffer isn't full
-    if (messageCount >= MAX_MESSAGES) {
-
-        // Shift messages up by one to make room for new message
-        for (int i = 0; i < MAX_MESSAGES - 1; i++) {
-            messages[i] = messages[i + 1];
-        }
-        messageCount = MAX_MESSAGES - 1;
-    }
-
+// Sets the text and display properties of a message slot (called with mutex locked)
+void fillMessage(ChatMessage* message, const char* text, const bool isOwn, const uint64_t traceId) {
     // Prepare message properties
     Color messageColor = SKYBLUE;
     bool isServerMessage = false;
@@ -201,43 +199,157 @@ void addMessage(const char* text, const bool isOwn) {
     }
 
     // Copy message text and set properties
-    strncpy(messages[messageCount]->text, messageText, MAX_MESSAGE_LENGTH - 1);
-    messages[messageCount]->text[MAX_MESSAGE_LENGTH - 1] = '\0';
-    messages[messageCount]->isOwn = isOwn;
-    messages[messageCount]->color = messageColor;
-    messages[messageCount]->isServerMessage = isServerMessage;
+    strncpy(message->text, messageText, MAX_MESSAGE_LENGTH - 1);
+    message->text[MAX_MESSAGE_LENGTH - 1] = '\0';
+    message->isOwn = isOwn;
+    message->color = messageColor;
+    message->isServerMessage = isServerMessage;
+    message->traceId = traceId;
 
     // Free cleaned message if it was created
     if (!isOwn) {
         free(cleaned->cleanText);
         free(cleaned);
     }
+}
 
+// Function to add a new message to the chat, traceId is non-zero for traced messages
+void addTracedMessage(const char* text, const bool isOwn, const uint64_t traceId) {
+    if (!messages) {
+        return;
+    }
+
+    // Lock the mutex for thread safety
+    prof_lock(&mutex);
+
+    // While message buffer isn't full
+    if (messageCount >= MAX_MESSAGES) {
+
+        // Shift messages up by one to make room for new message, the oldest slot is reused
+        ChatMessage* oldest = messages[0];
+        for (int i = 0; i < MAX_MESSAGES - 1; i++) {
+            messages[i] = messages[i + 1];
+        }
+        messages[MAX_MESSAGES - 1] = oldest;
+        messageCount = MAX_MESSAGES - 1;
+    }
+
+    fillMessage(messages[messageCount], text, isOwn, traceId);
     messageCount++;
     // Unlock the mutex after adding the message
-    pthread_mutex_unlock(&mutex);
+    prof_unlock(&mutex);
+}
+
+// Inserts an older message received from a history page above the messages already shown
+void addHistoryMessage(const char* text) {
+    if (!messages) {
+        return;
+    }
+    prof_lock(&mutex);
+    // Older than everything kept: dropped when the buffer is full
+    if (historyInsert < 0 || messageCount >= MAX_MESSAGES) {
+        prof_unlock(&mutex);
+        return;
+    }
+    ChatMessage* spare = messages[messageCount];
+    memmove(&messages[historyInsert + 1], &messages[historyInsert], (size_t)(messageCount - historyInsert) * sizeof(ChatMessage*));
+    messages[historyInsert] = spare;
+    fillMessage(spare, text, strstr(text, user.name) == text, 0);
+    historyInsert++;
+    messageCount++;
+    prof_unlock(&mutex);
+}
+
+void addMessage(const char* text, const bool isOwn) {
+    addTracedMessage(text, isOwn, 0);
+}
+
+// Sends a frame on the shared socket, frames from both threads never interleave
+int sendFrame(const uint8_t type, const void* payload, const size_t length) {
+    pthread_mutex_lock(&sendMutex);
+    const int status = send_frame(socketClient, type, 0, payload, length);
+    pthread_mutex_unlock(&sendMutex);
+    return status;
 }
 
+// Wall-clock timestamp sent back to the server when a traced message is displayed.
+// From util.c; util.h itself is not included because its log levels clash with raylib's.
+uint64_t realtime_ns(void);
+
 // Thread function that continuously listens for server messages, and adds the messages in the array
 void *listen_to_server() {
     if (!messages) return NULL;
-    char buffer[MAX_LEN]; //Temporary storage for incoming messages
+    char buffer[MAX_FRAME_PAYLOAD + 1]; //Temporary storage for incoming frames
 
     // Infinite loop for continuous listening (exits on error or disconnection)
     while (1) {
-        // recv() waits for data from the server (incoming message is written in the buffer)
-        const ssize_t receiver = recv(socketClient, buffer, sizeof(buffer) - 1, 0);
-
-        if (receiver <= 0) {
+        // recv_frame() waits for a complete frame from the server (payload is written in the buffer)
+        FrameHeader header;
+        if (recv_frame(socketClient, &header, buffer, sizeof(buffer) - 1) <= 0) {
             addMessage("Disconnected from the server.", false);
             break;
         }
+        // Ping/pong frames measure the round-trip time in both directions
+        if (header.type == FRAME_PING || header.type == FRAME_PONG) {
+            PingPayload ping;
+            if (header.length != sizeof(ping)) {
+                continue;
+            }
+            memcpy(&ping, buffer, sizeof(ping));
+            if (header.type == FRAME_PING) {
+                ping.reply_ns = proto_hton64(rtt_clock_ns());
+                sendFrame(FRAME_PONG, &ping, sizeof(ping));
+            } else {
+                prof_lock(&mutex);
+                rtt_add(&rttStats, rtt_clock_ns() - proto_ntoh64(ping.origin_ns));
+                prof_unlock(&mutex);
+            }
+            continue;
+        }
+        // The server refuses new users while overloaded and tells when to retry
+        if (header.type == FRAME_BUSY && header.length == sizeof(BusyPayload)) {
+            BusyPayload busy;
+            memcpy(&busy, buffer, sizeof(busy));
+            char notice[64];
+            snprintf(notice, sizeof(notice), "Server overloaded, try again in %u s.", (ntohl(busy.retry_after_ms) + 999) / 1000);
+            addMessage(notice, false);
+            continue;
+        }
+        // Older messages requested with /history, oldest first
+        if (header.type == FRAME_HISTORY && header.length >= sizeof(uint64_t)) {
+            buffer[header.length] = '\0';
+            addHistoryMessage(buffer + sizeof(uint64_t));
+            continue;
+        }
+        // End of a page (or of the replay on join): the next page starts before first_seq
+        if (header.type == FRAME_HISTORY_END && header.length == sizeof(HistoryEnd)) {
+            HistoryEnd end;
+            memcpy(&end, buffer, sizeof(end));
+            const uint64_t oldest = proto_ntoh64(end.oldest_seq);
+            prof_lock(&mutex);
+            historyBefore = proto_ntoh64(end.first_seq);
+            historyDone = oldest == 0 || historyBefore <= oldest;
+            historyInsert = -1;
+            prof_unlock(&mutex);
+            continue;
+        }
+        if (header.type != FRAME_TEXT) {
+            continue;
+        }
 
         // We add a null terminator to end the message
-        buffer[receiver] = '\0';
+        buffer[header.length] = '\0';
+
+        // Traced messages carry their trace id in front of the text
+        const char* text = buffer;
+        uint64_t traceId = 0;
+        if ((header.flags & FRAME_FLAG_TRACED) && header.length >= sizeof(traceId)) {
+            memcpy(&traceId, buffer, sizeof(traceId));
+            text = buffer + sizeof(traceId);
+        }
 
         // We show the received message in the UI
-        addMessage(buffer, strstr(buffer, user.name) == buffer);  // true if message starts with our name
+        addTracedMessage(text, strstr(text, user.name) == text, traceId);  // true if message starts with our name
     }
     // Thread terminates when connection drops or program exits
     return NULL; // Required for pthread function signature
@@ -250,6 +362,11 @@ void cleanupAndExit() {
     pthread_join(listen_thread, NULL);
     close(socketClient);
 
+#ifdef LOCK_PROFILING
+    // Lock contention report for the GUI mutex
+    lockprof_dump(stdout);
+#endif
+
     for (int i= 0; i < MAX_MESSAGES; i++) {
         free(messages[i]->text);
         free(messages[i]);
@@ -401,8 +518,33 @@ void handleTextInput() {
             cleanupAndExit();
         }
 
+        // Check for the /rtt command (shows the round-trip time locally)
+        if (strcmp(inputBuffer->buffer, "/rtt") == 0) {
+            RttSummary summary;
+            char line[160];
+            char text[200];
+            prof_lock(&mutex);
+            rtt_summary(&rttStats, &summary);
+            prof_unlock(&mutex);
+            rtt_format(&summary, line, sizeof(line));
+            snprintf(text, sizeof(text), "RTT: %s", line);
+            addMessage(text, false);
+        }
+        // Check for the /history command (loads older messages above the current ones)
+        else if (strcmp(inputBuffer->buffer, "/history") == 0) {
+            prof_lock(&mutex);
+            const bool done = historyDone;
+            const HistoryRequest request = {proto_hton64(historyBefore), htonl(HISTORY_PAGE), 0};
+            historyInsert = 0;
+            prof_unlock(&mutex);
+            if (done) {
+                addMessage("Start of history reached.", false);
+            } else if (sendFrame(FRAME_HISTORY_REQUEST, &request, sizeof(request)) < 0) {
+                addMessage("Error when requesting history.", false);
+            }
+        }
         // Sending message to server with error handling
-        if (send(socketClient, inputBuffer->buffer, inputBuffer->length, 0) < 0) {
+        else if (sendFrame(FRAME_CHAT, inputBuffer->buffer, inputBuffer->length) < 0) {
             addMessage("Error when sending message.", false);
         }
 
@@ -447,7 +589,18 @@ void drawInputWithCursor() {
     }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    //-U: connect through the server's Unix socket instead of TCP
+    const char *unixPath = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "U:")) != -1) {
+        if (opt != 'U') {
+            fprintf(stderr, "Usage: %s [-U unix_socket_path]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        unixPath = optarg;
+    }
+
     //User creation
     printf("Enter your name: ");
     fgets(user.name, sizeof(user.name), stdin); //retrieves name from stdin
@@ -482,30 +635,15 @@ int main() {
     inputBuffer->length = 0;
     inputBuffer->capacity = MAX_LEN;
 
-    // Socket setup
-    socketClient = socket(AF_INET, SOCK_STREAM, 0); //We create a socket client (Address Family Internet domain & TCP socket)
-
+    // Socket setup: the server's Unix socket when -U is given (same host), TCP on 127.0.0.1 otherwise
+    socketClient = proto_connect(unixPath);
     if (socketClient < 0) {
-        //socket() returns a negative value when an error is encountered
-        perror("Error when creating socket.");
-        exit(EXIT_FAILURE);
-    }
-
-
-    struct sockaddr_in addrClient = {0}; //Custom structure from in.h for configuring a socket connection
-    addrClient.sin_addr.s_addr = inet_addr("127.0.0.1"); //Server address
-    addrClient.sin_family = AF_INET; //domain --> Address Family Internet (IPv4)
-    addrClient.sin_port = htons(30001); //ensures correct "network byte order" (little-endian / big-endian relation)
-
-    //Testing connection between socket and the address specified in the client config
-    if (connect(socketClient, (struct sockaddr *)&addrClient, sizeof(addrClient)) < 0) {
         perror("Connection error.");
-        close(socketClient);
         exit(EXIT_FAILURE);
     }
 
     // Testing the initial data send (sending the user's name)
-    if (send(socketClient, &user, sizeof(user), 0) < 0) {
+    if (send_all(socketClient, &user, sizeof(user)) < 0) {
         perror("Error when sending the name.");
         close(socketClient);
         exit(EXIT_FAILURE);
@@ -534,6 +672,13 @@ int main() {
         // Handles keyboard input for chat messages
         handleTextInput();
 
+        // Periodic round-trip time probe
+        if (GetTime() - lastRttProbe >= RTT_PROBE_INTERVAL_MS / 1000.0) {
+            const PingPayload ping = {proto_hton64(rtt_clock_ns()), 0};
+            sendFrame(FRAME_PING, &ping, sizeof(ping));
+            lastRttProbe = GetTime();
+        }
+
         // Handles scrolling
         if (GetMouseWheelMove() != 0) { //Detects mouse wheel movement
             scrollPosition.y += GetMouseWheelMove() * scrollSpeed;
@@ -551,8 +696,12 @@ int main() {
         BeginDrawing();
         ClearBackground(RAYWHITE); // Clears screen using a white background
 
+        // Traced messages drawn in this frame, acknowledged once the frame is presented
+        uint64_t drawnTraceIds[MAX_MESSAGES];
+        int drawnTraceCount = 0;
+
         // Drawing messages
-        pthread_mutex_lock(&mutex); // Locks mutex for thread safety
+        prof_lock(&mutex); // Locks mutex for thread safety
         float y = SCREEN_HEIGHT - INPUT_HEIGHT - CHAT_MARGIN * 2 + scrollPosition.y;
 
         for (int i = messageCount - 1; i >= 0; i--) { // Loops through messages from newest to oldest
@@ -581,17 +730,31 @@ int main() {
             // Drawing message content (within the bubble)
             DrawText(messages[i]->text, (int) x, (int) y - 20, 30, BLACK);
 
+            if (messages[i]->traceId != 0) {
+                drawnTraceIds[drawnTraceCount++] = messages[i]->traceId;
+                messages[i]->traceId = 0;
+            }
+
             y -= 35; // Moves up for next message
             if (y < -30) break;  // Stop if message isn't in view
         }
         // Release lock after displaying message
-        pthread_mutex_unlock(&mutex);
+        prof_unlock(&mutex);
 
         // Draw input box
         drawInputWithCursor();
 
         // End the drawing phase
         EndDrawing();
+
+        // Report display time of traced messages to the server
+        if (drawnTraceCount > 0) {
+            const uint64_t displayNs = proto_hton64(realtime_ns());
+            for (int i = 0; i < drawnTraceCount; i++) {
+                const TraceDisplay display = {drawnTraceIds[i], displayNs};
+                sendFrame(FRAME_TRACE, &display, sizeof(display));
+            }
+        }
     }
 
     // Cleanup
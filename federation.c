@@ -0,0 +1,874 @@
+#define _GNU_SOURCE
+#include "federation.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hashring.h"
+#include "lockprof.h"
+#include "log.h"
+#include "protocol.h"
+#include "util.h"
+
+#define MAX_LINKS 64
+#define MAX_EVENTS 64
+#define READ_CHUNK 65536
+#define MAX_RELAY_TEXT (MAX_FRAME_PAYLOAD - sizeof(RelayHeader))
+
+typedef struct Link {
+    int socket;
+    int connecting;             // connexion sortante en cours : EPOLLOUT attendu
+    int closed;                 // libéré en fin d'itération
+    int want_write;             // EPOLLOUT armé
+    int peer;                   // pair -F à l'origine du lien, -1 : lien accepté
+    uint64_t remote_id;         // 0 tant que PeerHello n'est pas reçu
+    int gateway;                // passerelle de connexions (PEER_FLAG_GATEWAY)
+    char address[32];
+    char node[HASHRING_NAME_LEN];   // nom du pair sur l'anneau (grappe), "" sinon
+    Buffer in;
+    Buffer out;
+    size_t out_offset;          // octets de out déjà envoyés
+    uint64_t frames_in;
+    uint64_t frames_out;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} Link;
+
+typedef struct Peer {
+    struct sockaddr_in address;
+    char name[32];
+    Link *link;                 // NULL : nouvelle tentative à retry_ms
+    uint64_t retry_ms;
+    uint64_t connects;
+    int failing;                // échec déjà journalisé
+} Peer;
+
+struct Federation {
+    uint64_t id;
+    int port;
+    int listener;
+    int epoll_fd;
+    int wake_fd;
+    pthread_t thread;
+    int started;
+    _Atomic int stopping;
+    FederationDeliver deliver;
+
+    Peer peers[FEDERATION_MAX_PEERS];
+    int peer_count;
+
+    // Table des liens : modifiée par le thread de fédération, parcourue par l'admin
+    ProfMutex links_mutex;
+    Link *links[MAX_LINKS];
+    int link_count;
+
+    OriginTable origins;
+
+    // Publications en attente du thread : trames FRAME_RELAY bout à bout
+    ProfMutex outbox_mutex;
+    Buffer outbox;
+    uint64_t outbox_frames;
+    uint64_t origin_seq;
+    Buffer sending;             // échangé avec outbox par le thread
+
+    // Grappe (-C) : anneau modifié par le thread, sous links_mutex pour l'admin
+    char *room;
+    char self_node[HASHRING_NAME_LEN];
+    HashRing *ring;
+    char owner_node[HASHRING_NAME_LEN];
+    Link *owner;                // NULL : ce serveur possède le salon
+    // Messages de nos membres pour le propriétaire : trames FRAME_FORWARD, sous
+    // outbox_mutex comme owner_remote (lu par les workers)
+    int owner_remote;
+    Buffer forward_box;
+    uint64_t forward_frames;
+    Buffer forwarding;
+
+    _Atomic uint64_t published;
+    _Atomic uint64_t received;
+    _Atomic uint64_t forwarded;
+    _Atomic uint64_t duplicates;
+    _Atomic uint64_t lost;
+    _Atomic uint64_t overflows;     // publications perdues, thread en retard
+    _Atomic uint64_t links_dropped; // pairs trop lents
+    _Atomic uint64_t forwarded_to_owner;
+    _Atomic uint64_t sequenced_for_others;
+    _Atomic uint64_t owner_changes;
+};
+
+static void link_update_events(Federation *federation, Link *link, const int want_write) {
+    if (link->want_write == want_write) {
+        return;
+    }
+    link->want_write = want_write;
+    struct epoll_event event = {.events = EPOLLIN | (want_write ? EPOLLOUT : 0), .data.ptr = link};
+    epoll_ctl(federation->epoll_fd, EPOLL_CTL_MOD, link->socket, &event);
+}
+
+// Fermeture différée : le lien peut encore figurer dans les événements de l'itération
+static void link_close(Link *link) {
+    link->closed = 1;
+}
+
+// Envoie ce qui peut l'être sans bloquer ; le reste attend EPOLLOUT
+static void link_write(Federation *federation, Link *link) {
+    while (link->out_offset < link->out.length) {
+        const ssize_t sent = send(link->socket, link->out.data + link->out_offset,
+                                  link->out.length - link->out_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                link_close(link);
+                return;
+            }
+            break;
+        }
+        link->out_offset += (size_t)sent;
+        link->bytes_out += (uint64_t)sent;
+    }
+    if (link->out_offset == link->out.length) {
+        link->out.length = 0;
+        link->out_offset = 0;
+    } else if (link->out_offset > link->out.length / 2) {
+        memmove(link->out.data, link->out.data + link->out_offset, link->out.length - link->out_offset);
+        link->out.length -= link->out_offset;
+        link->out_offset = 0;
+    }
+    link_update_events(federation, link, link->out.length > 0);
+}
+
+// Trames complètes à envoyer sur un lien établi
+static void link_send(Federation *federation, Link *link, const char *frames, const size_t length,
+                      const uint64_t count) {
+    if (link->closed || link->connecting) {
+        return;
+    }
+    if (link->out.length - link->out_offset + length > FEDERATION_MAX_OUT) {
+        char line[96];
+        snprintf(line, sizeof(line), "Federation peer %s too slow, link dropped", link->address);
+        log_text(LOG_WARN, line);
+        atomic_fetch_add_explicit(&federation->links_dropped, 1, memory_order_relaxed);
+        link_close(link);
+        return;
+    }
+    if (buffer_append(&link->out, frames, length) < 0) {
+        link_close(link);
+        return;
+    }
+    link->frames_out += count;
+    link_write(federation, link);
+}
+
+static void link_send_hello(Federation *federation, Link *link) {
+    const PeerHello hello = {.server_id = proto_hton64(federation->id),
+                             .listen_port = htonl(federation->listener >= 0 ? (uint32_t)federation->port : 0)};
+    char frame[sizeof(FrameHeader) + sizeof(hello)];
+    link_send(federation, link, frame, encode_frame(frame, FRAME_PEER_HELLO, 0, &hello, sizeof(hello)), 1);
+}
+
+static Link *link_add(Federation *federation, const int socket, const int connecting, const int peer) {
+    if (federation->link_count == MAX_LINKS) {
+        errno = EMFILE;
+        return NULL;
+    }
+    Link *link = calloc(1, sizeof(Link));
+    if (!link) {
+        return NULL;
+    }
+    link->socket = socket;
+    link->connecting = connecting;
+    link->want_write = connecting;
+    link->peer = peer;
+    struct epoll_event event = {.events = connecting ? EPOLLOUT : EPOLLIN, .data.ptr = link};
+    if (epoll_ctl(federation->epoll_fd, EPOLL_CTL_ADD, socket, &event) < 0) {
+        free(link);
+        return NULL;
+    }
+    const int enable = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (peer >= 0) {
+        snprintf(link->address, sizeof(link->address), "%s", federation->peers[peer].name);
+    } else {
+        struct sockaddr_in address;
+        socklen_t address_len = sizeof(address);
+        char ip[INET_ADDRSTRLEN] = "?";
+        if (getpeername(socket, (struct sockaddr *)&address, &address_len) == 0) {
+            inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+        }
+        snprintf(link->address, sizeof(link->address), "%s:%d", ip, ntohs(address.sin_port));
+    }
+    prof_lock(&federation->links_mutex);
+    federation->links[federation->link_count++] = link;
+    prof_unlock(&federation->links_mutex);
+    return link;
+}
+
+// Lien établi (connexion sortante aboutie, ou acceptée)
+static void link_up(Federation *federation, Link *link) {
+    link->connecting = 0;
+    link_update_events(federation, link, 0);
+    if (link->peer >= 0) {
+        Peer *peer = &federation->peers[link->peer];
+        peer->connects++;
+        peer->failing = 0;
+    }
+    char line[96];
+    snprintf(line, sizeof(line), "Federation link up: %s", link->address);
+    log_text(LOG_INFO, line);
+    link_send_hello(federation, link);
+}
+
+// Propriétaire du salon d'après l'anneau courant ; les messages de nos membres
+// suivent le changement dès la prochaine transmission
+static void cluster_update_owner(Federation *federation) {
+    const char *node = hashring_lookup(federation->ring, federation->room, strlen(federation->room));
+    Link *owner = NULL;
+    if (strcmp(node, federation->self_node) != 0) {
+        for (int i = 0; i < federation->link_count && !owner; ++i) {
+            Link *link = federation->links[i];
+            if (!link->closed && strcmp(link->node, node) == 0) {
+                owner = link;
+            }
+        }
+    }
+    const int changed = strcmp(node, federation->owner_node) != 0;
+    prof_lock(&federation->links_mutex);
+    snprintf(federation->owner_node, sizeof(federation->owner_node), "%s", node);
+    federation->owner = owner;
+    prof_unlock(&federation->links_mutex);
+    prof_lock(&federation->outbox_mutex);
+    federation->owner_remote = owner != NULL;
+    prof_unlock(&federation->outbox_mutex);
+    if (changed) {
+        atomic_fetch_add_explicit(&federation->owner_changes, 1, memory_order_relaxed);
+        char line[160];
+        snprintf(line, sizeof(line), "Room %s now owned by %s%s", federation->room, node,
+                 owner ? "" : " (this server)");
+        log_text(LOG_INFO, line);
+    }
+}
+
+// Pair annoncé par son PeerHello : ajouté à l'anneau à son premier lien
+static void cluster_node_up(Federation *federation, Link *link, const uint32_t listen_port) {
+    if (!federation->ring || listen_port == 0) {
+        return;
+    }
+    struct sockaddr_in address;
+    socklen_t address_len = sizeof(address);
+    char ip[INET_ADDRSTRLEN];
+    if (getpeername(link->socket, (struct sockaddr *)&address, &address_len) < 0 ||
+        !inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip))) {
+        return;
+    }
+    snprintf(link->node, sizeof(link->node), "%s:%u", ip, listen_port);
+    prof_lock(&federation->links_mutex);
+    const int added = hashring_add(federation->ring, link->node) == 0;
+    prof_unlock(&federation->links_mutex);
+    if (added) {
+        cluster_update_owner(federation);
+    }
+}
+
+// Lien fermé : son nœud quitte l'anneau s'il n'a plus d'autre lien ouvert
+static void cluster_node_down(Federation *federation, const Link *link) {
+    if (!federation->ring || link->node[0] == '\0') {
+        return;
+    }
+    for (int i = 0; i < federation->link_count; ++i) {
+        const Link *other = federation->links[i];
+        if (other != link && !other->closed && strcmp(other->node, link->node) == 0) {
+            if (federation->owner == link) {
+                cluster_update_owner(federation);
+            }
+            return;
+        }
+    }
+    prof_lock(&federation->links_mutex);
+    hashring_remove(federation->ring, link->node);
+    prof_unlock(&federation->links_mutex);
+    cluster_update_owner(federation);
+}
+
+// Libère les liens fermés pendant l'itération ; leurs pairs sont retentés plus tard
+static void federation_reap(Federation *federation) {
+    const uint64_t now_ms = monotonic_ms();
+    for (int i = 0; i < federation->link_count;) {
+        Link *link = federation->links[i];
+        if (!link->closed) {
+            ++i;
+            continue;
+        }
+        if (link->peer >= 0) {
+            Peer *peer = &federation->peers[link->peer];
+            peer->link = NULL;
+            if (peer->retry_ms != UINT64_MAX) {
+                peer->retry_ms = now_ms + FEDERATION_RETRY_MS;
+            }
+            if (!link->connecting) {
+                peer->failing = 0;
+            }
+        }
+        if (!link->connecting) {
+            char line[96];
+            snprintf(line, sizeof(line), "Federation link down: %s", link->address);
+            log_text(LOG_INFO, line);
+        }
+        cluster_node_down(federation, link);
+        epoll_ctl(federation->epoll_fd, EPOLL_CTL_DEL, link->socket, NULL);
+        close(link->socket);
+        prof_lock(&federation->links_mutex);
+        federation->links[i] = federation->links[--federation->link_count];
+        prof_unlock(&federation->links_mutex);
+        free(link->in.data);
+        free(link->out.data);
+        free(link);
+    }
+}
+
+// Tentatives de connexion aux pairs -F déconnectés dont le délai est écoulé
+static void federation_connect_peers(Federation *federation) {
+    const uint64_t now_ms = monotonic_ms();
+    for (int i = 0; i < federation->peer_count; ++i) {
+        Peer *peer = &federation->peers[i];
+        if (peer->link || now_ms < peer->retry_ms) {
+            continue;
+        }
+        peer->retry_ms = now_ms + FEDERATION_RETRY_MS;
+        const int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            continue;
+        }
+        const int status = connect(sock, (struct sockaddr *)&peer->address, sizeof(peer->address));
+        if (status < 0 && errno != EINPROGRESS) {
+            close(sock);
+            continue;
+        }
+        peer->link = link_add(federation, sock, status < 0, i);
+        if (!peer->link) {
+            close(sock);
+        } else if (status == 0) {
+            link_up(federation, peer->link);
+        }
+    }
+}
+
+// Connexion sortante terminée : établie, ou refusée (nouvelle tentative plus tard)
+static void link_connected(Federation *federation, Link *link) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(link->socket, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+        error = errno;
+    }
+    if (error == 0) {
+        link_up(federation, link);
+        return;
+    }
+    Peer *peer = &federation->peers[link->peer];
+    if (!peer->failing) {
+        peer->failing = 1;
+        char line[96];
+        snprintf(line, sizeof(line), "Federation peer %s unreachable, retrying", peer->name);
+        log_errno(line, error);
+    }
+    link_close(link);
+}
+
+static void link_handle_frame(Federation *federation, Link *link, const FrameHeader *header, const char *frame) {
+    const char *payload = frame + sizeof(FrameHeader);
+    switch (header->type) {
+        case FRAME_PEER_HELLO: {
+            PeerHello hello;
+            if (header->length != sizeof(hello)) {
+                break;
+            }
+            memcpy(&hello, payload, sizeof(hello));
+            link->remote_id = proto_ntoh64(hello.server_id);
+            if (link->remote_id == federation->id) {
+                // Adresse de ce serveur lui-même dans -F : on ne réessaie pas
+                log_text(LOG_WARN, "Federation link to this server itself, closed");
+                if (link->peer >= 0) {
+                    federation->peers[link->peer].retry_ms = UINT64_MAX;
+                }
+                link_close(link);
+                break;
+            }
+            link->gateway = (ntohl(hello.flags) & PEER_FLAG_GATEWAY) != 0;
+            cluster_node_up(federation, link, ntohl(hello.listen_port));
+            break;
+        }
+        case FRAME_FORWARD:
+            // Message d'un membre d'une passerelle : au propriétaire du salon s'il est
+            // ailleurs dans la grappe
+            if (federation->owner && link->node[0] == '\0') {
+                link_send(federation, federation->owner, frame, sizeof(FrameHeader) + header->length, 1);
+                atomic_fetch_add_explicit(&federation->forwarded_to_owner, 1, memory_order_relaxed);
+                break;
+            }
+            // Transmis par un serveur de la grappe qui nous croit propriétaire : numéroté
+            // ici même si l'anneau a changé entre-temps, plutôt que perdu
+            atomic_fetch_add_explicit(&federation->sequenced_for_others, 1, memory_order_relaxed);
+            federation->deliver(payload, header->length, 1);
+            break;
+        case FRAME_RELAY: {
+            RelayHeader relay;
+            if (header->length < sizeof(relay)) {
+                break;
+            }
+            memcpy(&relay, payload, sizeof(relay));
+            const uint64_t origin = proto_ntoh64(relay.origin_id);
+            atomic_fetch_add_explicit(&federation->received, 1, memory_order_relaxed);
+            // Nos propres messages revenus par une boucle, ou un doublon d'un autre chemin
+            uint64_t skipped;
+            if (origin == federation->id ||
+                !origin_accept(&federation->origins, origin, proto_ntoh64(relay.origin_seq), &skipped)) {
+                atomic_fetch_add_explicit(&federation->duplicates, 1, memory_order_relaxed);
+                break;
+            }
+            if (skipped) {
+                atomic_fetch_add_explicit(&federation->lost, skipped, memory_order_relaxed);
+            }
+            federation->deliver(payload + sizeof(relay), header->length - sizeof(relay), 0);
+            // Retransmis tel quel aux autres serveurs, sauf à celui d'origine. Grappe : le
+            // propriétaire publie déjà vers chaque nœud, seuls les liens hors de l'anneau
+            // (passerelles) reçoivent une copie
+            const size_t length = sizeof(FrameHeader) + header->length;
+            for (int i = 0; i < federation->link_count; ++i) {
+                Link *other = federation->links[i];
+                if (federation->ring && other->node[0]) {
+                    continue;
+                }
+                if (other != link && other->remote_id != origin && !other->closed && !other->connecting) {
+                    link_send(federation, other, frame, length, 1);
+                    atomic_fetch_add_explicit(&federation->forwarded, 1, memory_order_relaxed);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void link_read(Federation *federation, Link *link) {
+    while (!link->closed) {
+        if (buffer_reserve(&link->in, READ_CHUNK) < 0) {
+            link_close(link);
+            return;
+        }
+        const ssize_t received = recv(link->socket, link->in.data + link->in.length, READ_CHUNK, 0);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                link_close(link);
+            }
+            break;
+        }
+        link->in.length += (size_t)received;
+        link->bytes_in += (uint64_t)received;
+
+        size_t offset = 0;
+        while (!link->closed && link->in.length - offset >= sizeof(FrameHeader)) {
+            FrameHeader header;
+            memcpy(&header, link->in.data + offset, sizeof(header));
+            header.length = ntohl(header.length);
+            if (header.length > MAX_FRAME_PAYLOAD) {
+                log_text(LOG_WARN, "Oversized federation frame, link closed");
+                link_close(link);
+                break;
+            }
+            if (link->in.length - offset < sizeof(header) + header.length) {
+                break;
+            }
+            link->frames_in++;
+            link_handle_frame(federation, link, &header, link->in.data + offset);
+            offset += sizeof(header) + header.length;
+        }
+        memmove(link->in.data, link->in.data + offset, link->in.length - offset);
+        link->in.length -= offset;
+    }
+}
+
+static void federation_accept(Federation *federation) {
+    for (;;) {
+        const int sock = accept4(federation->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_errno("Federation accept", errno);
+            }
+            return;
+        }
+        Link *link = link_add(federation, sock, 0, -1);
+        if (!link) {
+            log_errno("Error registering a federation link", errno);
+            close(sock);
+            continue;
+        }
+        link_up(federation, link);
+    }
+}
+
+// Grappe : deux serveurs qui se listent mutuellement en -F ont deux liens ; une
+// publication n'en emprunte qu'un
+static int cluster_duplicate_link(const Federation *federation, const int index) {
+    const Link *link = federation->links[index];
+    if (!federation->ring || link->node[0] == '\0') {
+        return 0;
+    }
+    for (int i = 0; i < index; ++i) {
+        const Link *other = federation->links[i];
+        if (!other->closed && !other->connecting && strcmp(other->node, link->node) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Publications accumulées depuis le dernier réveil : une copie par lien ; messages à
+// transmettre au propriétaire du salon : au lien du propriétaire, ou numérotés ici si
+// ce serveur l'est devenu depuis leur dépôt
+static void federation_flush_outbox(Federation *federation) {
+    prof_lock(&federation->outbox_mutex);
+    const Buffer pending = federation->outbox;
+    const uint64_t count = federation->outbox_frames;
+    federation->outbox = federation->sending;
+    federation->outbox.length = 0;
+    federation->outbox_frames = 0;
+    const Buffer forward = federation->forward_box;
+    const uint64_t forward_count = federation->forward_frames;
+    federation->forward_box = federation->forwarding;
+    federation->forward_box.length = 0;
+    federation->forward_frames = 0;
+    prof_unlock(&federation->outbox_mutex);
+
+    for (int i = 0; i < federation->link_count; ++i) {
+        if (!cluster_duplicate_link(federation, i)) {
+            link_send(federation, federation->links[i], pending.data, pending.length, count);
+        }
+    }
+    federation->sending = pending;
+
+    if (forward.length > 0 && federation->owner) {
+        link_send(federation, federation->owner, forward.data, forward.length, forward_count);
+        atomic_fetch_add_explicit(&federation->forwarded_to_owner, forward_count, memory_order_relaxed);
+    } else {
+        for (size_t offset = 0; offset < forward.length;) {
+            FrameHeader header;
+            memcpy(&header, forward.data + offset, sizeof(header));
+            const uint32_t length = ntohl(header.length);
+            federation->deliver(forward.data + offset + sizeof(header), length, 1);
+            offset += sizeof(header) + length;
+        }
+    }
+    federation->forwarding = forward;
+}
+
+static void *federation_thread(void *arg) {
+    Federation *federation = arg;
+    struct epoll_event events[MAX_EVENTS];
+    while (!atomic_load_explicit(&federation->stopping, memory_order_relaxed)) {
+        federation_connect_peers(federation);
+        const int count = epoll_wait(federation->epoll_fd, events, MAX_EVENTS, FEDERATION_RETRY_MS);
+        if (count < 0 && errno != EINTR) {
+            log_errno("Federation epoll_wait", errno);
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &federation->listener) {
+                federation_accept(federation);
+            } else if (ptr == &federation->wake_fd) {
+                uint64_t value;
+                if (read(federation->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    log_errno("Error reading the federation eventfd", errno);
+                }
+                federation_flush_outbox(federation);
+            } else {
+                Link *link = ptr;
+                if (link->closed) {
+                    continue;
+                }
+                if (link->connecting) {
+                    link_connected(federation, link);
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    link_read(federation, link);
+                }
+                if ((events[i].events & EPOLLOUT) && !link->closed) {
+                    link_write(federation, link);
+                }
+            }
+        }
+        federation_reap(federation);
+    }
+    return NULL;
+}
+
+// Écoute des pairs sur la boucle locale, comme les clients et l'admin
+static int federation_listen(Federation *federation, const int port) {
+    federation->listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (federation->listener < 0) {
+        return -1;
+    }
+    const int reuse = 1;
+    setsockopt(federation->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons((uint16_t)port)};
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(federation->listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(federation->listener, SOMAXCONN) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+Federation *federation_create(const int port, const FederationDeliver deliver) {
+    Federation *federation = calloc(1, sizeof(Federation));
+    if (!federation) {
+        return NULL;
+    }
+    federation->links_mutex = (ProfMutex)PROF_MUTEX_INITIALIZER("federation_links");
+    federation->outbox_mutex = (ProfMutex)PROF_MUTEX_INITIALIZER("federation_outbox");
+    federation->deliver = deliver;
+    federation->port = port;
+    federation->listener = -1;
+    federation->wake_fd = -1;
+    // Un identifiant par processus : un serveur redémarré est une nouvelle origine
+    if (getrandom(&federation->id, sizeof(federation->id), 0) != sizeof(federation->id)) {
+        federation->id = ((uint64_t)getpid() << 32) ^ (uint64_t)time(NULL) ^ monotonic_ms();
+    }
+    if (federation->id == 0) {
+        federation->id = 1;
+    }
+
+    federation->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    federation->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (federation->epoll_fd < 0 || federation->wake_fd < 0 || (port > 0 && federation_listen(federation, port) < 0)) {
+        const int saved = errno;
+        if (federation->listener >= 0) {
+            close(federation->listener);
+        }
+        if (federation->wake_fd >= 0) {
+            close(federation->wake_fd);
+        }
+        if (federation->epoll_fd >= 0) {
+            close(federation->epoll_fd);
+        }
+        free(federation);
+        errno = saved;
+        return NULL;
+    }
+    return federation;
+}
+
+int federation_add_peer(Federation *federation, const char *address) {
+    if (federation->peer_count == FEDERATION_MAX_PEERS) {
+        errno = ENOSPC;
+        return -1;
+    }
+    Peer *peer = &federation->peers[federation->peer_count];
+    memset(peer, 0, sizeof(*peer));
+    if (parse_address(address, &peer->address, peer->name, sizeof(peer->name)) < 0) {
+        return -1;
+    }
+    federation->peer_count++;
+    return 0;
+}
+
+int federation_set_room(Federation *federation, const char *room) {
+    if (federation->listener < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    federation->room = strdup(room);
+    federation->ring = hashring_create();
+    if (!federation->room || !federation->ring) {
+        errno = ENOMEM;
+        return -1;
+    }
+    // Le nom sous lequel les pairs nous voient : adresse d'écoute et port -f
+    snprintf(federation->self_node, sizeof(federation->self_node), "127.0.0.1:%d", federation->port);
+    hashring_add(federation->ring, federation->self_node);
+    snprintf(federation->owner_node, sizeof(federation->owner_node), "%s", federation->self_node);
+    return 0;
+}
+
+int federation_start(Federation *federation) {
+    struct epoll_event wake = {.events = EPOLLIN, .data.ptr = &federation->wake_fd};
+    struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = &federation->listener};
+    if (epoll_ctl(federation->epoll_fd, EPOLL_CTL_ADD, federation->wake_fd, &wake) < 0 ||
+        (federation->listener >= 0 &&
+         epoll_ctl(federation->epoll_fd, EPOLL_CTL_ADD, federation->listener, &listen_event) < 0)) {
+        return -1;
+    }
+    const int status = pthread_create(&federation->thread, NULL, federation_thread, federation);
+    if (status != 0) {
+        errno = status;
+        return -1;
+    }
+    federation->started = 1;
+    return 0;
+}
+
+void federation_stop(Federation *federation) {
+    if (federation->started) {
+        atomic_store(&federation->stopping, 1);
+        const uint64_t one = 1;
+        if (write(federation->wake_fd, &one, sizeof(one)) < 0) {
+            log_errno("Error waking the federation thread", errno);
+        }
+        pthread_join(federation->thread, NULL);
+    }
+    for (int i = 0; i < federation->link_count; ++i) {
+        Link *link = federation->links[i];
+        close(link->socket);
+        free(link->in.data);
+        free(link->out.data);
+        free(link);
+    }
+    if (federation->listener >= 0) {
+        close(federation->listener);
+    }
+    close(federation->wake_fd);
+    close(federation->epoll_fd);
+    free(federation->outbox.data);
+    free(federation->sending.data);
+    free(federation->forward_box.data);
+    free(federation->forwarding.data);
+    hashring_destroy(federation->ring);
+    free(federation->room);
+    free(federation);
+}
+
+void federation_publish(Federation *federation, const char *text, size_t length) {
+    if (length > MAX_RELAY_TEXT) {
+        length = MAX_RELAY_TEXT;
+    }
+    prof_lock(&federation->outbox_mutex);
+    // Numéroté même s'il est perdu : les autres serveurs verront le trou
+    const RelayHeader relay = {.origin_id = proto_hton64(federation->id),
+                               .origin_seq = proto_hton64(++federation->origin_seq)};
+    const FrameHeader header = {.length = htonl((uint32_t)(sizeof(relay) + length)), .type = FRAME_RELAY};
+    const int was_empty = federation->outbox.length == 0 && federation->forward_box.length == 0;
+    const size_t frame_len = sizeof(header) + sizeof(relay) + length;
+    if (federation->outbox.length + frame_len > FEDERATION_MAX_OUT ||
+        buffer_reserve(&federation->outbox, frame_len) < 0) {
+        prof_unlock(&federation->outbox_mutex);
+        atomic_fetch_add_explicit(&federation->overflows, 1, memory_order_relaxed);
+        return;
+    }
+    buffer_append(&federation->outbox, &header, sizeof(header));
+    buffer_append(&federation->outbox, &relay, sizeof(relay));
+    buffer_append(&federation->outbox, text, length);
+    federation->outbox_frames++;
+    prof_unlock(&federation->outbox_mutex);
+    atomic_fetch_add_explicit(&federation->published, 1, memory_order_relaxed);
+
+    // Le thread vide la boîte entière à chaque réveil
+    if (was_empty) {
+        const uint64_t one = 1;
+        if (write(federation->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            log_errno("Error waking the federation thread", errno);
+        }
+    }
+}
+
+int federation_forward(Federation *federation, const char *text, size_t length) {
+    if (!federation->ring) {
+        return 0;
+    }
+    if (length > MAX_FRAME_PAYLOAD) {
+        length = MAX_FRAME_PAYLOAD;
+    }
+    const FrameHeader header = {.length = htonl((uint32_t)length), .type = FRAME_FORWARD};
+    prof_lock(&federation->outbox_mutex);
+    if (!federation->owner_remote) {
+        prof_unlock(&federation->outbox_mutex);
+        return 0;
+    }
+    const int was_empty = federation->outbox.length == 0 && federation->forward_box.length == 0;
+    if (federation->forward_box.length + sizeof(header) + length > FEDERATION_MAX_OUT ||
+        buffer_reserve(&federation->forward_box, sizeof(header) + length) < 0) {
+        prof_unlock(&federation->outbox_mutex);
+        atomic_fetch_add_explicit(&federation->overflows, 1, memory_order_relaxed);
+        return 1;
+    }
+    buffer_append(&federation->forward_box, &header, sizeof(header));
+    buffer_append(&federation->forward_box, text, length);
+    federation->forward_frames++;
+    prof_unlock(&federation->outbox_mutex);
+
+    if (was_empty) {
+        const uint64_t one = 1;
+        if (write(federation->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            log_errno("Error waking the federation thread", errno);
+        }
+    }
+    return 1;
+}
+
+// Lecture sans verrou des compteurs des liens : valeurs indicatives
+void federation_dump(Federation *federation, FILE *out) {
+    prof_lock(&federation->links_mutex);
+    fprintf(out, "federation: server %016llx, ", (unsigned long long)federation->id);
+    if (federation->listener >= 0) {
+        fprintf(out, "accepting links on port %d", federation->port);
+    } else {
+        fprintf(out, "not accepting links");
+    }
+    fprintf(out, ", %d links, %d origins seen\n", federation->link_count, federation->origins.count);
+    fprintf(out, "published %llu messages (%llu lost, relay thread behind), received %llu frames, "
+                 "%llu duplicates dropped, %llu missed during link outages, %llu forwarded\n",
+            (unsigned long long)atomic_load(&federation->published), (unsigned long long)atomic_load(&federation->overflows),
+            (unsigned long long)atomic_load(&federation->received), (unsigned long long)atomic_load(&federation->duplicates),
+            (unsigned long long)atomic_load(&federation->lost), (unsigned long long)atomic_load(&federation->forwarded));
+    if (federation->ring) {
+        fprintf(out, "cluster: room %s owned by %s%s, %zu nodes on the ring, %llu owner changes\n"
+                     "forwarded %llu messages to the owner, sequenced %llu for other servers\n",
+                federation->room, federation->owner_node, federation->owner ? "" : " (this server)",
+                hashring_size(federation->ring), (unsigned long long)atomic_load(&federation->owner_changes),
+                (unsigned long long)atomic_load(&federation->forwarded_to_owner),
+                (unsigned long long)atomic_load(&federation->sequenced_for_others));
+    }
+    for (int i = 0; i < federation->link_count; ++i) {
+        const Link *link = federation->links[i];
+        fprintf(out, "  %-8s %-21s %s", link->peer >= 0 ? "peer" : link->gateway ? "gateway" : "accepted", link->address,
+                link->connecting ? "connecting" : "up");
+        if (link->remote_id) {
+            fprintf(out, ", server %016llx", (unsigned long long)link->remote_id);
+        }
+        if (link->node[0]) {
+            fprintf(out, ", node %s", link->node);
+        }
+        fprintf(out, ", in %llu frames (%llu KB), out %llu frames (%llu KB), %zu KB queued\n",
+                (unsigned long long)link->frames_in, (unsigned long long)(link->bytes_in >> 10),
+                (unsigned long long)link->frames_out, (unsigned long long)(link->bytes_out >> 10),
+                (link->out.length - link->out_offset) >> 10);
+    }
+    for (int i = 0; i < federation->peer_count; ++i) {
+        const Peer *peer = &federation->peers[i];
+        if (!peer->link) {
+            fprintf(out, "  %-8s %-21s %s, %llu connections so far\n", "peer", peer->name,
+                    peer->retry_ms == UINT64_MAX ? "disabled (this server)" : "down, retrying",
+                    (unsigned long long)peer->connects);
+        }
+    }
+    fprintf(out, "dropped %llu links to peers that stopped reading (over %d MB queued)\n",
+            (unsigned long long)atomic_load(&federation->links_dropped), FEDERATION_MAX_OUT >> 20);
+    prof_unlock(&federation->links_mutex);
+}
@@ -0,0 +1,79 @@
+#ifndef CHAT_FEDERATION_H
+#define CHAT_FEDERATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Fédération : plusieurs serveurs partagent le salon en se relayant sa diffusion par
+// des liens TCP (serveur -f port pour les accepter, -F host:port pour s'y connecter).
+//
+// Chaque message publié localement part en une seule trame FRAME_RELAY par lien, quel
+// que soit le nombre de membres distants ; chaque serveur le distribue ensuite à ses
+// propres membres. Un message reçu est retransmis sur les autres liens, donc n'importe
+// quel graphe connexe convient. Un arbre (chaîne, étoile) fait traverser chaque lien
+// une seule fois à chaque message ; un maillage complet ajoute des doublons, abandonnés
+// à l'arrivée, en échange de chemins de secours.
+//
+// Boucles et doublons : un message porte l'identifiant de son serveur d'origine et un
+// numéro qui y croît de 1 à chaque publication. Les liens TCP préservent l'ordre, donc
+// les messages d'une origine arrivent dans l'ordre par chaque chemin : tout numéro
+// déjà vu pour cette origine est un doublon (ou un retour) et il est abandonné. Un
+// numéro qui en saute d'autres signale des messages perdus pendant une coupure de lien
+// (pas de rattrapage : les messages manqués ne sont pas renvoyés).
+//
+// Un thread dédié gère les liens (reconnexion automatique des pairs -F). Un lien dont
+// le pair ne lit plus est coupé au-delà de FEDERATION_MAX_OUT octets en attente.
+//
+// Grappe (federation_set_room, serveur -C) : le salon est placé sur un anneau de
+// hachage cohérent (hashring.h) dont les nœuds sont ce serveur et les pairs reliés.
+// Son propriétaire numérote seul le salon : les autres lui transmettent les messages
+// de leurs membres (FRAME_FORWARD) et les diffusent quand ils leur reviennent par
+// FRAME_RELAY, donc tous les membres de la grappe voient le même ordre. Chaque
+// serveur doit être relié à tous les autres (maillage complet) : en grappe, un
+// message n'est pas retransmis de lien en lien. Un nœud qui arrive ou part ne
+// déplace que les salons de ses points de l'anneau ; les messages en route vers un
+// propriétaire dont le lien tombe sont perdus.
+//
+// Passerelles (chat_gateway) : elles se relient au port -f comme un pair, reçoivent
+// chaque message une fois par FRAME_RELAY et transmettent ceux de leurs membres par
+// FRAME_FORWARD ; le serveur les numérote (ou les passe au propriétaire en grappe).
+
+#define FEDERATION_MAX_PEERS 16
+#define FEDERATION_MAX_OUT (64 << 20)
+#define FEDERATION_RETRY_MS 1000
+
+typedef struct Federation Federation;
+
+// Appelée depuis le thread de fédération pour chaque message à distribuer.
+// local : message transmis par un serveur de la grappe à son propriétaire (ce
+// serveur), à numéroter et publier comme ceux de nos membres.
+typedef void (*FederationDeliver)(const char *text, size_t length, int local);
+
+// port : écoute des pairs sur 127.0.0.1, 0 pour n'accepter aucun lien.
+// NULL en cas d'erreur (errno positionné).
+Federation *federation_create(int port, FederationDeliver deliver);
+
+// Pair auquel se connecter : "host:port" (adresse IPv4) ou "port" (127.0.0.1) ;
+// -1 si l'adresse est invalide ou la table pleine
+int federation_add_peer(Federation *federation, const char *address);
+
+// Mode grappe pour ce salon, avant federation_start ; -1 (EINVAL) si le serveur
+// n'accepte pas de liens : son nom sur l'anneau est son adresse d'écoute
+int federation_set_room(Federation *federation, const char *room);
+
+int federation_start(Federation *federation);
+void federation_stop(Federation *federation);
+
+// Message diffusé localement : à appeler dans l'ordre de diffusion (sous le verrou qui
+// le fixe). Ne bloque pas : la trame est copiée et envoyée par le thread de fédération.
+void federation_publish(Federation *federation, const char *text, size_t length);
+
+// Message d'un membre en mode grappe : 1 s'il est transmis au propriétaire du salon
+// (il reviendra numéroté), 0 si ce serveur le diffuse lui-même
+int federation_forward(Federation *federation, const char *text, size_t length);
+
+// Liens, volumes échangés, doublons et pertes
+void federation_dump(Federation *federation, FILE *out);
+
+#endif
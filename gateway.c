@@ -0,0 +1,947 @@
+// Passerelle de connexions (chat_gateway) : tient les connexions des clients (même
+// protocole que client.c, même port par défaut) et les multiplexe sur quelques liens
+// persistants vers des serveurs, qui l'acceptent sur leur port de fédération (-f).
+//
+// Un message du salon arrive une seule fois par passerelle (FRAME_RELAY) et la
+// passerelle le distribue à ses propres membres : le serveur n'écrit plus vers chaque
+// utilisateur, il numérote et relaie. Les messages des membres partent vers le premier
+// serveur joignable (FRAME_FORWARD), qui les numérote et les renvoie à toutes les
+// passerelles, celle d'origine comprise. La mémoire des connexions et le coût de la
+// diffusion se répartissent ainsi sur autant de passerelles que nécessaire, devant un
+// serveur qui ne garde que l'ordre du salon.
+//
+// Reliée à plusieurs serveurs fédérés, la passerelle reçoit chaque message par
+// chacun : les doublons sont reconnus par leur origine et leur numéro, comme entre
+// serveurs (voir federation.h). Le serveur suivant prend le relais si le premier
+// tombe ; les messages en route sur le lien perdu le sont aussi.
+//
+// Servi localement : l'historique (replay à l'arrivée, pages /history) est celui des
+// messages reçus depuis le démarrage de la passerelle, avec ses propres numéros, et
+// les pings. /search, qui interroge l'index du serveur, n'est pas disponible.
+//
+//   ./server -p 30011 -f 31001 &
+//   ./chat_gateway -p 30001 -b 31001 &
+//   ./client
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "log.h"
+#include "protocol.h"
+#include "ratelimit.h"
+#include "rtt.h"
+#include "util.h"
+
+#define MAX_BACKENDS 8
+#define DEFAULT_MAX_USERS 10000
+#define MAX_LEN 1000                        // texte saisi, comme le serveur
+#define IN_BUFFER_SIZE (sizeof(FrameHeader) + MAX_LEN)
+#define MAX_CLIENT_OUT (1 << 20)            // au-delà, le client est trop lent : déconnexion
+#define MAX_BACKEND_OUT (64 << 20)
+#define SHRINK_OUT_BYTES 65536              // tampon vidé plus grand : rendu (après un replay)
+#define RETRY_MS 1000
+#define HANDSHAKE_TIMEOUT_MS 5000
+#define REPLAY_MESSAGES 50
+#define DEFAULT_HISTORY_KB 4096
+#define MAX_EVENTS 256
+#define READ_CHUNK 65536
+#define DEFAULT_MESSAGE_RATE 10
+#define DEFAULT_MESSAGE_BURST 20
+#define DEFAULT_BYTE_RATE 8192
+#define DEFAULT_BYTE_BURST 16384
+
+// Premier champ des clients et des serveurs : data.ptr d'epoll désigne l'un ou l'autre
+typedef enum EndpointKind {
+    ENDPOINT_CLIENT,
+    ENDPOINT_BACKEND,
+} EndpointKind;
+
+typedef struct Client {
+    EndpointKind kind;
+    int socket;
+    int active;                 // nom reçu : membre du salon
+    int closed;                 // libéré en fin d'itération
+    int want_write;             // EPOLLOUT armé
+    int queued;                 // dans la liste des écritures de l'itération
+    int throttled;              // avis de limitation déjà envoyé pour cette rafale
+    size_t index;               // place dans la table des clients
+    uint64_t accepted_ms;
+    char name[PROTOCOL_NAME_LEN];
+    size_t name_len;
+    char in[IN_BUFFER_SIZE];
+    size_t in_len;
+    Buffer out;
+    size_t out_offset;          // octets de out déjà envoyés
+    TokenBucket message_bucket;
+    TokenBucket byte_bucket;
+} Client;
+
+typedef struct Backend {
+    EndpointKind kind;
+    struct sockaddr_in address;
+    char name[32];
+    int socket;                 // -1 : déconnecté, nouvelle tentative à retry_ms
+    int connecting;             // connexion en cours : EPOLLOUT attendu
+    int closed;
+    int want_write;
+    int failing;                // échec déjà journalisé
+    uint64_t server_id;         // 0 tant que PeerHello n'est pas reçu
+    uint64_t retry_ms;
+    uint64_t connects;
+    Buffer in;
+    Buffer out;
+    size_t out_offset;
+} Backend;
+
+static int epoll_fd = -1;
+static int listener = -1;
+static int signal_fd = -1;
+static uint64_t gateway_id;
+static int max_users = DEFAULT_MAX_USERS;
+static int notices = 1;             // annonces d'arrivée et de départ (-n pour les couper)
+static RateLimit message_limit = {DEFAULT_MESSAGE_RATE, DEFAULT_MESSAGE_BURST};
+static RateLimit byte_limit = {DEFAULT_BYTE_RATE, DEFAULT_BYTE_BURST};
+
+// Tous les clients (en attente du nom ou membres) ; fermés et à écrire de l'itération
+static Client **clients;
+static size_t client_count;
+static size_t client_capacity;
+static int active_users;
+static Client **closing;
+static size_t closing_count;
+static Client **writing;
+static size_t writing_count;
+
+static Backend backends[MAX_BACKENDS];
+static int backend_count;
+
+static OriginTable origins;         // dédoublonnage des relais, comme la fédération
+
+// Messages reçus, numérotés localement pour le replay et les pages
+static History history;
+static HistoryCursor history_cursor;
+static uint64_t message_seq;
+
+static uint64_t relayed;            // messages reçus des serveurs et distribués
+static uint64_t duplicates;         // même message reçu par un autre serveur
+static uint64_t deliveries;         // copies mises en file vers les membres
+static uint64_t forwarded;          // messages de nos membres transmis aux serveurs
+static uint64_t unrouted;           // aucun serveur joignable : message refusé
+static uint64_t slow_clients;       // déconnectés, file d'envoi pleine
+static uint64_t throttled;
+
+static void update_events(const int socket, void *ptr, int *want_write, const int want) {
+    if (*want_write == want) {
+        return;
+    }
+    *want_write = want;
+    struct epoll_event event = {.events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = ptr};
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, socket, &event);
+}
+
+// Envoie ce qui peut l'être sans bloquer ; le reste attend EPOLLOUT. -1 si la
+// connexion est perdue.
+static int flush_out(const int socket, Buffer *out, size_t *out_offset) {
+    while (*out_offset < out->length) {
+        const ssize_t sent = send(socket, out->data + *out_offset, out->length - *out_offset,
+                                  MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            break;
+        }
+        *out_offset += (size_t)sent;
+    }
+    if (*out_offset == out->length) {
+        out->length = 0;
+        *out_offset = 0;
+        if (out->capacity > SHRINK_OUT_BYTES) {
+            free(out->data);
+            *out = (Buffer){0};
+        }
+    } else if (*out_offset > out->length / 2) {
+        memmove(out->data, out->data + *out_offset, out->length - *out_offset);
+        out->length -= *out_offset;
+        *out_offset = 0;
+    }
+    return 0;
+}
+
+static void backend_forward(Client *client, const char *text, size_t length);
+
+// Fermeture différée : le client peut encore figurer dans les événements de l'itération
+static void client_close(Client *client) {
+    if (client->closed) {
+        return;
+    }
+    client->closed = 1;
+    closing[closing_count++] = client;
+    if (client->active) {
+        active_users--;
+        log_leave(client->name);
+        if (!notices) {
+            return;
+        }
+        char notice[MAX_LEN];
+        const int length = snprintf(notice, sizeof(notice), "\033[31m%s: %s disconnected.\033[0m", "SERVER",
+                                    client->name);
+        backend_forward(NULL, notice, (size_t)length < sizeof(notice) ? (size_t)length : sizeof(notice) - 1);
+    }
+}
+
+// Trames pour ce client, envoyées en fin d'itération avec les autres
+static void client_queue(Client *client, const void *frames, const size_t length) {
+    if (client->closed) {
+        return;
+    }
+    if (client->out.length - client->out_offset + length > MAX_CLIENT_OUT ||
+        buffer_append(&client->out, frames, length) < 0) {
+        slow_clients++;
+        log_text(LOG_WARN, "Client too slow, disconnected");
+        client_close(client);
+        return;
+    }
+    if (!client->queued) {
+        client->queued = 1;
+        writing[writing_count++] = client;
+    }
+}
+
+static void client_send(Client *client, const uint8_t type, const void *payload, const size_t length) {
+    char frame[sizeof(FrameHeader) + MAX_FRAME_PAYLOAD];
+    client_queue(client, frame, encode_frame(frame, type, 0, payload, length));
+}
+
+static void client_notice(Client *client, const char *text) {
+    client_send(client, FRAME_TEXT, text, strlen(text));
+}
+
+// Message du salon : numéroté ici pour l'historique, une trame copiée vers chaque membre
+static void broadcast(const char *text, size_t length) {
+    if (length > MAX_FRAME_PAYLOAD) {
+        length = MAX_FRAME_PAYLOAD;
+    }
+    history_append(&history, ++message_seq, text, length);
+    char frame[sizeof(FrameHeader) + MAX_FRAME_PAYLOAD];
+    const size_t frame_len = encode_frame(frame, FRAME_TEXT, 0, text, length);
+    for (size_t i = 0; i < client_count; ++i) {
+        if (clients[i]->active) {
+            client_queue(clients[i], frame, frame_len);
+            deliveries++;
+        }
+    }
+    relayed++;
+}
+
+// Messages [first, last] de l'historique local, en trames de type donné (FRAME_HISTORY :
+// précédées de leur numéro), puis HistoryEnd
+static void client_send_history(Client *client, const uint8_t type, uint64_t first, const uint64_t last) {
+    const uint64_t oldest = history_first(&history);
+    if (first < oldest) {
+        first = oldest;
+    }
+    char payload[sizeof(uint64_t) + MAX_FRAME_PAYLOAD];
+    for (uint64_t seq = first; seq <= last && !client->closed; ++seq) {
+        size_t length;
+        const char *text = history_get(&history, &history_cursor, seq, &length);
+        if (!text) {
+            continue;
+        }
+        size_t offset = 0;
+        if (type == FRAME_HISTORY) {
+            const uint64_t wire_seq = proto_hton64(seq);
+            memcpy(payload, &wire_seq, sizeof(wire_seq));
+            offset = sizeof(wire_seq);
+        }
+        if (length > MAX_FRAME_PAYLOAD - offset) {
+            length = MAX_FRAME_PAYLOAD - offset;
+        }
+        memcpy(payload + offset, text, length);
+        client_send(client, type, payload, offset + length);
+    }
+    const HistoryEnd end = {proto_hton64(first), proto_hton64(oldest)};
+    client_send(client, FRAME_HISTORY_END, &end, sizeof(end));
+}
+
+// Le nom est reçu : replay des derniers messages et annonce au salon
+static void client_join(Client *client) {
+    client->name[sizeof(client->name) - 1] = '\0';
+    if (active_users >= max_users) {
+        log_refused(client->name);
+        client_close(client);
+        return;
+    }
+    client->active = 1;
+    active_users++;
+    const uint64_t now_ms = monotonic_ms();
+    bucket_init(&client->message_bucket, &message_limit, now_ms);
+    bucket_init(&client->byte_bucket, &byte_limit, now_ms);
+    client_send_history(client, FRAME_TEXT, message_seq >= REPLAY_MESSAGES ? message_seq - REPLAY_MESSAGES + 1 : 1,
+                        message_seq);
+
+    log_join(client->name);
+    if (!notices) {
+        return;
+    }
+    char notice[MAX_LEN];
+    const int length = snprintf(notice, sizeof(notice), "\033[32m%s: %s is connected.\033[0m\n", "SERVER",
+                                client->name);
+    backend_forward(NULL, notice, (size_t)length < sizeof(notice) ? (size_t)length : sizeof(notice) - 1);
+}
+
+// Seaux de messages et d'octets, comme sur le serveur
+static int client_admit(Client *client, const uint32_t length) {
+    const uint64_t now_ms = monotonic_ms();
+    if (bucket_take(&client->message_bucket, &message_limit, now_ms, 1)) {
+        if (bucket_take(&client->byte_bucket, &byte_limit, now_ms, length)) {
+            client->throttled = 0;
+            return 1;
+        }
+        bucket_refund(&client->message_bucket, 1);
+    }
+    throttled++;
+    if (!client->throttled) {
+        client->throttled = 1;
+        client_notice(client, "\033[33mSERVER: you are sending too fast, messages are being dropped.\033[0m");
+    }
+    return 0;
+}
+
+static void client_handle_frame(Client *client, const FrameHeader *header, const char *payload) {
+    switch (header->type) {
+        case FRAME_CHAT: {
+            if (!client_admit(client, header->length)) {
+                break;
+            }
+            if (header->length >= 7 && memcmp(payload, "/search", 7) == 0 &&
+                (header->length == 7 || payload[7] == ' ')) {
+                client_notice(client, "\033[33mSERVER: /search is not available through a gateway.\033[0m");
+                break;
+            }
+            char message[MAX_LEN + PROTOCOL_NAME_LEN + 10];
+            const int length = snprintf(message, sizeof(message), "%s : %.*s", client->name, (int)header->length,
+                                        payload);
+            log_chat(client->name, payload, header->length);
+            backend_forward(client, message, (size_t)length < sizeof(message) ? (size_t)length : sizeof(message) - 1);
+            break;
+        }
+        case FRAME_HISTORY_REQUEST: {
+            HistoryRequest request;
+            if (header->length != sizeof(request) || !client_admit(client, header->length)) {
+                break;
+            }
+            memcpy(&request, payload, sizeof(request));
+            uint64_t before = proto_ntoh64(request.before_seq);
+            if (before == 0 || before > message_seq + 1) {
+                before = message_seq + 1;
+            }
+            uint32_t count = ntohl(request.count);
+            if (count > MAX_HISTORY_PAGE) {
+                count = MAX_HISTORY_PAGE;
+            }
+            client_send_history(client, FRAME_HISTORY, before > count ? before - count : 1, before - 1);
+            break;
+        }
+        case FRAME_PING: {
+            PingPayload ping;
+            if (header->length == sizeof(ping)) {
+                memcpy(&ping, payload, sizeof(ping));
+                ping.reply_ns = proto_hton64(rtt_clock_ns());
+                client_send(client, FRAME_PONG, &ping, sizeof(ping));
+            }
+            break;
+        }
+        default:
+            // Pongs et accusés de trace : la passerelle ne mesure rien
+            break;
+    }
+}
+
+// Une lecture par événement (epoll déclenché par niveau) : un client bavard ne
+// retient pas la boucle
+static void client_read(Client *client) {
+    if (!client->active) {
+        const ssize_t received = recv(client->socket, client->name + client->name_len,
+                                      sizeof(client->name) - client->name_len, 0);
+        if (received <= 0) {
+            if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                client_close(client);
+            }
+            return;
+        }
+        client->name_len += (size_t)received;
+        if (client->name_len == sizeof(client->name)) {
+            client_join(client);
+        }
+        return;
+    }
+    const ssize_t received = recv(client->socket, client->in + client->in_len, sizeof(client->in) - client->in_len, 0);
+    if (received <= 0) {
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            client_close(client);
+        }
+        return;
+    }
+    client->in_len += (size_t)received;
+    size_t offset = 0;
+    while (!client->closed && client->in_len - offset >= sizeof(FrameHeader)) {
+        FrameHeader header;
+        memcpy(&header, client->in + offset, sizeof(header));
+        header.length = ntohl(header.length);
+        if (header.length > MAX_LEN - 1) {
+            log_text(LOG_WARN, "Oversized frame, client disconnected");
+            client_close(client);
+            return;
+        }
+        if (client->in_len - offset < sizeof(header) + header.length) {
+            break;
+        }
+        client_handle_frame(client, &header, client->in + offset + sizeof(header));
+        offset += sizeof(header) + header.length;
+    }
+    memmove(client->in, client->in + offset, client->in_len - offset);
+    client->in_len -= offset;
+}
+
+static void accept_clients(void) {
+    for (;;) {
+        const int sock = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_errno("Accept", errno);
+            }
+            return;
+        }
+        if (client_count == client_capacity) {
+            const size_t capacity = client_capacity ? client_capacity * 2 : 1024;
+            Client **table = realloc(clients, capacity * sizeof(Client *));
+            Client **closing_table = table ? realloc(closing, capacity * sizeof(Client *)) : NULL;
+            Client **writing_table = closing_table ? realloc(writing, capacity * sizeof(Client *)) : NULL;
+            if (table) {
+                clients = table;
+            }
+            if (closing_table) {
+                closing = closing_table;
+            }
+            if (!writing_table) {
+                log_errno("Error growing the client table", ENOMEM);
+                close(sock);
+                continue;
+            }
+            writing = writing_table;
+            client_capacity = capacity;
+        }
+        Client *client = calloc(1, sizeof(Client));
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+        if (!client || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) < 0) {
+            log_errno("Error registering a client", errno);
+            free(client);
+            close(sock);
+            continue;
+        }
+        const int enable = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        client->kind = ENDPOINT_CLIENT;
+        client->socket = sock;
+        client->accepted_ms = monotonic_ms();
+        client->index = client_count;
+        clients[client_count++] = client;
+    }
+}
+
+// Écritures groupées de l'itération : une par client, quel que soit le nombre de trames
+static void flush_clients(void) {
+    for (size_t i = 0; i < writing_count; ++i) {
+        Client *client = writing[i];
+        client->queued = 0;
+        if (client->closed) {
+            continue;
+        }
+        if (flush_out(client->socket, &client->out, &client->out_offset) < 0) {
+            client_close(client);
+            continue;
+        }
+        update_events(client->socket, client, &client->want_write, client->out.length > 0);
+    }
+    writing_count = 0;
+}
+
+static void reap_clients(void) {
+    for (size_t i = 0; i < closing_count; ++i) {
+        Client *client = closing[i];
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->socket, NULL);
+        close(client->socket);
+        Client *last = clients[--client_count];
+        clients[client->index] = last;
+        last->index = client->index;
+        free(client->out.data);
+        free(client);
+    }
+    closing_count = 0;
+}
+
+// Clients qui n'ont pas envoyé leur nom à temps
+static void expire_handshakes(const uint64_t now_ms) {
+    for (size_t i = 0; i < client_count; ++i) {
+        Client *client = clients[i];
+        if (!client->active && !client->closed && now_ms - client->accepted_ms > HANDSHAKE_TIMEOUT_MS) {
+            client_close(client);
+        }
+    }
+}
+
+static void backend_close(Backend *backend) {
+    backend->closed = 1;
+}
+
+static int backend_up(const Backend *backend) {
+    return backend->socket >= 0 && !backend->connecting && !backend->closed;
+}
+
+static void backend_send(Backend *backend, const void *frames, const size_t length) {
+    if (backend->out.length - backend->out_offset + length > MAX_BACKEND_OUT) {
+        char line[96];
+        snprintf(line, sizeof(line), "Server %s too slow, link dropped", backend->name);
+        log_text(LOG_WARN, line);
+        backend_close(backend);
+        return;
+    }
+    if (buffer_append(&backend->out, frames, length) < 0) {
+        backend_close(backend);
+    }
+}
+
+// Message d'un membre (client NULL : annonce de la passerelle) vers le premier serveur
+// joignable, envoyé en fin d'itération avec les autres
+static void backend_forward(Client *client, const char *text, size_t length) {
+    for (int i = 0; i < backend_count; ++i) {
+        Backend *backend = &backends[i];
+        if (backend_up(backend)) {
+            if (length > MAX_FRAME_PAYLOAD) {
+                length = MAX_FRAME_PAYLOAD;
+            }
+            char frame[sizeof(FrameHeader) + MAX_FRAME_PAYLOAD];
+            backend_send(backend, frame, encode_frame(frame, FRAME_FORWARD, 0, text, length));
+            forwarded++;
+            return;
+        }
+    }
+    unrouted++;
+    if (client) {
+        client_notice(client, "\033[33mSERVER: no server reachable, message not sent.\033[0m");
+    }
+}
+
+static void backend_link_up(Backend *backend) {
+    backend->connecting = 0;
+    backend->failing = 0;
+    backend->connects++;
+    update_events(backend->socket, backend, &backend->want_write, 0);
+    char line[96];
+    snprintf(line, sizeof(line), "Server link up: %s", backend->name);
+    log_text(LOG_INFO, line);
+    const PeerHello hello = {.server_id = proto_hton64(gateway_id), .flags = htonl(PEER_FLAG_GATEWAY)};
+    char frame[sizeof(FrameHeader) + sizeof(hello)];
+    backend_send(backend, frame, encode_frame(frame, FRAME_PEER_HELLO, 0, &hello, sizeof(hello)));
+}
+
+static void backend_handle_frame(Backend *backend, const FrameHeader *header, const char *payload) {
+    switch (header->type) {
+        case FRAME_PEER_HELLO: {
+            PeerHello hello;
+            if (header->length == sizeof(hello)) {
+                memcpy(&hello, payload, sizeof(hello));
+                backend->server_id = proto_ntoh64(hello.server_id);
+            }
+            break;
+        }
+        case FRAME_RELAY: {
+            RelayHeader relay;
+            if (header->length < sizeof(relay)) {
+                break;
+            }
+            memcpy(&relay, payload, sizeof(relay));
+            if (!origin_accept(&origins, proto_ntoh64(relay.origin_id), proto_ntoh64(relay.origin_seq), NULL)) {
+                duplicates++;
+                break;
+            }
+            broadcast(payload + sizeof(relay), header->length - sizeof(relay));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void backend_read(Backend *backend) {
+    if (buffer_reserve(&backend->in, READ_CHUNK) < 0) {
+        backend_close(backend);
+        return;
+    }
+    const ssize_t received = recv(backend->socket, backend->in.data + backend->in.length, READ_CHUNK, 0);
+    if (received <= 0) {
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            backend_close(backend);
+        }
+        return;
+    }
+    backend->in.length += (size_t)received;
+    size_t offset = 0;
+    while (!backend->closed && backend->in.length - offset >= sizeof(FrameHeader)) {
+        FrameHeader header;
+        memcpy(&header, backend->in.data + offset, sizeof(header));
+        header.length = ntohl(header.length);
+        if (header.length > MAX_FRAME_PAYLOAD) {
+            log_text(LOG_WARN, "Oversized frame from a server, link closed");
+            backend_close(backend);
+            return;
+        }
+        if (backend->in.length - offset < sizeof(header) + header.length) {
+            break;
+        }
+        backend_handle_frame(backend, &header, backend->in.data + offset + sizeof(header));
+        offset += sizeof(header) + header.length;
+    }
+    memmove(backend->in.data, backend->in.data + offset, backend->in.length - offset);
+    backend->in.length -= offset;
+}
+
+// Connexion sortante terminée : établie, ou refusée (nouvelle tentative plus tard)
+static void backend_connected(Backend *backend) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(backend->socket, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+        error = errno;
+    }
+    if (error == 0) {
+        backend_link_up(backend);
+        return;
+    }
+    if (!backend->failing) {
+        backend->failing = 1;
+        char line[96];
+        snprintf(line, sizeof(line), "Server %s unreachable, retrying", backend->name);
+        log_errno(line, error);
+    }
+    backend_close(backend);
+}
+
+// Envois groupés de l'itération, puis libération des liens fermés
+static void flush_backends(const uint64_t now_ms) {
+    for (int i = 0; i < backend_count; ++i) {
+        Backend *backend = &backends[i];
+        if (backend_up(backend)) {
+            if (flush_out(backend->socket, &backend->out, &backend->out_offset) < 0) {
+                backend_close(backend);
+            } else {
+                update_events(backend->socket, backend, &backend->want_write, backend->out.length > 0);
+            }
+        }
+        if (!backend->closed) {
+            continue;
+        }
+        if (!backend->connecting) {
+            char line[96];
+            snprintf(line, sizeof(line), "Server link down: %s", backend->name);
+            log_text(LOG_INFO, line);
+        }
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, backend->socket, NULL);
+        close(backend->socket);
+        backend->socket = -1;
+        backend->closed = 0;
+        backend->connecting = 0;
+        backend->server_id = 0;
+        backend->in.length = 0;
+        backend->out.length = 0;
+        backend->out_offset = 0;
+        backend->retry_ms = now_ms + RETRY_MS;
+    }
+}
+
+static void connect_backends(const uint64_t now_ms) {
+    for (int i = 0; i < backend_count; ++i) {
+        Backend *backend = &backends[i];
+        if (backend->socket >= 0 || now_ms < backend->retry_ms) {
+            continue;
+        }
+        backend->retry_ms = now_ms + RETRY_MS;
+        const int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            continue;
+        }
+        const int status = connect(sock, (struct sockaddr *)&backend->address, sizeof(backend->address));
+        struct epoll_event event = {.events = status < 0 ? EPOLLOUT : EPOLLIN, .data.ptr = backend};
+        if ((status < 0 && errno != EINPROGRESS) || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) < 0) {
+            close(sock);
+            continue;
+        }
+        const int enable = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        backend->socket = sock;
+        backend->connecting = status < 0;
+        backend->want_write = status < 0;
+        if (status == 0) {
+            backend_link_up(backend);
+        }
+    }
+}
+
+// Serveur : "host:port" (adresse IPv4) ou "port" (127.0.0.1)
+static int add_backend(const char *address) {
+    if (backend_count == MAX_BACKENDS) {
+        return -1;
+    }
+    Backend *backend = &backends[backend_count];
+    *backend = (Backend){.kind = ENDPOINT_BACKEND, .socket = -1};
+    if (parse_address(address, &backend->address, backend->name, sizeof(backend->name)) < 0) {
+        return -1;
+    }
+    backend_count++;
+    return 0;
+}
+
+static void print_stats(void) {
+    int up = 0;
+    for (int i = 0; i < backend_count; ++i) {
+        up += backend_up(&backends[i]);
+    }
+    printf("gateway: %d members, %zu connections, %d of %d servers linked\n", active_users, client_count, up,
+           backend_count);
+    printf("relayed %llu messages (%llu duplicates dropped) as %llu deliveries, forwarded %llu, "
+           "%llu refused with no server, %llu throttled, %llu slow clients disconnected\n",
+           (unsigned long long)relayed, (unsigned long long)duplicates, (unsigned long long)deliveries,
+           (unsigned long long)forwarded, (unsigned long long)unrouted, (unsigned long long)throttled,
+           (unsigned long long)slow_clients);
+    fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -b host:port... [-p port] [-u max_users] [-B history_kb] [-n] [-l debug|info|warn|error]"
+                    " [-s chat_sample] [-r rate[:burst]] [-R rate[:burst]]\n", prog);
+    fprintf(stderr, "  -b  server accepting federation links (server -f) at host:port, repeatable (max %d):\n"
+                    "      messages go to the first one linked\n", MAX_BACKENDS);
+    fprintf(stderr, "  -p  TCP port for clients on 127.0.0.1 (default: %d)\n", PROTOCOL_PORT);
+    fprintf(stderr, "  -u  maximum number of connected users (default: %d)\n", DEFAULT_MAX_USERS);
+    fprintf(stderr, "  -B  bytes kept for the local history, in KB (default: %d, min: %d)\n", DEFAULT_HISTORY_KB,
+            HISTORY_MIN_BUDGET >> 10);
+    fprintf(stderr, "  -n  do not announce arrivals and departures\n");
+    fprintf(stderr, "  -l  minimum log level (default: info)\n");
+    fprintf(stderr, "  -s  log one chat message out of N, 0 to disable (default: 1)\n");
+    fprintf(stderr, "  -r  chat messages per second and burst per user, 0 to disable (default: %d:%d)\n",
+            DEFAULT_MESSAGE_RATE, DEFAULT_MESSAGE_BURST);
+    fprintf(stderr, "  -R  chat bytes per second and burst per user, 0 to disable (default: %d:%d)\n",
+            DEFAULT_BYTE_RATE, DEFAULT_BYTE_BURST);
+    fprintf(stderr, "SIGUSR1 prints the counters, SIGINT/SIGTERM stop the gateway.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int port = PROTOCOL_PORT;
+    size_t history_kb = DEFAULT_HISTORY_KB;
+    LogLevel log_level = LOG_INFO;
+    unsigned chat_sample = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:p:u:B:nl:s:r:R:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (add_backend(optarg) < 0) {
+                    fprintf(stderr, "Invalid server '%s' (-b host:port, max %d)\n", optarg, MAX_BACKENDS);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'u':
+                max_users = atoi(optarg);
+                break;
+            case 'B':
+                history_kb = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                notices = 0;
+                break;
+            case 's':
+                chat_sample = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                if (parse_log_level(optarg, &log_level) < 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'r':
+            case 'R':
+                if (parse_rate(optarg, opt == 'r' ? &message_limit : &byte_limit) < 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (backend_count == 0 || port < 1 || port > 65535 || max_users < 1 ||
+        history_kb < HISTORY_MIN_BUDGET >> 10) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    // Signaux lus dans la boucle d'événements
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+
+    if (getrandom(&gateway_id, sizeof(gateway_id), 0) != sizeof(gateway_id)) {
+        gateway_id = ((uint64_t)getpid() << 32) ^ (uint64_t)time(NULL);
+    }
+    if (history_init(&history, history_kb << 10) < 0) {
+        perror("Error allocating the history");
+        exit(EXIT_FAILURE);
+    }
+    history_cursor_init(&history_cursor);
+
+    listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        perror("Socket Error");
+        exit(EXIT_FAILURE);
+    }
+    const int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons((uint16_t)port)};
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Binding Error");
+        exit(EXIT_FAILURE);
+    }
+    if (listen(listener, SOMAXCONN) < 0) {
+        perror("Listening Error");
+        exit(EXIT_FAILURE);
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = &listener};
+    struct epoll_event signal_event = {.events = EPOLLIN, .data.ptr = &signal_fd};
+    if (epoll_fd < 0 || signal_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &listen_event) < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &signal_event) < 0) {
+        perror("Error setting up the event loop");
+        exit(EXIT_FAILURE);
+    }
+
+    if (log_init(stdout, log_level, chat_sample) < 0) {
+        perror("Error starting the logger");
+        exit(EXIT_FAILURE);
+    }
+    printf("===== Gateway listening on port %d, %d servers =====\n", port, backend_count);
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t next_sweep_ms = 0;
+    int running = 1;
+    while (running) {
+        uint64_t now_ms = monotonic_ms();
+        connect_backends(now_ms);
+        if (now_ms >= next_sweep_ms) {
+            expire_handshakes(now_ms);
+            next_sweep_ms = now_ms + RETRY_MS;
+        }
+        const int count = epoll_wait(epoll_fd, events, MAX_EVENTS, closing_count ? 0 : RETRY_MS);
+        if (count < 0 && errno != EINTR) {
+            log_errno("epoll_wait", errno);
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &listener) {
+                accept_clients();
+            } else if (ptr == &signal_fd) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGUSR1) {
+                        print_stats();
+                    } else {
+                        running = 0;
+                    }
+                }
+            } else if (*(EndpointKind *)ptr == ENDPOINT_BACKEND) {
+                Backend *backend = ptr;
+                if (backend->closed) {
+                    continue;
+                }
+                if (backend->connecting) {
+                    backend_connected(backend);
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    backend_read(backend);
+                }
+                // EPOLLOUT : flush_backends reprend l'envoi
+            } else {
+                Client *client = ptr;
+                if (client->closed) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    client_read(client);
+                }
+                if ((events[i].events & EPOLLOUT) && !client->queued && !client->closed) {
+                    client->queued = 1;
+                    writing[writing_count++] = client;
+                }
+            }
+        }
+        // Les départs de l'itération annoncent au serveur : envois après les clients
+        now_ms = monotonic_ms();
+        flush_clients();
+        reap_clients();
+        flush_backends(now_ms);
+    }
+
+    print_stats();
+    log_shutdown();
+    for (size_t i = 0; i < client_count; ++i) {
+        close(clients[i]->socket);
+        free(clients[i]->out.data);
+        free(clients[i]);
+    }
+    for (int i = 0; i < backend_count; ++i) {
+        if (backends[i].socket >= 0) {
+            close(backends[i].socket);
+        }
+        free(backends[i].in.data);
+        free(backends[i].out.data);
+    }
+    free(clients);
+    free(closing);
+    free(writing);
+    history_free(&history);
+    close(signal_fd);
+    close(epoll_fd);
+    close(listener);
+    return 0;
+}
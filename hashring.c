@@ -0,0 +1,124 @@
+#include "hashring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct RingPoint {
+    uint64_t hash;
+    uint32_t node;
+} RingPoint;
+
+struct HashRing {
+    char nodes[HASHRING_MAX_NODES][HASHRING_NAME_LEN];
+    int used[HASHRING_MAX_NODES];
+    size_t node_count;
+    RingPoint points[HASHRING_MAX_NODES * HASHRING_REPLICAS];   // triés par hachage
+    size_t point_count;
+};
+
+// FNV-1a puis mélange final (splitmix64) : les noms voisins ("...:31001", "...:31011")
+// doivent tomber loin les uns des autres
+static uint64_t ring_hash(const char *data, const size_t length, const uint64_t seed) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    hash += 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+static int compare_points(const void *a, const void *b) {
+    const RingPoint *x = a;
+    const RingPoint *y = b;
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    return x->node < y->node ? -1 : x->node > y->node;
+}
+
+static int find_node(const HashRing *ring, const char *node) {
+    for (int i = 0; i < HASHRING_MAX_NODES; ++i) {
+        if (ring->used[i] && strcmp(ring->nodes[i], node) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+HashRing *hashring_create(void) {
+    return calloc(1, sizeof(HashRing));
+}
+
+void hashring_destroy(HashRing *ring) {
+    free(ring);
+}
+
+int hashring_add(HashRing *ring, const char *node) {
+    const size_t length = strlen(node);
+    if (length >= HASHRING_NAME_LEN || find_node(ring, node) >= 0) {
+        return -1;
+    }
+    int slot = 0;
+    while (slot < HASHRING_MAX_NODES && ring->used[slot]) {
+        slot++;
+    }
+    if (slot == HASHRING_MAX_NODES) {
+        return -1;
+    }
+    memcpy(ring->nodes[slot], node, length + 1);
+    ring->used[slot] = 1;
+    ring->node_count++;
+    // Un point par réplique : le hachage du nom, graine = numéro de la réplique
+    for (uint64_t replica = 0; replica < HASHRING_REPLICAS; ++replica) {
+        ring->points[ring->point_count++] = (RingPoint){ring_hash(node, length, replica), (uint32_t)slot};
+    }
+    qsort(ring->points, ring->point_count, sizeof(RingPoint), compare_points);
+    return 0;
+}
+
+int hashring_remove(HashRing *ring, const char *node) {
+    const int slot = find_node(ring, node);
+    if (slot < 0) {
+        return -1;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < ring->point_count; ++i) {
+        if (ring->points[i].node != (uint32_t)slot) {
+            ring->points[kept++] = ring->points[i];
+        }
+    }
+    ring->point_count = kept;
+    ring->used[slot] = 0;
+    ring->node_count--;
+    return 0;
+}
+
+int hashring_contains(const HashRing *ring, const char *node) {
+    return find_node(ring, node) >= 0;
+}
+
+size_t hashring_size(const HashRing *ring) {
+    return ring->node_count;
+}
+
+const char *hashring_lookup(const HashRing *ring, const char *key, const size_t length) {
+    if (ring->point_count == 0) {
+        return NULL;
+    }
+    const uint64_t hash = ring_hash(key, length, HASHRING_REPLICAS);
+    // Premier point de hachage >= celui de la clé, en revenant au début après le dernier
+    size_t low = 0;
+    size_t high = ring->point_count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (ring->points[middle].hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return ring->nodes[ring->points[low == ring->point_count ? 0 : low].node];
+}
@@ -0,0 +1,37 @@
+#ifndef CHAT_HASHRING_H
+#define CHAT_HASHRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Anneau de hachage cohérent : place des clés (noms de salons) sur des nœuds (noms
+// "host:port" des serveurs d'une grappe).
+//
+// Chaque nœud occupe HASHRING_REPLICAS points de l'anneau, placés par le hachage de
+// son nom : une clé appartient au nœud du premier point qui suit son propre hachage.
+// Ajouter ou retirer un nœud ne déplace que les clés de ses points, soit ~1/N des
+// clés, et deux serveurs qui connaissent les mêmes nœuds font les mêmes choix.
+//
+// Pas de verrou : l'anneau appartient à un seul thread, ou est reconstruit à part.
+
+#define HASHRING_REPLICAS 160
+#define HASHRING_MAX_NODES 64
+#define HASHRING_NAME_LEN 48
+
+typedef struct HashRing HashRing;
+
+HashRing *hashring_create(void);
+void hashring_destroy(HashRing *ring);
+
+// 0, ou -1 si le nœud est déjà présent, son nom trop long ou l'anneau plein
+int hashring_add(HashRing *ring, const char *node);
+// 0, ou -1 s'il est absent
+int hashring_remove(HashRing *ring, const char *node);
+int hashring_contains(const HashRing *ring, const char *node);
+size_t hashring_size(const HashRing *ring);
+
+// Nœud propriétaire de la clé (valide jusqu'à la prochaine modification), NULL si
+// l'anneau est vide
+const char *hashring_lookup(const HashRing *ring, const char *key, size_t length);
+
+#endif
@@ -0,0 +1,407 @@
+#include "histlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lockprof.h"
+#include "protocol.h"
+
+#define BUFFER_SIZE (64 * 1024)         // en dessous, le thread attend que le tampon se remplisse
+#define WRITE_WAIT_MS 10                // délai avant d'écrire un tampon peu rempli
+#define MAX_CHUNKS 16                   // segments par tampon : HISTLOG_PENDING / HISTLOG_SEGMENT_MIN + 2 au plus
+#define INDEX_MASK (HISTLOG_INDEX - 1)
+
+struct LogSegment {
+    _Atomic int refs;
+    int fd;
+    uint64_t number;
+    uint64_t first_seq;         // 0 tant que le segment est vide
+};
+
+// Position de la trame d'un message
+typedef struct LogEntry {
+    uint64_t seq;
+    uint64_t segment;
+    uint64_t offset;
+    uint32_t length;
+} LogEntry;
+
+// Trames d'un même segment, consécutives dans un tampon
+typedef struct LogChunk {
+    uint64_t segment;
+    uint64_t first_seq;
+    uint64_t last_seq;
+    size_t length;
+} LogChunk;
+
+typedef struct LogBuffer {
+    char *data;
+    size_t length;
+    LogChunk chunks[MAX_CHUNKS];
+    size_t chunk_count;
+} LogBuffer;
+
+struct HistoryLog {
+    ProfMutex mutex;            // protège tout ce qui suit, sauf le tampon en écriture
+    char *path;
+    size_t segment_bytes;
+    pthread_t thread;
+    _Atomic int stopping;
+
+    // Ajouts : positions des trames telles qu'elles seront écrites
+    LogBuffer buffers[2];
+    LogBuffer *filling;         // l'autre appartient au thread d'écriture
+    uint64_t appending;         // segment des prochains ajouts
+    uint64_t size;              // octets de ce segment, tampons compris
+    LogEntry *index;            // indice : seq & INDEX_MASK
+    uint64_t last_seq;          // dernier message ajouté
+
+    // Fichiers, tenus par le thread d'écriture
+    LogSegment *segments[HISTLOG_SEGMENTS];   // indice : numéro % HISTLOG_SEGMENTS
+    uint64_t current;           // segment ouvert en dernier
+    uint64_t first_seq;         // plus ancien message des segments conservés, 0 : aucun
+    uint64_t written_seq;       // dernier message écrit : les plages s'arrêtent là
+    int failed;
+    int error;                  // errno de l'échec, rendu par le prochain ajout
+    int reported;
+
+    uint64_t appended_bytes;
+    uint64_t writes;
+    uint64_t ranges;
+    uint64_t range_bytes;
+};
+
+static void segment_path(const HistoryLog *log, const uint64_t number, char *out, const size_t capacity) {
+    snprintf(out, capacity, "%s.%llu", log->path, (unsigned long long)number);
+}
+
+static void log_fail(HistoryLog *log, const int error) {
+    if (!log->failed) {
+        log->failed = 1;
+        log->error = error;
+    }
+}
+
+// Thread d'écriture (ou ouverture) : crée le segment suivant ; le plus ancien est
+// supprimé s'il y en a trop. Les appels système se font hors du verrou.
+static int log_rotate(HistoryLog *log, const uint64_t first_seq) {
+    const uint64_t number = log->current + 1;
+    char path[strlen(log->path) + 24];
+    segment_path(log, number, path, sizeof(path));
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    LogSegment *segment = malloc(sizeof(LogSegment));
+    if (!segment) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    atomic_init(&segment->refs, 1);
+    segment->fd = fd;
+    segment->number = number;
+    segment->first_seq = first_seq;
+
+    prof_lock(&log->mutex);
+    LogSegment **slot = &log->segments[number % HISTLOG_SEGMENTS];
+    LogSegment *evicted = *slot;
+    if (evicted) {
+        const LogSegment *oldest = log->segments[(number + 1) % HISTLOG_SEGMENTS];
+        log->first_seq = oldest->first_seq;
+    }
+    *slot = segment;
+    log->current = number;
+    prof_unlock(&log->mutex);
+
+    if (evicted) {
+        // Les plages en cours gardent le descripteur : la suppression ne les gêne pas
+        segment_path(log, evicted->number, path, sizeof(path));
+        unlink(path);
+        histlog_release(evicted);
+    }
+    return 0;
+}
+
+static int write_all(const int fd, const char *data, const size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        const ssize_t n = write(fd, data + done, length - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+// Écrit un tampon échangé, segment par segment ; les plages suivent au fil de l'eau
+static void log_write_buffer(HistoryLog *log, LogBuffer *buffer) {
+    const char *data = buffer->data;
+    for (size_t i = 0; i < buffer->chunk_count; ++i) {
+        const LogChunk *chunk = &buffer->chunks[i];
+        if (chunk->segment != log->current && log_rotate(log, chunk->first_seq) < 0) {
+            prof_lock(&log->mutex);
+            log_fail(log, errno);
+            prof_unlock(&log->mutex);
+            break;
+        }
+        LogSegment *segment = log->segments[log->current % HISTLOG_SEGMENTS];
+        const int status = write_all(segment->fd, data, chunk->length);
+        const int error = errno;
+        prof_lock(&log->mutex);
+        if (status < 0) {
+            log_fail(log, error);
+            prof_unlock(&log->mutex);
+            break;
+        }
+        if (!segment->first_seq) {
+            segment->first_seq = chunk->first_seq;
+        }
+        if (!log->first_seq) {
+            log->first_seq = chunk->first_seq;
+        }
+        log->written_seq = chunk->last_seq;
+        log->writes++;
+        prof_unlock(&log->mutex);
+        data += chunk->length;
+    }
+    buffer->length = 0;
+    buffer->chunk_count = 0;
+}
+
+static void *log_writer(void *arg) {
+    HistoryLog *log = arg;
+    const struct timespec wait = {0, WRITE_WAIT_MS * 1000000L};
+    for (;;) {
+        // Lu avant l'échange : après l'arrêt, le dernier tampon est vidé avant de sortir
+        const int stopping = atomic_load_explicit(&log->stopping, memory_order_acquire);
+        prof_lock(&log->mutex);
+        LogBuffer *buffer = log->filling;
+        log->filling = buffer == &log->buffers[0] ? &log->buffers[1] : &log->buffers[0];
+        const int failed = log->failed;
+        prof_unlock(&log->mutex);
+
+        const size_t length = buffer->length;
+        if (failed) {
+            buffer->length = 0;
+            buffer->chunk_count = 0;
+        } else if (length > 0) {
+            log_write_buffer(log, buffer);
+        }
+        if (stopping) {
+            break;
+        }
+        if (length < BUFFER_SIZE) {
+            nanosleep(&wait, NULL);
+        }
+    }
+    return NULL;
+}
+
+static void log_free(HistoryLog *log) {
+    for (size_t i = 0; i < HISTLOG_SEGMENTS; ++i) {
+        if (log->segments[i]) {
+            histlog_release(log->segments[i]);
+        }
+    }
+    free(log->path);
+    free(log->buffers[0].data);
+    free(log->buffers[1].data);
+    free(log->index);
+    free(log);
+}
+
+HistoryLog *histlog_open(const char *path, const size_t segment_bytes) {
+    if (segment_bytes < HISTLOG_SEGMENT_MIN) {
+        errno = EINVAL;
+        return NULL;
+    }
+    HistoryLog *log = calloc(1, sizeof(HistoryLog));
+    if (!log) {
+        return NULL;
+    }
+    log->mutex = (ProfMutex)PROF_MUTEX_INITIALIZER("history_log");
+    log->segment_bytes = segment_bytes;
+    log->path = strdup(path);
+    log->buffers[0].data = malloc(HISTLOG_PENDING);
+    log->buffers[1].data = malloc(HISTLOG_PENDING);
+    log->filling = &log->buffers[0];
+    log->index = calloc(HISTLOG_INDEX, sizeof(LogEntry));
+    int status = -1;
+    // Premier segment ouvert ici : une erreur de chemin est signalée au démarrage
+    if (log->path && log->buffers[0].data && log->buffers[1].data && log->index && log_rotate(log, 0) == 0) {
+        log->appending = log->current;
+        status = pthread_create(&log->thread, NULL, log_writer, log);
+        if (status != 0) {
+            char first[strlen(path) + 24];
+            segment_path(log, log->current, first, sizeof(first));
+            unlink(first);
+            errno = status;
+        }
+    }
+    if (status != 0) {
+        const int saved = errno;
+        log_free(log);
+        errno = saved;
+        return NULL;
+    }
+    return log;
+}
+
+void histlog_close(HistoryLog *log) {
+    atomic_store_explicit(&log->stopping, 1, memory_order_release);
+    pthread_join(log->thread, NULL);
+    log_free(log);
+}
+
+int histlog_append(HistoryLog *log, const uint64_t seq, const char *text, size_t length) {
+    if (length > MAX_FRAME_PAYLOAD) {
+        length = MAX_FRAME_PAYLOAD;
+    }
+    const size_t frame_len = length ? sizeof(FrameHeader) + length : 0;
+
+    prof_lock(&log->mutex);
+    if (log->failed) {
+        const int first = !log->reported;
+        log->reported = 1;
+        const int error = log->error;
+        prof_unlock(&log->mutex);
+        if (first) {
+            errno = error;
+            return -1;
+        }
+        return 0;
+    }
+    // Rotation logique : le thread d'écriture ouvrira le segment en arrivant à ces trames
+    if (log->size > 0 && log->size + frame_len > log->segment_bytes) {
+        log->appending++;
+        log->size = 0;
+    }
+    LogBuffer *buffer = log->filling;
+    LogChunk *chunk = buffer->chunk_count ? &buffer->chunks[buffer->chunk_count - 1] : NULL;
+    const int new_chunk = !chunk || chunk->segment != log->appending;
+    if (buffer->length + frame_len > HISTLOG_PENDING || (new_chunk && buffer->chunk_count == MAX_CHUNKS)) {
+        // Le disque ne suit plus : mieux vaut relire en mémoire que bloquer la diffusion
+        log_fail(log, ENOBUFS);
+        log->reported = 1;
+        prof_unlock(&log->mutex);
+        errno = ENOBUFS;
+        return -1;
+    }
+    if (new_chunk) {
+        chunk = &buffer->chunks[buffer->chunk_count++];
+        *chunk = (LogChunk){.segment = log->appending, .first_seq = seq};
+    }
+
+    LogEntry *entry = &log->index[seq & INDEX_MASK];
+    entry->seq = seq;
+    entry->segment = log->appending;
+    entry->offset = log->size;
+    entry->length = (uint32_t)frame_len;
+    if (frame_len) {
+        encode_frame(buffer->data + buffer->length, FRAME_TEXT, 0, text, length);
+    }
+    buffer->length += frame_len;
+    chunk->length += frame_len;
+    chunk->last_seq = seq;
+    log->size += frame_len;
+    log->last_seq = seq;
+    log->appended_bytes += frame_len;
+    prof_unlock(&log->mutex);
+    return 0;
+}
+
+void histlog_sync(HistoryLog *log) {
+    const struct timespec wait = {0, 1000000L};
+    for (;;) {
+        prof_lock(&log->mutex);
+        const int done = log->failed || log->written_seq == log->last_seq;
+        prof_unlock(&log->mutex);
+        if (done) {
+            return;
+        }
+        nanosleep(&wait, NULL);
+    }
+}
+
+size_t histlog_ranges(HistoryLog *log, uint64_t first_seq, uint64_t last_seq, LogRange *ranges, const size_t max) {
+    size_t count = 0;
+    prof_lock(&log->mutex);
+    // Au-delà de l'index, les positions ont été écrasées
+    uint64_t available = log->first_seq;
+    if (log->last_seq >= HISTLOG_INDEX && available < log->last_seq - HISTLOG_INDEX + 1) {
+        available = log->last_seq - HISTLOG_INDEX + 1;
+    }
+    if (first_seq < available) {
+        first_seq = available;
+    }
+    // sendfile lit le fichier : la fin encore en tampon est relue en mémoire
+    if (last_seq > log->written_seq) {
+        last_seq = log->written_seq;
+    }
+    if (log->failed || !available || first_seq > last_seq) {
+        prof_unlock(&log->mutex);
+        return 0;
+    }
+
+    uint64_t seq = first_seq;
+    while (seq <= last_seq && count < max) {
+        const LogEntry *start = &log->index[seq & INDEX_MASK];
+        LogSegment *segment = log->segments[start->segment % HISTLOG_SEGMENTS];
+        // Dernier message de la plage dans ce segment
+        uint64_t end_seq = last_seq;
+        if (start->segment != log->current) {
+            const LogSegment *next = log->segments[(start->segment + 1) % HISTLOG_SEGMENTS];
+            if (next->first_seq - 1 < end_seq) {
+                end_seq = next->first_seq - 1;
+            }
+        }
+        const LogEntry *end = &log->index[end_seq & INDEX_MASK];
+        atomic_fetch_add_explicit(&segment->refs, 1, memory_order_relaxed);
+        ranges[count++] = (LogRange){
+            .segment = segment,
+            .offset = start->offset,
+            .length = (size_t)(end->offset + end->length - start->offset),
+            .first_seq = seq,
+            .last_seq = end_seq,
+        };
+        log->range_bytes += end->offset + end->length - start->offset;
+        seq = end_seq + 1;
+    }
+    log->ranges += count;
+    prof_unlock(&log->mutex);
+    return count;
+}
+
+int histlog_fd(const LogSegment *segment) {
+    return segment->fd;
+}
+
+void histlog_release(LogSegment *segment) {
+    if (atomic_fetch_sub_explicit(&segment->refs, 1, memory_order_acq_rel) == 1) {
+        close(segment->fd);
+        free(segment);
+    }
+}
+
+void histlog_dump(HistoryLog *log, FILE *out) {
+    prof_lock(&log->mutex);
+    const uint64_t oldest = log->current >= HISTLOG_SEGMENTS ? log->current - HISTLOG_SEGMENTS + 1 : 1;
+    fprintf(out, "history log: %s.%llu to .%llu%s, seq %llu to %llu (%llu written), %llu KB in the current segment (max %zu KB)\n",
+            log->path, (unsigned long long)oldest, (unsigned long long)log->current,
+            log->failed ? (log->error == ENOBUFS ? " (disabled, the writer fell behind)" : " (disabled after a write error)") : "",
+            (unsigned long long)log->first_seq, (unsigned long long)log->last_seq,
+            (unsigned long long)log->written_seq, (unsigned long long)(log->size >> 10), log->segment_bytes >> 10);
+    fprintf(out, "appended %llu KB, %zu KB waiting for the writer, %llu writes, %llu ranges served (%llu KB)\n",
+            (unsigned long long)(log->appended_bytes >> 10), log->filling->length >> 10, (unsigned long long)log->writes,
+            (unsigned long long)log->ranges, (unsigned long long)(log->range_bytes >> 10));
+    prof_unlock(&log->mutex);
+}
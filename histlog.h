@@ -0,0 +1,67 @@
+#ifndef CHAT_HISTLOG_H
+#define CHAT_HISTLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Journal de l'historique sur disque, au format brut : les trames FRAME_TEXT telles
+// qu'elles partent sur le réseau (en-tête puis texte), bout à bout. Un replay est donc
+// une plage contiguë du fichier, envoyée par sendfile sans passer par l'espace
+// utilisateur.
+//
+// Le journal est découpé en segments (fichiers path.N) ; les HISTLOG_SEGMENTS plus
+// récents sont conservés, les plus anciens supprimés. Un ajout ne fait qu'une copie
+// dans le tampon en cours, sous un verrou bref : un thread d'écriture échange les
+// deux tampons et fait les write(), ouvertures et suppressions de segments. Seul ce
+// qui est déjà écrit est servi en plages ; le reste est à relire en mémoire.
+// Un segment reste ouvert tant qu'une plage y fait référence, même supprimé.
+
+#define HISTLOG_SEGMENTS 4
+#define HISTLOG_INDEX 65536             // derniers messages localisables (puissance de deux)
+#define HISTLOG_SEGMENT_MIN (1 << 20)
+#define HISTLOG_PENDING (8 << 20)       // par tampon : retard maximal du thread d'écriture
+
+typedef struct HistoryLog HistoryLog;
+typedef struct LogSegment LogSegment;
+
+// Trames des messages first_seq à last_seq : length octets à partir de offset dans
+// le segment, qui est référencé jusqu'à histlog_release
+typedef struct LogRange {
+    LogSegment *segment;
+    uint64_t offset;
+    size_t length;
+    uint64_t first_seq;
+    uint64_t last_seq;
+} LogRange;
+
+// Ouvre le premier segment et démarre le thread d'écriture. NULL en cas d'erreur
+// (errno positionné).
+HistoryLog *histlog_open(const char *path, size_t segment_bytes);
+
+// Écrit ce qui reste en attente, arrête le thread et libère le journal ; les plages
+// encore référencées restent valides
+void histlog_close(HistoryLog *log);
+
+// Écrivain unique : ajoute la trame du message seq (numéros strictement croissants),
+// sans appel système. Un texte vide (message manquant d'un secours) réserve le numéro
+// sans rien écrire : une plage qui le couvre ne l'envoie pas. -1 une seule fois, à la première erreur d'écriture ou si le
+// thread d'écriture a HISTLOG_PENDING octets de retard : le journal est ensuite
+// désactivé.
+int histlog_append(HistoryLog *log, uint64_t seq, const char *text, size_t length);
+
+// Attend que tout ce qui a été ajouté soit écrit (ou le journal désactivé)
+void histlog_sync(HistoryLog *log);
+
+// N'importe quel thread : plages couvrant ce qui est déjà écrit de [first_seq,
+// last_seq], une par segment (au plus max), de ranges[0].first_seq à
+// ranges[n - 1].last_seq sans trou. 0 si rien n'est disponible.
+size_t histlog_ranges(HistoryLog *log, uint64_t first_seq, uint64_t last_seq, LogRange *ranges, size_t max);
+
+int histlog_fd(const LogSegment *segment);
+void histlog_release(LogSegment *segment);
+
+// Segments, octets écrits et plages servies
+void histlog_dump(HistoryLog *log, FILE *out);
+
+#endif
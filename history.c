@@ -0,0 +1,361 @@
+#include "history.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define OPEN_COPY UINT64_MAX
+#define READ_ATTEMPTS 3
+
+typedef uint16_t RecordLength;
+
+// Tampons fixes : fenêtre (dictionnaire + bloc ouvert), sortie du compresseur, table LZ
+static size_t fixed_size(void) {
+    return LZ_DICT_MAX + HISTORY_BLOCK_SIZE + HISTORY_BLOCK_SIZE + LZ_HASH_SIZE * sizeof(uint32_t);
+}
+
+int history_init(History *history, size_t budget) {
+    memset(history, 0, sizeof(*history));
+    if (budget < HISTORY_MIN_BUDGET) {
+        budget = HISTORY_MIN_BUDGET;
+    }
+    // Une entrée de table par Ko d'arène : un bloc de 16 Ko de texte se compresse
+    // rarement sous 1 Ko
+    const size_t available = budget - fixed_size();
+    size_t entries = 4;
+    while (entries * 2 <= available / 1024) {
+        entries *= 2;
+    }
+    history->block_mask = entries - 1;
+    history->arena_size = available - entries * sizeof(HistoryBlock);
+    history->blocks = calloc(entries, sizeof(HistoryBlock));
+    history->arena = malloc(history->arena_size);
+    history->window = malloc(LZ_DICT_MAX + HISTORY_BLOCK_SIZE);
+    history->packed = malloc(HISTORY_BLOCK_SIZE);
+    history->lz_table = malloc(LZ_HASH_SIZE * sizeof(uint32_t));
+    if (!history->blocks || !history->arena || !history->window || !history->packed || !history->lz_table) {
+        history_free(history);
+        return -1;
+    }
+    return 0;
+}
+
+void history_free(History *history) {
+    free(history->blocks);
+    free(history->arena);
+    free(history->window);
+    free(history->packed);
+    free(history->lz_table);
+    history->blocks = NULL;
+    history->arena = NULL;
+    history->window = NULL;
+    history->packed = NULL;
+    history->lz_table = NULL;
+}
+
+// Compresse le bloc ouvert dans l'arène puis le vide ; next_seq ouvre le suivant
+static void history_seal(History *history, const uint64_t next_seq) {
+    char *raw = history->window + LZ_DICT_MAX;
+    const uint32_t raw_size = atomic_load_explicit(&history->open_used, memory_order_relaxed);
+    const uint32_t count = atomic_load_explicit(&history->open_count, memory_order_relaxed);
+    const uint64_t block_first = atomic_load_explicit(&history->open_first_seq, memory_order_relaxed);
+    uint64_t last = atomic_load_explicit(&history->last_block, memory_order_relaxed);
+
+    // Premier bloc : il sert d'échantillon pour le dictionnaire, fixé une fois pour toutes
+    if (last == 0) {
+        const size_t dict = lz_train(raw, raw_size, history->packed, LZ_DICT_MAX);
+        memcpy(history->window + LZ_DICT_MAX - dict, history->packed, dict);
+        atomic_store_explicit(&history->dict_size, (uint32_t)dict, memory_order_release);
+    }
+    const uint32_t dict = atomic_load_explicit(&history->dict_size, memory_order_relaxed);
+    const char *data = history->packed;
+    uint32_t size = (uint32_t)lz_compress(history->window + LZ_DICT_MAX - dict, dict, raw_size, history->packed,
+                                          raw_size - 1, history->lz_table);
+    if (size == 0) {
+        data = raw;
+        size = raw_size;
+    }
+
+    // Un bloc ne chevauche jamais la fin de l'arène : on saute le reste
+    uint64_t position = history->head;
+    size_t physical = position % history->arena_size;
+    if (physical + size > history->arena_size) {
+        position += history->arena_size - physical;
+        physical = 0;
+    }
+    const uint64_t end = position + size;
+
+    // La queue avance avant que les octets ne soient écrasés : un lecteur qui décode
+    // un bloc évincé le constate en relisant la queue
+    uint64_t tail = atomic_load_explicit(&history->tail, memory_order_relaxed);
+    if (end > tail + history->arena_size) {
+        tail = end - history->arena_size;
+        atomic_store_explicit(&history->tail, tail, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+
+    // Blocs évincés de l'arène, ou dont l'entrée de table va être réutilisée
+    const uint64_t number = last + 1;
+    uint64_t first = atomic_load_explicit(&history->first_block, memory_order_relaxed);
+    if (first == 0) {
+        first = number;
+    }
+    while (first < number) {
+        const HistoryBlock *block = &history->blocks[first & history->block_mask];
+        if (number - first <= history->block_mask &&
+            atomic_load_explicit(&block->offset, memory_order_relaxed) >= tail) {
+            break;
+        }
+        atomic_fetch_sub_explicit(&history->sealed_raw, atomic_load_explicit(&block->raw_size, memory_order_relaxed),
+                                  memory_order_relaxed);
+        first++;
+    }
+    atomic_store_explicit(&history->first_block, first, memory_order_release);
+
+    memcpy(history->arena + physical, data, size);
+
+    HistoryBlock *block = &history->blocks[number & history->block_mask];
+    atomic_store_explicit(&block->number, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&block->first_seq, block_first, memory_order_relaxed);
+    atomic_store_explicit(&block->offset, position, memory_order_relaxed);
+    atomic_store_explicit(&block->size, size, memory_order_relaxed);
+    atomic_store_explicit(&block->raw_size, raw_size, memory_order_relaxed);
+    atomic_store_explicit(&block->count, count, memory_order_relaxed);
+    atomic_store_explicit(&block->number, number, memory_order_release);
+
+    __atomic_store_n(&history->head, end, __ATOMIC_RELAXED);
+    atomic_store_explicit(&history->last_block, number, memory_order_release);
+    atomic_fetch_add_explicit(&history->sealed_raw, raw_size, memory_order_relaxed);
+    const uint64_t oldest = first == number ? block_first
+                                            : atomic_load_explicit(&history->blocks[first & history->block_mask].first_seq,
+                                                                   memory_order_relaxed);
+    atomic_store_explicit(&history->first_seq, oldest, memory_order_release);
+
+    // Le bloc est publié avant d'être retiré du bloc ouvert : un lecteur qui rate
+    // la copie du bloc ouvert le retrouve scellé
+    const uint64_t version = atomic_load_explicit(&history->open_version, memory_order_relaxed);
+    atomic_store_explicit(&history->open_version, version + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&history->open_count, 0, memory_order_relaxed);
+    atomic_store_explicit(&history->open_used, 0, memory_order_relaxed);
+    atomic_store_explicit(&history->open_first_seq, next_seq, memory_order_relaxed);
+    atomic_store_explicit(&history->open_version, version + 2, memory_order_release);
+}
+
+void history_append(History *history, const uint64_t seq, const char *text, size_t len) {
+    if (sizeof(RecordLength) + len > HISTORY_BLOCK_SIZE) {
+        len = HISTORY_BLOCK_SIZE - sizeof(RecordLength);
+    }
+    const size_t record = sizeof(RecordLength) + len;
+
+    uint32_t used = atomic_load_explicit(&history->open_used, memory_order_relaxed);
+    const uint32_t count = atomic_load_explicit(&history->open_count, memory_order_relaxed);
+    if (used + record > HISTORY_BLOCK_SIZE) {
+        history_seal(history, seq);
+        used = 0;
+    } else if (count == 0) {
+        atomic_store_explicit(&history->open_first_seq, seq, memory_order_relaxed);
+    }
+
+    char *raw = history->window + LZ_DICT_MAX;
+    const RecordLength length = (RecordLength)len;
+    memcpy(raw + used, &length, sizeof(length));
+    memcpy(raw + used + sizeof(length), text, len);
+    atomic_store_explicit(&history->open_used, used + (uint32_t)record, memory_order_relaxed);
+    atomic_store_explicit(&history->open_count, atomic_load_explicit(&history->open_count, memory_order_relaxed) + 1,
+                          memory_order_release);
+
+    if (atomic_load_explicit(&history->first_seq, memory_order_relaxed) == 0) {
+        atomic_store_explicit(&history->first_seq, seq, memory_order_release);
+    }
+    atomic_store_explicit(&history->last_seq, seq, memory_order_release);
+}
+
+void history_cursor_init(HistoryCursor *cursor) {
+    cursor->block = 0;
+    cursor->count = 0;
+}
+
+// Premier numéro d'un bloc scellé, validé contre sa réécriture ; 0 si elle a eu lieu
+static uint64_t block_first_seq(const History *history, const uint64_t number) {
+    const HistoryBlock *block = &history->blocks[number & history->block_mask];
+    if (atomic_load_explicit(&block->number, memory_order_acquire) != number) {
+        return 0;
+    }
+    const uint64_t first_seq = atomic_load_explicit(&block->first_seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&block->number, memory_order_relaxed) == number ? first_seq : 0;
+}
+
+// Décode le bloc scellé qui contient seq. 1 : décodé, 0 : pas dans un bloc scellé
+// (évincé ou encore ouvert, *evicted le précise), -1 : réécrit pendant la lecture
+static int cursor_load_sealed(const History *history, HistoryCursor *cursor, const uint64_t seq, int *evicted) {
+    const uint64_t last = atomic_load_explicit(&history->last_block, memory_order_acquire);
+    uint64_t low = atomic_load_explicit(&history->first_block, memory_order_acquire);
+    *evicted = 0;
+    if (last == 0 || low > last) {
+        return 0;
+    }
+    const uint64_t oldest = block_first_seq(history, low);
+    if (oldest == 0) {
+        return -1;
+    }
+    if (seq < oldest) {
+        *evicted = 1;
+        return 0;
+    }
+
+    // Dernier bloc dont le premier numéro est <= seq
+    uint64_t high = last;
+    while (low < high) {
+        const uint64_t middle = low + (high - low + 1) / 2;
+        const uint64_t first_seq = block_first_seq(history, middle);
+        if (first_seq == 0) {
+            return -1;
+        }
+        if (first_seq <= seq) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    const HistoryBlock *block = &history->blocks[low & history->block_mask];
+    if (atomic_load_explicit(&block->number, memory_order_acquire) != low) {
+        return -1;
+    }
+    const uint64_t first_seq = atomic_load_explicit(&block->first_seq, memory_order_relaxed);
+    const uint64_t offset = atomic_load_explicit(&block->offset, memory_order_relaxed);
+    const uint32_t size = atomic_load_explicit(&block->size, memory_order_relaxed);
+    const uint32_t raw_size = atomic_load_explicit(&block->raw_size, memory_order_relaxed);
+    const uint32_t count = atomic_load_explicit(&block->count, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&block->number, memory_order_relaxed) != low) {
+        return -1;
+    }
+    if (seq >= first_seq + count) {
+        return 0;
+    }
+
+    const size_t physical = offset % history->arena_size;
+    if (offset < atomic_load_explicit(&history->tail, memory_order_acquire) || physical + size > history->arena_size ||
+        raw_size > HISTORY_BLOCK_SIZE) {
+        return -1;
+    }
+    char *data = cursor->window + LZ_DICT_MAX;
+    if (size == raw_size) {
+        memcpy(data, history->arena + physical, size);
+    } else {
+        // Le dictionnaire ne change plus une fois le premier bloc publié
+        const uint32_t dict = atomic_load_explicit(&history->dict_size, memory_order_acquire);
+        memcpy(data - dict, history->window + LZ_DICT_MAX - dict, dict);
+        if (lz_decompress(history->arena + physical, size, data - dict, dict, HISTORY_BLOCK_SIZE) != raw_size) {
+            return -1;
+        }
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (offset < atomic_load_explicit(&history->tail, memory_order_relaxed)) {
+        return -1;
+    }
+
+    cursor->block = low;
+    cursor->first_seq = first_seq;
+    cursor->count = count;
+    cursor->size = raw_size;
+    cursor->next_seq = first_seq;
+    cursor->next_offset = 0;
+    return 1;
+}
+
+// Copie le bloc ouvert s'il contient seq (mêmes conventions que cursor_load_sealed)
+static int cursor_load_open(const History *history, HistoryCursor *cursor, const uint64_t seq) {
+    const uint64_t version = atomic_load_explicit(&history->open_version, memory_order_acquire);
+    if (version & 1) {
+        return -1;
+    }
+    const uint64_t first_seq = atomic_load_explicit(&history->open_first_seq, memory_order_relaxed);
+    const uint32_t count = atomic_load_explicit(&history->open_count, memory_order_acquire);
+    const uint32_t used = atomic_load_explicit(&history->open_used, memory_order_relaxed);
+    if (count == 0 || seq < first_seq || seq >= first_seq + count || used > HISTORY_BLOCK_SIZE) {
+        return atomic_load_explicit(&history->open_version, memory_order_relaxed) == version ? 0 : -1;
+    }
+    memcpy(cursor->window + LZ_DICT_MAX, history->window + LZ_DICT_MAX, used);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&history->open_version, memory_order_relaxed) != version) {
+        return -1;
+    }
+
+    cursor->block = OPEN_COPY;
+    cursor->first_seq = first_seq;
+    cursor->count = count;
+    cursor->size = used;
+    cursor->next_seq = first_seq;
+    cursor->next_offset = 0;
+    return 1;
+}
+
+// Parcourt les enregistrements du bloc décodé jusqu'à seq
+static const char *cursor_find(HistoryCursor *cursor, const uint64_t seq, size_t *length) {
+    if (seq < cursor->next_seq) {
+        cursor->next_seq = cursor->first_seq;
+        cursor->next_offset = 0;
+    }
+    const char *data = cursor->window + LZ_DICT_MAX;
+    while (cursor->next_offset + sizeof(RecordLength) <= cursor->size) {
+        RecordLength record;
+        memcpy(&record, data + cursor->next_offset, sizeof(record));
+        const uint32_t text = cursor->next_offset + (uint32_t)sizeof(record);
+        if (text + record > cursor->size) {
+            break;
+        }
+        cursor->next_offset = text + record;
+        if (cursor->next_seq++ == seq) {
+            *length = record;
+            return data + text;
+        }
+    }
+    return NULL;
+}
+
+const char *history_get(const History *history, HistoryCursor *cursor, const uint64_t seq, size_t *length) {
+    if (seq == 0) {
+        return NULL;
+    }
+    for (int attempt = 0; attempt < READ_ATTEMPTS; ++attempt) {
+        if (cursor->block && seq >= cursor->first_seq && seq < cursor->first_seq + cursor->count) {
+            return cursor_find(cursor, seq, length);
+        }
+        int evicted;
+        int found = cursor_load_sealed(history, cursor, seq, &evicted);
+        if (found == 0 && !evicted) {
+            found = cursor_load_open(history, cursor, seq);
+        }
+        if (found > 0) {
+            return cursor_find(cursor, seq, length);
+        }
+        if (found == 0) {
+            return NULL;
+        }
+        cursor->block = 0;
+    }
+    return NULL;
+}
+
+uint64_t history_first(const History *history) {
+    return atomic_load_explicit(&history->first_seq, memory_order_acquire);
+}
+
+size_t history_used(const History *history) {
+    return (size_t)(__atomic_load_n(&history->head, __ATOMIC_RELAXED) -
+                    atomic_load_explicit(&history->tail, memory_order_relaxed)) +
+           atomic_load_explicit(&history->open_used, memory_order_relaxed);
+}
+
+size_t history_raw(const History *history) {
+    return (size_t)atomic_load_explicit(&history->sealed_raw, memory_order_relaxed) +
+           atomic_load_explicit(&history->open_used, memory_order_relaxed);
+}
+
+size_t history_reserved(const History *history) {
+    return history->arena_size + (history->block_mask + 1) * sizeof(HistoryBlock) + fixed_size();
+}
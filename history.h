@@ -0,0 +1,96 @@
+#ifndef CHAT_HISTORY_H
+#define CHAT_HISTORY_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "lz.h"
+
+// Historique des messages diffusés, borné en octets plutôt qu'en nombre.
+// Les textes sont rangés bout à bout (2 octets de longueur puis le texte) dans un
+// bloc ouvert, en clair. Plein, le bloc est scellé : compressé (LZ avec un
+// dictionnaire entraîné sur le premier bloc) et rangé dans une arène circulaire.
+// Les plus anciens blocs sont évincés quand l'arène ou la table des blocs est pleine.
+//
+// Un seul écrivain à la fois (l'appelant sérialise history_append). Les lecteurs ne
+// prennent aucun verrou et n'écrivent rien de partagé : ils décodent un bloc dans
+// leur curseur puis vérifient qu'il n'a pas été réécrit entre-temps.
+
+#define HISTORY_MIN_BUDGET (128 * 1024)
+#define HISTORY_BLOCK_SIZE (16 * 1024)
+
+typedef struct HistoryBlock {
+    _Atomic uint64_t number;    // 0 pendant la réécriture de l'entrée
+    _Atomic uint64_t first_seq;
+    _Atomic uint64_t offset;    // position logique dans l'arène
+    _Atomic uint32_t size;      // octets compressés (= raw_size : stocké tel quel)
+    _Atomic uint32_t raw_size;
+    _Atomic uint32_t count;     // messages du bloc
+} HistoryBlock;
+
+typedef struct History {
+    // Blocs scellés : positions logiques croissantes, [tail, head) occupé
+    char *arena;
+    size_t arena_size;
+    HistoryBlock *blocks;
+    size_t block_mask;          // capacité de la table - 1 (puissance de deux)
+    uint64_t head;              // écrivain seulement
+    _Atomic uint64_t tail;      // avancé avant d'écraser des octets
+    _Atomic uint64_t first_block;
+    _Atomic uint64_t last_block;  // 0 : aucun bloc scellé
+
+    // Dictionnaire (fin des LZ_DICT_MAX premiers octets) suivi du bloc ouvert
+    char *window;
+    _Atomic uint32_t dict_size;
+    _Atomic uint64_t open_version;  // impair pendant le scellement
+    _Atomic uint64_t open_first_seq;
+    _Atomic uint32_t open_count;
+    _Atomic uint32_t open_used;
+
+    // Tampons de compression : écrivain seulement
+    char *packed;
+    uint32_t *lz_table;
+
+    _Atomic uint64_t first_seq;   // plus ancien message retenu
+    _Atomic uint64_t last_seq;    // dernier message ajouté
+    _Atomic uint64_t sealed_raw;  // octets en clair des blocs scellés retenus
+} History;
+
+// Bloc décodé par un lecteur ; un curseur sert pour des lectures successives (replay
+// dans l'ordre, recherche) sans redécoder le même bloc
+typedef struct HistoryCursor {
+    uint64_t block;             // bloc décodé, 0 : aucun, UINT64_MAX : copie du bloc ouvert
+    uint64_t first_seq;
+    uint32_t count;
+    uint32_t size;
+    uint64_t next_seq;          // reprise du parcours dans le bloc
+    uint32_t next_offset;
+    char window[LZ_DICT_MAX + HISTORY_BLOCK_SIZE];
+} HistoryCursor;
+
+// budget : octets pour l'arène et les tampons réunis (au moins HISTORY_MIN_BUDGET)
+int history_init(History *history, size_t budget);
+void history_free(History *history);
+
+// Ajoute le texte du message seq (numéros strictement croissants)
+void history_append(History *history, uint64_t seq, const char *text, size_t len);
+
+void history_cursor_init(HistoryCursor *cursor);
+
+// Texte du message seq, valable jusqu'au prochain appel avec ce curseur ; NULL s'il
+// n'est plus (ou pas) retenu
+const char *history_get(const History *history, HistoryCursor *cursor, uint64_t seq, size_t *length);
+
+// Plus ancien numéro encore lisible (indicatif : il peut être évincé juste après)
+uint64_t history_first(const History *history);
+
+// Octets occupés (compressés) et leur équivalent en clair
+size_t history_used(const History *history);
+size_t history_raw(const History *history);
+
+// Mémoire totale réservée (arène, table, tampons)
+size_t history_reserved(const History *history);
+
+#endif
@@ -0,0 +1,113 @@
+#include "lockprof.h"
+
+#ifdef LOCK_PROFILING
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+static _Atomic(LockSite *) sites = NULL;
+
+static void update_max(_Atomic uint64_t *max, const uint64_t value) {
+    uint64_t current = atomic_load_explicit(max, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(max, &current, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Ajoute le site à la liste globale lors de sa première utilisation
+static void register_site(LockSite *site, const char *lock_name) {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&site->registered, &expected, 1)) {
+        return;
+    }
+    site->lock_name = lock_name;
+    LockSite *head = atomic_load(&sites);
+    do {
+        site->next = head;
+    } while (!atomic_compare_exchange_weak(&sites, &head, site));
+}
+
+void lockprof_acquire(ProfMutex *m, LockSite *site) {
+    if (!atomic_load_explicit(&site->registered, memory_order_relaxed)) {
+        register_site(site, m->name);
+    }
+
+    uint64_t acquired;
+    if (pthread_mutex_trylock(&m->mutex) == EBUSY) {
+        // Verrou contesté : on mesure l'attente
+        const uint64_t start = monotonic_ns();
+        pthread_mutex_lock(&m->mutex);
+        acquired = monotonic_ns();
+        const uint64_t waited = acquired - start;
+        atomic_fetch_add_explicit(&site->contended, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&site->wait_ns, waited, memory_order_relaxed);
+        update_max(&site->wait_max_ns, waited);
+    } else {
+        acquired = monotonic_ns();
+    }
+    atomic_fetch_add_explicit(&site->acquisitions, 1, memory_order_relaxed);
+
+    m->acquired_ns = acquired;
+    m->site = site;
+}
+
+void lockprof_release(ProfMutex *m) {
+    LockSite *site = m->site;
+    const uint64_t held = monotonic_ns() - m->acquired_ns;
+    pthread_mutex_unlock(&m->mutex);
+
+    atomic_fetch_add_explicit(&site->hold_ns, held, memory_order_relaxed);
+    update_max(&site->hold_max_ns, held);
+}
+
+static int compare_wait(const void *lhs, const void *rhs) {
+    const uint64_t a = atomic_load(&(*(LockSite *const *)lhs)->wait_ns);
+    const uint64_t b = atomic_load(&(*(LockSite *const *)rhs)->wait_ns);
+    return (a < b) - (a > b);
+}
+
+void lockprof_dump(FILE *out) {
+    size_t count = 0;
+    for (LockSite *site = atomic_load(&sites); site; site = site->next) {
+        count++;
+    }
+    LockSite **sorted = malloc((count ? count : 1) * sizeof(LockSite *));
+    if (!sorted) {
+        return;
+    }
+    count = 0;
+    for (LockSite *site = atomic_load(&sites); site; site = site->next) {
+        sorted[count++] = site;
+    }
+    qsort(sorted, count, sizeof(LockSite *), compare_wait);
+
+    fprintf(out, "%-16s %-28s %10s %10s %12s %10s %12s %10s\n", "lock", "site", "acquired",
+            "contended", "wait_avg_us", "wait_max", "hold_avg_us", "hold_max");
+    for (size_t i = 0; i < count; ++i) {
+        const LockSite *site = sorted[i];
+        const uint64_t acquisitions = atomic_load(&site->acquisitions);
+        const uint64_t contended = atomic_load(&site->contended);
+        char where[128];
+        snprintf(where, sizeof(where), "%s:%d(%s)", site->file, site->line, site->function);
+        fprintf(out, "%-16s %-28s %10llu %9.1f%% %12.2f %10.2f %12.2f %10.2f\n",
+                site->lock_name ? site->lock_name : "?", where,
+                (unsigned long long)acquisitions,
+                acquisitions ? 100.0 * (double)contended / (double)acquisitions : 0.0,
+                contended ? (double)atomic_load(&site->wait_ns) / (double)contended / 1000.0 : 0.0,
+                (double)atomic_load(&site->wait_max_ns) / 1000.0,
+                acquisitions ? (double)atomic_load(&site->hold_ns) / (double)acquisitions / 1000.0 : 0.0,
+                (double)atomic_load(&site->hold_max_ns) / 1000.0);
+    }
+    free(sorted);
+}
+
+#else
+
+void lockprof_dump(FILE *out) {
+    fprintf(out, "lock profiling disabled (build with PROFILE=1)\n");
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef CHAT_LOCKPROF_H
+#define CHAT_LOCKPROF_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Mutex instrumenté : avec -DLOCK_PROFILING chaque site d'appel de prof_lock()
+// mesure le temps d'attente, le temps de détention et le nombre d'acquisitions
+// contestées. Sans ce drapeau les macros se réduisent à pthread_mutex_lock/unlock.
+
+#ifdef LOCK_PROFILING
+
+#include <stdatomic.h>
+
+typedef struct LockSite {
+    const char *lock_name;
+    const char *file;
+    const char *function;
+    int line;
+    _Atomic int registered;
+    _Atomic uint64_t acquisitions;
+    _Atomic uint64_t contended;
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t wait_max_ns;
+    _Atomic uint64_t hold_ns;
+    _Atomic uint64_t hold_max_ns;
+    struct LockSite *next;
+} LockSite;
+
+typedef struct ProfMutex {
+    pthread_mutex_t mutex;
+    const char *name;
+    uint64_t acquired_ns;   // écrit uniquement par le détenteur
+    LockSite *site;
+} ProfMutex;
+
+#define PROF_MUTEX_INITIALIZER(lock_name) { PTHREAD_MUTEX_INITIALIZER, lock_name, 0, NULL }
+
+void lockprof_acquire(ProfMutex *m, LockSite *site);
+void lockprof_release(ProfMutex *m);
+
+#define prof_lock(m) do { \
+        static LockSite lockprof_site_ = { .file = __FILE__, .function = __func__, .line = __LINE__ }; \
+        lockprof_acquire((m), &lockprof_site_); \
+    } while (0)
+#define prof_unlock(m) lockprof_release(m)
+
+#else
+
+typedef struct ProfMutex {
+    pthread_mutex_t mutex;
+} ProfMutex;
+
+#define PROF_MUTEX_INITIALIZER(lock_name) { PTHREAD_MUTEX_INITIALIZER }
+#define prof_lock(m) pthread_mutex_lock(&(m)->mutex)
+#define prof_unlock(m) pthread_mutex_unlock(&(m)->mutex)
+
+#endif
+
+// Affiche les statistiques par site, triées par temps d'attente cumulé
+void lockprof_dump(FILE *out);
+
+#endif
@@ -0,0 +1,360 @@
+#include "log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util.h"
+
+#define LOG_RING_SIZE (64 * 1024)   // puissance de 2
+#define LOG_MAX_FIELD 1024          // taille max d'un champ texte
+#define LOG_BATCH_SIZE (64 * 1024)  // taille du tampon d'écriture du thread de fond
+#define LOG_STAGE_RECORDS 4096     // enregistrements triés par passe
+#define LOG_STAGE_BYTES (256 * 1024)
+#define LOG_IDLE_SLEEP_NS 2000000   // 2 ms entre deux passes quand rien n'est à écrire
+
+enum { RING_FREE = 0, RING_OWNED, RING_ORPHAN };
+
+// En-tête d'un enregistrement, suivi des champs a et b
+typedef struct LogRecord {
+    uint64_t timestamp_ns;
+    int32_t code;
+    uint16_t a_len;
+    uint16_t b_len;
+    uint8_t level;
+    uint8_t event;
+} LogRecord;
+
+// Anneau SPSC : un thread producteur, le thread de fond comme consommateur
+typedef struct LogRing {
+    _Atomic uint64_t head;      // position d'écriture (producteur)
+    char pad1[64 - sizeof(uint64_t)];
+    _Atomic uint64_t tail;      // position de lecture (consommateur)
+    char pad2[64 - sizeof(uint64_t)];
+    _Atomic int state;
+    unsigned chat_counter;      // compteur d'échantillonnage, propre au producteur
+    struct LogRing *next;
+    char data[LOG_RING_SIZE];
+} LogRing;
+
+static _Atomic(LogRing *) rings = NULL;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static _Thread_local LogRing *thread_ring = NULL;
+
+static FILE *log_out = NULL;
+static LogLevel log_min_level = LOG_INFO;
+static unsigned log_chat_sample = 1;
+static _Atomic int log_running = 0;
+static _Atomic unsigned long long dropped = 0;
+static pthread_t log_thread;
+
+// Libère l'anneau quand son thread se termine : le thread de fond le rendra
+// réutilisable une fois vidé.
+static void release_ring(void *arg) {
+    LogRing *ring = arg;
+    atomic_store_explicit(&ring->state, RING_ORPHAN, memory_order_release);
+}
+
+static LogRing *acquire_ring(void) {
+    pthread_mutex_lock(&rings_mutex);
+    LogRing *ring = atomic_load(&rings);
+    while (ring) {
+        int expected = RING_FREE;
+        if (atomic_compare_exchange_strong(&ring->state, &expected, RING_OWNED)) {
+            break;
+        }
+        ring = ring->next;
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(LogRing));
+        if (ring) {
+            atomic_store(&ring->state, RING_OWNED);
+            ring->next = atomic_load(&rings);
+            atomic_store_explicit(&rings, ring, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    if (ring) {
+        ring->chat_counter = 0;
+        pthread_setspecific(ring_key, ring);
+    }
+    return ring;
+}
+
+static void ring_copy_in(LogRing *ring, uint64_t pos, const void *src, size_t len) {
+    const size_t offset = pos & (LOG_RING_SIZE - 1);
+    const size_t first = len < LOG_RING_SIZE - offset ? len : LOG_RING_SIZE - offset;
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, (const char *)src + first, len - first);
+}
+
+static void ring_copy_out(const LogRing *ring, uint64_t pos, void *dst, size_t len) {
+    const size_t offset = pos & (LOG_RING_SIZE - 1);
+    const size_t first = len < LOG_RING_SIZE - offset ? len : LOG_RING_SIZE - offset;
+    memcpy(dst, ring->data + offset, first);
+    memcpy((char *)dst + first, ring->data, len - first);
+}
+
+static size_t record_size(size_t a_len, size_t b_len) {
+    return (sizeof(LogRecord) + a_len + b_len + 7) & ~(size_t)7;
+}
+
+void log_event(LogLevel level, LogEvent event, int code,
+               const char *a, size_t a_len, const char *b, size_t b_len) {
+    if (level < log_min_level || !atomic_load_explicit(&log_running, memory_order_relaxed)) {
+        return;
+    }
+
+    LogRing *ring = thread_ring;
+    if (!ring) {
+        ring = thread_ring = acquire_ring();
+        if (!ring) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    if (event == LOG_EV_CHAT) {
+        // Échantillonnage du contenu des messages
+        if (log_chat_sample == 0 || ring->chat_counter++ % log_chat_sample != 0) {
+            return;
+        }
+    }
+
+    if (a_len > LOG_MAX_FIELD) a_len = LOG_MAX_FIELD;
+    if (b_len > LOG_MAX_FIELD) b_len = LOG_MAX_FIELD;
+    const size_t size = record_size(a_len, b_len);
+
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (LOG_RING_SIZE - (head - tail) < size) {
+        // Anneau plein : on perd l'enregistrement plutôt que d'attendre
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    const LogRecord record = {
+        .timestamp_ns = realtime_ns(),
+        .code = code,
+        .a_len = (uint16_t)a_len,
+        .b_len = (uint16_t)b_len,
+        .level = (uint8_t)level,
+        .event = (uint8_t)event,
+    };
+    ring_copy_in(ring, head, &record, sizeof(record));
+    if (a_len) ring_copy_in(ring, head + sizeof(record), a, a_len);
+    if (b_len) ring_copy_in(ring, head + sizeof(record) + a_len, b, b_len);
+    atomic_store_explicit(&ring->head, head + size, memory_order_release);
+}
+
+// Formate un enregistrement dans le tampon du lot, renvoie le nombre d'octets écrits
+static size_t format_record(char *out, size_t room, const LogRecord *record,
+                            const char *a, const char *b) {
+    int written = 0;
+    switch (record->event) {
+        case LOG_EV_JOIN:
+            written = snprintf(out, room, "\033[32m%.*s is connected.\033[0m\n", record->a_len, a);
+            break;
+        case LOG_EV_LEAVE:
+            written = snprintf(out, room, "\033[31m%.*s disconnected.\033[0m\n", record->a_len, a);
+            break;
+        case LOG_EV_REFUSED:
+            written = snprintf(out, room, "Server is full, connection refused for %.*s\n", record->a_len, a);
+            break;
+        case LOG_EV_CHAT:
+            written = snprintf(out, room, "%.*s : %.*s\n", record->a_len, a, record->b_len, b);
+            break;
+        case LOG_EV_ERRNO:
+            written = snprintf(out, room, "%.*s: %s\n", record->a_len, a, strerror(record->code));
+            break;
+        default:
+            written = snprintf(out, room, "%.*s\n", record->a_len, a);
+            break;
+    }
+    if (written < 0) return 0;
+    return (size_t)written < room ? (size_t)written : room - 1;
+}
+
+// Enregistrements extraits des anneaux lors d'une passe, triés par horodatage
+// avant d'être formatés pour que les lignes de threads différents restent
+// dans l'ordre chronologique.
+typedef struct StagedRecord {
+    LogRecord record;
+    const char *fields;
+} StagedRecord;
+
+typedef struct LogStage {
+    StagedRecord *records;
+    size_t count;
+    char *bytes;
+    size_t used;
+} LogStage;
+
+// Copie les enregistrements d'un anneau dans la zone de tri ; renvoie le nombre extrait
+static size_t drain_ring(LogRing *ring, LogStage *stage) {
+    size_t count = 0;
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail != head && stage->count < LOG_STAGE_RECORDS) {
+        StagedRecord *staged = &stage->records[stage->count];
+        ring_copy_out(ring, tail, &staged->record, sizeof(staged->record));
+        const size_t fields_len = staged->record.a_len + staged->record.b_len;
+        if (LOG_STAGE_BYTES - stage->used < fields_len) {
+            break;
+        }
+        ring_copy_out(ring, tail + sizeof(staged->record), stage->bytes + stage->used, fields_len);
+        staged->fields = stage->bytes + stage->used;
+        stage->used += fields_len;
+        stage->count++;
+
+        tail += record_size(staged->record.a_len, staged->record.b_len);
+        count++;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return count;
+}
+
+static size_t drain_all(LogStage *stage) {
+    size_t count = 0;
+    for (LogRing *ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        const int state = atomic_load_explicit(&ring->state, memory_order_acquire);
+        count += drain_ring(ring, stage);
+        if (state == RING_ORPHAN &&
+            atomic_load_explicit(&ring->tail, memory_order_relaxed) ==
+            atomic_load_explicit(&ring->head, memory_order_acquire)) {
+            // Le producteur est parti et l'anneau est vide : réutilisable
+            atomic_store_explicit(&ring->state, RING_FREE, memory_order_release);
+        }
+    }
+    return count;
+}
+
+static int compare_staged(const void *lhs, const void *rhs) {
+    const uint64_t a = ((const StagedRecord *)lhs)->record.timestamp_ns;
+    const uint64_t b = ((const StagedRecord *)rhs)->record.timestamp_ns;
+    return (a > b) - (a < b);
+}
+
+// Formate la zone de tri dans le tampon du lot et l'écrit
+static void write_stage(LogStage *stage, char *batch, size_t batch_len) {
+    qsort(stage->records, stage->count, sizeof(StagedRecord), compare_staged);
+    for (size_t i = 0; i < stage->count; ++i) {
+        const StagedRecord *staged = &stage->records[i];
+        // Chaque ligne formatée tient largement dans 3 Ko
+        if (LOG_BATCH_SIZE - batch_len < 3 * LOG_MAX_FIELD) {
+            fwrite(batch, 1, batch_len, log_out);
+            batch_len = 0;
+        }
+        batch_len += format_record(batch + batch_len, LOG_BATCH_SIZE - batch_len, &staged->record,
+                                   staged->fields, staged->fields + staged->record.a_len);
+    }
+    if (batch_len > 0) {
+        fwrite(batch, 1, batch_len, log_out);
+        fflush(log_out);
+    }
+    stage->count = 0;
+    stage->used = 0;
+}
+
+static void *log_thread_main(void *arg) {
+    (void)arg;
+    char *batch = malloc(LOG_BATCH_SIZE);
+    LogStage stage = {
+        .records = malloc(LOG_STAGE_RECORDS * sizeof(StagedRecord)),
+        .bytes = malloc(LOG_STAGE_BYTES),
+    };
+    if (!batch || !stage.records || !stage.bytes) {
+        free(batch);
+        free(stage.records);
+        free(stage.bytes);
+        return NULL;
+    }
+    unsigned long long reported_drops = 0;
+
+    while (1) {
+        const int running = atomic_load(&log_running);
+        const size_t count = drain_all(&stage);
+
+        size_t batch_len = 0;
+        const unsigned long long drops = atomic_load_explicit(&dropped, memory_order_relaxed);
+        if (drops != reported_drops) {
+            const int written = snprintf(batch, LOG_BATCH_SIZE, "[log] %llu records dropped\n",
+                                         drops - reported_drops);
+            if (written > 0) batch_len = (size_t)written;
+            reported_drops = drops;
+        }
+        if (count > 0 || batch_len > 0) {
+            write_stage(&stage, batch, batch_len);
+        }
+
+        if (!running && count == 0) {
+            break;
+        }
+        if (count == 0) {
+            const struct timespec idle = {0, LOG_IDLE_SLEEP_NS};
+            nanosleep(&idle, NULL);
+        }
+    }
+    free(batch);
+    free(stage.records);
+    free(stage.bytes);
+    return NULL;
+}
+
+int log_init(FILE *out, const LogLevel min_level, const unsigned chat_sample) {
+    log_out = out ? out : stdout;
+    log_min_level = min_level;
+    log_chat_sample = chat_sample;
+
+    if (pthread_key_create(&ring_key, release_ring) != 0) {
+        return -1;
+    }
+    atomic_store(&log_running, 1);
+    if (pthread_create(&log_thread, NULL, log_thread_main, NULL) != 0) {
+        atomic_store(&log_running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void log_shutdown(void) {
+    if (!atomic_exchange(&log_running, 0)) {
+        return;
+    }
+    pthread_join(log_thread, NULL);
+}
+
+unsigned long long log_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+void log_text(const LogLevel level, const char *text) {
+    log_event(level, LOG_EV_TEXT, 0, text, strlen(text), NULL, 0);
+}
+
+void log_join(const char *name) {
+    log_event(LOG_INFO, LOG_EV_JOIN, 0, name, strlen(name), NULL, 0);
+}
+
+void log_leave(const char *name) {
+    log_event(LOG_INFO, LOG_EV_LEAVE, 0, name, strlen(name), NULL, 0);
+}
+
+void log_refused(const char *name) {
+    log_event(LOG_WARN, LOG_EV_REFUSED, 0, name, strlen(name), NULL, 0);
+}
+
+void log_chat(const char *name, const char *text, const size_t len) {
+    log_event(LOG_INFO, LOG_EV_CHAT, 0, name, strlen(name), text, len);
+}
+
+void log_errno(const char *context, const int err) {
+    log_event(LOG_ERROR, LOG_EV_ERRNO, err, context, strlen(context), NULL, 0);
+}
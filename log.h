@@ -0,0 +1,52 @@
+#ifndef CHAT_LOG_H
+#define CHAT_LOG_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Journalisation asynchrone du serveur.
+// Les threads du chemin critique écrivent des enregistrements binaires compacts
+// dans un anneau qui leur est propre ; un thread de fond les formate et les
+// écrit par lots. Si un anneau est plein l'enregistrement est abandonné (et
+// compté) : la journalisation ne ralentit jamais la diffusion des messages.
+
+typedef enum LogLevel {
+    LOG_DEBUG = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR,
+} LogLevel;
+
+typedef enum LogEvent {
+    LOG_EV_TEXT = 0,   // texte libre (a)
+    LOG_EV_JOIN,       // a = nom
+    LOG_EV_LEAVE,      // a = nom
+    LOG_EV_REFUSED,    // a = nom, serveur plein
+    LOG_EV_CHAT,       // a = nom, b = contenu du message
+    LOG_EV_ERRNO,      // a = contexte, code = errno
+} LogEvent;
+
+// Démarre le thread de journalisation. Seuls les enregistrements de niveau
+// >= min_level sont conservés ; un message de chat sur chat_sample est journalisé
+// (0 désactive complètement le contenu des messages).
+int log_init(FILE *out, LogLevel min_level, unsigned chat_sample);
+
+// Vide les anneaux puis arrête le thread de journalisation.
+void log_shutdown(void);
+
+// Point d'entrée générique : ne bloque jamais, ne fait aucune allocation sur le
+// chemin normal.
+void log_event(LogLevel level, LogEvent event, int code,
+               const char *a, size_t a_len, const char *b, size_t b_len);
+
+// Nombre d'enregistrements perdus faute de place dans les anneaux.
+unsigned long long log_dropped(void);
+
+void log_text(LogLevel level, const char *text);
+void log_join(const char *name);
+void log_leave(const char *name);
+void log_refused(const char *name);
+void log_chat(const char *name, const char *text, size_t len);
+void log_errno(const char *context, int err);
+
+#endif
@@ -0,0 +1,261 @@
+#include "lz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LAST_LITERALS 5             // la fin du bloc reste en littéraux
+#define SHORT_COPY 16               // copies courtes de taille fixe (pas d'appel à memcpy)
+#define TRAIN_KMER 6
+#define TRAIN_SEGMENT 64
+#define TRAIN_BUCKETS 8192
+
+static inline uint32_t read32(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t read64(const char *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash4(const uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Longueur au-delà de 15 : suite d'octets 255 terminée par un octet < 255
+static uint8_t *put_length(uint8_t *out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+// Une séquence : littéraux puis correspondance (match_len 0 : dernière séquence)
+static uint8_t *emit(uint8_t *out, const uint8_t *out_end, const char *literals, const size_t literal_len,
+                     const char *in_end, const size_t offset, const size_t match_len) {
+    const size_t worst = 1 + literal_len + literal_len / 255 + 1 + (match_len ? 2 + match_len / 255 + 1 : 0);
+    if (worst > (size_t)(out_end - out)) {
+        return NULL;
+    }
+    const size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t *token = out++;
+    *token = (uint8_t)((literal_len < 15 ? literal_len : 15) << 4 | (match_code < 15 ? match_code : 15));
+    if (literal_len >= 15) {
+        out = put_length(out, literal_len - 15);
+    }
+    if (literal_len <= SHORT_COPY && in_end - literals >= SHORT_COPY && out_end - out >= SHORT_COPY) {
+        memcpy(out, literals, SHORT_COPY);
+    } else {
+        memcpy(out, literals, literal_len);
+    }
+    out += literal_len;
+    if (match_len) {
+        *out++ = (uint8_t)(offset & 0xff);
+        *out++ = (uint8_t)(offset >> 8);
+        if (match_code >= 15) {
+            out = put_length(out, match_code - 15);
+        }
+    }
+    return out;
+}
+
+size_t lz_compress(const char *window, const size_t prefix, const size_t length, char *dst, const size_t capacity,
+                   uint32_t *table) {
+    // Positions + 1 (0 : case vide). Le dictionnaire est indexé à chaque appel.
+    memset(table, 0, LZ_HASH_SIZE * sizeof(uint32_t));
+    for (size_t pos = 0; pos + LZ_MIN_MATCH <= prefix; ++pos) {
+        table[hash4(read32(window + pos))] = (uint32_t)pos + 1;
+    }
+
+    uint8_t *out = (uint8_t *)dst;
+    const uint8_t *out_end = out + capacity;
+    const char *anchor = window + prefix;
+    const char *ip = anchor;
+    const char *in_end = anchor + length;
+    const char *limit = length > LAST_LITERALS ? anchor + length - LAST_LITERALS : anchor;
+
+    while (ip < limit) {
+        const uint32_t value = read32(ip);
+        const uint32_t hash = hash4(value);
+        const uint32_t candidate = table[hash];
+        table[hash] = (uint32_t)(ip - window) + 1;
+        if (!candidate || (size_t)(ip - window) - (candidate - 1) > LZ_MAX_OFFSET ||
+            read32(window + candidate - 1) != value) {
+            ip++;
+            continue;
+        }
+        const char *match = window + candidate - 1;
+        size_t match_len = LZ_MIN_MATCH;
+        // Extension par mots de 8 octets, le premier octet différent par ctz
+        while (ip + match_len + 8 <= limit) {
+            const uint64_t diff = read64(ip + match_len) ^ read64(match + match_len);
+            if (diff) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                match_len += (size_t)__builtin_clzll(diff) / 8;
+#else
+                match_len += (size_t)__builtin_ctzll(diff) / 8;
+#endif
+                break;
+            }
+            match_len += 8;
+        }
+        if (ip + match_len + 8 > limit) {
+            while (ip + match_len < limit && match[match_len] == ip[match_len]) {
+                match_len++;
+            }
+        }
+        out = emit(out, out_end, anchor, (size_t)(ip - anchor), in_end, (size_t)(ip - match), match_len);
+        if (!out) {
+            return 0;
+        }
+        ip += match_len;
+        anchor = ip;
+    }
+
+    out = emit(out, out_end, anchor, (size_t)(in_end - anchor), in_end, 0, 0);
+    return out ? (size_t)(out - (uint8_t *)dst) : 0;
+}
+
+static int get_length(const uint8_t **ip, const uint8_t *end, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+ssize_t lz_decompress(const char *src, const size_t size, char *window, const size_t prefix, const size_t capacity) {
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *end = ip + size;
+    char *out = window + prefix;
+    const char *out_end = out + capacity;
+
+    while (ip < end) {
+        const uint8_t token = *ip++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && get_length(&ip, end, &literal_len) < 0) {
+            return -1;
+        }
+        if (literal_len > (size_t)(end - ip) || literal_len > (size_t)(out_end - out)) {
+            return -1;
+        }
+        // Cas courant : quelques littéraux, copiés par 16 quand il y a de la marge
+        if (literal_len <= SHORT_COPY && end - ip >= SHORT_COPY && out_end - out >= SHORT_COPY) {
+            memcpy(out, ip, SHORT_COPY);
+        } else {
+            memcpy(out, ip, literal_len);
+        }
+        out += literal_len;
+        ip += literal_len;
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        const size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && get_length(&ip, end, &match_len) < 0) {
+            return -1;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(out - window) || match_len > (size_t)(out_end - out)) {
+            return -1;
+        }
+        const char *match = out - offset;
+        if (offset >= 8 && match_len <= 3 * 8 && out_end - out >= 3 * 8) {
+            // Par mots de 8 octets : chaque mot source est écrit avant d'être relu
+            memcpy(out, match, 8);
+            memcpy(out + 8, match + 8, 8);
+            memcpy(out + 16, match + 16, 8);
+        } else if (offset >= match_len) {
+            memcpy(out, match, match_len);
+        } else {
+            // Recouvrement : répétition d'un motif court
+            for (size_t i = 0; i < match_len; ++i) {
+                out[i] = match[i];
+            }
+        }
+        out += match_len;
+    }
+    return out - (window + prefix);
+}
+
+static uint32_t kmer_hash(const char *p) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < TRAIN_KMER; ++i) {
+        hash = (hash ^ (uint8_t)p[i]) * 16777619u;
+    }
+    return hash % TRAIN_BUCKETS;
+}
+
+size_t lz_train(const char *sample, const size_t length, char *dict, const size_t capacity) {
+    if (length < TRAIN_SEGMENT || capacity < TRAIN_SEGMENT) {
+        const size_t size = length < capacity ? length : capacity;
+        memcpy(dict, sample, size);
+        return size;
+    }
+
+    const size_t kmers = length - TRAIN_KMER + 1;
+    uint16_t *hashes = malloc(kmers * sizeof(uint16_t));
+    uint32_t *counts = calloc(TRAIN_BUCKETS, sizeof(uint32_t));
+    uint8_t *taken = calloc(length / (TRAIN_SEGMENT / 2) + 1, 1);
+    if (!hashes || !counts || !taken) {
+        free(taken);
+        free(counts);
+        free(hashes);
+        return 0;
+    }
+    for (size_t i = 0; i < kmers; ++i) {
+        hashes[i] = (uint16_t)kmer_hash(sample + i);
+        counts[hashes[i]]++;
+    }
+
+    // Glouton : le segment dont les sous-chaînes sont les plus fréquentes, puis on
+    // oublie ces sous-chaînes pour que le suivant apporte autre chose
+    const size_t per_segment = TRAIN_SEGMENT - TRAIN_KMER + 1;
+    size_t size = 0;
+    while (size + TRAIN_SEGMENT <= capacity) {
+        size_t best = 0;
+        uint64_t best_score = per_segment;          // des sous-chaînes vues une fois ne servent à rien
+        for (size_t start = 0; start + TRAIN_SEGMENT <= length; start += TRAIN_SEGMENT / 2) {
+            if (taken[start / (TRAIN_SEGMENT / 2)]) {
+                continue;
+            }
+            uint64_t score = 0;
+            for (size_t i = 0; i < per_segment; ++i) {
+                score += counts[hashes[start + i]];
+            }
+            if (score > best_score) {
+                best_score = score;
+                best = start + 1;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        const size_t start = best - 1;
+        taken[start / (TRAIN_SEGMENT / 2)] = 1;
+        for (size_t i = 0; i < per_segment; ++i) {
+            counts[hashes[start + i]] = 0;
+        }
+        memcpy(dict + size, sample + start, TRAIN_SEGMENT);
+        size += TRAIN_SEGMENT;
+    }
+
+    free(taken);
+    free(counts);
+    free(hashes);
+    return size;
+}
@@ -0,0 +1,35 @@
+#ifndef CHAT_LZ_H
+#define CHAT_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Compression LZ77 rapide (format à la LZ4 : jeton, littéraux, décalage sur 2 octets,
+// correspondances d'au moins 4 octets), avec dictionnaire partagé.
+//
+// Le dictionnaire précède les données dans une même fenêtre : les correspondances
+// peuvent y remonter, ce qui compresse bien les petits blocs de texte de discussion
+// dont les mots reviennent d'un bloc à l'autre.
+
+#define LZ_DICT_MAX 4096
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+// Compresse window[prefix, prefix + length) ; window[0, prefix) est le dictionnaire.
+// table : LZ_HASH_SIZE entrées de travail. Renvoie la taille compressée, 0 si elle
+// dépasserait capacity.
+size_t lz_compress(const char *window, size_t prefix, size_t length, char *dst, size_t capacity, uint32_t *table);
+
+// Décompresse src dans window + prefix (window[0, prefix) : le même dictionnaire).
+// Entrée vérifiée : renvoie la taille décompressée, -1 si src est corrompu ou si la
+// sortie dépasserait capacity.
+ssize_t lz_decompress(const char *src, size_t size, char *window, size_t prefix, size_t capacity);
+
+// Construit un dictionnaire (au plus capacity octets) à partir d'un échantillon de
+// texte : les segments dont les sous-chaînes reviennent le plus souvent
+size_t lz_train(const char *sample, size_t length, char *dict, size_t capacity);
+
+#endif
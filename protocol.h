@@ -0,0 +1,235 @@
+#ifndef CHAT_PROTOCOL_H
+#define CHAT_PROTOCOL_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Protocole commun au serveur et aux clients.
+// Après l'envoi du nom (struct de 100 octets), tous les échanges sont des trames :
+// un en-tête fixe de 8 octets (ordre réseau) suivi de `length` octets de données.
+
+#define PROTOCOL_NAME_LEN 100
+#define PROTOCOL_PORT 30001     // TCP, sur 127.0.0.1
+#define MAX_FRAME_PAYLOAD 4096
+
+typedef struct FrameHeader {
+    uint32_t length;    // taille des données qui suivent l'en-tête
+    uint8_t type;
+    uint8_t flags;
+    uint16_t reserved;
+} FrameHeader;
+
+typedef enum FrameType {
+    FRAME_CHAT = 1,     // client -> serveur : message saisi
+    FRAME_TEXT = 2,     // serveur -> client : ligne à afficher
+    FRAME_TRACE = 3,    // client -> serveur : TraceDisplay d'un message tracé
+    FRAME_PING = 4,     // dans les deux sens : PingPayload, reply_ns à 0
+    FRAME_PONG = 5,     // réponse à un ping : origin_ns renvoyé tel quel
+    FRAME_BUSY = 6,     // serveur -> client : BusyPayload, serveur surchargé, connexion refusée
+    FRAME_HISTORY_REQUEST = 7,  // client -> serveur : HistoryRequest, page d'historique
+    FRAME_HISTORY = 8,          // serveur -> client : numéro (uint64, ordre réseau) puis texte
+    FRAME_HISTORY_END = 9,      // serveur -> client : HistoryEnd, fin d'une page ou du replay
+    FRAME_PEER_HELLO = 10,      // serveur <-> serveur (fédération) : PeerHello, première trame d'un lien
+    FRAME_RELAY = 11,           // serveur <-> serveur : RelayHeader puis texte d'un message diffusé
+    FRAME_FORWARD = 12,         // vers le serveur qui numérote le salon (grappe -C, passerelle) : texte
+    FRAME_REPLICA_HELLO = 13,   // secours <-> primaire (-y) : ReplicaHello, première trame dans chaque sens
+    FRAME_REPLICA_MESSAGE = 14, // primaire -> secours : numéro (uint64, ordre réseau) puis texte
+    FRAME_REPLICA_MEMBER = 15,  // primaire -> secours : nom, flags = REPLICA_JOIN, _LEAVE ou _RESET
+    FRAME_REPLICA_ACK = 16,     // secours -> primaire : dernier numéro appliqué (uint64, ordre réseau)
+    FRAME_REPLICA_DETACH = 17,  // primaire -> secours : refusé ou lâché, flags = REPLICA_DETACH_*, sans données
+} FrameType;
+
+// Les données commencent par un identifiant de trace (uint64, ordre réseau)
+#define FRAME_FLAG_TRACED 0x01
+
+// Accusé d'affichage d'un message tracé, renvoyé par le client
+typedef struct TraceDisplay {
+    uint64_t trace_id;
+    uint64_t display_ns;    // CLOCK_REALTIME du client
+} TraceDisplay;
+
+// Ping/pong : origin_ns est l'horloge de l'émetteur du ping (renvoyée telle quelle),
+// reply_ns celle de l'autre extrémité au moment de la réponse
+typedef struct PingPayload {
+    uint64_t origin_ns;
+    uint64_t reply_ns;
+} PingPayload;
+
+// Refus pour surcharge : le client peut réessayer après retry_after_ms (ordre réseau)
+typedef struct BusyPayload {
+    uint32_t retry_after_ms;
+} BusyPayload;
+
+// Au plus count messages de numéro < before_seq (0 : les plus récents), envoyés du
+// plus ancien au plus récent en trames FRAME_HISTORY (ordre réseau)
+typedef struct HistoryRequest {
+    uint64_t before_seq;
+    uint32_t count;
+    uint32_t reserved;
+} HistoryRequest;
+
+#define MAX_HISTORY_PAGE 500
+
+// Liens de fédération (serveur -f/-F) : pas de nom, des trames dès la connexion
+typedef struct PeerHello {
+    uint64_t server_id;         // tiré au démarrage, unique par processus
+    uint32_t listen_port;       // port -f de l'émetteur, 0 : il n'accepte pas de liens
+    uint32_t flags;             // PEER_FLAG_* (ordre réseau)
+} PeerHello;
+
+// Passerelle de connexions (chat_gateway) : envoie des FRAME_FORWARD, reçoit les relais
+#define PEER_FLAG_GATEWAY 0x01
+
+// Message relayé : origin_seq croît de 1 par message publié par le serveur d'origine
+typedef struct RelayHeader {
+    uint64_t origin_id;
+    uint64_t origin_seq;
+} RelayHeader;
+
+// Réplication vers un secours (serveur -Y / -y) : numéro du dernier message déjà
+// appliqué par le secours, 0 s'il part de rien. Le primaire répond avec son dernier
+// numéro publié : le lien ne compte comme établi qu'à partir de cette réponse.
+typedef struct ReplicaHello {
+    uint64_t last_seq;
+} ReplicaHello;
+
+// FRAME_REPLICA_MEMBER : RESET vide la liste (début d'un instantané), sans nom
+#define REPLICA_JOIN 0x01
+#define REPLICA_LEAVE 0x02
+#define REPLICA_RESET 0x03
+
+// FRAME_REPLICA_DETACH : le primaire ferme le lien de lui-même, le secours retentera
+#define REPLICA_DETACH_FULL 0x01    // trop de secours reliés
+#define REPLICA_DETACH_SLOW 0x02    // secours en retard, file pleine
+
+// Fin d'une page, et du replay à l'arrivée : rien de plus ancien que first_seq n'a été
+// envoyé (prochaine page : before_seq = first_seq). oldest_seq est le plus ancien
+// message encore disponible (0 : aucun) ; first_seq <= oldest_seq : début atteint.
+typedef struct HistoryEnd {
+    uint64_t first_seq;
+    uint64_t oldest_seq;
+} HistoryEnd;
+
+static inline uint64_t proto_hton64(const uint64_t value) {
+    return ((uint64_t)htonl((uint32_t)value) << 32) | htonl((uint32_t)(value >> 32));
+}
+
+static inline uint64_t proto_ntoh64(const uint64_t value) {
+    return proto_hton64(value);
+}
+
+// Connexion au serveur : socket Unix (serveur lancé avec -U) si unix_path est donné,
+// TCP 127.0.0.1:PROTOCOL_PORT sinon. Renvoie le descripteur, ou -1 (errno positionné).
+static inline int proto_connect(const char *unix_path) {
+    if (unix_path) {
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+        if (strlen(unix_path) >= sizeof(address.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strcpy(address.sun_path, unix_path);
+        const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock >= 0 && connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            const int saved = errno;
+            close(sock);
+            errno = saved;
+            return -1;
+        }
+        return sock;
+    }
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(PROTOCOL_PORT)};
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock >= 0 && connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        const int saved = errno;
+        close(sock);
+        errno = saved;
+        return -1;
+    }
+    return sock;
+}
+
+// Envoie exactement len octets ; renvoie 0, ou -1 en cas d'erreur
+static inline int send_all(const int socket, const void *data, size_t len) {
+    const char *cursor = data;
+    while (len > 0) {
+        const ssize_t sent = send(socket, cursor, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        cursor += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+// Reçoit exactement len octets ; renvoie 1 si tout est reçu, 0 si la connexion est
+// fermée, -1 en cas d'erreur
+static inline int recv_all(const int socket, void *data, size_t len) {
+    char *cursor = data;
+    while (len > 0) {
+        const ssize_t received = recv(socket, cursor, len, 0);
+        if (received == 0) return 0;
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        cursor += received;
+        len -= (size_t)received;
+    }
+    return 1;
+}
+
+// Écrit en-tête + données dans out (de taille >= sizeof(FrameHeader) + len) ;
+// renvoie la taille totale de la trame
+static inline size_t encode_frame(void *out, const uint8_t type, const uint8_t flags,
+                                  const void *payload, const size_t len) {
+    FrameHeader header = {
+        .length = htonl((uint32_t)len),
+        .type = type,
+        .flags = flags,
+        .reserved = 0,
+    };
+    memcpy(out, &header, sizeof(header));
+    if (len) memcpy((char *)out + sizeof(header), payload, len);
+    return sizeof(header) + len;
+}
+
+// Envoie une trame en un seul appel (les trames de plusieurs threads ne s'entremêlent
+// pas tant que chaque envoi sur une même socket est protégé par un verrou)
+static inline int send_frame(const int socket, const uint8_t type, const uint8_t flags,
+                             const void *payload, const size_t len) {
+    char frame[sizeof(FrameHeader) + MAX_FRAME_PAYLOAD];
+    if (len > MAX_FRAME_PAYLOAD) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return send_all(socket, frame, encode_frame(frame, type, flags, payload, len));
+}
+
+// Lit une trame complète (taille des données dans header->length) ; renvoie 1 si une
+// trame a été lue, 0 si la connexion est fermée, -1 en cas d'erreur ou de trame
+// trop grande pour payload
+static inline int recv_frame(const int socket, FrameHeader *header, void *payload, const size_t capacity) {
+    const int status = recv_all(socket, header, sizeof(*header));
+    if (status <= 0) return status;
+    header->length = ntohl(header->length);
+    if (header->length > capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (header->length > 0 && recv_all(socket, payload, header->length) <= 0) {
+        return -1;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CHAT_RATELIMIT_H
+#define CHAT_RATELIMIT_H
+
+#include <stdint.h>
+
+// Seau à jetons, en arithmétique entière et sans lecture d'horloge : l'appelant
+// fournit l'heure courante en ms (celle de la boucle d'événements). Les jetons
+// sont comptés en millièmes, si bien qu'un débit de r par seconde ajoute
+// exactement r millièmes par milliseconde.
+
+#define RATE_SCALE 1000
+
+typedef struct RateLimit {
+    uint32_t rate;          // jetons par seconde, 0 = pas de limite
+    uint32_t burst;         // jetons accumulables au maximum
+} RateLimit;
+
+typedef struct TokenBucket {
+    uint64_t tokens;        // en millièmes de jeton
+    uint64_t last_ms;
+} TokenBucket;
+
+// Un seau neuf est plein : la rafale autorisée est disponible immédiatement
+static inline void bucket_init(TokenBucket *bucket, const RateLimit *limit, const uint64_t now_ms) {
+    bucket->tokens = (uint64_t)limit->burst * RATE_SCALE;
+    bucket->last_ms = now_ms;
+}
+
+// Retire cost jetons si possible ; renvoie 0 si le seau est insuffisant (rien n'est retiré)
+static inline int bucket_take(TokenBucket *bucket, const RateLimit *limit, const uint64_t now_ms,
+                              const uint64_t cost) {
+    if (limit->rate == 0) {
+        return 1;
+    }
+    if (now_ms > bucket->last_ms) {
+        const uint64_t cap = (uint64_t)limit->burst * RATE_SCALE;
+        const uint64_t refill = (now_ms - bucket->last_ms) * limit->rate;
+        bucket->tokens = bucket->tokens + refill > cap ? cap : bucket->tokens + refill;
+        bucket->last_ms = now_ms;
+    }
+    if (bucket->tokens < cost * RATE_SCALE) {
+        return 0;
+    }
+    bucket->tokens -= cost * RATE_SCALE;
+    return 1;
+}
+
+// Rend des jetons pris par bucket_take (autre limite dépassée entre-temps)
+static inline void bucket_refund(TokenBucket *bucket, const uint64_t cost) {
+    bucket->tokens += cost * RATE_SCALE;
+}
+
+#endif
@@ -0,0 +1,1026 @@
+#define _GNU_SOURCE
+#include "replica.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lockprof.h"
+#include "log.h"
+#include "protocol.h"
+#include "util.h"
+
+#define MAX_EVENTS 32
+#define READ_CHUNK 65536
+#define IDLE_WAIT_MS 1000
+#define BATCH_WAIT_MS 1         // sous trafic, le thread regroupe ce qui arrive pendant ce délai
+#define MEMBERS_MIN_CAPACITY 64
+
+typedef enum LinkState {
+    LINK_WAITING,               // ReplicaHello pas encore reçu
+    LINK_CATCHING_UP,           // envoi depuis l'historique, à partir de next_seq
+    LINK_LIVE,                  // flux continu des enregistrements
+    LINK_DETACHING,             // lâché : la file se vide, FRAME_REPLICA_DETACH part en dernier
+} LinkState;
+
+// Lien vers un secours, ou (secours) vers le primaire
+typedef struct Link {
+    int socket;
+    int connecting;             // connexion sortante en cours : EPOLLOUT attendu
+    int closed;                 // libéré en fin d'itération
+    int want_write;             // EPOLLOUT armé
+    LinkState state;
+    uint64_t next_seq;          // rattrapage : prochain message lu dans l'historique
+    uint64_t acked_seq;         // dernier numéro acquitté par le secours
+    uint64_t missed;            // déjà évincés de l'historique au rattrapage
+    char address[32];
+    Buffer in;
+    Buffer out;
+    size_t out_offset;          // octets de out déjà envoyés
+    uint64_t bytes_out;
+    uint8_t detach;             // raison à envoyer une fois out vidée, 0 une fois partie
+    int shut;                   // shutdown(SHUT_WR) fait : le secours ferme à son tour
+} Link;
+
+// Membres connectés au primaire : nom -> nombre de connexions sous ce nom
+typedef struct Member {
+    char name[PROTOCOL_NAME_LEN];
+    uint32_t count;             // 0 : case libre
+} Member;
+
+typedef struct MemberTable {
+    Member *slots;
+    size_t capacity;            // puissance de deux
+    size_t names;
+    size_t connections;
+} MemberTable;
+
+struct Replica {
+    int port;
+    int listener;
+    int epoll_fd;
+    int wake_fd;
+    pthread_t thread;
+    int started;
+    _Atomic int stopping;
+    const History *history;
+    _Atomic uint64_t *history_seq;
+    HistoryCursor *cursor;      // rattrapage, thread de réplication seulement
+    ReplicaApply apply;
+    ReplicaPromote promote;
+
+    // Secours : lien vers le primaire, LINK_LIVE dès sa réponse au ReplicaHello, retenté
+    // tant qu'il n'est pas tombé dans cet état
+    struct sockaddr_in primary_address;
+    char primary_name[32];
+    Link *upstream;
+    _Atomic int upstream_live;  // pour l'admin, qui ne lit pas upstream
+    int upstream_failing;       // échec déjà signalé, jusqu'à la prochaine réponse
+    uint64_t retry_ms;
+    _Atomic int standby;
+    _Atomic int promote_requested;
+    _Atomic uint64_t applied_seq;
+    _Atomic uint64_t missed;
+
+    // Secours reliés : table modifiée par le thread, parcourue par l'admin
+    ProfMutex links_mutex;
+    Link *links[REPLICA_MAX_STANDBYS];
+    int link_count;
+
+    // Enregistrements en attente du thread, trames bout à bout, et membres qu'ils
+    // décrivent : un instantané pris sous le même verrou est cohérent avec la boîte
+    ProfMutex outbox_mutex;
+    Buffer outbox;
+    MemberTable members;
+    int active;                 // secours ayant envoyé leur ReplicaHello
+    int sleeping;               // thread en attente : le prochain enregistrement le réveille
+    Buffer sending;             // échangé avec outbox par le thread
+    Buffer snapshot;
+
+    _Atomic uint64_t records;
+    _Atomic uint64_t batches;
+    _Atomic uint64_t caught_up;     // messages envoyés depuis l'historique
+    _Atomic uint64_t overflows;     // enregistrements perdus, thread en retard
+    _Atomic uint64_t links_dropped; // secours trop lents
+};
+
+// En-tête et données d'une trame, d'un seul bloc
+static int buffer_append_frame(Buffer *buffer, const uint8_t type, const uint8_t flags, const void *prefix,
+                               const size_t prefix_len, const void *data, const size_t length) {
+    const FrameHeader header = {.length = htonl((uint32_t)(prefix_len + length)), .type = type, .flags = flags};
+    if (buffer_reserve(buffer, sizeof(header) + prefix_len + length) < 0) {
+        return -1;
+    }
+    char *cursor = buffer->data + buffer->length;
+    memcpy(cursor, &header, sizeof(header));
+    memcpy(cursor + sizeof(header), prefix, prefix_len);
+    memcpy(cursor + sizeof(header) + prefix_len, data, length);
+    buffer->length += sizeof(header) + prefix_len + length;
+    return 0;
+}
+
+static uint64_t name_hash(const char *name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *name; ++name) {
+        hash ^= (unsigned char)*name;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Case du nom, ou case libre où l'insérer (sondage linéaire)
+static size_t members_slot(const MemberTable *table, const char *name) {
+    const size_t mask = table->capacity - 1;
+    size_t i = name_hash(name) & mask;
+    while (table->slots[i].count && strcmp(table->slots[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int members_grow(MemberTable *table) {
+    const size_t capacity = table->capacity ? table->capacity * 2 : MEMBERS_MIN_CAPACITY;
+    Member *slots = calloc(capacity, sizeof(Member));
+    if (!slots) {
+        return -1;
+    }
+    MemberTable grown = {slots, capacity, table->names, table->connections};
+    for (size_t i = 0; i < table->capacity; ++i) {
+        if (table->slots[i].count) {
+            grown.slots[members_slot(&grown, table->slots[i].name)] = table->slots[i];
+        }
+    }
+    free(table->slots);
+    *table = grown;
+    return 0;
+}
+
+// Libère la case i en recollant la suite de sa série (pas de marque de suppression)
+static void members_remove_slot(MemberTable *table, size_t i) {
+    const size_t mask = table->capacity - 1;
+    size_t j = i;
+    for (;;) {
+        table->slots[i].count = 0;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (table->slots[j].count == 0) {
+                return;
+            }
+            // Reste en place si sa case d'origine est dans (i, j]
+            const size_t home = name_hash(table->slots[j].name) & mask;
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+                continue;
+            }
+            break;
+        }
+        table->slots[i] = table->slots[j];
+        i = j;
+    }
+}
+
+static void members_update(MemberTable *table, const char *name, const int joined) {
+    if (joined) {
+        if ((table->names + 1) * 2 > table->capacity && members_grow(table) < 0) {
+            return;
+        }
+        Member *member = &table->slots[members_slot(table, name)];
+        if (member->count == 0) {
+            snprintf(member->name, sizeof(member->name), "%s", name);
+            table->names++;
+        }
+        member->count++;
+        table->connections++;
+        return;
+    }
+    if (table->capacity == 0) {
+        return;
+    }
+    const size_t i = members_slot(table, name);
+    if (table->slots[i].count == 0) {
+        return;
+    }
+    table->connections--;
+    if (--table->slots[i].count == 0) {
+        table->names--;
+        members_remove_slot(table, i);
+    }
+}
+
+static void members_clear(MemberTable *table) {
+    if (table->slots) {
+        memset(table->slots, 0, table->capacity * sizeof(Member));
+    }
+    table->names = 0;
+    table->connections = 0;
+}
+
+static void replica_wake(Replica *replica) {
+    const uint64_t one = 1;
+    if (write(replica->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_errno("Error waking the replication thread", errno);
+    }
+}
+
+// Changement de la liste des membres et son enregistrement pour les secours
+static void member_record(Replica *replica, const uint8_t op, const char *name) {
+    prof_lock(&replica->outbox_mutex);
+    if (op == REPLICA_RESET) {
+        members_clear(&replica->members);
+    } else {
+        members_update(&replica->members, name, op == REPLICA_JOIN);
+    }
+    // Aucun secours à suivre : la table suffit pour le prochain instantané
+    if (replica->active == 0) {
+        prof_unlock(&replica->outbox_mutex);
+        return;
+    }
+    const size_t length = op == REPLICA_RESET ? 0 : strnlen(name, PROTOCOL_NAME_LEN - 1);
+    const int status = buffer_append_frame(&replica->outbox, FRAME_REPLICA_MEMBER, op, NULL, 0, name, length);
+    const int wake = status == 0 && replica->sleeping;
+    replica->sleeping &= !wake;
+    prof_unlock(&replica->outbox_mutex);
+    if (status < 0) {
+        atomic_fetch_add_explicit(&replica->overflows, 1, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_add_explicit(&replica->records, 1, memory_order_relaxed);
+    if (wake) {
+        replica_wake(replica);
+    }
+}
+
+static void link_update_events(Replica *replica, Link *link, const int want_write) {
+    if (link->want_write == want_write) {
+        return;
+    }
+    link->want_write = want_write;
+    struct epoll_event event = {.events = EPOLLIN | (want_write ? EPOLLOUT : 0), .data.ptr = link};
+    epoll_ctl(replica->epoll_fd, EPOLL_CTL_MOD, link->socket, &event);
+}
+
+static void link_close(Link *link) {
+    link->closed = 1;
+}
+
+// Envoie ce qui peut l'être sans bloquer ; le reste attend EPOLLOUT. Un lien lâché
+// ajoute FRAME_REPLICA_DETACH une fois sa file vidée, donc sur une fin de trame.
+static void link_write(Replica *replica, Link *link) {
+    if (link->detach && link->out_offset == link->out.length) {
+        char frame[sizeof(FrameHeader)];
+        link->out.length = 0;
+        link->out_offset = 0;
+        if (buffer_append(&link->out, frame, encode_frame(frame, FRAME_REPLICA_DETACH, link->detach, NULL, 0)) < 0) {
+            link_close(link);
+            return;
+        }
+        link->detach = 0;
+    }
+    while (link->out_offset < link->out.length) {
+        const ssize_t sent = send(link->socket, link->out.data + link->out_offset,
+                                  link->out.length - link->out_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                link_close(link);
+                return;
+            }
+            break;
+        }
+        link->out_offset += (size_t)sent;
+        link->bytes_out += (uint64_t)sent;
+    }
+    if (link->out_offset == link->out.length) {
+        link->out.length = 0;
+        link->out_offset = 0;
+        if (link->detach) {
+            link_write(replica, link);
+            return;
+        }
+        if (link->state == LINK_DETACHING && !link->shut) {
+            // Fin côté primaire : le secours lit l'adieu puis ferme, on lit jusqu'à EOF
+            shutdown(link->socket, SHUT_WR);
+            link->shut = 1;
+        }
+    } else if (link->out_offset > link->out.length / 2) {
+        memmove(link->out.data, link->out.data + link->out_offset, link->out.length - link->out_offset);
+        link->out.length -= link->out_offset;
+        link->out_offset = 0;
+    }
+    link_update_events(replica, link, link->out.length > 0);
+}
+
+static size_t link_queued(const Link *link) {
+    return link->out.length - link->out_offset;
+}
+
+// Secours qui ne reçoit plus les enregistrements
+static void link_deactivate(Replica *replica, Link *link) {
+    if (link->state == LINK_CATCHING_UP || link->state == LINK_LIVE) {
+        prof_lock(&replica->outbox_mutex);
+        replica->active--;
+        prof_unlock(&replica->outbox_mutex);
+    }
+}
+
+// Lâche un secours sans le promouvoir : il reçoit la fin de sa file puis la raison,
+// et ne voit la fermeture qu'après. Fermer tout de suite ressemblerait à une panne.
+static void link_detach(Replica *replica, Link *link, const uint8_t reason) {
+    link_deactivate(replica, link);
+    link->state = LINK_DETACHING;
+    link->detach = reason;
+    link_write(replica, link);
+}
+
+// Ajoute des trames à la file du lien ; elles partent au prochain link_write
+static void link_queue(Replica *replica, Link *link, const char *frames, const size_t length) {
+    if (link->closed || link->state == LINK_DETACHING || length == 0) {
+        return;
+    }
+    if (link_queued(link) + length > REPLICA_MAX_OUT) {
+        char line[96];
+        snprintf(line, sizeof(line), "Standby %s too slow, link dropped", link->address);
+        log_text(LOG_WARN, line);
+        atomic_fetch_add_explicit(&replica->links_dropped, 1, memory_order_relaxed);
+        link_detach(replica, link, REPLICA_DETACH_SLOW);
+        return;
+    }
+    if (buffer_append(&link->out, frames, length) < 0) {
+        link_close(link);
+    }
+}
+
+static Link *link_add(Replica *replica, const int socket, const int connecting) {
+    Link *link = calloc(1, sizeof(Link));
+    if (!link) {
+        return NULL;
+    }
+    link->socket = socket;
+    link->connecting = connecting;
+    link->want_write = connecting;
+    struct epoll_event event = {.events = connecting ? EPOLLOUT : EPOLLIN, .data.ptr = link};
+    if (epoll_ctl(replica->epoll_fd, EPOLL_CTL_ADD, socket, &event) < 0) {
+        free(link);
+        return NULL;
+    }
+    const int enable = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    struct sockaddr_in address;
+    socklen_t address_len = sizeof(address);
+    char ip[INET_ADDRSTRLEN] = "?";
+    if (getpeername(socket, (struct sockaddr *)&address, &address_len) == 0) {
+        inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+    }
+    snprintf(link->address, sizeof(link->address), "%s:%d", ip, ntohs(address.sin_port));
+    return link;
+}
+
+static void link_free(Link *link) {
+    close(link->socket);
+    free(link->in.data);
+    free(link->out.data);
+    free(link);
+}
+
+// Promotion : le lien vers le primaire est abandonné, les membres qu'il annonçait
+// sont partis avec lui
+static void replica_become_primary(Replica *replica, const char *reason) {
+    if (!atomic_exchange(&replica->standby, 0)) {
+        return;
+    }
+    if (replica->upstream) {
+        link_close(replica->upstream);
+    }
+    prof_lock(&replica->outbox_mutex);
+    const size_t members = replica->members.connections;
+    prof_unlock(&replica->outbox_mutex);
+    member_record(replica, REPLICA_RESET, "");
+    const uint64_t last_seq = atomic_load(&replica->applied_seq);
+    char line[160];
+    snprintf(line, sizeof(line), "Promoted to primary (%s) at message #%llu, %zu members were connected to %s",
+             reason, (unsigned long long)last_seq, members, replica->primary_name);
+    log_text(LOG_WARN, line);
+    replica->promote(last_seq);
+}
+
+// Message du primaire : appliqué dans l'ordre, les manquants remplacés par du vide
+static void upstream_message(Replica *replica, const char *payload, const size_t length) {
+    uint64_t seq;
+    memcpy(&seq, payload, sizeof(seq));
+    seq = proto_ntoh64(seq);
+    const uint64_t applied = atomic_load_explicit(&replica->applied_seq, memory_order_relaxed);
+    if (seq <= applied) {
+        return;
+    }
+    if (applied && seq > applied + 1) {
+        atomic_fetch_add_explicit(&replica->missed, seq - applied - 1, memory_order_relaxed);
+        for (uint64_t missing = applied + 1; missing < seq; ++missing) {
+            replica->apply(missing, "", 0);
+        }
+    }
+    replica->apply(seq, payload + sizeof(seq), length - sizeof(seq));
+    atomic_store_explicit(&replica->applied_seq, seq, memory_order_relaxed);
+}
+
+static void link_handle_frame(Replica *replica, Link *link, const FrameHeader *header, const char *payload) {
+    switch (header->type) {
+        case FRAME_REPLICA_HELLO: {
+            ReplicaHello hello;
+            if (link->state != LINK_WAITING || header->length != sizeof(hello)) {
+                break;
+            }
+            memcpy(&hello, payload, sizeof(hello));
+            const uint64_t last_seq = proto_ntoh64(hello.last_seq);
+            if (link == replica->upstream) {
+                // Réponse du primaire : à partir d'ici, perdre le lien promeut le secours
+                link->state = LINK_LIVE;
+                atomic_store(&replica->upstream_live, 1);
+                replica->upstream_failing = 0;
+                char line[128];
+                snprintf(line, sizeof(line), "Replicating from primary %s, at message #%llu (primary at #%llu)",
+                         replica->primary_name, (unsigned long long)atomic_load(&replica->applied_seq),
+                         (unsigned long long)last_seq);
+                log_text(LOG_INFO, line);
+                break;
+            }
+            // Réponse avant le rattrapage : le secours sait le lien établi
+            const ReplicaHello reply = {proto_hton64(atomic_load_explicit(replica->history_seq, memory_order_acquire))};
+            char frame[sizeof(FrameHeader) + sizeof(reply)];
+            link_queue(replica, link, frame, encode_frame(frame, FRAME_REPLICA_HELLO, 0, &reply, sizeof(reply)));
+            link->next_seq = last_seq + 1;
+            link->acked_seq = last_seq;
+            link->state = LINK_CATCHING_UP;
+            // Les messages publiés avant sont dans l'historique (history_seq est écrit
+            // avant replica_message), les suivants arrivent dans la boîte
+            prof_lock(&replica->outbox_mutex);
+            replica->active++;
+            prof_unlock(&replica->outbox_mutex);
+            char line[128];
+            snprintf(line, sizeof(line), "Standby %s attached, catching up from message #%llu", link->address,
+                     (unsigned long long)link->next_seq);
+            log_text(LOG_INFO, line);
+            break;
+        }
+        case FRAME_REPLICA_ACK: {
+            uint64_t seq;
+            if (header->length == sizeof(seq)) {
+                memcpy(&seq, payload, sizeof(seq));
+                link->acked_seq = proto_ntoh64(seq);
+            }
+            break;
+        }
+        case FRAME_REPLICA_MESSAGE:
+            if (link == replica->upstream && link->state == LINK_LIVE && header->length >= sizeof(uint64_t)) {
+                upstream_message(replica, payload, header->length);
+            }
+            break;
+        case FRAME_REPLICA_MEMBER:
+            if (link == replica->upstream && link->state == LINK_LIVE &&
+                (header->flags == REPLICA_RESET || header->length > 0)) {
+                char name[PROTOCOL_NAME_LEN];
+                const size_t length = header->length < sizeof(name) - 1 ? header->length : sizeof(name) - 1;
+                memcpy(name, payload, length);
+                name[length] = '\0';
+                member_record(replica, header->flags, name);
+            }
+            break;
+        case FRAME_REPLICA_DETACH:
+            if (link == replica->upstream) {
+                if (!replica->upstream_failing) {
+                    char line[128];
+                    snprintf(line, sizeof(line), "Primary %s %s, retrying", replica->primary_name,
+                             header->flags == REPLICA_DETACH_FULL ? "has too many standbys"
+                                                                  : "dropped this standby (too slow)");
+                    log_text(LOG_WARN, line);
+                    replica->upstream_failing = 1;
+                }
+                link->state = LINK_DETACHING;
+                replica->retry_ms = monotonic_ms() + REPLICA_REJOIN_MS;
+                link_close(link);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void link_read(Replica *replica, Link *link) {
+    const uint64_t applied = atomic_load_explicit(&replica->applied_seq, memory_order_relaxed);
+    while (!link->closed) {
+        if (buffer_reserve(&link->in, READ_CHUNK) < 0) {
+            link_close(link);
+            return;
+        }
+        const ssize_t received = recv(link->socket, link->in.data + link->in.length, READ_CHUNK, 0);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                link_close(link);
+            }
+            break;
+        }
+        link->in.length += (size_t)received;
+
+        size_t offset = 0;
+        while (!link->closed && link->in.length - offset >= sizeof(FrameHeader)) {
+            FrameHeader header;
+            memcpy(&header, link->in.data + offset, sizeof(header));
+            header.length = ntohl(header.length);
+            if (header.length > MAX_FRAME_PAYLOAD + sizeof(uint64_t)) {
+                log_text(LOG_WARN, "Oversized replication frame, link closed");
+                link_close(link);
+                break;
+            }
+            if (link->in.length - offset < sizeof(header) + header.length) {
+                break;
+            }
+            link_handle_frame(replica, link, &header, link->in.data + offset + sizeof(header));
+            offset += sizeof(header) + header.length;
+        }
+        memmove(link->in.data, link->in.data + offset, link->in.length - offset);
+        link->in.length -= offset;
+    }
+    // Secours : un acquittement par lecture, pour le retard affiché par le primaire
+    const uint64_t now_applied = atomic_load_explicit(&replica->applied_seq, memory_order_relaxed);
+    if (link == replica->upstream && now_applied != applied && !link->closed) {
+        const uint64_t wire_seq = proto_hton64(now_applied);
+        char frame[sizeof(FrameHeader) + sizeof(wire_seq)];
+        link_queue(replica, link, frame, encode_frame(frame, FRAME_REPLICA_ACK, 0, &wire_seq, sizeof(wire_seq)));
+        link_write(replica, link);
+    }
+}
+
+// Secours : connexion au primaire (non bloquante), retentée tant qu'il n'est pas promu
+static void upstream_connect(Replica *replica) {
+    const uint64_t now_ms = monotonic_ms();
+    if (!atomic_load(&replica->standby) || replica->upstream || now_ms < replica->retry_ms) {
+        return;
+    }
+    replica->retry_ms = now_ms + REPLICA_RETRY_MS;
+    const int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return;
+    }
+    const int status = connect(sock, (struct sockaddr *)&replica->primary_address, sizeof(replica->primary_address));
+    if (status < 0 && errno != EINPROGRESS) {
+        close(sock);
+        return;
+    }
+    replica->upstream = link_add(replica, sock, 1);
+    if (!replica->upstream) {
+        close(sock);
+    }
+}
+
+static void upstream_connected(Replica *replica, Link *link) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(link->socket, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+        error = errno;
+    }
+    if (error) {
+        link_close(link);
+        return;
+    }
+    link->connecting = 0;
+    snprintf(link->address, sizeof(link->address), "%s", replica->primary_name);
+    const ReplicaHello hello = {proto_hton64(atomic_load(&replica->applied_seq))};
+    char frame[sizeof(FrameHeader) + sizeof(hello)];
+    link_queue(replica, link, frame, encode_frame(frame, FRAME_REPLICA_HELLO, 0, &hello, sizeof(hello)));
+    link_write(replica, link);
+}
+
+static void replica_accept(Replica *replica) {
+    for (;;) {
+        const int sock = accept4(replica->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_errno("Replication accept", errno);
+            }
+            return;
+        }
+        Link *link = replica->link_count < REPLICA_MAX_STANDBYS ? link_add(replica, sock, 0) : NULL;
+        if (!link) {
+            // Le secours refusé n'a pas reçu de ReplicaHello : même sans cette trame,
+            // la fermeture ne le promeut pas
+            log_text(LOG_WARN, "Standby refused, too many standbys");
+            char frame[sizeof(FrameHeader)];
+            send(sock, frame, encode_frame(frame, FRAME_REPLICA_DETACH, REPLICA_DETACH_FULL, NULL, 0),
+                 MSG_NOSIGNAL | MSG_DONTWAIT);
+            close(sock);
+            continue;
+        }
+        prof_lock(&replica->links_mutex);
+        replica->links[replica->link_count++] = link;
+        prof_unlock(&replica->links_mutex);
+    }
+}
+
+// Rattrapage par tranches : au plus REPLICA_CATCHUP_QUEUE octets en file, le reste au
+// prochain tour. Un message évincé entre-temps est sauté : le secours le verra manquer.
+static void link_catch_up(Replica *replica, Link *link, const uint64_t last) {
+    const uint64_t first = history_first(replica->history);
+    if (link->next_seq < first) {
+        link->missed += first - link->next_seq;
+        link->next_seq = first;
+    }
+    while (link->next_seq <= last && link_queued(link) < REPLICA_CATCHUP_QUEUE && !link->closed) {
+        size_t length;
+        const char *text = history_get(replica->history, replica->cursor, link->next_seq, &length);
+        if (text) {
+            const uint64_t wire_seq = proto_hton64(link->next_seq);
+            Buffer frame = {0};
+            if (buffer_append_frame(&frame, FRAME_REPLICA_MESSAGE, 0, &wire_seq, sizeof(wire_seq), text, length) == 0) {
+                link_queue(replica, link, frame.data, frame.length);
+            }
+            free(frame.data);
+            atomic_fetch_add_explicit(&replica->caught_up, 1, memory_order_relaxed);
+        } else {
+            link->missed++;
+        }
+        link->next_seq++;
+    }
+}
+
+// Messages de la boîte pour un secours qui vient de rattraper l'historique : ceux
+// qu'il a déjà reçus sont sautés, les membres sont dans l'instantané
+static void link_queue_after(Replica *replica, Link *link, const Buffer *pending) {
+    for (size_t offset = 0; offset < pending->length;) {
+        FrameHeader header;
+        memcpy(&header, pending->data + offset, sizeof(header));
+        const size_t frame_len = sizeof(header) + ntohl(header.length);
+        if (header.type == FRAME_REPLICA_MESSAGE) {
+            uint64_t seq;
+            memcpy(&seq, pending->data + offset + sizeof(header), sizeof(seq));
+            if (proto_ntoh64(seq) >= link->next_seq) {
+                link_queue(replica, link, pending->data + offset, frame_len);
+            }
+        }
+        offset += frame_len;
+    }
+}
+
+// Expédie la boîte ; 0 si elle était vide (le thread peut alors dormir)
+static int replica_flush(Replica *replica) {
+    // Lu avant l'échange : tout message suivant est dans la boîte échangée ou la prochaine
+    const uint64_t last = atomic_load_explicit(replica->history_seq, memory_order_acquire);
+    int going_live = 0;
+    for (int i = 0; i < replica->link_count; ++i) {
+        Link *link = replica->links[i];
+        if (link->state == LINK_CATCHING_UP && !link->closed) {
+            link_catch_up(replica, link, last);
+            going_live |= link->next_seq > last;
+        }
+    }
+
+    prof_lock(&replica->outbox_mutex);
+    const Buffer pending = replica->outbox;
+    replica->outbox = replica->sending;
+    replica->outbox.length = 0;
+    replica->sleeping = pending.length == 0;
+    replica->snapshot.length = 0;
+    if (going_live) {
+        buffer_append_frame(&replica->snapshot, FRAME_REPLICA_MEMBER, REPLICA_RESET, NULL, 0, NULL, 0);
+        for (size_t i = 0; i < replica->members.capacity; ++i) {
+            const Member *member = &replica->members.slots[i];
+            for (uint32_t k = 0; k < member->count; ++k) {
+                buffer_append_frame(&replica->snapshot, FRAME_REPLICA_MEMBER, REPLICA_JOIN, NULL, 0, member->name,
+                                    strlen(member->name));
+            }
+        }
+    }
+    prof_unlock(&replica->outbox_mutex);
+
+    if (pending.length > 0) {
+        atomic_fetch_add_explicit(&replica->batches, 1, memory_order_relaxed);
+    }
+    for (int i = 0; i < replica->link_count; ++i) {
+        Link *link = replica->links[i];
+        if (link->closed) {
+            continue;
+        }
+        if (link->state == LINK_LIVE) {
+            link_queue(replica, link, pending.data, pending.length);
+        } else if (link->state == LINK_CATCHING_UP && link->next_seq > last) {
+            link_queue(replica, link, replica->snapshot.data, replica->snapshot.length);
+            link_queue_after(replica, link, &pending);
+            link->state = LINK_LIVE;
+            char line[128];
+            snprintf(line, sizeof(line), "Standby %s caught up at message #%llu (%llu missed)", link->address,
+                     (unsigned long long)last, (unsigned long long)link->missed);
+            log_text(LOG_INFO, line);
+        }
+        if (link_queued(link) > 0) {
+            link_write(replica, link);
+        }
+    }
+    replica->sending = pending;
+    return pending.length > 0;
+}
+
+// Libère les liens fermés ; le primaire perdu en plein flux promeut le secours
+static void replica_reap(Replica *replica) {
+    for (int i = 0; i < replica->link_count;) {
+        Link *link = replica->links[i];
+        if (!link->closed) {
+            ++i;
+            continue;
+        }
+        link_deactivate(replica, link);
+        if (link->state != LINK_WAITING) {
+            char line[96];
+            snprintf(line, sizeof(line), "Standby %s detached", link->address);
+            log_text(LOG_INFO, line);
+        }
+        epoll_ctl(replica->epoll_fd, EPOLL_CTL_DEL, link->socket, NULL);
+        prof_lock(&replica->links_mutex);
+        replica->links[i] = replica->links[--replica->link_count];
+        prof_unlock(&replica->links_mutex);
+        link_free(link);
+    }
+    Link *upstream = replica->upstream;
+    if (upstream && upstream->closed) {
+        epoll_ctl(replica->epoll_fd, EPOLL_CTL_DEL, upstream->socket, NULL);
+        const int was_live = upstream->state == LINK_LIVE;
+        replica->upstream = NULL;
+        atomic_store(&replica->upstream_live, 0);
+        link_free(upstream);
+        if (was_live) {
+            replica_become_primary(replica, "link to the primary lost");
+        } else if (!replica->upstream_failing && atomic_load(&replica->standby)) {
+            // Refus, mauvais port, fermeture avant la réponse : rien ne prouve une panne
+            char line[96];
+            snprintf(line, sizeof(line), "Primary %s unreachable, retrying", replica->primary_name);
+            log_text(LOG_WARN, line);
+            replica->upstream_failing = 1;
+        }
+    }
+}
+
+static int replica_busy(const Replica *replica) {
+    for (int i = 0; i < replica->link_count; ++i) {
+        const Link *link = replica->links[i];
+        if (link->state == LINK_CATCHING_UP && !link->closed && link_queued(link) < REPLICA_CATCHUP_QUEUE) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *replica_thread(void *arg) {
+    Replica *replica = arg;
+    struct epoll_event events[MAX_EVENTS];
+    int shipped = 0;
+    while (!atomic_load_explicit(&replica->stopping, memory_order_relaxed)) {
+        upstream_connect(replica);
+        int timeout = IDLE_WAIT_MS;
+        if (replica_busy(replica)) {
+            timeout = 0;
+        } else if (shipped) {
+            timeout = BATCH_WAIT_MS;
+        } else if (atomic_load(&replica->standby) && !replica->upstream) {
+            timeout = REPLICA_RETRY_MS;
+        }
+        const int count = epoll_wait(replica->epoll_fd, events, MAX_EVENTS, timeout);
+        if (count < 0 && errno != EINTR) {
+            log_errno("Replication epoll_wait", errno);
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &replica->listener) {
+                replica_accept(replica);
+            } else if (ptr == &replica->wake_fd) {
+                uint64_t value;
+                if (read(replica->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    log_errno("Error reading the replication eventfd", errno);
+                }
+            } else {
+                Link *link = ptr;
+                if (link->closed) {
+                    continue;
+                }
+                if (link->connecting) {
+                    upstream_connected(replica, link);
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    link_read(replica, link);
+                }
+                if ((events[i].events & EPOLLOUT) && !link->closed) {
+                    link_write(replica, link);
+                }
+            }
+        }
+        if (atomic_exchange(&replica->promote_requested, 0)) {
+            replica_become_primary(replica, "requested");
+        }
+        shipped = replica_flush(replica);
+        replica_reap(replica);
+    }
+    return NULL;
+}
+
+Replica *replica_create(const int port, const char *primary, const History *history, _Atomic uint64_t *history_seq,
+                        const ReplicaApply apply, const ReplicaPromote promote) {
+    Replica *replica = calloc(1, sizeof(Replica));
+    HistoryCursor *cursor = malloc(sizeof(HistoryCursor));
+    if (!replica || !cursor) {
+        free(replica);
+        free(cursor);
+        errno = ENOMEM;
+        return NULL;
+    }
+    history_cursor_init(cursor);
+    replica->links_mutex = (ProfMutex)PROF_MUTEX_INITIALIZER("replica_links");
+    replica->outbox_mutex = (ProfMutex)PROF_MUTEX_INITIALIZER("replica_outbox");
+    replica->sleeping = 1;
+    replica->port = port;
+    replica->listener = -1;
+    replica->history = history;
+    replica->history_seq = history_seq;
+    replica->cursor = cursor;
+    replica->apply = apply;
+    replica->promote = promote;
+
+    if (primary) {
+        if (parse_address(primary, &replica->primary_address, replica->primary_name,
+                          sizeof(replica->primary_name)) < 0) {
+            free(cursor);
+            free(replica);
+            return NULL;
+        }
+        atomic_store(&replica->standby, 1);
+    }
+
+    replica->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    replica->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int status = replica->epoll_fd < 0 || replica->wake_fd < 0 ? -1 : 0;
+    if (status == 0 && port > 0) {
+        replica->listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        const int reuse = 1;
+        struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons((uint16_t)port)};
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (replica->listener < 0 || setsockopt(replica->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+            bind(replica->listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            listen(replica->listener, SOMAXCONN) < 0) {
+            status = -1;
+        }
+    }
+    if (status < 0) {
+        const int saved = errno;
+        if (replica->listener >= 0) {
+            close(replica->listener);
+        }
+        if (replica->wake_fd >= 0) {
+            close(replica->wake_fd);
+        }
+        if (replica->epoll_fd >= 0) {
+            close(replica->epoll_fd);
+        }
+        free(cursor);
+        free(replica);
+        errno = saved;
+        return NULL;
+    }
+    return replica;
+}
+
+int replica_start(Replica *replica) {
+    struct epoll_event wake = {.events = EPOLLIN, .data.ptr = &replica->wake_fd};
+    struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = &replica->listener};
+    if (epoll_ctl(replica->epoll_fd, EPOLL_CTL_ADD, replica->wake_fd, &wake) < 0 ||
+        (replica->listener >= 0 &&
+         epoll_ctl(replica->epoll_fd, EPOLL_CTL_ADD, replica->listener, &listen_event) < 0)) {
+        return -1;
+    }
+    const int status = pthread_create(&replica->thread, NULL, replica_thread, replica);
+    if (status != 0) {
+        errno = status;
+        return -1;
+    }
+    replica->started = 1;
+    return 0;
+}
+
+void replica_stop(Replica *replica) {
+    if (replica->started) {
+        atomic_store(&replica->stopping, 1);
+        replica_wake(replica);
+        pthread_join(replica->thread, NULL);
+    }
+    for (int i = 0; i < replica->link_count; ++i) {
+        link_free(replica->links[i]);
+    }
+    if (replica->upstream) {
+        link_free(replica->upstream);
+    }
+    if (replica->listener >= 0) {
+        close(replica->listener);
+    }
+    close(replica->wake_fd);
+    close(replica->epoll_fd);
+    free(replica->outbox.data);
+    free(replica->sending.data);
+    free(replica->snapshot.data);
+    free(replica->members.slots);
+    free(replica->cursor);
+    free(replica);
+}
+
+void replica_message(Replica *replica, const uint64_t seq, const char *text, size_t length) {
+    if (length > MAX_FRAME_PAYLOAD) {
+        length = MAX_FRAME_PAYLOAD;
+    }
+    const uint64_t wire_seq = proto_hton64(seq);
+    prof_lock(&replica->outbox_mutex);
+    // Aucun secours à suivre : un arrivant trouvera ce message dans l'historique
+    if (replica->active == 0) {
+        prof_unlock(&replica->outbox_mutex);
+        return;
+    }
+    const int status = replica->outbox.length + length > REPLICA_MAX_OUT
+                           ? -1
+                           : buffer_append_frame(&replica->outbox, FRAME_REPLICA_MESSAGE, 0, &wire_seq,
+                                                 sizeof(wire_seq), text, length);
+    // Un seul réveil par rafale : tant que le trafic continue, le thread repasse de
+    // lui-même toutes les BATCH_WAIT_MS
+    const int wake = status == 0 && replica->sleeping;
+    replica->sleeping &= !wake;
+    prof_unlock(&replica->outbox_mutex);
+    if (status < 0) {
+        atomic_fetch_add_explicit(&replica->overflows, 1, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_add_explicit(&replica->records, 1, memory_order_relaxed);
+    if (wake) {
+        replica_wake(replica);
+    }
+}
+
+void replica_member(Replica *replica, const char *name, const int joined) {
+    member_record(replica, joined ? REPLICA_JOIN : REPLICA_LEAVE, name);
+}
+
+void replica_promote(Replica *replica) {
+    atomic_store(&replica->promote_requested, 1);
+    replica_wake(replica);
+}
+
+// Lecture sans verrou des compteurs des liens : valeurs indicatives
+void replica_dump(Replica *replica, FILE *out) {
+    const uint64_t last = atomic_load(replica->history_seq);
+    if (atomic_load(&replica->standby)) {
+        fprintf(out, "replica: standby of %s, %s, applied message #%llu (%llu missed)\n", replica->primary_name,
+                atomic_load(&replica->upstream_live) ? "replicating" : "waiting for the primary",
+                (unsigned long long)atomic_load(&replica->applied_seq),
+                (unsigned long long)atomic_load(&replica->missed));
+    } else {
+        fprintf(out, "replica: primary%s%s, last message #%llu\n", replica->primary_name[0] ? ", promoted from standby of " : "",
+                replica->primary_name, (unsigned long long)last);
+    }
+    prof_lock(&replica->outbox_mutex);
+    fprintf(out, "%zu members connected (%zu names)\n", replica->members.connections, replica->members.names);
+    prof_unlock(&replica->outbox_mutex);
+    if (replica->listener < 0) {
+        return;
+    }
+    fprintf(out, "shipped %llu records in %llu batches (%llu lost, replication thread behind), "
+                 "%llu messages sent from the history to catch up\n",
+            (unsigned long long)atomic_load(&replica->records), (unsigned long long)atomic_load(&replica->batches),
+            (unsigned long long)atomic_load(&replica->overflows), (unsigned long long)atomic_load(&replica->caught_up));
+
+    prof_lock(&replica->links_mutex);
+    fprintf(out, "accepting standbys on port %d, %d linked\n", replica->port, replica->link_count);
+    for (int i = 0; i < replica->link_count; ++i) {
+        const Link *link = replica->links[i];
+        fprintf(out, "  %-21s ", link->address);
+        if (link->state == LINK_WAITING) {
+            fprintf(out, "waiting for hello");
+        } else if (link->state == LINK_CATCHING_UP) {
+            fprintf(out, "catching up, at message #%llu", (unsigned long long)link->next_seq);
+        } else if (link->state == LINK_DETACHING) {
+            fprintf(out, "detaching, %s", link->shut ? "waiting for the standby to close" : "draining");
+        } else {
+            fprintf(out, "live, acked #%llu (%llu behind)", (unsigned long long)link->acked_seq,
+                    (unsigned long long)(last > link->acked_seq ? last - link->acked_seq : 0));
+        }
+        fprintf(out, ", %llu missed, sent %llu KB, %zu KB queued\n", (unsigned long long)link->missed,
+                (unsigned long long)(link->bytes_out >> 10), link_queued(link) >> 10);
+    }
+    prof_unlock(&replica->links_mutex);
+    fprintf(out, "dropped %llu standbys that stopped reading (over %d MB queued)\n",
+            (unsigned long long)atomic_load(&replica->links_dropped), REPLICA_MAX_OUT >> 20);
+}
@@ -0,0 +1,71 @@
+#ifndef CHAT_REPLICA_H
+#define CHAT_REPLICA_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "history.h"
+
+// Réplication asynchrone vers des serveurs de secours (serveur -Y port pour les
+// accepter, -y host:port pour en être un).
+//
+// Le primaire expédie, dans l'ordre de diffusion, chaque message numéroté et chaque
+// arrivée ou départ d'un membre. Les enregistrements s'accumulent dans une boîte sous
+// le verrou qui fixe l'ordre et partent par lots depuis un thread dédié : la diffusion
+// ne fait qu'une copie en mémoire, jamais d'appel système ni d'attente du secours, qui
+// n'acquitte que pour mesurer son retard.
+//
+// Un secours qui arrive (ou revient) annonce son dernier numéro : le primaire le
+// rattrape depuis son historique en mémoire, par tranches, puis lui envoie la liste
+// des membres et passe au flux continu. Des messages déjà évincés de l'historique
+// manquent au secours ; ils sont comptés et remplacés par des textes vides.
+//
+// Le secours refuse les clients (FRAME_BUSY) et applique le flux à son historique
+// (et à son journal -D) avec les mêmes numéros. Quand le lien vers le primaire tombe
+// alors que le primaire avait répondu à son ReplicaHello (plantage, arrêt), il est
+// promu sur-le-champ : il accepte ses clients et numérote la suite, sans autre perte
+// que les messages encore en route. Un primaire redémarré doit revenir comme secours
+// du serveur promu. Un secours refusé ou lâché par le primaire (FRAME_REPLICA_DETACH),
+// ou dont le lien tombe avant la réponse, n'est pas promu : il retente plus tard.
+
+#define REPLICA_MAX_STANDBYS 8
+#define REPLICA_MAX_OUT (64 << 20)
+#define REPLICA_CATCHUP_QUEUE (1 << 20)     // rattrapage : octets en file au plus
+#define REPLICA_RETRY_MS 100                // secours : attente du primaire injoignable
+#define REPLICA_REJOIN_MS 1000              // secours refusé ou lâché : attente avant de revenir
+
+typedef struct Replica Replica;
+
+// Secours, thread de réplication : message du primaire à stocker (numéros croissants,
+// sans trou). Appelée aussi avec un texte vide pour un message manquant.
+typedef void (*ReplicaApply)(uint64_t seq, const char *text, size_t length);
+// Secours promu (thread de réplication ou admin) : le serveur accepte ses clients
+typedef void (*ReplicaPromote)(uint64_t last_seq);
+
+// port : secours acceptés sur 127.0.0.1, 0 pour aucun. primary : "host:port" (ou
+// "port") du primaire dont ce serveur est le secours, NULL s'il est primaire.
+// history et history_seq : historique du serveur et dernier numéro publié, lus pour
+// rattraper un secours. NULL en cas d'erreur (errno positionné).
+Replica *replica_create(int port, const char *primary, const History *history, _Atomic uint64_t *history_seq,
+                        ReplicaApply apply, ReplicaPromote promote);
+
+int replica_start(Replica *replica);
+void replica_stop(Replica *replica);
+
+// Message diffusé (ou appliqué) : à appeler dans l'ordre des numéros, sous le verrou
+// qui le fixe, une fois seq publié dans history_seq. Ne bloque pas ; sans secours
+// relié, ne fait rien.
+void replica_message(Replica *replica, uint64_t seq, const char *text, size_t length);
+
+// Arrivée (joined = 1) ou départ d'un membre, sous le verrou de la table des membres
+void replica_member(Replica *replica, const char *name, int joined);
+
+// Promotion manuelle d'un secours (admin) ; sans effet sur un primaire
+void replica_promote(Replica *replica);
+
+// Rôle, secours reliés et leur retard, membres connus
+void replica_dump(Replica *replica, FILE *out);
+
+#endif
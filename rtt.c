@@ -0,0 +1,66 @@
+#include "rtt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+uint64_t rtt_clock_ns(void) {
+    return monotonic_ns();
+}
+
+void rtt_add(RttStats *stats, const uint64_t rtt_ns) {
+    const uint64_t rtt_us = rtt_ns / 1000;
+    stats->samples_us[stats->next] = rtt_us > UINT32_MAX ? UINT32_MAX : (uint32_t)rtt_us;
+    stats->next = (stats->next + 1) % RTT_WINDOW;
+    if (stats->count < RTT_WINDOW) {
+        stats->count++;
+    }
+    stats->total++;
+}
+
+static int compare_u32(const void *lhs, const void *rhs) {
+    const uint32_t a = *(const uint32_t *)lhs;
+    const uint32_t b = *(const uint32_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+void rtt_summary_of(uint32_t *samples_us, const size_t count, RttSummary *summary) {
+    memset(summary, 0, sizeof(*summary));
+    summary->count = (unsigned)count;
+    if (count == 0) {
+        return;
+    }
+
+    summary->last_ms = samples_us[count - 1] / 1000.0;
+    qsort(samples_us, count, sizeof(uint32_t), compare_u32);
+
+    double sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += samples_us[i];
+    }
+    const size_t p99 = (size_t)(0.99 * (double)(count - 1) + 0.5);
+    summary->min_ms = samples_us[0] / 1000.0;
+    summary->avg_ms = sum / (double)count / 1000.0;
+    summary->p99_ms = samples_us[p99] / 1000.0;
+}
+
+void rtt_summary(const RttStats *stats, RttSummary *summary) {
+    // Copie dans l'ordre d'arrivée : le dernier échantillon reste en fin de tableau
+    uint32_t ordered[RTT_WINDOW];
+    const unsigned first = (stats->next + RTT_WINDOW - stats->count) % RTT_WINDOW;
+    for (unsigned i = 0; i < stats->count; ++i) {
+        ordered[i] = stats->samples_us[(first + i) % RTT_WINDOW];
+    }
+    rtt_summary_of(ordered, stats->count, summary);
+}
+
+void rtt_format(const RttSummary *summary, char *out, const size_t size) {
+    if (summary->count == 0) {
+        snprintf(out, size, "no RTT sample yet");
+        return;
+    }
+    snprintf(out, size, "last %.2f ms, min %.2f ms, avg %.2f ms, p99 %.2f ms (%u samples)",
+             summary->last_ms, summary->min_ms, summary->avg_ms, summary->p99_ms, summary->count);
+}
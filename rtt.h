@@ -0,0 +1,44 @@
+#ifndef CHAT_RTT_H
+#define CHAT_RTT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Mesure du temps aller-retour (trames FRAME_PING / FRAME_PONG).
+// Les statistiques portent sur une fenêtre glissante des derniers échantillons.
+
+// Le serveur, qui garde une fenêtre par connexion, la réduit à la compilation (Makefile)
+#ifndef RTT_WINDOW
+#define RTT_WINDOW 128
+#endif
+#define RTT_PROBE_INTERVAL_MS 5000
+
+typedef struct RttStats {
+    uint32_t samples_us[RTT_WINDOW];
+    unsigned count;         // échantillons valides dans la fenêtre
+    unsigned next;          // prochain emplacement à écraser
+    uint64_t total;         // échantillons reçus depuis le début
+} RttStats;
+
+typedef struct RttSummary {
+    unsigned count;
+    double last_ms;
+    double min_ms;
+    double avg_ms;
+    double p99_ms;
+} RttSummary;
+
+// Horloge utilisée pour l'horodatage des pings (CLOCK_MONOTONIC, en ns)
+uint64_t rtt_clock_ns(void);
+
+void rtt_add(RttStats *stats, uint64_t rtt_ns);
+void rtt_summary(const RttStats *stats, RttSummary *summary);
+
+// Résumé d'un ensemble quelconque d'échantillons (trié sur place), par exemple
+// toutes les connexions réunies ; last_ms est le dernier élément du tableau
+void rtt_summary_of(uint32_t *samples_us, size_t count, RttSummary *summary);
+
+// Écrit un résumé lisible (« last 0.21 ms, min ... ») dans out
+void rtt_format(const RttSummary *summary, char *out, size_t size);
+
+#endif
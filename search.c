@@ -0,0 +1,795 @@
+#include "search.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lockprof.h"
+#include "util.h"
+
+#define BLOCK_POSTINGS 128          // numéros par bloc de la table de sauts
+#define MERGE_FANOUT 4              // segments de même niveau fusionnés ensemble
+#define PASS_MESSAGES 65536         // au plus par segment publié
+#define POLL_MS 20
+#define BUILD_TABLE_MIN 1024
+
+// Mot d'un segment : ses numéros sont dans les blocs skips[skips ...]
+typedef struct SegmentTerm {
+    uint32_t text;              // position du mot dans Segment.text
+    uint32_t count;             // messages contenant le mot
+    uint32_t skips;
+    uint16_t length;
+} SegmentTerm;
+
+// Début d'un bloc : son premier numéro (le plus grand), puis les écarts suivants
+// (varint) à partir de offset dans postings
+typedef struct Skip {
+    uint32_t seq;
+    uint32_t offset;
+} Skip;
+
+// Segment publié, immuable. Les numéros sont relatifs à base.
+typedef struct Segment {
+    _Atomic int refs;
+    int level;                  // nombre de fusions successives
+    uint64_t base;
+    uint64_t last_seq;
+    size_t messages;
+    uint32_t term_count;
+    SegmentTerm *terms;         // triés
+    char *text;
+    Skip *skips;
+    uint8_t *postings;
+    size_t bytes;
+} Segment;
+
+// Mot du segment en construction : numéros relatifs, croissants
+typedef struct BuildTerm {
+    char text[SEARCH_MAX_TERM_LEN];
+    uint16_t length;            // 0 : case vide
+    uint32_t hash;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *seqs;
+} BuildTerm;
+
+struct SearchIndex {
+    // Segment en construction : écrivain seulement
+    BuildTerm *table;
+    size_t table_size;          // puissance de deux
+    size_t term_count;
+    uint64_t build_base;
+    uint64_t build_last;
+    size_t build_messages;
+
+    // Segments publiés, du plus récent au plus ancien. Modifiée par l'écrivain sous
+    // le verrou, copiée par les requêtes.
+    ProfMutex mutex;
+    Segment **segments;
+    size_t segment_count;
+    size_t segment_capacity;
+
+    const History *history;
+    pthread_t thread;
+    int started;
+    _Atomic int stopping;
+
+    _Atomic uint64_t indexed;       // dernier numéro publié
+    _Atomic size_t bytes;
+    _Atomic uint64_t merges;
+    _Atomic uint64_t skipped;       // évincés de l'historique avant d'être indexés
+    _Atomic uint64_t queries;
+    _Atomic uint64_t query_ns;
+    _Atomic uint64_t max_query_ns;
+};
+
+typedef void (*TermCallback)(void *arg, const char *term, size_t length);
+
+// Rend la place inutilisée : le tampon devient un tableau du segment
+static void *buffer_take(Buffer *buffer) {
+    void *data = buffer->length ? realloc(buffer->data, buffer->length) : buffer->data;
+    return data ? data : buffer->data;
+}
+
+static int put_varint(Buffer *buffer, uint32_t value) {
+    uint8_t bytes[5];
+    size_t size = 0;
+    while (value >= 0x80) {
+        bytes[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[size++] = (uint8_t)value;
+    return buffer_append(buffer, bytes, size);
+}
+
+static uint32_t get_varint(const uint8_t **cursor) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *(*cursor)++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+// Mots d'un texte : lettres et chiffres ASCII en minuscules, octets UTF-8 (>= 0x80)
+// gardés tels quels, séquences d'échappement ANSI (couleurs des avis) ignorées. Les
+// mots plus longs que SEARCH_MAX_TERM_LEN sont tronqués, à l'indexation comme à la
+// requête.
+static void tokenize(const char *text, const size_t length, const TermCallback callback, void *arg) {
+    char term[SEARCH_MAX_TERM_LEN];
+    size_t term_len = 0;
+    for (size_t i = 0; i <= length; ++i) {
+        const unsigned char c = i < length ? (unsigned char)text[i] : ' ';
+        if (c == 0x1b) {
+            // CSI : ESC [ paramètres lettre finale
+            while (i + 1 < length && !((text[i + 1] >= 'A' && text[i + 1] <= 'Z') ||
+                                       (text[i + 1] >= 'a' && text[i + 1] <= 'z'))) {
+                i++;
+            }
+            i++;
+        } else if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c >= 0x80) {
+            if (term_len < sizeof(term)) {
+                term[term_len++] = (char)c;
+            }
+            continue;
+        } else if (c >= 'A' && c <= 'Z') {
+            if (term_len < sizeof(term)) {
+                term[term_len++] = (char)(c - 'A' + 'a');
+            }
+            continue;
+        }
+        if (term_len) {
+            callback(arg, term, term_len);
+            term_len = 0;
+        }
+    }
+}
+
+static uint32_t term_hash(const char *term, const size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (uint8_t)term[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int term_compare(const char *a, const size_t a_len, const char *b, const size_t b_len) {
+    const int order = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (order) {
+        return order;
+    }
+    return a_len < b_len ? -1 : a_len > b_len;
+}
+
+SearchIndex *search_create(void) {
+    SearchIndex *index = calloc(1, sizeof(SearchIndex));
+    if (!index) {
+        return NULL;
+    }
+    index->table_size = BUILD_TABLE_MIN;
+    index->table = calloc(index->table_size, sizeof(BuildTerm));
+    if (!index->table) {
+        free(index);
+        return NULL;
+    }
+    index->mutex = (ProfMutex)PROF_MUTEX_INITIALIZER("search_segments");
+    return index;
+}
+
+static BuildTerm *build_slot(BuildTerm *table, const size_t size, const char *term, const size_t length,
+                             const uint32_t hash) {
+    size_t i = hash & (size - 1);
+    while (table[i].length &&
+           (table[i].hash != hash || table[i].length != length || memcmp(table[i].text, term, length) != 0)) {
+        i = (i + 1) & (size - 1);
+    }
+    return &table[i];
+}
+
+static int build_grow(SearchIndex *index) {
+    const size_t size = index->table_size * 2;
+    BuildTerm *table = calloc(size, sizeof(BuildTerm));
+    if (!table) {
+        return -1;
+    }
+    for (size_t i = 0; i < index->table_size; ++i) {
+        const BuildTerm *term = &index->table[i];
+        if (term->length) {
+            *build_slot(table, size, term->text, term->length, term->hash) = *term;
+        }
+    }
+    free(index->table);
+    index->table = table;
+    index->table_size = size;
+    return 0;
+}
+
+typedef struct AddContext {
+    SearchIndex *index;
+    uint32_t seq;
+} AddContext;
+
+static void build_add(void *arg, const char *text, const size_t length) {
+    const AddContext *context = arg;
+    SearchIndex *index = context->index;
+    if (index->term_count * 2 >= index->table_size && build_grow(index) < 0) {
+        return;
+    }
+    const uint32_t hash = term_hash(text, length);
+    BuildTerm *term = build_slot(index->table, index->table_size, text, length, hash);
+    if (!term->length) {
+        memcpy(term->text, text, length);
+        term->length = (uint16_t)length;
+        term->hash = hash;
+        index->term_count++;
+    }
+    // Un mot répété dans un message ne compte qu'une fois
+    if (term->count && term->seqs[term->count - 1] == context->seq) {
+        return;
+    }
+    if (term->count == term->capacity) {
+        const uint32_t capacity = term->capacity ? term->capacity * 2 : 4;
+        uint32_t *seqs = realloc(term->seqs, capacity * sizeof(uint32_t));
+        if (!seqs) {
+            return;
+        }
+        term->seqs = seqs;
+        term->capacity = capacity;
+    }
+    term->seqs[term->count++] = context->seq;
+}
+
+void search_add(SearchIndex *index, const uint64_t seq, const char *text, const size_t length) {
+    if (index->build_messages == 0) {
+        index->build_base = seq;
+    }
+    AddContext context = {index, (uint32_t)(seq - index->build_base)};
+    tokenize(text, length, build_add, &context);
+    index->build_last = seq;
+    index->build_messages++;
+}
+
+// Construction d'un segment : mots ajoutés dans l'ordre, numéros décroissants
+typedef struct SegmentWriter {
+    Buffer terms;
+    Buffer text;
+    Buffer skips;
+    Buffer postings;
+} SegmentWriter;
+
+static int writer_add(SegmentWriter *writer, const char *text, const size_t length, const uint32_t *seqs,
+                      const uint32_t count) {
+    const SegmentTerm term = {
+        .text = (uint32_t)writer->text.length,
+        .count = count,
+        .skips = (uint32_t)(writer->skips.length / sizeof(Skip)),
+        .length = (uint16_t)length,
+    };
+    if (buffer_append(&writer->text, text, length) < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (i % BLOCK_POSTINGS == 0) {
+            const Skip skip = {seqs[i], (uint32_t)writer->postings.length};
+            if (buffer_append(&writer->skips, &skip, sizeof(skip)) < 0) {
+                return -1;
+            }
+        } else if (put_varint(&writer->postings, seqs[i - 1] - seqs[i]) < 0) {
+            return -1;
+        }
+    }
+    return buffer_append(&writer->terms, &term, sizeof(term));
+}
+
+static void writer_discard(SegmentWriter *writer) {
+    free(writer->terms.data);
+    free(writer->text.data);
+    free(writer->skips.data);
+    free(writer->postings.data);
+}
+
+static Segment *writer_finish(SegmentWriter *writer, const uint64_t base, const uint64_t last_seq,
+                              const size_t messages, const int level) {
+    Segment *segment = calloc(1, sizeof(Segment));
+    if (!segment) {
+        writer_discard(writer);
+        return NULL;
+    }
+    atomic_init(&segment->refs, 1);
+    segment->level = level;
+    segment->base = base;
+    segment->last_seq = last_seq;
+    segment->messages = messages;
+    segment->term_count = (uint32_t)(writer->terms.length / sizeof(SegmentTerm));
+    segment->bytes = sizeof(Segment) + writer->terms.length + writer->text.length + writer->skips.length +
+                     writer->postings.length;
+    segment->terms = buffer_take(&writer->terms);
+    segment->text = buffer_take(&writer->text);
+    segment->skips = buffer_take(&writer->skips);
+    segment->postings = buffer_take(&writer->postings);
+    return segment;
+}
+
+static void segment_release(SearchIndex *index, Segment *segment) {
+    if (atomic_fetch_sub_explicit(&segment->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    atomic_fetch_sub_explicit(&index->bytes, segment->bytes, memory_order_relaxed);
+    free(segment->terms);
+    free(segment->text);
+    free(segment->skips);
+    free(segment->postings);
+    free(segment);
+}
+
+static const SegmentTerm *segment_find(const Segment *segment, const char *text, const size_t length) {
+    size_t low = 0;
+    size_t high = segment->term_count;
+    while (low < high) {
+        const size_t middle = (low + high) / 2;
+        const SegmentTerm *term = &segment->terms[middle];
+        const int order = term_compare(segment->text + term->text, term->length, text, length);
+        if (order == 0) {
+            return term;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+// Parcours d'une liste de numéros, du plus récent au plus ancien
+typedef struct Postings {
+    const Segment *segment;
+    const SegmentTerm *term;
+    uint32_t index;
+    uint32_t value;
+    const uint8_t *cursor;
+} Postings;
+
+static void postings_load(Postings *postings, const uint32_t block) {
+    const Skip *skip = &postings->segment->skips[postings->term->skips + block];
+    postings->index = block * BLOCK_POSTINGS;
+    postings->value = skip->seq;
+    postings->cursor = postings->segment->postings + skip->offset;
+}
+
+static int postings_next(Postings *postings) {
+    if (++postings->index >= postings->term->count) {
+        return 0;
+    }
+    if (postings->index % BLOCK_POSTINGS == 0) {
+        postings_load(postings, postings->index / BLOCK_POSTINGS);
+    } else {
+        postings->value -= get_varint(&postings->cursor);
+    }
+    return 1;
+}
+
+// Avance jusqu'au premier numéro <= target ; 0 si la liste est épuisée
+static int postings_seek(Postings *postings, const uint32_t target) {
+    if (postings->value <= target) {
+        return 1;
+    }
+    // Saute les blocs entiers au-dessus de target (recherche dichotomique des sauts)
+    const Skip *skips = &postings->segment->skips[postings->term->skips];
+    const uint32_t blocks = (postings->term->count + BLOCK_POSTINGS - 1) / BLOCK_POSTINGS;
+    uint32_t low = postings->index / BLOCK_POSTINGS + 1;
+    if (low < blocks && skips[low].seq >= target) {
+        uint32_t high = blocks - 1;
+        while (low < high) {
+            const uint32_t middle = low + (high - low + 1) / 2;
+            if (skips[middle].seq >= target) {
+                low = middle;
+            } else {
+                high = middle - 1;
+            }
+        }
+        postings_load(postings, low);
+    }
+    while (postings->value > target) {
+        if (!postings_next(postings)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void segment_decode(const Segment *segment, const SegmentTerm *term, uint32_t *out, const uint32_t shift) {
+    Postings postings = {segment, term, 0, 0, NULL};
+    postings_load(&postings, 0);
+    out[0] = postings.value + shift;
+    for (uint32_t i = 1; postings_next(&postings); ++i) {
+        out[i] = postings.value + shift;
+    }
+}
+
+static int build_order(const void *a, const void *b) {
+    const BuildTerm *left = *(const BuildTerm *const *)a;
+    const BuildTerm *right = *(const BuildTerm *const *)b;
+    return term_compare(left->text, left->length, right->text, right->length);
+}
+
+static void build_reset(SearchIndex *index) {
+    for (size_t i = 0; i < index->table_size; ++i) {
+        free(index->table[i].seqs);
+    }
+    memset(index->table, 0, index->table_size * sizeof(BuildTerm));
+    index->term_count = 0;
+    index->build_messages = 0;
+}
+
+static Segment *build_segment(SearchIndex *index) {
+    BuildTerm **sorted = malloc(index->term_count * sizeof(BuildTerm *) + 1);
+    uint32_t *seqs = malloc(index->build_messages * sizeof(uint32_t));
+    if (!sorted || !seqs) {
+        free(sorted);
+        free(seqs);
+        return NULL;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < index->table_size; ++i) {
+        if (index->table[i].length) {
+            sorted[count++] = &index->table[i];
+        }
+    }
+    qsort(sorted, count, sizeof(BuildTerm *), build_order);
+
+    SegmentWriter writer = {0};
+    int failed = 0;
+    for (size_t i = 0; i < count && !failed; ++i) {
+        const BuildTerm *term = sorted[i];
+        for (uint32_t j = 0; j < term->count; ++j) {
+            seqs[j] = term->seqs[term->count - 1 - j];
+        }
+        failed = writer_add(&writer, term->text, term->length, seqs, term->count) < 0;
+    }
+    free(seqs);
+    free(sorted);
+    if (failed) {
+        writer_discard(&writer);
+        return NULL;
+    }
+    return writer_finish(&writer, index->build_base, index->build_last, index->build_messages, 0);
+}
+
+// Fusionne des segments consécutifs (du plus récent au plus ancien) en un seul
+static Segment *merge_segments(Segment *const *inputs, const size_t count) {
+    const uint64_t base = inputs[count - 1]->base;
+    size_t messages = 0;
+    for (size_t i = 0; i < count; ++i) {
+        messages += inputs[i]->messages;
+    }
+    uint32_t *seqs = malloc(messages * sizeof(uint32_t));
+    uint32_t positions[MERGE_FANOUT] = {0};
+    if (!seqs) {
+        return NULL;
+    }
+
+    SegmentWriter writer = {0};
+    for (;;) {
+        // Plus petit mot restant parmi les entrées
+        const char *text = NULL;
+        size_t length = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (positions[i] < inputs[i]->term_count) {
+                const SegmentTerm *term = &inputs[i]->terms[positions[i]];
+                const char *candidate = inputs[i]->text + term->text;
+                if (!text || term_compare(candidate, term->length, text, length) < 0) {
+                    text = candidate;
+                    length = term->length;
+                }
+            }
+        }
+        if (!text) {
+            break;
+        }
+
+        // Ses listes, de la plus récente à la plus ancienne, rebasées
+        uint32_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (positions[i] >= inputs[i]->term_count) {
+                continue;
+            }
+            const SegmentTerm *term = &inputs[i]->terms[positions[i]];
+            if (term_compare(inputs[i]->text + term->text, term->length, text, length) == 0) {
+                segment_decode(inputs[i], term, seqs + total, (uint32_t)(inputs[i]->base - base));
+                total += term->count;
+                positions[i]++;
+            }
+        }
+        if (writer_add(&writer, text, length, seqs, total) < 0) {
+            free(seqs);
+            writer_discard(&writer);
+            return NULL;
+        }
+    }
+    free(seqs);
+    return writer_finish(&writer, base, inputs[0]->last_seq, messages, inputs[0]->level + 1);
+}
+
+// Fusionne tant que les MERGE_FANOUT segments les plus récents sont de même niveau
+static void search_merge(SearchIndex *index) {
+    for (;;) {
+        if (index->segment_count < MERGE_FANOUT) {
+            return;
+        }
+        Segment *inputs[MERGE_FANOUT];
+        memcpy(inputs, index->segments, sizeof(inputs));
+        for (size_t i = 1; i < MERGE_FANOUT; ++i) {
+            if (inputs[i]->level != inputs[0]->level) {
+                return;
+            }
+        }
+        // Hors verrou : l'écrivain est seul à modifier la liste, les requêtes
+        // continuent sur les segments d'origine
+        Segment *merged = merge_segments(inputs, MERGE_FANOUT);
+        if (!merged) {
+            return;
+        }
+        atomic_fetch_add_explicit(&index->bytes, merged->bytes, memory_order_relaxed);
+        prof_lock(&index->mutex);
+        index->segments[0] = merged;
+        memmove(index->segments + 1, index->segments + MERGE_FANOUT,
+                (index->segment_count - MERGE_FANOUT) * sizeof(Segment *));
+        index->segment_count -= MERGE_FANOUT - 1;
+        prof_unlock(&index->mutex);
+        atomic_fetch_add_explicit(&index->merges, 1, memory_order_relaxed);
+        for (size_t i = 0; i < MERGE_FANOUT; ++i) {
+            segment_release(index, inputs[i]);
+        }
+    }
+}
+
+void search_commit(SearchIndex *index) {
+    if (index->build_messages == 0) {
+        return;
+    }
+    Segment *segment = build_segment(index);
+    const uint64_t last = index->build_last;
+    build_reset(index);
+    if (!segment) {
+        return;
+    }
+
+    if (index->segment_count == index->segment_capacity) {
+        const size_t capacity = index->segment_capacity ? index->segment_capacity * 2 : 16;
+        prof_lock(&index->mutex);
+        Segment **segments = realloc(index->segments, capacity * sizeof(Segment *));
+        if (segments) {
+            index->segments = segments;
+            index->segment_capacity = capacity;
+        }
+        prof_unlock(&index->mutex);
+        if (!segments) {
+            segment_release(index, segment);
+            return;
+        }
+    }
+    atomic_fetch_add_explicit(&index->bytes, segment->bytes, memory_order_relaxed);
+    prof_lock(&index->mutex);
+    memmove(index->segments + 1, index->segments, index->segment_count * sizeof(Segment *));
+    index->segments[0] = segment;
+    index->segment_count++;
+    prof_unlock(&index->mutex);
+    atomic_store_explicit(&index->indexed, last, memory_order_relaxed);
+
+    search_merge(index);
+}
+
+void search_trim(SearchIndex *index, const uint64_t first_seq) {
+    Segment *dropped[16];
+    size_t count = 0;
+    prof_lock(&index->mutex);
+    while (index->segment_count > 0 && count < sizeof(dropped) / sizeof(dropped[0]) &&
+           index->segments[index->segment_count - 1]->last_seq < first_seq) {
+        dropped[count++] = index->segments[--index->segment_count];
+    }
+    prof_unlock(&index->mutex);
+    for (size_t i = 0; i < count; ++i) {
+        segment_release(index, dropped[i]);
+    }
+}
+
+static void *search_thread(void *arg) {
+    SearchIndex *index = arg;
+    HistoryCursor *cursor = malloc(sizeof(HistoryCursor));
+    if (!cursor) {
+        return NULL;
+    }
+    history_cursor_init(cursor);
+    const struct timespec poll = {0, POLL_MS * 1000000L};
+
+    uint64_t next = 1;
+    while (!atomic_load_explicit(&index->stopping, memory_order_relaxed)) {
+        const uint64_t last = atomic_load_explicit(&index->history->last_seq, memory_order_acquire);
+        if (next > last) {
+            nanosleep(&poll, NULL);
+            continue;
+        }
+        const uint64_t first = history_first(index->history);
+        if (next < first) {
+            atomic_fetch_add_explicit(&index->skipped, first - next, memory_order_relaxed);
+            next = first;
+        }
+        const uint64_t end = last - next >= PASS_MESSAGES ? next + PASS_MESSAGES - 1 : last;
+        for (; next <= end; ++next) {
+            size_t length;
+            const char *text = history_get(index->history, cursor, next, &length);
+            if (text) {
+                search_add(index, next, text, length);
+            } else {
+                atomic_fetch_add_explicit(&index->skipped, 1, memory_order_relaxed);
+            }
+        }
+        search_commit(index);
+        search_trim(index, history_first(index->history));
+    }
+    free(cursor);
+    return NULL;
+}
+
+int search_start(SearchIndex *index, const History *history) {
+    index->history = history;
+    if (pthread_create(&index->thread, NULL, search_thread, index) != 0) {
+        return -1;
+    }
+    index->started = 1;
+    return 0;
+}
+
+void search_stop(SearchIndex *index) {
+    if (index->started) {
+        // Le thread voit le drapeau au plus tard après une attente de POLL_MS ou
+        // une passe d'indexation
+        atomic_store(&index->stopping, 1);
+        pthread_join(index->thread, NULL);
+    }
+    build_reset(index);
+    for (size_t i = 0; i < index->segment_count; ++i) {
+        segment_release(index, index->segments[i]);
+    }
+    free(index->segments);
+    free(index->table);
+    free(index);
+}
+
+typedef struct QueryTerms {
+    char text[SEARCH_MAX_TERMS][SEARCH_MAX_TERM_LEN];
+    size_t length[SEARCH_MAX_TERMS];
+    size_t count;
+} QueryTerms;
+
+static void query_add(void *arg, const char *text, const size_t length) {
+    QueryTerms *terms = arg;
+    for (size_t i = 0; i < terms->count; ++i) {
+        if (terms->length[i] == length && memcmp(terms->text[i], text, length) == 0) {
+            return;
+        }
+    }
+    if (terms->count < SEARCH_MAX_TERMS) {
+        memcpy(terms->text[terms->count], text, length);
+        terms->length[terms->count++] = length;
+    }
+}
+
+// Intersection dans un segment : la liste la plus courte mène, les autres sautent
+// jusqu'à son numéro courant
+static size_t segment_query(const Segment *segment, const QueryTerms *terms, uint64_t *seqs, const size_t max) {
+    Postings postings[SEARCH_MAX_TERMS];
+    size_t lead = 0;
+    for (size_t i = 0; i < terms->count; ++i) {
+        const SegmentTerm *term = segment_find(segment, terms->text[i], terms->length[i]);
+        if (!term) {
+            return 0;
+        }
+        postings[i] = (Postings){segment, term, 0, 0, NULL};
+        postings_load(&postings[i], 0);
+        if (term->count < postings[lead].term->count) {
+            lead = i;
+        }
+    }
+
+    size_t found = 0;
+    uint32_t target = postings[lead].value;
+    while (found < max) {
+        int matched = 1;
+        for (size_t i = 0; i < terms->count; ++i) {
+            if (i == lead) {
+                continue;
+            }
+            if (!postings_seek(&postings[i], target)) {
+                return found;
+            }
+            if (postings[i].value < target) {
+                target = postings[i].value;
+                matched = 0;
+                break;
+            }
+        }
+        if (matched) {
+            seqs[found++] = segment->base + target;
+            if (!postings_next(&postings[lead])) {
+                return found;
+            }
+        } else if (!postings_seek(&postings[lead], target)) {
+            return found;
+        }
+        target = postings[lead].value;
+    }
+    return found;
+}
+
+ssize_t search_query(SearchIndex *index, const char *query, const size_t length, uint64_t *seqs, const size_t max) {
+    QueryTerms terms = {0};
+    tokenize(query, length, query_add, &terms);
+    if (terms.count == 0) {
+        return -1;
+    }
+    const uint64_t start = monotonic_ns();
+
+    // Instantané de la liste : les segments restent valides même fusionnés entre-temps
+    prof_lock(&index->mutex);
+    const size_t count = index->segment_count;
+    Segment **snapshot = malloc(count * sizeof(Segment *) + 1);
+    if (snapshot) {
+        for (size_t i = 0; i < count; ++i) {
+            snapshot[i] = index->segments[i];
+            atomic_fetch_add_explicit(&snapshot[i]->refs, 1, memory_order_relaxed);
+        }
+    }
+    prof_unlock(&index->mutex);
+    if (!snapshot) {
+        return 0;
+    }
+
+    size_t found = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (found < max) {
+            found += segment_query(snapshot[i], &terms, seqs + found, max - found);
+        }
+        segment_release(index, snapshot[i]);
+    }
+    free(snapshot);
+
+    const uint64_t elapsed = monotonic_ns() - start;
+    atomic_fetch_add_explicit(&index->queries, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&index->query_ns, elapsed, memory_order_relaxed);
+    uint64_t max_ns = atomic_load_explicit(&index->max_query_ns, memory_order_relaxed);
+    while (elapsed > max_ns && !atomic_compare_exchange_weak_explicit(&index->max_query_ns, &max_ns, elapsed,
+                                                                      memory_order_relaxed, memory_order_relaxed)) {
+    }
+    return (ssize_t)found;
+}
+
+size_t search_memory(SearchIndex *index) {
+    return atomic_load_explicit(&index->bytes, memory_order_relaxed);
+}
+
+void search_dump(SearchIndex *index, FILE *out) {
+    prof_lock(&index->mutex);
+    fprintf(out, "search: %zu segments, indexed up to seq %llu, %zu KB\n", index->segment_count,
+            (unsigned long long)atomic_load_explicit(&index->indexed, memory_order_relaxed), search_memory(index) >> 10);
+    for (size_t i = 0; i < index->segment_count; ++i) {
+        const Segment *segment = index->segments[i];
+        fprintf(out, "  level %d: seq %llu to %llu, %zu messages, %u terms, %zu KB\n", segment->level,
+                (unsigned long long)segment->base, (unsigned long long)segment->last_seq, segment->messages,
+                segment->term_count, segment->bytes >> 10);
+    }
+    prof_unlock(&index->mutex);
+
+    const uint64_t queries = atomic_load_explicit(&index->queries, memory_order_relaxed);
+    fprintf(out, "merges %llu, skipped %llu (evicted before indexing)\n",
+            (unsigned long long)atomic_load_explicit(&index->merges, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&index->skipped, memory_order_relaxed));
+    fprintf(out, "queries %llu, average %.3f ms, max %.3f ms\n", (unsigned long long)queries,
+            queries ? (double)atomic_load_explicit(&index->query_ns, memory_order_relaxed) / (double)queries / 1e6 : 0.0,
+            (double)atomic_load_explicit(&index->max_query_ns, memory_order_relaxed) / 1e6);
+}
@@ -0,0 +1,54 @@
+#ifndef CHAT_SEARCH_H
+#define CHAT_SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "history.h"
+
+// Recherche plein texte dans l'historique : index inversé incrémental.
+//
+// Un thread d'indexation suit l'historique, découpe les messages en mots (ASCII en
+// minuscules, séquences UTF-8 gardées telles quelles) et publie à chaque passage un
+// petit segment immuable. Les segments sont fusionnés par quatre en arrière-plan
+// (niveaux successifs) : leur nombre reste logarithmique. Dans un segment, chaque mot
+// a sa liste de numéros de messages, du plus récent au plus ancien, codée en écarts
+// (varint) par blocs de 128 avec une table de sauts.
+//
+// L'indexation ne touche jamais le chemin de diffusion : elle ne lit l'historique
+// que sans verrou. Les requêtes prennent un instantané de la liste des segments
+// (références comptées) et ne bloquent pas l'indexation.
+
+#define SEARCH_MAX_TERMS 8
+#define SEARCH_MAX_TERM_LEN 32
+
+typedef struct SearchIndex SearchIndex;
+
+SearchIndex *search_create(void);
+
+// Écrivain unique (thread d'indexation, ou banc d'essai)
+void search_add(SearchIndex *index, uint64_t seq, const char *text, size_t length);
+// Publie les messages ajoutés depuis le dernier appel, puis fusionne si besoin
+void search_commit(SearchIndex *index);
+// Oublie les segments entièrement antérieurs à first_seq
+void search_trim(SearchIndex *index, uint64_t first_seq);
+
+// Démarre le thread qui indexe l'historique au fil de l'eau ; -1 en cas d'erreur
+int search_start(SearchIndex *index, const History *history);
+// Arrête le thread d'indexation (s'il a démarré) et libère l'index. Aucune requête
+// ne doit être en cours.
+void search_stop(SearchIndex *index);
+
+// N'importe quel thread : numéros des messages contenant tous les mots de la requête,
+// du plus récent au plus ancien (au plus max). -1 si la requête n'a aucun mot.
+ssize_t search_query(SearchIndex *index, const char *query, size_t length, uint64_t *seqs, size_t max);
+
+// Octets occupés par les segments publiés
+size_t search_memory(SearchIndex *index);
+
+// Segments, messages indexés et coût des requêtes
+void search_dump(SearchIndex *index, FILE *out);
+
+#endif
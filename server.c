@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -6,169 +7,2740 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <errno.h>
+#include <malloc.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <linux/errqueue.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+
+#include "admin.h"
+#include "federation.h"
+#include "histlog.h"
+#include "history.h"
+#include "search.h"
+#include "shmring.h"
+#include "lockprof.h"
+#include "log.h"
+#include "protocol.h"
+#include "ratelimit.h"
+#include "replica.h"
+#include "rtt.h"
+#include "slab.h"
+#include "timerwheel.h"
+#include "trace.h"
+#include "util.h"
 
 #define MAX_USERS 10
 #define MAX_LEN 1000
-#define MAX_STORED_MESSAGES 50
+#define REPLAY_MESSAGES 50                  // derniers messages rejoués à l'arrivée
+#define PAGED_REPLAY_USERS 100              // au-delà, pas de replay : les clients paginent
+#define PAGE_QUEUE_BYTES 65536              // une page n'allonge pas la file au-delà
+#define SEARCH_RESULTS 20                   // réponses à /search, les plus récentes
+#define DEFAULT_HISTORY_KB 16384
+#define LOG_SEGMENT_BYTES (64 << 20)        // segments du journal sur disque (-D)
+#define DEFAULT_ADMIN_PORT 30002
+#define SERVER_PORT 30001
+#define MAX_WORKERS 64
+#define MAX_EVENTS 256
+#define ACCEPT_BATCH 64
+#define MAX_IOV 64
+#define IN_BUFFER_SIZE (sizeof(FrameHeader) + MAX_LEN)
+#define MAX_OUT_BYTES (1 << 20)             // au-delà, le client est trop lent : déconnexion
+#define HANDSHAKE_TIMEOUT_MS 5000
+#define IDLE_TIMEOUT_MS 30000
+#define DEFAULT_MESSAGE_RATE 10             // messages de chat par seconde et par utilisateur
+#define DEFAULT_MESSAGE_BURST 20
+#define DEFAULT_BYTE_RATE 8192              // octets de chat par seconde et par utilisateur
+#define DEFAULT_BYTE_BURST 16384
+#define HEARTBEAT_INTERVAL_MS RTT_PROBE_INTERVAL_MS
+#define SHED_LAG_MS 20                      // latence de boucle au-delà de laquelle on déleste
+#define SHED_QUEUE_BYTES (16 << 20)         // octets en attente d'écriture, par worker
+#define OVERLOAD_FACTOR 5                   // seuils × 5 : refus des nouvelles connexions
+#define LOAD_CHECK_MS 100                   // réveil minimal tant que la charge est élevée
+#define REPLAY_RETRY_MS 250
+#define DEFAULT_MEMORY_BUDGET_MB 256
+#define MEMORY_PAUSE_GRACE_MS 1000          // lectures suspendues plus longtemps : éviction
+#define READ_QUANTUM 4096                   // octets lus par connexion et par tour (DRR)
+#define WRITE_QUANTUM 65536                 // octets écrits par connexion et par tour
+#define RETRY_AFTER_MS 5000
+#define BROADCAST_BATCH 64                  // messages distribués en un seul passage sur la table
+
+// Niveaux de délestage, du plus léger au plus sévère
+typedef enum LoadLevel {
+    LOAD_NORMAL,
+    LOAD_SHEDDING,      // annonces d'arrivée/départ supprimées, historique différé
+    LOAD_OVERLOADED,    // nouvelles connexions refusées
+} LoadLevel;
+
+static const char *load_level_names[] = {"normal", "shedding", "overloaded"};
+
+// Pression mémoire, en fraction du budget global (-M)
+typedef enum MemoryLevel {
+    MEMORY_OK,
+    MEMORY_SHRINK,      // >= 80 % : tampons inutilisés rendus au système
+    MEMORY_PAUSE,       // >= 90 % : plus de lecture sur les connexions actives
+    MEMORY_EVICT,       // >= 100 % : déconnexion des clients les plus en retard
+} MemoryLevel;
+
+static const char *memory_level_names[] = {"ok", "shrink", "pause", "evict"};
+
+// Trame diffusée : construite une fois, partagée (compteur de références) par
+// toutes les files d'écriture qui la contiennent
+typedef struct Message {
+    _Atomic int refs;
+    uint64_t seq;               // numéro de diffusion, 0 pour une trame adressée à une seule connexion
+    uint64_t trace_id;
+    size_t length;
+    LogSegment *segment;        // non NULL : trames déjà écrites dans le journal, envoyées
+    uint64_t file_offset;       // par sendfile depuis file_offset (frame est vide)
+    char frame[];
+} Message;
+
+typedef struct OutNode {
+    Message *message;
+    struct OutNode *next;
+} OutNode;
+
+// Appel sendmsg MSG_ZEROCOPY en vol : le noyau lit encore les trames dans nos pages
+// jusqu'à sa notification, chacune garde une référence jusque-là
+typedef struct ZeroCopySend {
+    struct ZeroCopySend *next;
+    uint32_t id;                // numéro de l'appel sur la socket (compté par le noyau)
+    uint32_t count;
+    Message *messages[];
+} ZeroCopySend;
+
+typedef enum ConnState {
+    CONN_HANDSHAKE,     // en attente du nom
+    CONN_ACTIVE,        // utilisateur connecté
+    CONN_CLOSING,       // fermeture différée à la fin de l'itération
+} ConnState;
+
+typedef struct Worker Worker;
+
+// File d'écriture d'une connexion active
+typedef struct OutQueue {
+    OutNode *head;
+    OutNode *tail;
+    uint32_t bytes;             // au plus MAX_OUT_BYTES
+    uint32_t nodes;
+} OutQueue;
+
+// Indicateurs d'une connexion active (colonne flags de la table du worker)
+enum {
+    SLOT_CLOSING = 1 << 0,      // fermée : ne reçoit plus rien
+    SLOT_DIRTY = 1 << 1,        // présente dans worker->dirty
+};
+
+// Tampon privé d'une connexion ayant une trame incomplète
+typedef struct InBuffer {
+    char data[IN_BUFFER_SIZE];
+} InBuffer;
+
+typedef struct Connection {
+    int socket;
+    ConnState state;
+    char nom[PROTOCOL_NAME_LEN];
+    Worker *worker;
+    size_t index;               // position dans la table du worker si active
+    int was_active;
+
+    // Lecture : tampon privé seulement si une trame incomplète est en attente,
+    // sinon la lecture se fait dans le tampon partagé du worker
+    InBuffer *in;
+    size_t in_len;
+
+    // Écriture (la file elle-même est dans la table du worker)
+    size_t out_offset;          // octets déjà envoyés du premier message
+    size_t replay_bytes;        // trames propres à la connexion en attente (historique, pongs)
+    int want_write;             // EPOLLOUT armé
+    uint64_t write_round;       // dernier tour où la connexion a été servie en écriture
+    struct Connection *next_closing;
+
+    // Minuteries
+    Timer handshake_timer;
+    Timer idle_timer;
+    Timer heartbeat_timer;
+    Timer replay_timer;         // historique différé par le délestage
+    uint64_t last_activity_ms;
+
+    // MSG_ZEROCOPY (-Z) : appels dont le noyau n'a pas encore rendu les pages
+    int zerocopy;               // SO_ZEROCOPY accepté et le noyau n'a pas dû copier
+    uint32_t zerocopy_next;
+    ZeroCopySend *zerocopy_head;
+    ZeroCopySend *zerocopy_tail;
+
+    // -S : anneaux en mémoire partagée à la place de la socket, qui ne sert plus qu'à
+    // constater le départ du client (EPOLLRDHUP)
+    ShmLink *shm;
+
+    // Page d'historique demandée, envoyée au rythme où la file se vide
+    uint64_t page_first;
+    uint64_t page_next;
+    uint64_t page_end;          // exclu ; 0 : aucune page en cours
+
+    // Ordonnancement équitable (deficit round robin) : crédit d'octets restant du tour
+    size_t read_deficit;
+    size_t write_deficit;
+    _Atomic uint64_t read_bytes;
+    _Atomic uint64_t written_bytes;
+    uint64_t read_mark;         // valeurs au dernier relevé de l'admin (sous user_mutex)
+    uint64_t written_mark;
+
+    RttStats rtt;               // modifié sous user_mutex
+
+    // Limitation de débit, appliquée avant la diffusion
+    TokenBucket message_bucket;
+    TokenBucket byte_bucket;
+    int throttled;              // avis déjà envoyé pour cette rafale
+    _Atomic uint64_t throttled_messages;
+    _Atomic uint64_t throttled_bytes;
+} Connection;
+
+// Boucle d'événements : chaque worker possède ses connexions, sa roue de
+// temporisation et une boîte de réception des messages à diffuser
+struct Worker {
+    int id;
+    pthread_t thread;
+    int epoll_fd;
+    int wake_fd;
+    uint64_t now_ms;
+    TimerWheel timers;
+
+    // Connexions actives, rangées par colonnes à l'indice conn->index : la diffusion
+    // ne lit que les colonnes chaudes (indicateurs, arrivée, file d'écriture) et ne
+    // touche pas la structure Connection (nom, minuteries, RTT, limites de débit).
+    // Modifiées sous user_mutex, lues sans verrou par le worker.
+    Connection **conns;
+    uint8_t *flags;
+    uint64_t *join_seqs;        // messages de numéro <= join_seq : rejoués depuis l'historique
+                                // (UINT64_MAX : replay différé, rien en direct d'ici là)
+    OutQueue *queues;
+    size_t conn_count;
+    size_t conn_capacity;
+
+    ProfMutex inbox_mutex;
+    Message **inbox;
+    size_t inbox_count;
+    size_t inbox_capacity;
+    Message **draining;
+    size_t draining_capacity;
+
+    // Connexions ayant des données à écrire, dans l'ordre de service (NULL : fermée
+    // entre-temps). Une connexion y figure au plus une fois : conn_capacity suffit.
+    Connection **dirty;
+    size_t dirty_count;
+    Connection **flushing;      // liste en cours d'écriture, échangée avec dirty
+    uint64_t round;             // numéro d'itération
+    Connection *closing;        // connexions à fermer en fin d'itération
+
+    // Tampon de lecture partagé par toutes les connexions du worker
+    char read_buffer[READ_QUANTUM];
+    size_t in_buffers;          // tampons privés attribués
+
+    // Dernier bloc d'historique décodé : les arrivées groupées le rejouent sans le
+    // décompresser à nouveau
+    HistoryCursor history_cursor;
+
+    // Mémoire : connexions allouées (y compris en poignée de main) et nœuds de file
+    size_t connections;
+    size_t out_nodes;
+    size_t shm_links;
+    size_t shm_bytes;
+    _Atomic size_t memory_bytes;    // publié en fin d'itération
+    int memory_level;
+    int reads_paused;
+    uint64_t paused_since_ms;
+
+    // Mesures de charge : écrites par le worker en fin d'itération, lues par l'admin
+    size_t out_bytes;           // octets en attente d'écriture sur toutes les connexions
+    _Atomic uint64_t lag_us;    // moyenne glissante de la durée d'une itération
+    _Atomic uint64_t max_lag_us;
+    _Atomic size_t queued_bytes;
+    _Atomic size_t inbox_depth; // messages distribués à la dernière itération
+    _Atomic int load;           // LoadLevel
+    _Atomic uint64_t read_exhausted;    // tours où une connexion a épuisé son crédit
+    _Atomic uint64_t write_exhausted;
+
+    // Coût cumulé de la distribution de la boîte aux connexions
+    _Atomic uint64_t broadcast_messages;
+    _Atomic uint64_t broadcast_recipients;
+    _Atomic uint64_t broadcast_cycles;
+
+    // Envois MSG_ZEROCOPY : appels, octets, appels que le noyau a finalement copiés
+    _Atomic uint64_t zerocopy_sends;
+    _Atomic uint64_t zerocopy_bytes;
+    _Atomic uint64_t zerocopy_copied;
+    _Atomic uint64_t zerocopy_fallbacks;    // ENOBUFS : envoyé par copie
+};
+
+// Configuration (options de la ligne de commande)
+static int max_users = MAX_USERS;
+static unsigned handshake_timeout_ms = HANDSHAKE_TIMEOUT_MS;
+static unsigned idle_timeout_ms = IDLE_TIMEOUT_MS;
+static RateLimit message_limit = {DEFAULT_MESSAGE_RATE, DEFAULT_MESSAGE_BURST};
+static RateLimit byte_limit = {DEFAULT_BYTE_RATE, DEFAULT_BYTE_BURST};
+
+static int notices = 1;                 // annonces d'arrivée et de départ (-n pour les supprimer)
+static int paged_users = PAGED_REPLAY_USERS;
+static size_t zerocopy_min = 0;         // -Z : envois d'au moins autant d'octets sans copie, 0 : jamais
+static unsigned shed_lag_ms = SHED_LAG_MS;
+static size_t shed_queue_bytes = SHED_QUEUE_BYTES;
+
+static size_t memory_budget = (size_t)DEFAULT_MEMORY_BUDGET_MB << 20;
+
+// Trames vivantes (partagées ou non), comptées une seule fois
+static _Atomic size_t message_bytes = 0;
+
+// Actions de pression mémoire depuis le démarrage
+static _Atomic uint64_t memory_shrinks = 0;
+static _Atomic uint64_t memory_pauses = 0;
+static _Atomic uint64_t memory_evictions = 0;
+
+// Délestage depuis le démarrage
+static _Atomic uint64_t rejected_connections = 0;
+static _Atomic uint64_t shed_notices = 0;
+static _Atomic uint64_t deferred_replays = 0;
+
+// Pagination de l'historique depuis le démarrage
+static _Atomic uint64_t paged_joins = 0;
+static _Atomic uint64_t history_pages = 0;
+static _Atomic uint64_t history_page_messages = 0;
+
+// Volume refusé par la limitation de débit depuis le démarrage
+static _Atomic uint64_t throttled_messages = 0;
+static _Atomic uint64_t throttled_bytes = 0;
+
+static Worker *workers[MAX_WORKERS];
+static int worker_count = 1;
+static int listen_socket = -1;
+static int unix_socket = -1;            // -U : même protocole sur une socket Unix, -1 : aucune
+static int shm_socket = -1;             // -S : rattachement des clients en mémoire partagée
+static _Atomic int stopping = 0;
+static _Thread_local Worker *current_worker = NULL;
+
+int user_count = 0;
+ProfMutex user_mutex = PROF_MUTEX_INITIALIZER("user_mutex");
+
+// Historique borné en octets (-B), écrit sous messages_mutex, lu sans verrou
+static History history;
+static size_t history_budget = (size_t)DEFAULT_HISTORY_KB << 10;
+static SearchIndex *search_index = NULL;     // suit l'historique depuis son propre thread
+static HistoryLog *history_log = NULL;       // -D : replay envoyé depuis le disque
+static Federation *federation = NULL;        // -f/-F : salon partagé avec d'autres serveurs
+static Replica *replica = NULL;              // -Y/-y : journal expédié aux secours, ou reçu du primaire
+static _Atomic int standby = 0;             // -y : clients refusés jusqu'à la promotion
+static _Atomic uint64_t history_seq = 0;    // dernier message stocké et distribué
+uint64_t message_seq = 0;
+ProfMutex messages_mutex = PROF_MUTEX_INITIALIZER("messages_mutex"); // Numérotation et ordre de distribution
+
+// Compteur de cycles du processeur (nanosecondes là où il n'est pas accessible)
+static inline uint64_t cycle_count(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+// Niveau de charge du serveur : celui du worker le plus chargé
+static LoadLevel load_level(void) {
+    int level = LOAD_NORMAL;
+    for (int i = 0; i < worker_count; ++i) {
+        const int load = atomic_load_explicit(&workers[i]->load, memory_order_relaxed);
+        if (load > level) {
+            level = load;
+        }
+    }
+    return (LoadLevel)level;
+}
+
+static Message *message_create(const uint8_t type, const uint8_t flags, const void *payload,
+                               const size_t len, const uint64_t trace_id) {
+    Message *message = slab_alloc(sizeof(Message) + sizeof(FrameHeader) + len);
+    if (!message) {
+        return NULL;
+    }
+    atomic_init(&message->refs, 1);
+    atomic_fetch_add_explicit(&message_bytes, sizeof(Message) + sizeof(FrameHeader) + len, memory_order_relaxed);
+    message->seq = 0;
+    message->trace_id = trace_id;
+    message->segment = NULL;
+    message->length = encode_frame(message->frame, type, flags, payload, len);
+    return message;
+}
+
+// Plage du journal : seul l'en-tête occupe de la mémoire, la référence au segment
+// est transférée au message
+static Message *message_from_log(const LogRange *range) {
+    Message *message = slab_alloc(sizeof(Message));
+    if (!message) {
+        histlog_release(range->segment);
+        return NULL;
+    }
+    atomic_init(&message->refs, 1);
+    atomic_fetch_add_explicit(&message_bytes, sizeof(Message), memory_order_relaxed);
+    message->seq = 0;
+    message->trace_id = 0;
+    message->length = range->length;
+    message->segment = range->segment;
+    message->file_offset = range->offset;
+    return message;
+}
+
+static void message_release(Message *message) {
+    if (atomic_fetch_sub_explicit(&message->refs, 1, memory_order_acq_rel) == 1) {
+        if (message->segment) {
+            atomic_fetch_sub_explicit(&message_bytes, sizeof(Message), memory_order_relaxed);
+            histlog_release(message->segment);
+        } else {
+            atomic_fetch_sub_explicit(&message_bytes, sizeof(Message) + message->length, memory_order_relaxed);
+        }
+        slab_free(message);
+    }
+}
+
+// Dépose un message dans la boîte de réception d'un worker
+static void worker_post(Worker *worker, Message *message) {
+    prof_lock(&worker->inbox_mutex);
+    if (worker->inbox_count == worker->inbox_capacity) {
+        const size_t capacity = worker->inbox_capacity ? worker->inbox_capacity * 2 : 64;
+        Message **inbox = realloc(worker->inbox, capacity * sizeof(Message *));
+        if (!inbox) {
+            prof_unlock(&worker->inbox_mutex);
+            log_errno("Error growing a worker inbox", ENOMEM);
+            return;
+        }
+        worker->inbox = inbox;
+        worker->inbox_capacity = capacity;
+    }
+    atomic_fetch_add_explicit(&message->refs, 1, memory_order_relaxed);
+    worker->inbox[worker->inbox_count++] = message;
+    const int was_empty = worker->inbox_count == 1;
+    prof_unlock(&worker->inbox_mutex);
+
+    // Le worker courant vide sa boîte à chaque itération : inutile de le réveiller
+    if (was_empty && worker != current_worker) {
+        const uint64_t one = 1;
+        if (write(worker->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            log_errno("Error waking a worker", errno);
+        }
+    }
+}
+
+// Stocke et distribue un message ; local : publié ici, donc relayé aux serveurs
+// fédérés (un message reçu d'eux n'y repart pas par ce chemin)
+static void diffuse_text(const char *message, size_t length, const uint64_t trace_id, const int local) {
+    // La trame est construite une seule fois pour tous les destinataires
+    char payload[MAX_FRAME_PAYLOAD];
+    size_t payload_len = 0;
+    if (trace_id) {
+        const uint64_t wire_id = proto_hton64(trace_id);
+        memcpy(payload, &wire_id, sizeof(wire_id));
+        payload_len = sizeof(wire_id);
+    }
+    if (length > MAX_FRAME_PAYLOAD - payload_len) {
+        length = MAX_FRAME_PAYLOAD - payload_len;
+    }
+    memcpy(payload + payload_len, message, length);
+    payload_len += length;
+
+    Message *frame = message_create(FRAME_TEXT, trace_id ? FRAME_FLAG_TRACED : 0, payload, payload_len, trace_id);
+    if (!frame) {
+        log_errno("Error allocating a message", ENOMEM);
+        return;
+    }
+
+    // Stockage et distribution sous le même verrou : tous les workers reçoivent
+    // les messages dans le même ordre
+    prof_lock(&messages_mutex);
+    frame->seq = ++message_seq;
+    history_append(&history, frame->seq, message, length);
+    if (history_log && histlog_append(history_log, frame->seq, message, length) < 0) {
+        log_errno("Error writing the history log, replay falls back to memory", errno);
+    }
+    if (trace_id) {
+        trace_record(trace_id, TRACE_SEQUENCE, -1, realtime_ns());
+    }
+    for (int i = 0; i < worker_count; ++i) {
+        worker_post(workers[i], frame);
+    }
+    // Publié dans l'ordre de diffusion : les autres serveurs voient les messages
+    // d'ici dans le même ordre que nos membres
+    if (local && federation) {
+        federation_publish(federation, message, length);
+    }
+    // Publié une fois stocké et distribué : un arrivant qui lit ce numéro trouve les
+    // messages antérieurs dans l'historique et reçoit les suivants par sa boîte
+    atomic_store_explicit(&history_seq, frame->seq, memory_order_release);
+    // Après history_seq : un secours qui arrive rattrape ce numéro depuis l'historique
+    // s'il ne le reçoit pas par la boîte de réplication
+    if (replica) {
+        replica_message(replica, frame->seq, message, length);
+    }
+    prof_unlock(&messages_mutex);
+
+    message_release(frame);
+}
+
+// Fonction pour diffuser un message à tous les utilisateurs et le stocker.
+// trace_id non nul : le message est tracé (étapes sequence, enqueue et write).
+void diffuse_message(const char *message, const uint64_t trace_id) {
+    const size_t length = strlen(message);
+    // Grappe (-C) : un autre serveur possède le salon, le message nous reviendra
+    // numéroté par lui (sa trace s'arrête donc ici)
+    if (federation && federation_forward(federation, message, length)) {
+        return;
+    }
+    diffuse_text(message, length, trace_id, 1);
+}
+
+// Message d'un autre serveur fédéré (thread de fédération) : distribué à nos membres.
+// local : transmis par la grappe à ce serveur, propriétaire du salon, qui le publie.
+static void diffuse_federated(const char *message, const size_t length, const int local) {
+    diffuse_text(message, length, 0, local);
+}
+
+// Secours (-y), thread de réplication : message du primaire stocké sous son numéro.
+// Personne n'est connecté ici avant la promotion : rien à distribuer. Un message
+// manquant arrive vide : il garde les numéros contigus, replays et pages le sautent.
+static void replica_applied(const uint64_t seq, const char *message, const size_t length) {
+    prof_lock(&messages_mutex);
+    message_seq = seq;
+    history_append(&history, seq, message, length);
+    if (history_log && histlog_append(history_log, seq, message, length) < 0) {
+        log_errno("Error writing the history log, replay falls back to memory", errno);
+    }
+    atomic_store_explicit(&history_seq, seq, memory_order_release);
+    // Nos propres secours (-Y) suivent le même flux
+    replica_message(replica, seq, message, length);
+    prof_unlock(&messages_mutex);
+}
+
+// Secours promu : la numérotation continue après last_seq, les clients sont acceptés
+static void replica_promoted(const uint64_t last_seq) {
+    (void)last_seq;
+    atomic_store(&standby, 0);
+}
+
+// Annonces d'arrivée et de départ : premier trafic sacrifié en cas de surcharge
+static void diffuse_notice(const char *message) {
+    if (!notices) {
+        return;
+    }
+    if (load_level() >= LOAD_SHEDDING) {
+        atomic_fetch_add_explicit(&shed_notices, 1, memory_order_relaxed);
+        return;
+    }
+    diffuse_message(message, 0);
+}
+
+static void conn_close(Connection *conn) {
+    if (conn->state == CONN_CLOSING) {
+        return;
+    }
+    conn->was_active = conn->state == CONN_ACTIVE;
+    if (conn->was_active) {
+        conn->worker->flags[conn->index] |= SLOT_CLOSING;
+    }
+    conn->state = CONN_CLOSING;
+    conn->next_closing = conn->worker->closing;
+    conn->worker->closing = conn;
+}
+
+static void log_conn(const LogLevel level, const char *what, const Connection *conn) {
+    char line[PROTOCOL_NAME_LEN + 64];
+    snprintf(line, sizeof(line), "%s: %s", what, conn->nom);
+    log_text(level, line);
+}
+
+// File circulaire : une connexion qui a épuisé son crédit repasse en fin de file
+static void worker_mark_dirty(Worker *worker, const size_t index) {
+    if (!(worker->flags[index] & SLOT_DIRTY)) {
+        worker->flags[index] |= SLOT_DIRTY;
+        worker->dirty[worker->dirty_count++] = worker->conns[index];
+    }
+}
+
+static void conn_mark_dirty(Connection *conn) {
+    worker_mark_dirty(conn->worker, conn->index);
+}
+
+static OutQueue *conn_queue(const Connection *conn) {
+    return &conn->worker->queues[conn->index];
+}
+
+// Ajoute une trame en fin de file, sans prendre de référence : à l'appelant de le faire
+static int queue_push(Worker *worker, OutQueue *queue, Message *message) {
+    OutNode *node = slab_alloc(sizeof(OutNode));
+    if (!node) {
+        return -1;
+    }
+    node->message = message;
+    node->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = node;
+    } else {
+        queue->head = node;
+    }
+    queue->tail = node;
+    queue->bytes += (uint32_t)message->length;
+    queue->nodes++;
+    worker->out_bytes += message->length;
+    worker->out_nodes++;
+    return 0;
+}
+
+// Ajoute une trame à la file d'écriture de la connexion (écrite en fin d'itération)
+static void conn_enqueue(Connection *conn, Message *message) {
+    if (conn->state != CONN_ACTIVE) {
+        return;
+    }
+    OutQueue *queue = conn_queue(conn);
+    if (queue->bytes + message->length > MAX_OUT_BYTES) {
+        log_conn(LOG_WARN, "Slow consumer disconnected", conn);
+        conn_close(conn);
+        return;
+    }
+    if (queue_push(conn->worker, queue, message) < 0) {
+        conn_close(conn);
+        return;
+    }
+    atomic_fetch_add_explicit(&message->refs, 1, memory_order_relaxed);
+    if (message->seq == 0) {
+        conn->replay_bytes += message->length;
+    }
+    if (message->trace_id) {
+        trace_record(message->trace_id, TRACE_ENQUEUE, conn->socket, realtime_ns());
+    }
+    conn_mark_dirty(conn);
+}
+
+// Trame destinée à une seule connexion (pong, ping)
+static void conn_send(Connection *conn, const uint8_t type, const void *payload, const size_t len) {
+    Message *message = message_create(type, 0, payload, len, 0);
+    if (!message) {
+        conn_close(conn);
+        return;
+    }
+    conn_enqueue(conn, message);
+    message_release(message);
+}
+
+// Suite de la page en cours, tant que la file reste sous PAGE_QUEUE_BYTES : le reste
+// attend que conn_flush l'ait vidée. Les messages évincés entre-temps sont sautés.
+static void conn_page_pump(Connection *conn) {
+    const OutQueue *queue = conn_queue(conn);
+    char entry[sizeof(uint64_t) + MAX_FRAME_PAYLOAD];
+    while (conn->page_next < conn->page_end && queue->bytes < PAGE_QUEUE_BYTES && conn->state == CONN_ACTIVE) {
+        const uint64_t seq = conn->page_next++;
+        size_t length;
+        const char *text = history_get(&history, &conn->worker->history_cursor, seq, &length);
+        // Vide : message perdu par un secours avant sa promotion, numéro seulement
+        if (!text || length == 0) {
+            continue;
+        }
+        if (length > MAX_FRAME_PAYLOAD - sizeof(seq)) {
+            length = MAX_FRAME_PAYLOAD - sizeof(seq);
+        }
+        const uint64_t wire_seq = proto_hton64(seq);
+        memcpy(entry, &wire_seq, sizeof(wire_seq));
+        memcpy(entry + sizeof(wire_seq), text, length);
+        conn_send(conn, FRAME_HISTORY, entry, sizeof(wire_seq) + length);
+        atomic_fetch_add_explicit(&history_page_messages, 1, memory_order_relaxed);
+    }
+    if (conn->page_end && conn->page_next >= conn->page_end && conn->state == CONN_ACTIVE) {
+        conn->page_end = 0;
+        const HistoryEnd end = {proto_hton64(conn->page_first), proto_hton64(history_first(&history))};
+        conn_send(conn, FRAME_HISTORY_END, &end, sizeof(end));
+    }
+}
+
+static void conn_apply_events(Connection *conn) {
+    // Lectures suspendues par la pression mémoire : seuls les utilisateurs connectés
+    // sont concernés, les poignées de main restent possibles
+    const int paused = conn->worker->reads_paused && conn->state == CONN_ACTIVE;
+    struct epoll_event event = {
+        .events = (paused ? 0 : EPOLLIN) | (conn->want_write ? EPOLLOUT : 0),
+        .data.ptr = conn,
+    };
+    if (conn->shm) {
+        // Une seule sonnette pour les deux sens : le client la fait sonner aussi quand
+        // il libère de la place, que l'on attend (want_write) même lectures suspendues
+        event.events = paused && !conn->want_write ? 0 : EPOLLIN;
+        epoll_ctl(conn->worker->epoll_fd, EPOLL_CTL_MOD, conn->shm->rx.bell, &event);
+        return;
+    }
+    epoll_ctl(conn->worker->epoll_fd, EPOLL_CTL_MOD, conn->socket, &event);
+}
+
+static void conn_update_events(Connection *conn, const int want_write) {
+    if (conn->want_write == want_write) {
+        return;
+    }
+    conn->want_write = want_write;
+    conn_apply_events(conn);
+}
+
+// Appel terminé (ou socket fermée) : le noyau ne lit plus ses trames
+static void zerocopy_release(ZeroCopySend *send) {
+    for (uint32_t i = 0; i < send->count; ++i) {
+        message_release(send->messages[i]);
+    }
+    slab_free(send);
+}
+
+// sendmsg MSG_ZEROCOPY des count premières trames de la file : elles restent
+// référencées jusqu'à la notification du noyau (conn_zerocopy_reap). Sans mémoire
+// pour le suivi, ou si le noyau refuse (ENOBUFS : trop de pages épinglées), envoi
+// ordinaire par copie.
+static ssize_t conn_send_zerocopy(Connection *conn, const struct msghdr *msg, const int count, const size_t batch) {
+    Worker *worker = conn->worker;
+    ZeroCopySend *send = slab_alloc(sizeof(ZeroCopySend) + (size_t)count * sizeof(Message *));
+    ssize_t sent = -1;
+    if (send) {
+        sent = sendmsg(conn->socket, msg, MSG_NOSIGNAL | MSG_DONTWAIT | MSG_ZEROCOPY);
+        if (sent >= 0) {
+            send->next = NULL;
+            send->id = conn->zerocopy_next++;
+            send->count = 0;
+            for (const OutNode *node = conn_queue(conn)->head; (int)send->count < count; node = node->next) {
+                atomic_fetch_add_explicit(&node->message->refs, 1, memory_order_relaxed);
+                send->messages[send->count++] = node->message;
+            }
+            if (conn->zerocopy_tail) {
+                conn->zerocopy_tail->next = send;
+            } else {
+                conn->zerocopy_head = send;
+            }
+            conn->zerocopy_tail = send;
+            atomic_fetch_add_explicit(&worker->zerocopy_sends, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&worker->zerocopy_bytes, batch, memory_order_relaxed);
+            return sent;
+        }
+        slab_free(send);
+        if (errno != ENOBUFS) {
+            return sent;
+        }
+    }
+    atomic_fetch_add_explicit(&worker->zerocopy_fallbacks, 1, memory_order_relaxed);
+    return sendmsg(conn->socket, msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// Notifications de la file d'erreurs de la socket (EPOLLERR) : chacune couvre une
+// suite d'appels terminés, dont les trames sont libérées dans l'ordre
+static void conn_zerocopy_reap(Connection *conn) {
+    Worker *worker = conn->worker;
+    while (conn->zerocopy_head) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+        if (recvmsg(conn->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return;
+        }
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            struct sock_extended_err err;
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // Le noyau a dû copier (boucle locale, carte sans scatter-gather) : les
+            // envois suivants coûteraient l'épinglage en plus de la copie
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                atomic_fetch_add_explicit(&worker->zerocopy_copied, err.ee_data - err.ee_info + 1, memory_order_relaxed);
+                conn->zerocopy = 0;
+            }
+            while (conn->zerocopy_head && (int32_t)(conn->zerocopy_head->id - err.ee_data) <= 0) {
+                ZeroCopySend *send = conn->zerocopy_head;
+                conn->zerocopy_head = send->next;
+                zerocopy_release(send);
+            }
+            if (!conn->zerocopy_head) {
+                conn->zerocopy_tail = NULL;
+            }
+        }
+    }
+}
+
+// Copie dans l'anneau d'un client en mémoire partagée, avec les conventions de
+// sendmsg : -1 et EAGAIN s'il est plein (le client sonnera en libérant de la place)
+static ssize_t conn_shm_write(Connection *conn, const struct iovec *iov, const int count) {
+    size_t written = shm_write(&conn->shm->tx, iov, count);
+    if (written == 0 && shm_arm_write(&conn->shm->tx)) {
+        written = shm_write(&conn->shm->tx, iov, count);
+    }
+    if (written == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return (ssize_t)written;
+}
+
+// Écrit autant que possible de la file d'écriture en un seul sendmsg, ou un seul
+// sendfile si elle commence par une plage du journal.
+// Au plus le crédit du tour (WRITE_QUANTUM) : le reste attend le tour suivant
+static void conn_flush(Connection *conn) {
+    Worker *worker = conn->worker;
+    if (conn->write_round == worker->round) {
+        // Déjà servie à ce tour : elle le sera au suivant
+        conn_mark_dirty(conn);
+        return;
+    }
+    conn->write_round = worker->round;
+    conn->write_deficit += WRITE_QUANTUM;
+
+    OutQueue *queue = conn_queue(conn);
+    while (queue->head && conn->state != CONN_CLOSING) {
+        if (conn->write_deficit == 0) {
+            atomic_fetch_add_explicit(&worker->write_exhausted, 1, memory_order_relaxed);
+            conn_update_events(conn, 0);
+            conn_mark_dirty(conn);
+            return;
+        }
+        ssize_t sent;
+        const Message *first = queue->head->message;
+        if (first->segment) {
+            // Du cache de pages du fichier à la socket, sans copie en espace utilisateur
+            off_t file_offset = (off_t)(first->file_offset + conn->out_offset);
+            size_t length = first->length - conn->out_offset;
+            if (length > conn->write_deficit) {
+                length = conn->write_deficit;
+            }
+            sent = sendfile(conn->socket, histlog_fd(first->segment), &file_offset, length);
+            if (sent == 0) {
+                log_conn(LOG_ERROR, "History log range truncated, connection closed", conn);
+                conn_close(conn);
+                return;
+            }
+        } else {
+            struct iovec iov[MAX_IOV];
+            int count = 0;
+            size_t offset = conn->out_offset;
+            size_t budget = conn->write_deficit;
+            for (OutNode *node = queue->head; node && !node->message->segment && count < MAX_IOV && budget > 0;
+                 node = node->next) {
+                iov[count].iov_base = node->message->frame + offset;
+                iov[count].iov_len = node->message->length - offset;
+                if (iov[count].iov_len > budget) {
+                    iov[count].iov_len = budget;
+                }
+                budget -= iov[count].iov_len;
+                offset = 0;
+                count++;
+            }
+
+            struct msghdr msg = {.msg_iov = iov, .msg_iovlen = (size_t)count};
+            const size_t batch = conn->write_deficit - budget;
+            if (conn->shm) {
+                sent = conn_shm_write(conn, iov, count);
+            } else if (conn->zerocopy && batch >= zerocopy_min) {
+                sent = conn_send_zerocopy(conn, &msg, count, batch);
+            } else {
+                sent = sendmsg(conn->socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            }
+        }
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn_update_events(conn, 1);
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            // Client parti : la lecture constatera la fermeture, inutile de le journaliser
+            if (errno != EPIPE && errno != ECONNRESET) {
+                log_errno("Error sending to the client", errno);
+            }
+            conn_close(conn);
+            return;
+        }
+        conn->write_deficit -= (size_t)sent;
+        atomic_fetch_add_explicit(&conn->written_bytes, (uint64_t)sent, memory_order_relaxed);
+
+        // Libère les trames entièrement envoyées
+        while (sent > 0) {
+            OutNode *node = queue->head;
+            const size_t remaining = node->message->length - conn->out_offset;
+            if ((size_t)sent < remaining) {
+                conn->out_offset += (size_t)sent;
+                queue->bytes -= (uint32_t)sent;
+                worker->out_bytes -= (size_t)sent;
+                break;
+            }
+            sent -= (ssize_t)remaining;
+            queue->bytes -= (uint32_t)remaining;
+            worker->out_bytes -= remaining;
+            conn->out_offset = 0;
+            queue->head = node->next;
+            queue->nodes--;
+            worker->out_nodes--;
+            if (node->message->seq == 0) {
+                conn->replay_bytes -= node->message->length;
+            }
+            if (!queue->head) {
+                queue->tail = NULL;
+            }
+            if (node->message->trace_id) {
+                trace_record(node->message->trace_id, TRACE_WRITE, conn->socket, realtime_ns());
+            }
+            message_release(node->message);
+            slab_free(node);
+        }
+        if (conn->page_end && queue->bytes < PAGE_QUEUE_BYTES / 2) {
+            conn_page_pump(conn);
+        }
+    }
+    // File vide : le crédit inutilisé n'est pas conservé
+    conn->write_deficit = 0;
+    conn_update_events(conn, 0);
+}
+
+// Minuteries de connexion
+static void on_handshake_timeout(Timer *timer, void *arg) {
+    (void)timer;
+    Connection *conn = arg;
+    if (conn->state == CONN_HANDSHAKE) {
+        log_text(LOG_INFO, "Handshake timeout, connection closed");
+        conn_close(conn);
+    }
+}
+
+static void on_idle_timeout(Timer *timer, void *arg) {
+    Connection *conn = arg;
+    if (conn->state != CONN_ACTIVE) {
+        return;
+    }
+    // Réarmement paresseux : l'activité ne touche pas la roue, seulement last_activity_ms
+    const uint64_t idle = conn->worker->now_ms - conn->last_activity_ms;
+    if (idle < idle_timeout_ms) {
+        timer_schedule(&conn->worker->timers, timer, idle_timeout_ms - idle);
+        return;
+    }
+    log_conn(LOG_INFO, "Idle timeout", conn);
+    conn_close(conn);
+}
+
+static void on_heartbeat(Timer *timer, void *arg) {
+    Connection *conn = arg;
+    if (conn->state != CONN_ACTIVE) {
+        return;
+    }
+    const PingPayload ping = {proto_hton64(rtt_clock_ns()), 0};
+    conn_send(conn, FRAME_PING, &ping, sizeof(ping));
+    timer_schedule(&conn->worker->timers, timer, HEARTBEAT_INTERVAL_MS);
+}
+
+// Redimensionne toutes les colonnes de la table (user_mutex verrouillé). Un échec
+// en réduction est sans conséquence : le tableau garde son ancienne taille.
+static int worker_resize_table(Worker *worker, const size_t capacity) {
+    Connection **conns = realloc(worker->conns, capacity * sizeof(Connection *));
+    if (conns) {
+        worker->conns = conns;
+    }
+    uint8_t *flags = realloc(worker->flags, capacity * sizeof(uint8_t));
+    if (flags) {
+        worker->flags = flags;
+    }
+    uint64_t *join_seqs = realloc(worker->join_seqs, capacity * sizeof(uint64_t));
+    if (join_seqs) {
+        worker->join_seqs = join_seqs;
+    }
+    OutQueue *queues = realloc(worker->queues, capacity * sizeof(OutQueue));
+    if (queues) {
+        worker->queues = queues;
+    }
+    Connection **dirty = realloc(worker->dirty, capacity * sizeof(Connection *));
+    if (dirty) {
+        worker->dirty = dirty;
+    }
+    Connection **flushing = realloc(worker->flushing, capacity * sizeof(Connection *));
+    if (flushing) {
+        worker->flushing = flushing;
+    }
+    if (capacity > worker->conn_capacity && (!conns || !flags || !join_seqs || !queues || !dirty || !flushing)) {
+        return -1;
+    }
+    worker->conn_capacity = capacity;
+    return 0;
+}
+
+// Nouvel utilisateur connecté
+static int add_user(Connection *conn) {
+    Worker *worker = conn->worker;
+    prof_lock(&user_mutex);
+    if (user_count >= max_users) {
+        prof_unlock(&user_mutex);
+        return -1;
+    }
+    if (worker->conn_count == worker->conn_capacity &&
+        worker_resize_table(worker, worker->conn_capacity ? worker->conn_capacity * 2 : 64) < 0) {
+        prof_unlock(&user_mutex);
+        return -1;
+    }
+    const size_t index = worker->conn_count++;
+    conn->index = index;
+    worker->conns[index] = conn;
+    worker->flags[index] = 0;
+    worker->join_seqs[index] = 0;
+    worker->queues[index] = (OutQueue){0};
+    user_count++;
+    if (replica) {
+        replica_member(replica, conn->nom, 1);
+    }
+    prof_unlock(&user_mutex);
+    return 0;
+}
+
+// Déconnexion d'un utilisateur
+static void delete_user(Connection *conn) {
+    Worker *worker = conn->worker;
+    prof_lock(&user_mutex);
+    // La dernière connexion prend la place libérée, toutes colonnes comprises
+    const size_t last = --worker->conn_count;
+    worker->conns[conn->index] = worker->conns[last];
+    worker->flags[conn->index] = worker->flags[last];
+    worker->join_seqs[conn->index] = worker->join_seqs[last];
+    worker->queues[conn->index] = worker->queues[last];
+    worker->conns[conn->index]->index = conn->index;
+    user_count--;
+    if (replica) {
+        replica_member(replica, conn->nom, 0);
+    }
+    prof_unlock(&user_mutex);
+}
+
+// Premier des count derniers messages jusqu'à last encore retenus
+static uint64_t history_window(const uint64_t last, const uint64_t count) {
+    const uint64_t first = history_first(&history);
+    const uint64_t window = last >= count ? last - count + 1 : 1;
+    return window > first ? window : first;
+}
+
+// Replay depuis le journal sur disque : une plage par segment, envoyée par sendfile.
+// Renvoie le dernier numéro couvert (le premier dans *covered), 0 si le journal n'a
+// rien de la plage ; la fin pas encore écrite reste à relire en mémoire.
+static uint64_t history_replay_log(Connection *conn, const uint64_t first, const uint64_t last, uint64_t *covered) {
+    LogRange ranges[HISTLOG_SEGMENTS];
+    const size_t count = histlog_ranges(history_log, first, last, ranges, HISTLOG_SEGMENTS);
+    for (size_t i = 0; i < count; ++i) {
+        if (ranges[i].length == 0) {
+            // Rien que des messages manquants : aucun octet dans le journal
+            histlog_release(ranges[i].segment);
+            continue;
+        }
+        Message *message = message_from_log(&ranges[i]);
+        if (!message) {
+            for (size_t j = i + 1; j < count; ++j) {
+                histlog_release(ranges[j].segment);
+            }
+            conn_close(conn);
+            break;
+        }
+        conn_enqueue(conn, message);
+        message_release(message);
+    }
+    if (!count) {
+        return 0;
+    }
+    *covered = ranges[0].first_seq;
+    return ranges[count - 1].last_seq;
+}
+
+// Rejoue les derniers messages diffusés avant l'arrivée de l'utilisateur, sauf dans
+// un grand salon (plus de -P utilisateurs) : le client demandera des pages s'il le
+// veut. Dans les deux cas HistoryEnd lui indique d'où paginer sans doublon.
+// Sans verrou : l'écrivain peut évincer un message pendant la lecture, il est alors
+// simplement sauté (il serait sorti de l'historique un instant plus tard)
+static void history_replay(Connection *conn) {
+    const uint64_t join_seq = conn->worker->join_seqs[conn->index];
+    uint64_t first = join_seq + 1;
+    if (paged_users > 0 && user_count <= paged_users) {
+        first = history_window(join_seq, REPLAY_MESSAGES);
+    } else {
+        atomic_fetch_add_explicit(&paged_joins, 1, memory_order_relaxed);
+    }
+
+    uint64_t seq = first;
+    // Le journal part par sendfile : pas vers un anneau en mémoire partagée
+    if (history_log && !conn->shm && first <= join_seq) {
+        uint64_t covered;
+        const uint64_t logged = history_replay_log(conn, first, join_seq, &covered);
+        if (logged) {
+            first = covered;
+            seq = logged + 1;
+        }
+    }
+    for (; seq <= join_seq && conn->state == CONN_ACTIVE; ++seq) {
+        size_t length;
+        const char *text = history_get(&history, &conn->worker->history_cursor, seq, &length);
+        // Vide : message perdu par un secours avant sa promotion, numéro seulement
+        if (!text || length == 0) {
+            continue;
+        }
+        Message *message = message_create(FRAME_TEXT, 0, text, length, 0);
+        if (!message) {
+            conn_close(conn);
+            return;
+        }
+        conn_enqueue(conn, message);
+        message_release(message);
+    }
+    const HistoryEnd end = {proto_hton64(first), proto_hton64(history_first(&history))};
+    conn_send(conn, FRAME_HISTORY_END, &end, sizeof(end));
+}
+
+static void on_replay(Timer *timer, void *arg) {
+    Connection *conn = arg;
+    if (conn->state != CONN_ACTIVE) {
+        return;
+    }
+    if (load_level() >= LOAD_SHEDDING) {
+        timer_schedule(&conn->worker->timers, timer, REPLAY_RETRY_MS);
+        return;
+    }
+    // Le flux en direct reprend après ce numéro : rien de plus récent n'a été envoyé
+    conn->worker->join_seqs[conn->index] = atomic_load_explicit(&history_seq, memory_order_acquire);
+    history_replay(conn);
+}
+
+// Surcharge (ou secours pas encore promu) : refus immédiat avec un délai conseillé
+// avant de réessayer
+static void conn_reject_busy(Connection *conn, const char *reason) {
+    const BusyPayload busy = {htonl(RETRY_AFTER_MS)};
+    char frame[sizeof(FrameHeader) + sizeof(busy)];
+    const size_t length = encode_frame(frame, FRAME_BUSY, 0, &busy, sizeof(busy));
+    // Le tampon d'envoi (ou l'anneau) est vide à ce stade : un seul envoi suffit
+    if (conn->shm) {
+        const struct iovec iov = {.iov_base = frame, .iov_len = length};
+        shm_write(&conn->shm->tx, &iov, 1);
+    } else if (send(conn->socket, frame, length, MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+        log_errno("Error sending the busy notice", errno);
+    }
+    atomic_fetch_add_explicit(&rejected_connections, 1, memory_order_relaxed);
+    log_conn(LOG_WARN, reason, conn);
+    conn_close(conn);
+}
+
+// Le nom est reçu : l'utilisateur rejoint le salon
+static void conn_activate(Connection *conn) {
+    conn->nom[sizeof(conn->nom) - 1] = '\0';
+    timer_cancel(&conn->worker->timers, &conn->handshake_timer);
+
+    if (atomic_load_explicit(&standby, memory_order_relaxed)) {
+        conn_reject_busy(conn, "Standby server, connection refused for");
+        return;
+    }
+    if (load_level() >= LOAD_OVERLOADED) {
+        conn_reject_busy(conn, "Server overloaded, connection refused for");
+        return;
+    }
+
+    //Si trop de monde
+    if (add_user(conn) < 0) {
+        log_refused(conn->nom);
+        conn_close(conn);
+        return;
+    }
+    conn->state = CONN_ACTIVE;
+    if (conn->worker->reads_paused) {
+        conn_apply_events(conn);
+    }
+    conn->last_activity_ms = conn->worker->now_ms;
+    timer_schedule(&conn->worker->timers, &conn->idle_timer, idle_timeout_ms);
+    // Décalage aléatoire pour étaler les pings de toutes les connexions
+    timer_schedule(&conn->worker->timers, &conn->heartbeat_timer,
+                   HEARTBEAT_INTERVAL_MS / 2 + (uint64_t)rand() % HEARTBEAT_INTERVAL_MS);
+
+    // Tout message déjà publié sera rejoué depuis l'historique. Replay différé : pas de
+    // direct avant lui, sinon l'historique arriverait sous les messages plus récents
+    if (load_level() >= LOAD_SHEDDING) {
+        conn->worker->join_seqs[conn->index] = UINT64_MAX;
+        atomic_fetch_add_explicit(&deferred_replays, 1, memory_order_relaxed);
+        timer_schedule(&conn->worker->timers, &conn->replay_timer, REPLAY_RETRY_MS);
+    } else {
+        conn->worker->join_seqs[conn->index] = atomic_load_explicit(&history_seq, memory_order_acquire);
+        history_replay(conn);
+    }
+
+    log_join(conn->nom);
+    //Affichage de la connection à tous les utilisateurs
+    char connection_formatted_message[MAX_LEN];
+    snprintf(connection_formatted_message, sizeof(connection_formatted_message), "\033[32m%s: %s is connected.\033[0m\n", "SERVER", conn->nom);
+    diffuse_notice(connection_formatted_message);
+}
+
+// Seaux de messages et d'octets : un message refusé n'est ni journalisé ni diffusé
+static int conn_admit(Connection *conn, const uint32_t length) {
+    const uint64_t now_ms = conn->worker->now_ms;
+    if (bucket_take(&conn->message_bucket, &message_limit, now_ms, 1)) {
+        if (bucket_take(&conn->byte_bucket, &byte_limit, now_ms, length)) {
+            conn->throttled = 0;
+            return 1;
+        }
+        bucket_refund(&conn->message_bucket, 1);
+    }
+
+    atomic_fetch_add_explicit(&conn->throttled_messages, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&conn->throttled_bytes, length, memory_order_relaxed);
+    atomic_fetch_add_explicit(&throttled_messages, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&throttled_bytes, length, memory_order_relaxed);
+
+    // Un seul avis par rafale, sinon l'avis lui-même devient un flot
+    if (!conn->throttled) {
+        conn->throttled = 1;
+        static const char notice[] = "\033[33mSERVER: you are sending too fast, messages are being dropped.\033[0m";
+        conn_send(conn, FRAME_TEXT, notice, sizeof(notice) - 1);
+        log_conn(LOG_DEBUG, "Rate limited", conn);
+    }
+    return 0;
+}
+
+// /search mots... : les messages les plus récents contenant tous les mots, envoyés au
+// seul demandeur, du plus ancien au plus récent
+static void conn_search(Connection *conn, const char *query, size_t length) {
+    while (length > 0 && *query == ' ') {
+        query++;
+        length--;
+    }
+    uint64_t seqs[SEARCH_RESULTS];
+    const uint64_t start = monotonic_ns();
+    const ssize_t found = search_query(search_index, query, length, seqs, SEARCH_RESULTS);
+    const uint64_t elapsed = monotonic_ns() - start;
+
+    char line[MAX_FRAME_PAYLOAD];
+    int line_len;
+    if (found < 0) {
+        line_len = snprintf(line, sizeof(line), "\033[33mSERVER: usage: /search word [word...]\033[0m");
+    } else {
+        line_len = snprintf(line, sizeof(line), "\033[36mSERVER: %zd result%s for \"%.*s\" (%.2f ms)\033[0m", found,
+                            found == 1 ? "" : "s", (int)length, query, (double)elapsed / 1e6);
+    }
+    conn_send(conn, FRAME_TEXT, line, (size_t)line_len < sizeof(line) ? (size_t)line_len : sizeof(line) - 1);
+
+    for (ssize_t i = found - 1; i >= 0 && conn->state == CONN_ACTIVE; --i) {
+        size_t text_len;
+        const char *text = history_get(&history, &conn->worker->history_cursor, seqs[i], &text_len);
+        if (!text) {
+            continue;
+        }
+        line_len = snprintf(line, sizeof(line), "\033[36m#%llu\033[0m %.*s", (unsigned long long)seqs[i],
+                            (int)text_len, text);
+        conn_send(conn, FRAME_TEXT, line, (size_t)line_len < sizeof(line) ? (size_t)line_len : sizeof(line) - 1);
+    }
+}
+
+// Page demandée : remplace celle éventuellement en cours, envoyée par conn_page_pump
+static void conn_history_request(Connection *conn, const HistoryRequest *request) {
+    const uint64_t last = atomic_load_explicit(&history_seq, memory_order_acquire);
+    uint64_t before = proto_ntoh64(request->before_seq);
+    if (before == 0 || before > last + 1) {
+        before = last + 1;
+    }
+    uint32_t count = ntohl(request->count);
+    if (count > MAX_HISTORY_PAGE) {
+        count = MAX_HISTORY_PAGE;
+    }
+    const uint64_t first = history_first(&history);
+    const uint64_t start = before > count ? before - count : 1;
+    conn->page_first = start > first ? start : first;
+    if (conn->page_first > before) {
+        conn->page_first = before;
+    }
+    conn->page_next = conn->page_first;
+    conn->page_end = before;
+    atomic_fetch_add_explicit(&history_pages, 1, memory_order_relaxed);
+    conn_page_pump(conn);
+}
+
+static void handle_frame(Connection *conn, const FrameHeader *header, const char *payload,
+                         const uint64_t received_ns) {
+    switch (header->type) {
+        case FRAME_CHAT: {
+            if (!conn_admit(conn, header->length)) {
+                break;
+            }
+            // Commande de recherche : ni journalisée ni diffusée
+            if (header->length >= 7 && memcmp(payload, "/search", 7) == 0 &&
+                (header->length == 7 || payload[7] == ' ')) {
+                conn_search(conn, payload + 7, header->length - 7);
+                break;
+            }
+            // Créer un message formaté avec une taille suffisante
+            char formatted_message[MAX_LEN + sizeof(conn->nom) + 10];
+            snprintf(formatted_message, sizeof(formatted_message), "%s : %.*s", conn->nom,
+                     (int)header->length, payload);
+
+            const uint64_t trace_id = trace_sample();
+            if (trace_id) {
+                trace_record(trace_id, TRACE_RECV, conn->socket, received_ns);
+                trace_record(trace_id, TRACE_PARSE, conn->socket, realtime_ns());
+            }
+
+            log_chat(conn->nom, payload, header->length);
+
+            // Diffuser le message à tous les utilisateurs et le stocker
+            diffuse_message(formatted_message, trace_id);
+            break;
+        }
+        case FRAME_HISTORY_REQUEST: {
+            HistoryRequest request;
+            if (header->length != sizeof(request) || !conn_admit(conn, header->length)) {
+                break;
+            }
+            memcpy(&request, payload, sizeof(request));
+            conn_history_request(conn, &request);
+            break;
+        }
+        case FRAME_TRACE: {
+            // Accusé d'affichage d'un message tracé
+            TraceDisplay display;
+            if (header->length == sizeof(display)) {
+                memcpy(&display, payload, sizeof(display));
+                trace_record(proto_ntoh64(display.trace_id), TRACE_DISPLAY, conn->socket,
+                             proto_ntoh64(display.display_ns));
+            }
+            break;
+        }
+        case FRAME_PING:
+        case FRAME_PONG: {
+            PingPayload ping;
+            if (header->length != sizeof(ping)) {
+                break;
+            }
+            memcpy(&ping, payload, sizeof(ping));
+            if (header->type == FRAME_PING) {
+                ping.reply_ns = proto_hton64(rtt_clock_ns());
+                conn_send(conn, FRAME_PONG, &ping, sizeof(ping));
+            } else {
+                prof_lock(&user_mutex);
+                rtt_add(&conn->rtt, rtt_clock_ns() - proto_ntoh64(ping.origin_ns));
+                prof_unlock(&user_mutex);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Découpe les trames complètes du tampon de lecture
+// Traite les trames complètes de data ; renvoie le nombre d'octets consommés
+static size_t conn_parse(Connection *conn, const char *data, const size_t len, const uint64_t received_ns) {
+    size_t offset = 0;
+    while (conn->state == CONN_ACTIVE && len - offset >= sizeof(FrameHeader)) {
+        FrameHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        header.length = ntohl(header.length);
+        if (header.length > MAX_LEN - 1) {
+            // Trame trop grande pour un client légitime
+            log_conn(LOG_WARN, "Oversized frame, connection closed", conn);
+            conn_close(conn);
+            break;
+        }
+        if (len - offset < sizeof(header) + header.length) {
+            break;
+        }
+        handle_frame(conn, &header, data + offset + sizeof(header), received_ns);
+        offset += sizeof(header) + header.length;
+    }
+    return offset;
+}
+
+// Les tampons libérés restent dans le cache slab du worker : pas de réserve à gérer ici
+static InBuffer *in_buffer_acquire(Worker *worker) {
+    InBuffer *buffer = slab_alloc(sizeof(InBuffer));
+    if (buffer) {
+        worker->in_buffers++;
+    }
+    return buffer;
+}
+
+static void in_buffer_release(Worker *worker, InBuffer *buffer) {
+    worker->in_buffers--;
+    slab_free(buffer);
+}
+
+// Données reçues : dans le tampon privé s'il existe, sinon dans le tampon partagé.
+// Seule une trame incomplète est recopiée dans un tampon privé.
+static void conn_consume(Connection *conn, const size_t received, const uint64_t received_ns) {
+    Worker *worker = conn->worker;
+    if (conn->in) {
+        conn->in_len += received;
+        const size_t consumed = conn_parse(conn, conn->in->data, conn->in_len, received_ns);
+        conn->in_len -= consumed;
+        if (conn->in_len == 0) {
+            in_buffer_release(worker, conn->in);
+            conn->in = NULL;
+        } else if (consumed > 0) {
+            memmove(conn->in->data, conn->in->data + consumed, conn->in_len);
+        }
+        return;
+    }
 
-typedef struct User {
-    char nom[100];
-    int socket;
-} User;
+    const size_t consumed = conn_parse(conn, worker->read_buffer, received, received_ns);
+    if (consumed == received || conn->state == CONN_CLOSING) {
+        return;
+    }
+    // Le reste est forcément une trame incomplète de taille valide (< IN_BUFFER_SIZE)
+    conn->in = in_buffer_acquire(worker);
+    if (!conn->in) {
+        conn_close(conn);
+        return;
+    }
+    conn->in_len = received - consumed;
+    memcpy(conn->in->data, worker->read_buffer + consumed, conn->in_len);
+}
 
-User connected_users[MAX_USERS];
-int user_count = 0;
-pthread_mutex_t user_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Tableau pour stocker les 50 derniers messages
-char last_messages[MAX_STORED_MESSAGES][MAX_LEN];
-int last_message_index = 0;
-pthread_mutex_t messages_mutex = PTHREAD_MUTEX_INITIALIZER; // Mutex pour protéger l'accès aux messages
-
-//Nouvel utilisateur connecté
-int add_user(const User *user) {
-    pthread_mutex_lock(&user_mutex);
-    if (user_count >= MAX_USERS) {
-        pthread_mutex_unlock(&user_mutex);
+// Lecture depuis la socket ou l'anneau partagé, avec les conventions de recv. Un
+// anneau vidé est armé avant de rendre la main : le client sonnera au prochain envoi.
+static ssize_t conn_recv(Connection *conn, void *buffer, const size_t length) {
+    if (!conn->shm) {
+        return recv(conn->socket, buffer, length, 0);
+    }
+    size_t received = 0;
+    do {
+        received += shm_read(&conn->shm->rx, (char *)buffer + received, length - received);
+    } while (received < length && shm_arm_read(&conn->shm->rx));
+    if (received == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return (ssize_t)received;
+}
+
+// Au plus READ_QUANTUM octets par tour : epoll (déclenché par niveau) signale
+// de nouveau la connexion à l'itération suivante s'il reste des données
+static void conn_read(Connection *conn) {
+    if (conn->shm) {
+        shm_bell_clear(conn->shm->rx.bell);
+    }
+    conn->read_deficit += READ_QUANTUM;
+    while (conn->state != CONN_CLOSING) {
+        // Pendant la poignée de main on ne lit que le nom, les trames peuvent suivre
+        char *target;
+        size_t room;
+        if (conn->state == CONN_HANDSHAKE) {
+            target = conn->nom + conn->in_len;
+            room = sizeof(conn->nom) - conn->in_len;
+        } else if (conn->in) {
+            target = conn->in->data + conn->in_len;
+            room = sizeof(conn->in->data) - conn->in_len;
+        } else {
+            target = conn->worker->read_buffer;
+            room = sizeof(conn->worker->read_buffer);
+        }
+        if (conn->read_deficit == 0) {
+            atomic_fetch_add_explicit(&conn->worker->read_exhausted, 1, memory_order_relaxed);
+            // L'anneau n'est pas armé : la sonnette tient lieu du niveau d'une socket
+            if (conn->shm) {
+                shm_bell_ring(conn->shm->rx.bell);
+            }
+            return;
+        }
+        if (room > conn->read_deficit) {
+            room = conn->read_deficit;
+        }
+
+        const ssize_t received = conn_recv(conn, target, room);
+        if (received == 0) {
+            conn_close(conn);
+            return;
+        }
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_close(conn);
+            }
+            conn->read_deficit = 0;
+            return;
+        }
+        conn->read_deficit -= (size_t)received;
+        atomic_fetch_add_explicit(&conn->read_bytes, (uint64_t)received, memory_order_relaxed);
+        conn->last_activity_ms = conn->worker->now_ms;
+
+        if (conn->state == CONN_HANDSHAKE) {
+            conn->in_len += (size_t)received;
+            if (conn->in_len == sizeof(conn->nom)) {
+                conn->in_len = 0;
+                conn_activate(conn);
+            }
+            continue;
+        }
+        conn_consume(conn, (size_t)received, realtime_ns());
+        if ((size_t)received < room) {
+            conn->read_deficit = 0;
+            return;
+        }
+    }
+}
+
+// Client en mémoire partagée (-S) : crée ses anneaux, les lui transmet sur la socket
+// de rattachement et inscrit la sonnette du serveur. -1 en cas d'erreur.
+static int conn_attach_shm(Connection *conn) {
+    Worker *worker = conn->worker;
+    ShmLink *link = malloc(sizeof(ShmLink));
+    if (!link) {
+        return -1;
+    }
+    if (shm_link_create(link) < 0) {
+        free(link);
         return -1;
     }
-    connected_users[user_count++] = *user;
-    pthread_mutex_unlock(&user_mutex);
+    // Armé avant que le client ne puisse écrire : son nom fera sonner
+    shm_arm_read(&link->rx);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = conn};
+    if (shm_link_send(link, conn->socket) < 0 || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, link->rx.bell, &event) < 0) {
+        shm_link_destroy(link);
+        free(link);
+        return -1;
+    }
+    conn->shm = link;
+    worker->shm_links++;
+    worker->shm_bytes += link->size;
     return 0;
 }
 
-//Déconnexion d'un utilisateur
-void delete_user(const int socket) {
-    pthread_mutex_lock(&user_mutex);
-    for (int i = 0; i < user_count; ++i) {
-        if (connected_users[i].socket == socket) {
-            connected_users[i] = connected_users[user_count - 1];
-            user_count--;
-            break;
+static void conn_detach_shm(Connection *conn) {
+    Worker *worker = conn->worker;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->shm->rx.bell, NULL);
+    worker->shm_links--;
+    worker->shm_bytes -= conn->shm->size;
+    shm_link_destroy(conn->shm);
+    free(conn->shm);
+    conn->shm = NULL;
+}
+
+static void worker_accept(Worker *worker, const int listener) {
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        const int socket = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                log_errno("Acceptation Error", errno);
+            }
+            return;
+        }
+
+        Connection *conn = slab_calloc(sizeof(Connection));
+        if (!conn) {
+            close(socket);
+            continue;
+        }
+        worker->connections++;
+        conn->socket = socket;
+        conn->state = CONN_HANDSHAKE;
+        conn->worker = worker;
+        bucket_init(&conn->message_bucket, &message_limit, worker->now_ms);
+        bucket_init(&conn->byte_bucket, &byte_limit, worker->now_ms);
+        timer_init(&conn->handshake_timer, on_handshake_timeout, conn);
+        timer_init(&conn->idle_timer, on_idle_timeout, conn);
+        timer_init(&conn->heartbeat_timer, on_heartbeat, conn);
+        timer_init(&conn->replay_timer, on_replay, conn);
+        // Les écritures sont déjà regroupées par conn_flush : Nagle ne ferait qu'attendre
+        // l'accusé différé du client (~40 ms) derrière une rafale
+        const int enable = 1;
+        if (listener == listen_socket) {
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        // SO_ZEROCOPY n'existe pas sur les sockets Unix : l'échec laisse la copie
+        conn->zerocopy = zerocopy_min && setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+
+        if (listener == shm_socket && conn_attach_shm(conn) < 0) {
+            log_errno("Error creating a shared-memory link", errno);
+            close(socket);
+            worker->connections--;
+            slab_free(conn);
+            continue;
         }
+
+        struct epoll_event event = {.events = conn->shm ? EPOLLRDHUP : EPOLLIN, .data.ptr = conn};
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, socket, &event) < 0) {
+            log_errno("Error registering a connection", errno);
+            if (conn->shm) {
+                conn_detach_shm(conn);
+            }
+            close(socket);
+            worker->connections--;
+            slab_free(conn);
+            continue;
+        }
+        // Le client doit envoyer son nom avant l'échéance
+        timer_schedule(&worker->timers, &conn->handshake_timer, handshake_timeout_ms);
     }
-    pthread_mutex_unlock(&user_mutex);
 }
 
-// Fonction pour stocker un message dans le tableau global
-void store_message(const char *message) {
-    pthread_mutex_lock(&messages_mutex);
-    snprintf(last_messages[last_message_index], MAX_LEN, "%s", message);
-    last_message_index = (last_message_index + 1) % MAX_STORED_MESSAGES;
-    pthread_mutex_unlock(&messages_mutex);
+// Distribue un lot de messages en un seul passage sur la table, destinataire par
+// destinataire, sans toucher aux structures Connection. Les références sont prises
+// une fois par message à la fin : la trame partagée n'est modifiée qu'une fois.
+static void worker_broadcast(Worker *worker, Message **messages, const size_t count) {
+    uint32_t refs[BROADCAST_BATCH] = {0};
+    for (size_t k = 0; k < worker->conn_count; ++k) {
+        if (worker->flags[k] & SLOT_CLOSING) {
+            continue;
+        }
+        OutQueue *queue = &worker->queues[k];
+        const uint64_t join_seq = worker->join_seqs[k];
+        int queued = 0;
+        for (size_t i = 0; i < count; ++i) {
+            Message *message = messages[i];
+            if (message->seq <= join_seq) {
+                continue;
+            }
+            if (queue->bytes + message->length > MAX_OUT_BYTES) {
+                log_conn(LOG_WARN, "Slow consumer disconnected", worker->conns[k]);
+                conn_close(worker->conns[k]);
+                break;
+            }
+            if (queue_push(worker, queue, message) < 0) {
+                conn_close(worker->conns[k]);
+                break;
+            }
+            refs[i]++;
+            queued = 1;
+            if (message->trace_id) {
+                trace_record(message->trace_id, TRACE_ENQUEUE, worker->conns[k]->socket, realtime_ns());
+            }
+        }
+        if (queued) {
+            worker_mark_dirty(worker, k);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (refs[i]) {
+            atomic_fetch_add_explicit(&messages[i]->refs, refs[i], memory_order_relaxed);
+        }
+    }
 }
 
-// Fonction pour diffuser un message à tous les utilisateurs et le stocker
-void diffuse_message(const char *message) {
-    // Stockage du message avant la diffusion
-    store_message(message);
+// Distribue les messages reçus aux connexions actives du worker
+static void worker_drain_inbox(Worker *worker) {
+    // Échange des tableaux : les autres threads déposent pendant la distribution
+    prof_lock(&worker->inbox_mutex);
+    Message **messages = worker->inbox;
+    const size_t count = worker->inbox_count;
+    const size_t capacity = worker->inbox_capacity;
+    worker->inbox = worker->draining;
+    worker->inbox_capacity = worker->draining_capacity;
+    worker->inbox_count = 0;
+    worker->draining = messages;
+    worker->draining_capacity = capacity;
+    prof_unlock(&worker->inbox_mutex);
 
-    pthread_mutex_lock(&user_mutex);
-    for (int i = 0; i < user_count; ++i) {
-        if (send(connected_users[i].socket, message, strlen(message), 0) < 0) {
-            perror("Error sending to the client");
+    if (count == 0) {
+        atomic_store_explicit(&worker->inbox_depth, 0, memory_order_relaxed);
+        return;
+    }
+    const size_t recipients = worker->conn_count;
+    const uint64_t start = cycle_count();
+    for (size_t i = 0; i < count; i += BROADCAST_BATCH) {
+        const size_t batch = count - i < BROADCAST_BATCH ? count - i : BROADCAST_BATCH;
+        worker_broadcast(worker, messages + i, batch);
+        for (size_t j = 0; j < batch; ++j) {
+            message_release(messages[i + j]);
         }
     }
-    pthread_mutex_unlock(&user_mutex);
+    const uint64_t cycles = cycle_count() - start;
+
+    atomic_store_explicit(&worker->inbox_depth, count, memory_order_relaxed);
+    // Seul le worker écrit ses compteurs : pas besoin d'incrément atomique
+    atomic_store_explicit(&worker->broadcast_messages,
+                          atomic_load_explicit(&worker->broadcast_messages, memory_order_relaxed) + count,
+                          memory_order_relaxed);
+    atomic_store_explicit(&worker->broadcast_recipients,
+                          atomic_load_explicit(&worker->broadcast_recipients, memory_order_relaxed) +
+                          count * recipients, memory_order_relaxed);
+    atomic_store_explicit(&worker->broadcast_cycles,
+                          atomic_load_explicit(&worker->broadcast_cycles, memory_order_relaxed) + cycles,
+                          memory_order_relaxed);
 }
 
-void *client_handler(void *arg) {
-    const int socketClient = *(int *)arg;
-    free(arg);
+static void worker_flush_dirty(Worker *worker) {
+    // Les connexions re-marquées pendant l'écriture vont dans la liste suivante
+    Connection **conns = worker->dirty;
+    const size_t count = worker->dirty_count;
+    worker->dirty = worker->flushing;
+    worker->dirty_count = 0;
+    worker->flushing = conns;
+    for (size_t i = 0; i < count; ++i) {
+        Connection *conn = conns[i];
+        if (!conn) {
+            continue;
+        }
+        worker->flags[conn->index] &= (uint8_t)~SLOT_DIRTY;
+        if (conn->state != CONN_CLOSING && !conn->want_write) {
+            conn_flush(conn);
+        }
+    }
+}
 
-    User user;
-    if (recv(socketClient, &user, sizeof(user), 0) <= 0) {
-        close(socketClient);
-        pthread_exit(NULL);
+static void conn_destroy(Connection *conn) {
+    Worker *worker = conn->worker;
+    timer_cancel(&worker->timers, &conn->handshake_timer);
+    timer_cancel(&worker->timers, &conn->idle_timer);
+    timer_cancel(&worker->timers, &conn->heartbeat_timer);
+    timer_cancel(&worker->timers, &conn->replay_timer);
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->socket, NULL);
+    if (conn->shm) {
+        conn_detach_shm(conn);
+    }
+    if (conn->zerocopy_head) {
+        // Des trames envoyées sans copie sont encore en file dans le noyau : fermeture
+        // abrupte, il les abandonne au lieu de les lire dans des pages bientôt réutilisées
+        const struct linger abort_close = {1, 0};
+        setsockopt(conn->socket, SOL_SOCKET, SO_LINGER, &abort_close, sizeof(abort_close));
+        while (conn->zerocopy_head) {
+            ZeroCopySend *send = conn->zerocopy_head;
+            conn->zerocopy_head = send->next;
+            zerocopy_release(send);
+        }
     }
+    close(conn->socket);
 
-    user.socket = socketClient;
+    if (conn->in) {
+        in_buffer_release(worker, conn->in);
+    }
+    if (conn->was_active) {
+        OutQueue *queue = conn_queue(conn);
+        worker->out_bytes -= queue->bytes;
+        worker->out_nodes -= queue->nodes;
+        while (queue->head) {
+            OutNode *node = queue->head;
+            queue->head = node->next;
+            message_release(node->message);
+            slab_free(node);
+        }
+        delete_user(conn);
+        log_leave(conn->nom);
+        //Affichage des messages de déconnection
+        char disconnection_formatted_message[MAX_LEN];
+        snprintf(disconnection_formatted_message, sizeof(disconnection_formatted_message), "\033[31m%s: %s disconnected.\033[0m", "SERVER", conn->nom);
+        diffuse_notice(disconnection_formatted_message);
+    }
+    worker->connections--;
+    slab_free(conn);
+}
 
-    //Si trop de monde
-    if (add_user(&user) < 0) {
-        printf("Server is full, connection refused for %s\n", user.nom);
-        close(socketClient);
-        pthread_exit(NULL);
+static void worker_close_pending(Worker *worker) {
+    while (worker->closing) {
+        Connection *conn = worker->closing;
+        worker->closing = conn->next_closing;
+        // Une connexion fermée peut encore figurer dans la liste des connexions à écrire
+        if (conn->was_active && (worker->flags[conn->index] & SLOT_DIRTY)) {
+            for (size_t i = 0; i < worker->dirty_count; ++i) {
+                if (worker->dirty[i] == conn) {
+                    worker->dirty[i] = NULL;
+                    break;
+                }
+            }
+        }
+        conn_destroy(conn);
     }
+}
 
-    printf("\033[32m%s is connected.\033[0m\n", user.nom);
-    //Affichage de la connection à tous les utilisateurs
-    char connection_formatted_message[MAX_LEN];
-    snprintf(connection_formatted_message, sizeof(connection_formatted_message), "\033[32m%s: %s is connected.\033[0m\n", "SERVER", user.nom);
-    diffuse_message(connection_formatted_message);
+// Mémoire détenue par une connexion : structure, entrée en attente, file d'écriture.
+// Les trames diffusées sont partagées : elles sont comptées ici pour chaque destinataire.
+// Lecture sans verrou depuis l'admin : valeurs indicatives.
+static size_t conn_memory(const Worker *worker, const size_t index) {
+    const OutQueue *queue = &worker->queues[index];
+    return sizeof(Connection) + (__atomic_load_n(&worker->conns[index]->in, __ATOMIC_RELAXED) ? sizeof(InBuffer) : 0)
+           + __atomic_load_n(&queue->bytes, __ATOMIC_RELAXED)
+           + __atomic_load_n(&queue->nodes, __ATOMIC_RELAXED) * sizeof(OutNode);
+}
+
+// Total réel : chaque trame n'est comptée qu'une fois
+static size_t memory_used(void) {
+    size_t used = atomic_load_explicit(&message_bytes, memory_order_relaxed) + history_reserved(&history);
+    for (int i = 0; i < worker_count; ++i) {
+        used += atomic_load_explicit(&workers[i]->memory_bytes, memory_order_relaxed);
+    }
+    return used;
+}
+
+// Rend au système les tableaux surdimensionnés après un pic
+static void worker_shrink_buffers(Worker *worker) {
+    free(worker->draining);
+    worker->draining = NULL;
+    worker->draining_capacity = 0;
+
+    prof_lock(&user_mutex);
+    if (worker->conn_capacity > worker->conn_count * 2 && worker->conn_count > 0) {
+        worker_resize_table(worker, worker->conn_count);
+    }
+    prof_unlock(&user_mutex);
+    malloc_trim(0);
+    atomic_fetch_add_explicit(&memory_shrinks, 1, memory_order_relaxed);
+}
+
+static void worker_pause_reads(Worker *worker, const int paused) {
+    worker->reads_paused = paused;
+    worker->paused_since_ms = worker->now_ms;
+    for (size_t i = 0; i < worker->conn_count; ++i) {
+        conn_apply_events(worker->conns[i]);
+    }
+    if (paused) {
+        atomic_fetch_add_explicit(&memory_pauses, 1, memory_order_relaxed);
+    }
+    log_text(paused ? LOG_WARN : LOG_INFO, paused ? "Memory pressure: reads paused" : "Memory pressure: reads resumed");
+}
+
+// Le client le plus en retard est celui qui retient le plus de trames
+static void worker_evict_slowest(Worker *worker) {
+    Connection *slowest = NULL;
+    uint32_t slowest_bytes = 0;
+    for (size_t i = 0; i < worker->conn_count; ++i) {
+        if (!(worker->flags[i] & SLOT_CLOSING) && worker->queues[i].bytes > slowest_bytes) {
+            slowest = worker->conns[i];
+            slowest_bytes = worker->queues[i].bytes;
+        }
+    }
+    if (slowest) {
+        atomic_fetch_add_explicit(&memory_evictions, 1, memory_order_relaxed);
+        log_conn(LOG_WARN, "Memory pressure, slowest consumer disconnected", slowest);
+        conn_close(slowest);
+    }
+}
+
+static void worker_update_memory(Worker *worker) {
+    atomic_store_explicit(&worker->memory_bytes,
+                          sizeof(Worker) + worker->connections * sizeof(Connection) +
+                          worker->in_buffers * sizeof(InBuffer) +
+                          worker->out_nodes * sizeof(OutNode) +
+                          worker->shm_links * sizeof(ShmLink) + worker->shm_bytes +
+                          (worker->inbox_capacity + worker->draining_capacity) * sizeof(Message *) +
+                          worker->conn_capacity * (3 * sizeof(Connection *) + sizeof(uint8_t) +
+                                                   sizeof(uint64_t) + sizeof(OutQueue)),
+                          memory_order_relaxed);
+
+    const size_t used = memory_used();
+    int level = MEMORY_OK;
+    if (used >= memory_budget) {
+        level = MEMORY_EVICT;
+    } else if (used >= memory_budget / 10 * 9) {
+        level = MEMORY_PAUSE;
+    } else if (used >= memory_budget / 10 * 8) {
+        level = MEMORY_SHRINK;
+    }
+
+    if (level >= MEMORY_SHRINK && worker->memory_level < MEMORY_SHRINK) {
+        worker_shrink_buffers(worker);
+    }
+    // Reprise des lectures seulement sous 80 % : pas d'oscillation autour du seuil
+    if (level >= MEMORY_PAUSE && !worker->reads_paused) {
+        worker_pause_reads(worker, 1);
+    } else if (level == MEMORY_OK && worker->reads_paused) {
+        worker_pause_reads(worker, 0);
+    }
+    // Si les retardataires ne lisent toujours pas, la pause bloquerait tout le salon
+    if (level >= MEMORY_EVICT) {
+        worker_evict_slowest(worker);
+    } else if (worker->reads_paused && worker->now_ms - worker->paused_since_ms >= MEMORY_PAUSE_GRACE_MS) {
+        worker_evict_slowest(worker);
+        worker->paused_since_ms = worker->now_ms;
+    }
+    worker->memory_level = level;
+}
+
+// Un événement prêt attend au pire la fin de l'itération en cours : la durée des
+// itérations (moyenne glissante 1/8) mesure la latence de la boucle
+static void worker_update_load(Worker *worker, const uint64_t busy_us) {
+    const uint64_t lag_us = (7 * atomic_load_explicit(&worker->lag_us, memory_order_relaxed) + busy_us) / 8;
+    atomic_store_explicit(&worker->lag_us, lag_us, memory_order_relaxed);
+    if (busy_us > atomic_load_explicit(&worker->max_lag_us, memory_order_relaxed)) {
+        atomic_store_explicit(&worker->max_lag_us, busy_us, memory_order_relaxed);
+    }
+    atomic_store_explicit(&worker->queued_bytes, worker->out_bytes, memory_order_relaxed);
+
+    const uint64_t shed_us = (uint64_t)shed_lag_ms * 1000;
+    int level = LOAD_NORMAL;
+    if (lag_us >= shed_us * OVERLOAD_FACTOR || worker->out_bytes >= shed_queue_bytes * OVERLOAD_FACTOR) {
+        level = LOAD_OVERLOADED;
+    } else if (lag_us >= shed_us || worker->out_bytes >= shed_queue_bytes) {
+        level = LOAD_SHEDDING;
+    }
+    if (level != atomic_load_explicit(&worker->load, memory_order_relaxed)) {
+        char line[96];
+        snprintf(line, sizeof(line), "Worker %d load: %s (lag %llu us, %zu bytes queued)", worker->id,
+                 load_level_names[level], (unsigned long long)lag_us, worker->out_bytes);
+        log_text(level == LOAD_NORMAL ? LOG_INFO : LOG_WARN, line);
+        atomic_store_explicit(&worker->load, level, memory_order_relaxed);
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    current_worker = worker;
+    struct epoll_event events[MAX_EVENTS];
 
-    char buffer[MAX_LEN];
-    while (1) {
-        const ssize_t bytes_received = recv(socketClient, buffer, sizeof(buffer) - 1, 0);
-        if (bytes_received <= 0) {
+    while (!atomic_load_explicit(&stopping, memory_order_relaxed)) {
+        int timeout = timer_wheel_timeout(&worker->timers);
+        // Des connexions ont épuisé leur crédit d'écriture : pas d'attente
+        if (worker->dirty_count) {
+            timeout = 0;
+        }
+        // Sous charge, on se réveille régulièrement pour que la mesure redescende
+        if ((atomic_load_explicit(&worker->load, memory_order_relaxed) != LOAD_NORMAL ||
+             worker->memory_level != MEMORY_OK) &&
+            (timeout < 0 || timeout > LOAD_CHECK_MS)) {
+            timeout = LOAD_CHECK_MS;
+        }
+        const int count = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, timeout);
+        if (count < 0 && errno != EINTR) {
+            log_errno("epoll_wait", errno);
             break;
         }
-        buffer[bytes_received] = '\0';
+        const uint64_t start_us = monotonic_us();
+        worker->now_ms = start_us / 1000;
+        worker->round++;
+        // Avant les événements : la roue doit être à l'heure quand ils arment des
+        // minuteries (une connexion acceptée après un long sommeil expirait aussitôt)
+        timer_wheel_advance(&worker->timers, worker->now_ms);
+
+        for (int i = 0; i < count; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &listen_socket || ptr == &unix_socket || ptr == &shm_socket) {
+                worker_accept(worker, *(int *)ptr);
+            } else if (ptr == worker) {
+                uint64_t value;
+                if (read(worker->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    log_errno("Error reading a worker eventfd", errno);
+                }
+            } else {
+                Connection *conn = ptr;
+                if ((events[i].events & EPOLLERR) && conn->zerocopy_head) {
+                    conn_zerocopy_reap(conn);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    conn_read(conn);
+                }
+                // Mémoire partagée : EPOLLIN vient de la sonnette (données ou place libérée),
+                // EPOLLRDHUP de la socket de rattachement (après lecture de ce qui reste)
+                if (conn->shm && (events[i].events & (EPOLLRDHUP | EPOLLHUP))) {
+                    conn_read(conn);
+                    conn_close(conn);
+                }
+                const int writable = (events[i].events & EPOLLOUT) || (conn->shm && conn->want_write);
+                if (writable && conn->state != CONN_CLOSING) {
+                    conn_flush(conn);
+                }
+            }
+        }
+
+        worker_update_memory(worker);
+
+        // Une fermeture diffuse un message de départ dans notre propre boîte
+        // (sans réveil) : on recommence tant qu'il reste des connexions à fermer
+        do {
+            worker_close_pending(worker);
+            worker_drain_inbox(worker);
+            worker_flush_dirty(worker);
+        } while (worker->closing);
+
+        worker_update_load(worker, monotonic_us() - start_us);
+    }
+    return NULL;
+}
+
+static Worker *worker_create(const int id) {
+    Worker *worker = calloc(1, sizeof(Worker));
+    if (!worker) {
+        return NULL;
+    }
+    worker->id = id;
+    worker->inbox_mutex = (ProfMutex)PROF_MUTEX_INITIALIZER("inbox_mutex");
+    worker->now_ms = monotonic_ms();
+    timer_wheel_init(&worker->timers, worker->now_ms);
+    history_cursor_init(&worker->history_cursor);
+
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (worker->epoll_fd < 0 || worker->wake_fd < 0) {
+        free(worker);
+        return NULL;
+    }
+
+    // EPOLLEXCLUSIVE : une seule boucle est réveillée par connexion entrante.
+    // data.ptr désigne la variable du descripteur d'écoute, pour les distinguer.
+    struct epoll_event listen_event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &listen_socket};
+    struct epoll_event unix_event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &unix_socket};
+    struct epoll_event shm_event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = &shm_socket};
+    struct epoll_event wake_event = {.events = EPOLLIN, .data.ptr = worker};
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, listen_socket, &listen_event) < 0 ||
+        (unix_socket >= 0 && epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, unix_socket, &unix_event) < 0) ||
+        (shm_socket >= 0 && epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, shm_socket, &shm_event) < 0) ||
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &wake_event) < 0) {
+        free(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+
+// Commandes d'administration
+static void admin_locks(FILE *out, const char *args) {
+    (void)args;
+    lockprof_dump(out);
+}
+
+static void admin_users(FILE *out, const char *args) {
+    (void)args;
+    prof_lock(&user_mutex);
+    fprintf(out, "%d/%d users connected\n", user_count, max_users);
+    for (int w = 0; w < worker_count; ++w) {
+        for (size_t i = 0; i < workers[w]->conn_count; ++i) {
+            const Connection *conn = workers[w]->conns[i];
+            fprintf(out, "  %s (socket %d, worker %d)\n", conn->nom, conn->socket, w);
+        }
+    }
+    prof_unlock(&user_mutex);
+}
+
+static void admin_workers(FILE *out, const char *args) {
+    (void)args;
+    prof_lock(&user_mutex);
+    for (int w = 0; w < worker_count; ++w) {
+        fprintf(out, "worker %d: %zu users, %zu timers armed, %zu shared-memory links\n", w,
+                workers[w]->conn_count, workers[w]->timers.count, workers[w]->shm_links);
+    }
+    prof_unlock(&user_mutex);
+}
+
+// Temps aller-retour par connexion, puis sur l'ensemble des connexions
+static void admin_rtt(FILE *out, const char *args) {
+    (void)args;
+    char line[160];
+    uint32_t *all = NULL;
+    size_t all_count = 0;
+
+    prof_lock(&user_mutex);
+    all = malloc(((size_t)user_count + 1) * RTT_WINDOW * sizeof(uint32_t));
+    for (int w = 0; w < worker_count; ++w) {
+        for (size_t i = 0; i < workers[w]->conn_count; ++i) {
+            const Connection *conn = workers[w]->conns[i];
+            RttSummary summary;
+            rtt_summary(&conn->rtt, &summary);
+            rtt_format(&summary, line, sizeof(line));
+            fprintf(out, "  %-20s %s\n", conn->nom, line);
+            if (all) {
+                memcpy(all + all_count, conn->rtt.samples_us, conn->rtt.count * sizeof(uint32_t));
+                all_count += conn->rtt.count;
+            }
+        }
+    }
+    prof_unlock(&user_mutex);
+
+    if (all) {
+        RttSummary summary;
+        rtt_summary_of(all, all_count, &summary);
+        rtt_format(&summary, line, sizeof(line));
+        fprintf(out, "all connections: %s\n", line);
+        free(all);
+    }
+}
+
+static void admin_throttle(FILE *out, const char *args) {
+    (void)args;
+    fprintf(out, "limits: %u msg/s (burst %u), %u bytes/s (burst %u)\n", message_limit.rate,
+            message_limit.burst, byte_limit.rate, byte_limit.burst);
+    fprintf(out, "throttled: %llu messages, %llu bytes\n",
+            (unsigned long long)atomic_load_explicit(&throttled_messages, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&throttled_bytes, memory_order_relaxed));
+    prof_lock(&user_mutex);
+    for (int w = 0; w < worker_count; ++w) {
+        for (size_t i = 0; i < workers[w]->conn_count; ++i) {
+            Connection *conn = workers[w]->conns[i];
+            const uint64_t messages = atomic_load_explicit(&conn->throttled_messages, memory_order_relaxed);
+            if (messages) {
+                fprintf(out, "  %-20s %llu messages, %llu bytes\n", conn->nom, (unsigned long long)messages,
+                        (unsigned long long)atomic_load_explicit(&conn->throttled_bytes, memory_order_relaxed));
+            }
+        }
+    }
+    prof_unlock(&user_mutex);
+}
+
+static void admin_load(FILE *out, const char *args) {
+    (void)args;
+    fprintf(out, "load: %s (shed above %u ms lag or %zu bytes queued, refuse above x%d)\n",
+            load_level_names[load_level()], shed_lag_ms, shed_queue_bytes, OVERLOAD_FACTOR);
+    for (int w = 0; w < worker_count; ++w) {
+        const Worker *worker = workers[w];
+        fprintf(out, "  worker %d: %-10s lag %llu us (max %llu us), %zu bytes queued, %zu messages last drain\n",
+                w, load_level_names[atomic_load_explicit(&worker->load, memory_order_relaxed)],
+                (unsigned long long)atomic_load_explicit(&worker->lag_us, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&worker->max_lag_us, memory_order_relaxed),
+                atomic_load_explicit(&worker->queued_bytes, memory_order_relaxed),
+                atomic_load_explicit(&worker->inbox_depth, memory_order_relaxed));
+    }
+    fprintf(out, "rejected connections: %llu, dropped notices: %llu, deferred replays: %llu\n",
+            (unsigned long long)atomic_load_explicit(&rejected_connections, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&shed_notices, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&deferred_replays, memory_order_relaxed));
+}
+
+// Messages retenus par l'historique, lus sans verrou comme pour le rejeu
+static void admin_history(FILE *out, const char *args) {
+    (void)args;
+    const uint64_t last = atomic_load_explicit(&history_seq, memory_order_acquire);
+    HistoryCursor *cursor = malloc(sizeof(HistoryCursor));
+    if (!cursor) {
+        fprintf(out, "out of memory\n");
+        return;
+    }
+    history_cursor_init(cursor);
+    for (uint64_t seq = history_window(last, REPLAY_MESSAGES); seq <= last; ++seq) {
+        size_t length;
+        const char *text = history_get(&history, cursor, seq, &length);
+        if (text && length > 0) {
+            fprintf(out, "%8llu  %.*s\n", (unsigned long long)seq, (int)length, text);
+        }
+    }
+    free(cursor);
+
+    const uint64_t first = history_first(&history);
+    const uint64_t retained = first && last >= first ? last - first + 1 : 0;
+    const size_t used = history_used(&history);
+    const size_t raw = history_raw(&history);
+    fprintf(out, "%llu messages retained (seq %llu to %llu), %zu KB of %zu KB",
+            (unsigned long long)retained, (unsigned long long)first, (unsigned long long)last, used >> 10,
+            history_reserved(&history) >> 10);
+    if (retained) {
+        fprintf(out, ", %.1f bytes per message", (double)used / (double)retained);
+    }
+    if (used) {
+        fprintf(out, ", compression %.2fx", (double)raw / (double)used);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "paged joins (over %d users): %llu, pages served: %llu (%llu messages)\n", paged_users,
+            (unsigned long long)atomic_load_explicit(&paged_joins, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&history_pages, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&history_page_messages, memory_order_relaxed));
+    if (history_log) {
+        histlog_dump(history_log, out);
+    }
+}
+
+// Coût de la diffusion par destinataire depuis le démarrage
+static void admin_broadcast(FILE *out, const char *args) {
+    (void)args;
+    for (int w = 0; w < worker_count; ++w) {
+        const Worker *worker = workers[w];
+        const uint64_t messages = atomic_load_explicit(&worker->broadcast_messages, memory_order_relaxed);
+        const uint64_t recipients = atomic_load_explicit(&worker->broadcast_recipients, memory_order_relaxed);
+        const uint64_t cycles = atomic_load_explicit(&worker->broadcast_cycles, memory_order_relaxed);
+        fprintf(out, "worker %d: %zu members, %llu messages, %llu recipients, %llu cycles (%.1f per recipient)\n",
+                w, __atomic_load_n(&worker->conn_count, __ATOMIC_RELAXED), (unsigned long long)messages,
+                (unsigned long long)recipients, (unsigned long long)cycles,
+                recipients ? (double)cycles / (double)recipients : 0.0);
+        if (zerocopy_min) {
+            fprintf(out, "  zero-copy: %llu sends (%llu KB), %llu copied by the kernel, %llu fell back to copies\n",
+                    (unsigned long long)atomic_load_explicit(&worker->zerocopy_sends, memory_order_relaxed),
+                    (unsigned long long)(atomic_load_explicit(&worker->zerocopy_bytes, memory_order_relaxed) >> 10),
+                    (unsigned long long)atomic_load_explicit(&worker->zerocopy_copied, memory_order_relaxed),
+                    (unsigned long long)atomic_load_explicit(&worker->zerocopy_fallbacks, memory_order_relaxed));
+        }
+    }
+}
+
+// Indice d'équité de Jain : 1 si toutes les valeurs sont égales, 1/n si une seule domine.
+// Il mesure le service obtenu : une demande inégale donne aussi un indice bas.
+static double jain_index(const uint64_t *values, const size_t count) {
+    double sum = 0, squares = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += (double)values[i];
+        squares += (double)values[i] * (double)values[i];
+    }
+    return squares > 0 ? sum * sum / ((double)count * squares) : 1.0;
+}
+
+// Part du service (octets lus et écrits) reçue par chaque connexion depuis le relevé précédent
+static void admin_fairness(FILE *out, const char *args) {
+    (void)args;
+    prof_lock(&user_mutex);
+    const size_t capacity = (size_t)user_count;
+    uint64_t *reads = calloc(capacity + 1, sizeof(uint64_t));
+    uint64_t *writes = calloc(capacity + 1, sizeof(uint64_t));
+    if (!reads || !writes) {
+        prof_unlock(&user_mutex);
+        free(reads);
+        free(writes);
+        fprintf(out, "out of memory\n");
+        return;
+    }
+
+    size_t count = 0;
+    uint64_t read_total = 0, write_total = 0;
+    for (int w = 0; w < worker_count; ++w) {
+        for (size_t i = 0; i < workers[w]->conn_count && count < capacity; ++i) {
+            Connection *conn = workers[w]->conns[i];
+            const uint64_t read = atomic_load_explicit(&conn->read_bytes, memory_order_relaxed);
+            const uint64_t written = atomic_load_explicit(&conn->written_bytes, memory_order_relaxed);
+            reads[count] = read - conn->read_mark;
+            writes[count] = written - conn->written_mark;
+            conn->read_mark = read;
+            conn->written_mark = written;
+            read_total += reads[count];
+            write_total += writes[count];
+            count++;
+        }
+    }
+    count = 0;
+    for (int w = 0; w < worker_count; ++w) {
+        for (size_t i = 0; i < workers[w]->conn_count && count < capacity; ++i, ++count) {
+            fprintf(out, "  %-20s read %10llu bytes (%5.1f%%)  written %10llu bytes (%5.1f%%)\n",
+                    workers[w]->conns[i]->nom, (unsigned long long)reads[count],
+                    read_total ? 100.0 * (double)reads[count] / (double)read_total : 0.0,
+                    (unsigned long long)writes[count],
+                    write_total ? 100.0 * (double)writes[count] / (double)write_total : 0.0);
+        }
+    }
+    prof_unlock(&user_mutex);
+
+    fprintf(out, "Jain fairness index: read %.3f, written %.3f (%zu connections)\n",
+            jain_index(reads, count), jain_index(writes, count), count);
+    for (int w = 0; w < worker_count; ++w) {
+        fprintf(out, "worker %d: quantum exhausted %llu times reading, %llu times writing\n", w,
+                (unsigned long long)atomic_load_explicit(&workers[w]->read_exhausted, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&workers[w]->write_exhausted, memory_order_relaxed));
+    }
+    free(reads);
+    free(writes);
+}
+
+static void admin_memory(FILE *out, const char *args) {
+    (void)args;
+    const size_t used = memory_used();
+    fprintf(out, "memory: %zu KB used of %zu KB budget (%.1f%%)\n", used >> 10, memory_budget >> 10,
+            100.0 * (double)used / (double)memory_budget);
+    fprintf(out, "  messages %zu KB, history %zu KB, slab reserved %zu KB\n",
+            atomic_load_explicit(&message_bytes, memory_order_relaxed) >> 10, history_reserved(&history) >> 10,
+            slab_reserved() >> 10);
+    fprintf(out, "  shrinks %llu, read pauses %llu, evictions %llu\n",
+            (unsigned long long)atomic_load_explicit(&memory_shrinks, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&memory_pauses, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&memory_evictions, memory_order_relaxed));
+
+    prof_lock(&user_mutex);
+    for (int w = 0; w < worker_count; ++w) {
+        const Worker *worker = workers[w];
+        fprintf(out, "worker %d: %zu KB, pressure %s%s\n", w,
+                atomic_load_explicit(&worker->memory_bytes, memory_order_relaxed) >> 10,
+                memory_level_names[__atomic_load_n(&worker->memory_level, __ATOMIC_RELAXED)],
+                __atomic_load_n(&worker->reads_paused, __ATOMIC_RELAXED) ? ", reads paused" : "");
+        for (size_t i = 0; i < worker->conn_count; ++i) {
+            const Connection *conn = worker->conns[i];
+            fprintf(out, "  %-20s %8zu bytes: struct %zu, input %zu, output %u, replay %zu\n", conn->nom,
+                    conn_memory(worker, i), sizeof(Connection), __atomic_load_n(&conn->in_len, __ATOMIC_RELAXED),
+                    __atomic_load_n(&worker->queues[i].bytes, __ATOMIC_RELAXED),
+                    __atomic_load_n(&conn->replay_bytes, __ATOMIC_RELAXED));
+        }
+    }
+    prof_unlock(&user_mutex);
+}
+
+static void admin_search(FILE *out, const char *args) {
+    (void)args;
+    search_dump(search_index, out);
+}
+
+static void admin_slab(FILE *out, const char *args) {
+    (void)args;
+    slab_dump(out);
+}
 
-        // Créer un message formaté avec une taille suffisante
-        char formatted_message[MAX_LEN + sizeof(user.nom) + 10];
-        snprintf(formatted_message, sizeof(formatted_message), "%s : %s", user.nom, buffer);
+static void admin_federation(FILE *out, const char *args) {
+    (void)args;
+    federation_dump(federation, out);
+}
 
-        printf("%s\n", formatted_message);
+static void admin_replica(FILE *out, const char *args) {
+    (void)args;
+    replica_dump(replica, out);
+}
 
-        // Diffuser le message à tous les utilisateurs et le stocker
-        diffuse_message(formatted_message);
+static void admin_promote(FILE *out, const char *args) {
+    (void)args;
+    if (!atomic_load(&standby)) {
+        fprintf(out, "already primary\n");
+        return;
     }
+    replica_promote(replica);
+    fprintf(out, "promotion requested, see the log\n");
+}
+
+static void admin_log(FILE *out, const char *args) {
+    (void)args;
+    fprintf(out, "log records dropped: %llu\n", log_dropped());
+}
 
-    printf("\033[31m%s disconnected.\033[0m\n", user.nom);
-    //Affichage des messages de déconnection 
-    char disconnection_formatted_message[MAX_LEN];
-    snprintf(disconnection_formatted_message, sizeof(disconnection_formatted_message), "\033[31m%s: %s disconnected.\033[0m", "SERVER", user.nom);
-    diffuse_message(disconnection_formatted_message);
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-l debug|info|warn|error] [-s chat_sample] [-a admin_port]"
+                    " [-t trace_file [-T trace_sample]] [-w workers] [-u max_users]"
+                    " [-H handshake_ms] [-i idle_ms] [-n] [-L lag_ms] [-M memory_mb] [-B history_kb] [-D log_path] [-P users] [-Z bytes] [-U unix_path] [-S shm_path] [-p port] [-f peer_port] [-F host:port]... [-C room] [-Y standby_port] [-y host:port] [-G] [-r rate[:burst]] [-R rate[:burst]]\n", prog);
+    fprintf(stderr, "  -l  minimum log level (default: info)\n");
+    fprintf(stderr, "  -s  log one chat message out of N, 0 to disable (default: 1)\n");
+    fprintf(stderr, "  -a  admin interface port on 127.0.0.1, 0 to disable (default: %d)\n", DEFAULT_ADMIN_PORT);
+    fprintf(stderr, "  -t  write per-message pipeline timestamps to trace_file (see trace_report)\n");
+    fprintf(stderr, "  -T  trace one message out of N (default: 100)\n");
+    fprintf(stderr, "  -w  number of event loop threads (default: 1, max: %d)\n", MAX_WORKERS);
+    fprintf(stderr, "  -u  maximum number of connected users (default: %d)\n", MAX_USERS);
+    fprintf(stderr, "  -H  delay to send the user name before being disconnected (default: %d ms)\n", HANDSHAKE_TIMEOUT_MS);
+    fprintf(stderr, "  -i  disconnect clients silent for this long (default: %d ms)\n", IDLE_TIMEOUT_MS);
+    fprintf(stderr, "  -n  do not broadcast join and leave notices (very large rooms, benchmarks)\n");
+    fprintf(stderr, "  -L  loop lag that starts load shedding, x%d refuses new users (default: %d ms)\n",
+            OVERLOAD_FACTOR, SHED_LAG_MS);
+    fprintf(stderr, "  -M  memory budget before pausing reads and evicting slow clients (default: %d MB)\n",
+            DEFAULT_MEMORY_BUDGET_MB);
+    fprintf(stderr, "  -B  bytes kept for the message history, in KB (default: %d, min: %d)\n",
+            DEFAULT_HISTORY_KB, HISTORY_MIN_BUDGET >> 10);
+    fprintf(stderr, "  -D  also write the history to log_path.N segments (%d MB each, last %d kept)\n"
+                    "      and replay it to joining users with sendfile\n", LOG_SEGMENT_BYTES >> 20, HISTLOG_SEGMENTS);
+    fprintf(stderr, "  -P  above this many users, no history replay on join: clients page back on demand,\n"
+                    "      0 to always page (default: %d)\n", PAGED_REPLAY_USERS);
+    fprintf(stderr, "  -Z  send writes of at least this many bytes with MSG_ZEROCOPY, 0 to disable (default: 0)\n");
+    fprintf(stderr, "  -U  also accept clients on a Unix stream socket at unix_path (same protocol)\n");
+    fprintf(stderr, "  -S  accept local clients over shared-memory rings, attached through a Unix socket\n"
+                    "      at shm_path (see shmclient.h)\n");
+    fprintf(stderr, "  -p  TCP port for clients on 127.0.0.1 (default: %d)\n", SERVER_PORT);
+    fprintf(stderr, "  -f  accept federation links from other servers on this port (default: none)\n");
+    fprintf(stderr, "  -F  link to the server accepting federation links at host:port, repeatable (max %d):\n"
+                    "      the room is shared, each message crosses each link once\n", FEDERATION_MAX_PEERS);
+    fprintf(stderr, "  -C  cluster mode, needs -f and a full mesh of -F links: the room named here is placed\n"
+                    "      on a consistent-hash ring of the linked servers, its owner orders all messages\n");
+    fprintf(stderr, "  -Y  accept warm standby servers on this port: the message log and the member list\n"
+                    "      are shipped to them asynchronously, in batches (default: none, max %d)\n",
+            REPLICA_MAX_STANDBYS);
+    fprintf(stderr, "  -y  run as the warm standby of the server accepting standbys at host:port: clients\n"
+                    "      are refused until it is promoted, when the link drops or by the admin 'promote'\n");
+    fprintf(stderr, "  -G  back connections and frames with huge pages\n");
+    fprintf(stderr, "  -r  chat messages per second and burst per user, 0 to disable (default: %d:%d)\n",
+            DEFAULT_MESSAGE_RATE, DEFAULT_MESSAGE_BURST);
+    fprintf(stderr, "  -R  chat bytes per second and burst per user, 0 to disable (default: %d:%d)\n",
+            DEFAULT_BYTE_RATE, DEFAULT_BYTE_BURST);
+}
 
-    delete_user(socketClient);
+// Socket d'écoute Unix : un fichier socket laissé par une exécution précédente est
+// remplacé, jamais un autre type de fichier. -1 en cas d'erreur (errno positionné).
+static int open_unix_listener(const char *path) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        return -1;
+    }
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        const int saved = errno;
+        close(listener);
+        errno = saved;
+        return -1;
+    }
+    return listener;
+}
 
-    close(socketClient);
-    pthread_exit(NULL);
+// Une connexion = un descripteur : on relève la limite au maximum autorisé
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
 }
 
+int main(int argc, char *argv[]) {
+    LogLevel log_level = LOG_INFO;
+    unsigned chat_sample = 1;
+    int admin_port = DEFAULT_ADMIN_PORT;
+    const char *trace_path = NULL;
+    const char *log_path = NULL;
+    const char *unix_path = NULL;
+    const char *shm_path = NULL;
+    int port = SERVER_PORT;
+    int peer_port = 0;
+    const char *peers[FEDERATION_MAX_PEERS];
+    int peer_count = 0;
+    const char *cluster_room = NULL;
+    int standby_port = 0;
+    const char *primary = NULL;
+    unsigned trace_rate = 100;
+    int hugepages = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "l:s:a:t:T:w:u:H:i:nL:M:B:D:P:Z:U:S:p:f:F:C:Y:y:Gr:R:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                if (parse_log_level(optarg, &log_level) < 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                chat_sample = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'a':
+                admin_port = atoi(optarg);
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
+            case 'T':
+                trace_rate = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                worker_count = atoi(optarg);
+                break;
+            case 'u':
+                max_users = atoi(optarg);
+                break;
+            case 'H':
+                handshake_timeout_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                idle_timeout_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                notices = 0;
+                break;
+            case 'L':
+                shed_lag_ms = (unsigned)strtoul(optarg, NULL, 10);
+                break;
+            case 'M':
+                memory_budget = (size_t)strtoul(optarg, NULL, 10) << 20;
+                break;
+            case 'B':
+                history_budget = (size_t)strtoul(optarg, NULL, 10) << 10;
+                break;
+            case 'D':
+                log_path = optarg;
+                break;
+            case 'P':
+                paged_users = atoi(optarg);
+                break;
+            case 'Z':
+                zerocopy_min = (size_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'U':
+                unix_path = optarg;
+                break;
+            case 'S':
+                shm_path = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'f':
+                peer_port = atoi(optarg);
+                break;
+            case 'F':
+                if (peer_count == FEDERATION_MAX_PEERS) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                peers[peer_count++] = optarg;
+                break;
+            case 'C':
+                cluster_room = optarg;
+                break;
+            case 'Y':
+                standby_port = atoi(optarg);
+                break;
+            case 'y':
+                primary = optarg;
+                break;
+            case 'G':
+                hugepages = 1;
+                break;
+            case 'r':
+            case 'R':
+                if (parse_rate(optarg, opt == 'r' ? &message_limit : &byte_limit) < 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (worker_count < 1 || worker_count > MAX_WORKERS || max_users < 1 || paged_users < 0 || shed_lag_ms < 1 ||
+        memory_budget == 0 || port < 1 || port > 65535 || peer_port < 0 || peer_port > 65535 ||
+        (cluster_room && peer_port == 0) || standby_port < 0 || standby_port > 65535 ||
+        (primary && (peer_port || peer_count))) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    // Une rafale plus petite qu'un message bloquerait définitivement les longs messages
+    if (byte_limit.rate && byte_limit.burst < MAX_LEN) {
+        fprintf(stderr, "The byte burst (-R) must be at least %d\n", MAX_LEN);
+        exit(EXIT_FAILURE);
+    }
+
+    raise_fd_limit();
 
-int main() {
-    const int socketServer = socket(AF_INET, SOCK_STREAM, 0);
-    if (socketServer < 0) {
+    listen_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_socket < 0) {
         perror("Error when creating the server socket");
         exit(EXIT_FAILURE);
     }
 
+    const int reuse = 1;
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // Les sockets acceptées activent SO_ZEROCOPY une à une : on vérifie une fois le support
+    if (zerocopy_min && setsockopt(listen_socket, SOL_SOCKET, SO_ZEROCOPY, &reuse, sizeof(reuse)) < 0) {
+        perror("MSG_ZEROCOPY is not available (-Z)");
+        close(listen_socket);
+        exit(EXIT_FAILURE);
+    }
+
     struct sockaddr_in addrServer = {0};
     addrServer.sin_addr.s_addr = inet_addr("127.0.0.1");
     addrServer.sin_family = AF_INET;
-    addrServer.sin_port = htons(30001);
+    addrServer.sin_port = htons((uint16_t)port);
 
-    if (bind(socketServer, (struct sockaddr *)&addrServer, sizeof(addrServer)) < 0) {
+    if (bind(listen_socket, (struct sockaddr *)&addrServer, sizeof(addrServer)) < 0) {
         perror("Binding Error");
-        close(socketServer);
+        close(listen_socket);
         exit(EXIT_FAILURE);
     }
 
-    if (listen(socketServer, 10) < 0) {
+    if (listen(listen_socket, SOMAXCONN) < 0) {
         perror("Listening Error");
-        close(socketServer);
+        close(listen_socket);
         exit(EXIT_FAILURE);
     }
 
-    printf("===== Server is open on port 30001 =====\n");
+    if (unix_path) {
+        unix_socket = open_unix_listener(unix_path);
+        if (unix_socket < 0) {
+            perror("Error when creating the Unix socket (-U)");
+            close(listen_socket);
+            exit(EXIT_FAILURE);
+        }
+        printf("===== Server is open on port %d and on %s =====\n", port, unix_path);
+    } else {
+        printf("===== Server is open on port %d =====\n", port);
+    }
+    if (shm_path) {
+        shm_socket = open_unix_listener(shm_path);
+        if (shm_socket < 0) {
+            perror("Error when creating the shared-memory socket (-S)");
+            close(listen_socket);
+            exit(EXIT_FAILURE);
+        }
+        printf("===== Shared-memory clients attach on %s =====\n", shm_path);
+    }
+    fflush(stdout);
+
+    // Un client parti ne doit pas tuer le serveur (et le journal en attente) via SIGPIPE :
+    // l'erreur EPIPE est remontée par send() et journalisée
+    signal(SIGPIPE, SIG_IGN);
 
-    while (1) {
-        struct sockaddr_in addrClient;
-        socklen_t addr_len = sizeof(addrClient);
-        const int socketClient = accept(socketServer, (struct sockaddr *)&addrClient, &addr_len);
+    // SIGINT/SIGTERM restent bloqués dans tous les threads : le thread principal les
+    // attend avec sigwait()
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
 
-        if (socketClient < 0) {
-            perror("Acceptation Error");
-            continue;
+    // Les workers journalisent via le thread de fond, jamais directement sur stdout
+    if (log_init(stdout, log_level, chat_sample) < 0) {
+        perror("Error starting the logger");
+        close(listen_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    if (trace_path && trace_init(trace_path, trace_rate) < 0) {
+        perror("Error opening the trace file");
+        close(listen_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    if (history_init(&history, history_budget) < 0) {
+        perror("Error allocating the message history");
+        close(listen_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    if (log_path) {
+        history_log = histlog_open(log_path, LOG_SEGMENT_BYTES);
+        if (!history_log) {
+            perror("Error creating the history log");
+            close(listen_socket);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    search_index = search_create();
+    if (!search_index || search_start(search_index, &history) < 0) {
+        perror("Error starting the search index");
+        close(listen_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    if (peer_port || peer_count) {
+        federation = federation_create(peer_port, diffuse_federated);
+        if (!federation) {
+            perror("Error when creating the federation socket (-f)");
+            close(listen_socket);
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < peer_count; ++i) {
+            if (federation_add_peer(federation, peers[i]) < 0) {
+                fprintf(stderr, "Invalid federation peer '%s' (-F host:port)\n", peers[i]);
+                close(listen_socket);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (cluster_room && federation_set_room(federation, cluster_room) < 0) {
+            perror("Error setting up the cluster (-C)");
+            close(listen_socket);
+            exit(EXIT_FAILURE);
         }
+        if (cluster_room) {
+            printf("===== Cluster room '%s', federation links accepted on port %d, %d peers =====\n", cluster_room,
+                   peer_port, peer_count);
+        } else if (peer_port) {
+            printf("===== Federation links accepted on port %d, %d peers =====\n", peer_port, peer_count);
+        } else {
+            printf("===== Federation with %d peers =====\n", peer_count);
+        }
+        fflush(stdout);
+    }
+
+    // Après l'historique, que le primaire relit pour rattraper un secours
+    if (standby_port || primary) {
+        replica = replica_create(standby_port, primary, &history, &history_seq, replica_applied, replica_promoted);
+        if (!replica) {
+            perror(primary ? "Error setting up the standby (-y host:port)" : "Error when creating the standby socket (-Y)");
+            close(listen_socket);
+            exit(EXIT_FAILURE);
+        }
+        atomic_store(&standby, primary != NULL);
+        if (primary) {
+            printf("===== Warm standby of %s, clients refused until promoted =====\n", primary);
+        }
+        if (standby_port) {
+            printf("===== Standby servers accepted on port %d =====\n", standby_port);
+        }
+        fflush(stdout);
+    }
+
+    slab_init(hugepages);
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i] = worker_create(i);
+        if (!workers[i]) {
+            perror("Error creating a worker");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    admin_register("users", "list connected users", admin_users);
+    admin_register("workers", "connections and armed timers per event loop", admin_workers);
+    admin_register("locks", "lock contention profile per call site", admin_locks);
+    admin_register("rtt", "round-trip time per connection", admin_rtt);
+    admin_register("throttle", "rate limits and throttled volume", admin_throttle);
+    admin_register("load", "event loop lag, queued bytes and load shedding", admin_load);
+    admin_register("fairness", "service share per connection since the last call", admin_fairness);
+    admin_register("memory", "memory held per connection and in total", admin_memory);
+    admin_register("broadcast", "fan-out cost per recipient since startup", admin_broadcast);
+    admin_register("history", "messages retained for replay", admin_history);
+    admin_register("search", "full-text index segments and query cost", admin_search);
+    admin_register("slab", "allocator occupancy per size class", admin_slab);
+    admin_register("log", "logger statistics", admin_log);
+    if (federation) {
+        admin_register("federation", "links to other servers and relayed traffic", admin_federation);
+    }
+    if (replica) {
+        admin_register("replica", "standby servers and replication lag", admin_replica);
+    }
+    if (primary) {
+        admin_register("promote", "promote this standby to primary now", admin_promote);
+    }
+    if (admin_port > 0 && admin_start(admin_port) < 0) {
+        perror("Error starting the admin interface");
+    }
+
+    for (int i = 0; i < worker_count; ++i) {
+        if (pthread_create(&workers[i]->thread, NULL, worker_main, workers[i]) != 0) {
+            perror("Error when creating a worker thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Après les workers : un message relayé est distribué aussitôt reçu
+    if (federation && federation_start(federation) < 0) {
+        perror("Error starting the federation thread");
+        exit(EXIT_FAILURE);
+    }
+    if (replica && replica_start(replica) < 0) {
+        perror("Error starting the replication thread");
+        exit(EXIT_FAILURE);
+    }
+
+    int sig;
+    sigwait(&stop_signals, &sig);
 
-        int *arg = malloc(sizeof(int));
-        *arg = socketClient;
+    // Réveille les workers pour qu'ils sortent de leur boucle
+    atomic_store(&stopping, 1);
+    for (int i = 0; i < worker_count; ++i) {
+        const uint64_t one = 1;
+        if (write(workers[i]->wake_fd, &one, sizeof(one)) < 0) {
+            perror("Error waking a worker");
+        }
+        pthread_join(workers[i]->thread, NULL);
+    }
+    // Après les workers, qui publient jusqu'à leur arrêt
+    if (federation) {
+        federation_stop(federation);
+    }
+    if (replica) {
+        replica_stop(replica);
+    }
+    // Après les workers aussi : plus aucune requête /search en cours
+    search_stop(search_index);
+    // Après tous ceux qui publient : ce qui reste en attente est écrit
+    if (history_log) {
+        histlog_close(history_log);
+    }
 
-        pthread_t thread;
-        pthread_create(&thread, NULL, client_handler, arg);
-        pthread_detach(thread);
+    if (trace_dropped()) {
+        char line[96];
+        snprintf(line, sizeof(line), "Trace: %llu stages dropped, writer behind", trace_dropped());
+        log_text(LOG_WARN, line);
+    }
+    log_text(LOG_INFO, "===== Server is shutting down =====");
+    log_shutdown();
+    trace_shutdown();
+#ifdef LOCK_PROFILING
+    lockprof_dump(stderr);
+#endif
+    close(listen_socket);
+    if (unix_socket >= 0) {
+        close(unix_socket);
+        unlink(unix_path);
     }
+    if (shm_socket >= 0) {
+        close(shm_socket);
+        unlink(shm_path);
+    }
+    return 0;
 }
@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include "shmclient.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shmring.h"
+#include "util.h"
+
+#define DEFAULT_SPIN_US 50
+
+struct ShmClient {
+    ShmLink link;
+    int control;                // socket de rattachement : sa fermeture signale la fin du serveur
+    pthread_mutex_t send_mutex;
+    uint64_t spin_ns;
+};
+
+// Scrutation active tant que le délai n'est pas écoulé (deadline à 0 : première attente)
+static int client_spin(const ShmClient *client, uint64_t *deadline) {
+    if (client->spin_ns == 0) {
+        return 0;
+    }
+    const uint64_t now = monotonic_ns();
+    if (*deadline == 0) {
+        *deadline = now + client->spin_ns;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    return now < *deadline;
+}
+
+// S'endort sur la sonnette (attente déjà annoncée) ; -1 si le serveur a fermé la
+// connexion, ou si sa socket de rattachement est fermée (arrêt brutal)
+static int client_sleep(ShmClient *client, const int bell) {
+    if (shm_closed(&client->link)) {
+        return -1;
+    }
+    struct pollfd fds[2] = {{.fd = bell, .events = POLLIN}, {.fd = client->control, .events = POLLIN}};
+    while (poll(fds, 2, -1) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (fds[0].revents & POLLIN) {
+        shm_bell_clear(bell);
+        return 0;
+    }
+    return -1;
+}
+
+// Reçoit exactement length octets ; 1, ou 0 si la connexion est fermée
+static int client_read(ShmClient *client, void *buffer, size_t length) {
+    ShmEnd *rx = &client->link.rx;
+    char *cursor = buffer;
+    uint64_t deadline = 0;
+    while (length > 0) {
+        const size_t received = shm_read(rx, cursor, length);
+        if (received > 0) {
+            cursor += received;
+            length -= received;
+            deadline = 0;
+            continue;
+        }
+        if (client_spin(client, &deadline) || shm_arm_read(rx)) {
+            continue;
+        }
+        if (client_sleep(client, rx->bell) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Envoie exactement length octets ; 0, ou -1 si la connexion est fermée
+static int client_write(ShmClient *client, const void *data, size_t length) {
+    ShmEnd *tx = &client->link.tx;
+    const char *cursor = data;
+    uint64_t deadline = 0;
+    while (length > 0) {
+        if (shm_closed(&client->link)) {
+            errno = EPIPE;
+            return -1;
+        }
+        const struct iovec iov = {.iov_base = (void *)cursor, .iov_len = length};
+        const size_t written = shm_write(tx, &iov, 1);
+        if (written > 0) {
+            cursor += written;
+            length -= written;
+            deadline = 0;
+            continue;
+        }
+        if (client_spin(client, &deadline) || shm_arm_write(tx)) {
+            continue;
+        }
+        if (client_sleep(client, tx->bell) < 0) {
+            errno = EPIPE;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+ShmClient *shm_client_open(const char *path, const char *name) {
+    ShmClient *client = calloc(1, sizeof(ShmClient));
+    if (!client) {
+        return NULL;
+    }
+    client->control = proto_connect(path);
+    if (client->control < 0 || shm_link_receive(&client->link, client->control) < 0) {
+        const int saved = errno;
+        if (client->control >= 0) {
+            close(client->control);
+        }
+        free(client);
+        errno = saved;
+        return NULL;
+    }
+    pthread_mutex_init(&client->send_mutex, NULL);
+    // Sur un seul processeur, tourner ne ferait que retarder le serveur
+    client->spin_ns = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? DEFAULT_SPIN_US * 1000ULL : 0;
+
+    char nom[PROTOCOL_NAME_LEN] = {0};
+    strncpy(nom, name, sizeof(nom) - 1);
+    if (client_write(client, nom, sizeof(nom)) < 0) {
+        const int saved = errno;
+        shm_client_close(client);
+        errno = saved;
+        return NULL;
+    }
+    return client;
+}
+
+int shm_client_send(ShmClient *client, const uint8_t type, const void *payload, const size_t len) {
+    char frame[sizeof(FrameHeader) + MAX_FRAME_PAYLOAD];
+    if (len > MAX_FRAME_PAYLOAD) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    const size_t length = encode_frame(frame, type, 0, payload, len);
+    pthread_mutex_lock(&client->send_mutex);
+    const int status = client_write(client, frame, length);
+    pthread_mutex_unlock(&client->send_mutex);
+    return status;
+}
+
+int shm_client_recv(ShmClient *client, FrameHeader *header, void *payload, const size_t capacity) {
+    if (!client_read(client, header, sizeof(*header))) {
+        return 0;
+    }
+    header->length = ntohl(header->length);
+    if (header->length > capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (header->length > 0 && !client_read(client, payload, header->length)) {
+        return -1;
+    }
+    return 1;
+}
+
+void shm_client_set_spin(ShmClient *client, const unsigned spin_us) {
+    client->spin_ns = spin_us * 1000ULL;
+}
+
+void shm_client_close(ShmClient *client) {
+    shm_link_destroy(&client->link);
+    close(client->control);
+    pthread_mutex_destroy(&client->send_mutex);
+    free(client);
+}
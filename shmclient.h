@@ -0,0 +1,41 @@
+#ifndef CHAT_SHMCLIENT_H
+#define CHAT_SHMCLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+// Bibliothèque cliente du transport en mémoire partagée (serveur lancé avec -S path),
+// pour les bots et ponts de la même machine : mêmes trames que sur une socket, avec
+// les mêmes conventions que send_frame et recv_frame.
+//
+//   ShmClient *bot = shm_client_open("/tmp/chat.shm", "bot");
+//   shm_client_send(bot, FRAME_CHAT, text, strlen(text));
+//   while (shm_client_recv(bot, &header, payload, sizeof(payload)) > 0) { ... }
+//
+// Un seul thread à la fois dans shm_client_recv ; les envois sont sérialisés par un
+// verrou (le thread de réception peut répondre aux pings du serveur, à faire pour ne
+// pas être déconnecté comme inactif). Avant de s'endormir sur sa sonnette, chaque
+// attente tourne un court instant si la machine a plusieurs processeurs.
+//
+// Édition de liens : make libchatshm.a, puis -L. -lchatshm -pthread
+
+typedef struct ShmClient ShmClient;
+
+// Rattachement et envoi du nom ; NULL en cas d'erreur (errno positionné)
+ShmClient *shm_client_open(const char *path, const char *name);
+
+// 0, ou -1 si la connexion est fermée (errno à EPIPE) ou la trame trop grande
+int shm_client_send(ShmClient *client, uint8_t type, const void *payload, size_t len);
+
+// 1 si une trame a été lue, 0 si le serveur a fermé la connexion, -1 en cas d'erreur
+// ou de trame trop grande pour payload
+int shm_client_recv(ShmClient *client, FrameHeader *header, void *payload, size_t capacity);
+
+// Attente d'un réveil avant de s'endormir (0 : jamais)
+void shm_client_set_spin(ShmClient *client, unsigned spin_us);
+
+void shm_client_close(ShmClient *client);
+
+#endif
@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+#include "shmring.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_MAGIC 0x43484d31u           // « CHM1 »
+#define RING_MASK (SHM_RING_BYTES - 1)
+
+// Descripteurs transmis au client, dans cet ordre
+enum { FD_MEMORY, FD_SERVER_BELL, FD_CLIENT_RECV_BELL, FD_CLIENT_SEND_BELL };
+
+struct ShmShared {
+    uint32_t magic;
+    uint32_t capacity;
+    _Atomic uint32_t closed;    // l'un des côtés a fermé le lien
+};
+
+// Positions en octets depuis l'ouverture, chacune sur sa propre ligne de cache :
+// le producteur n'écrit que head, le consommateur que tail. Les données suivent.
+struct ShmRing {
+    _Alignas(64) _Atomic uint64_t head;
+    _Atomic uint32_t consumer_waiting;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Atomic uint32_t producer_waiting;
+};
+
+#define SHARED_SIZE 64
+#define RING_SIZE (sizeof(ShmRing) + SHM_RING_BYTES)
+#define LINK_SIZE (SHARED_SIZE + 2 * RING_SIZE)
+
+// Anneau 0 : client vers serveur, anneau 1 : serveur vers client
+static ShmRing *ring_at(ShmShared *shared, const int index) {
+    return (ShmRing *)((char *)shared + SHARED_SIZE + (size_t)index * RING_SIZE);
+}
+
+static char *ring_data(ShmRing *ring) {
+    return (char *)ring + sizeof(ShmRing);
+}
+
+void shm_bell_ring(const int bell) {
+    const uint64_t one = 1;
+    const ssize_t written = write(bell, &one, sizeof(one));
+    (void)written;      // EAGAIN seulement si le compteur déborde : la sonnette est déjà mise
+}
+
+static void bell_ring(ShmEnd *end) {
+    shm_bell_ring(end->peer_bell);
+    end->bells++;
+}
+
+// Appelé après avoir publié une position : réveille l'autre côté s'il attend.
+// La barrière fait pendant à celle de shm_arm_* : l'un des deux voit forcément l'autre.
+static void wake_peer(ShmEnd *end, _Atomic uint32_t *waiting) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed) &&
+        atomic_exchange_explicit(waiting, 0, memory_order_relaxed)) {
+        bell_ring(end);
+    }
+}
+
+static void link_setup(ShmLink *link, const int server) {
+    ShmRing *to_server = ring_at(link->shared, 0);
+    ShmRing *to_client = ring_at(link->shared, 1);
+    link->size = LINK_SIZE;
+    link->rx = (ShmEnd){.ring = server ? to_server : to_client};
+    link->tx = (ShmEnd){.ring = server ? to_client : to_server};
+    if (server) {
+        link->rx.bell = link->tx.bell = link->fds[FD_SERVER_BELL];
+        link->rx.peer_bell = link->fds[FD_CLIENT_SEND_BELL];
+        link->tx.peer_bell = link->fds[FD_CLIENT_RECV_BELL];
+    } else {
+        link->rx.bell = link->fds[FD_CLIENT_RECV_BELL];
+        link->tx.bell = link->fds[FD_CLIENT_SEND_BELL];
+        link->rx.peer_bell = link->tx.peer_bell = link->fds[FD_SERVER_BELL];
+    }
+}
+
+static void link_close_fds(ShmLink *link) {
+    for (int i = 0; i < SHM_LINK_FDS; ++i) {
+        if (link->fds[i] >= 0) {
+            close(link->fds[i]);
+            link->fds[i] = -1;
+        }
+    }
+}
+
+int shm_link_create(ShmLink *link) {
+    memset(link, 0, sizeof(*link));
+    for (int i = 0; i < SHM_LINK_FDS; ++i) {
+        link->fds[i] = -1;
+    }
+    link->fds[FD_MEMORY] = memfd_create("chat-shm", MFD_CLOEXEC);
+    for (int i = FD_SERVER_BELL; i < SHM_LINK_FDS; ++i) {
+        link->fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    for (int i = 0; i < SHM_LINK_FDS; ++i) {
+        if (link->fds[i] < 0) {
+            const int saved = errno;
+            link_close_fds(link);
+            errno = saved;
+            return -1;
+        }
+    }
+    if (ftruncate(link->fds[FD_MEMORY], LINK_SIZE) < 0 ||
+        (link->shared = mmap(NULL, LINK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, link->fds[FD_MEMORY], 0)) ==
+            MAP_FAILED) {
+        const int saved = errno;
+        link->shared = NULL;
+        link_close_fds(link);
+        errno = saved;
+        return -1;
+    }
+    // ftruncate a mis la mémoire à zéro : positions et indicateurs sont prêts
+    link->shared->magic = SHM_MAGIC;
+    link->shared->capacity = SHM_RING_BYTES;
+    link_setup(link, 1);
+    return 0;
+}
+
+int shm_link_send(const ShmLink *link, const int socket) {
+    const uint32_t magic = SHM_MAGIC;
+    struct iovec iov = {.iov_base = (void *)&magic, .iov_len = sizeof(magic)};
+    char control[CMSG_SPACE(sizeof(link->fds))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(link->fds));
+    memcpy(CMSG_DATA(cmsg), link->fds, sizeof(link->fds));
+    return sendmsg(socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)sizeof(magic) ? 0 : -1;
+}
+
+int shm_link_receive(ShmLink *link, const int socket) {
+    memset(link, 0, sizeof(*link));
+    for (int i = 0; i < SHM_LINK_FDS; ++i) {
+        link->fds[i] = -1;
+    }
+    uint32_t magic = 0;
+    struct iovec iov = {.iov_base = &magic, .iov_len = sizeof(magic)};
+    char control[CMSG_SPACE(sizeof(link->fds))];
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    const ssize_t received = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+        return -1;
+    }
+    const struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(link->fds))) {
+        memcpy(link->fds, CMSG_DATA(cmsg), sizeof(link->fds));
+    }
+    // Un serveur d'une autre version, ou refus (connexion fermée sans descripteurs)
+    struct stat st;
+    if (received != sizeof(magic) || magic != SHM_MAGIC || link->fds[FD_MEMORY] < 0 ||
+        fstat(link->fds[FD_MEMORY], &st) < 0 || (size_t)st.st_size != LINK_SIZE) {
+        link_close_fds(link);
+        errno = EPROTO;
+        return -1;
+    }
+    link->shared = mmap(NULL, LINK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, link->fds[FD_MEMORY], 0);
+    if (link->shared == MAP_FAILED) {
+        const int saved = errno;
+        link->shared = NULL;
+        link_close_fds(link);
+        errno = saved;
+        return -1;
+    }
+    if (link->shared->magic != SHM_MAGIC || link->shared->capacity != SHM_RING_BYTES) {
+        munmap(link->shared, LINK_SIZE);
+        link->shared = NULL;
+        link_close_fds(link);
+        errno = EPROTO;
+        return -1;
+    }
+    link_setup(link, 0);
+    return 0;
+}
+
+void shm_link_destroy(ShmLink *link) {
+    if (link->shared) {
+        atomic_store_explicit(&link->shared->closed, 1, memory_order_release);
+        bell_ring(&link->rx);
+        bell_ring(&link->tx);
+        munmap(link->shared, LINK_SIZE);
+        link->shared = NULL;
+    }
+    link_close_fds(link);
+}
+
+size_t shm_read(ShmEnd *rx, void *buffer, size_t length) {
+    ShmRing *ring = rx->ring;
+    if (rx->cached - rx->position < length) {
+        rx->cached = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    const size_t available = (size_t)(rx->cached - rx->position);
+    if (length > available) {
+        length = available;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    const size_t start = (size_t)(rx->position & RING_MASK);
+    const size_t first = length < SHM_RING_BYTES - start ? length : SHM_RING_BYTES - start;
+    memcpy(buffer, ring_data(ring) + start, first);
+    memcpy((char *)buffer + first, ring_data(ring), length - first);
+    rx->position += length;
+    atomic_store_explicit(&ring->tail, rx->position, memory_order_release);
+    wake_peer(rx, &ring->producer_waiting);
+    return length;
+}
+
+size_t shm_write(ShmEnd *tx, const struct iovec *iov, const int count) {
+    ShmRing *ring = tx->ring;
+    size_t wanted = 0;
+    for (int i = 0; i < count; ++i) {
+        wanted += iov[i].iov_len;
+    }
+    if (SHM_RING_BYTES - (tx->position - tx->cached) < wanted) {
+        tx->cached = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    }
+    size_t room = SHM_RING_BYTES - (size_t)(tx->position - tx->cached);
+    size_t written = 0;
+    for (int i = 0; i < count && room > 0; ++i) {
+        const char *cursor = iov[i].iov_base;
+        size_t length = iov[i].iov_len < room ? iov[i].iov_len : room;
+        room -= length;
+        while (length > 0) {
+            const size_t start = (size_t)((tx->position + written) & RING_MASK);
+            const size_t chunk = length < SHM_RING_BYTES - start ? length : SHM_RING_BYTES - start;
+            memcpy(ring_data(ring) + start, cursor, chunk);
+            cursor += chunk;
+            length -= chunk;
+            written += chunk;
+        }
+    }
+    if (written == 0) {
+        return 0;
+    }
+    tx->position += written;
+    atomic_store_explicit(&ring->head, tx->position, memory_order_release);
+    wake_peer(tx, &ring->consumer_waiting);
+    return written;
+}
+
+int shm_arm_read(ShmEnd *rx) {
+    ShmRing *ring = rx->ring;
+    atomic_store_explicit(&ring->consumer_waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    rx->cached = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (rx->cached == rx->position) {
+        return 0;
+    }
+    atomic_store_explicit(&ring->consumer_waiting, 0, memory_order_relaxed);
+    return 1;
+}
+
+int shm_arm_write(ShmEnd *tx) {
+    ShmRing *ring = tx->ring;
+    atomic_store_explicit(&ring->producer_waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    tx->cached = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (tx->position - tx->cached == SHM_RING_BYTES) {
+        return 0;
+    }
+    atomic_store_explicit(&ring->producer_waiting, 0, memory_order_relaxed);
+    return 1;
+}
+
+void shm_bell_clear(const int bell) {
+    uint64_t value;
+    const ssize_t received = read(bell, &value, sizeof(value));
+    (void)received;     // EAGAIN : elle n'avait pas sonné
+}
+
+int shm_closed(const ShmLink *link) {
+    return atomic_load_explicit(&link->shared->closed, memory_order_acquire) != 0;
+}
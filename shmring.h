@@ -0,0 +1,72 @@
+#ifndef CHAT_SHMRING_H
+#define CHAT_SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// Transport en mémoire partagée pour les clients de la même machine (bots, ponts).
+//
+// Le serveur crée pour chaque client un memfd contenant deux anneaux à un producteur
+// et un consommateur, un par sens, qui transportent exactement le flux d'octets d'une
+// socket : le nom, puis les trames. Aucun appel système sur le chemin des données :
+// un côté ne fait sonner l'autre (eventfd) que si celui-ci a annoncé qu'il s'endormait
+// faute de données (consommateur) ou de place (producteur).
+//
+// Le rattachement passe par une socket Unix (SCM_RIGHTS) qui reste ouverte ensuite :
+// sa fermeture signale le départ du client, sans jamais porter de données.
+
+#define SHM_RING_BYTES (256 * 1024)     // par sens, puissance de deux
+#define SHM_LINK_FDS 4                  // memfd, sonnette du serveur, sonnettes du client (réception, émission)
+
+typedef struct ShmShared ShmShared;
+typedef struct ShmRing ShmRing;
+
+// Un sens vu d'un côté ; les positions partagées ne sont relues que si la copie
+// locale ne suffit plus
+typedef struct ShmEnd {
+    ShmRing *ring;
+    uint64_t position;      // producteur : octets écrits ; consommateur : octets lus
+    uint64_t cached;        // producteur : dernière position lue du consommateur, et inversement
+    int bell;               // sonnette de ce côté : attente de cet anneau
+    int peer_bell;          // sonnette de l'autre côté, quand il attend
+    uint64_t bells;         // sonnettes envoyées
+} ShmEnd;
+
+typedef struct ShmLink {
+    ShmShared *shared;
+    size_t size;
+    ShmEnd rx;
+    ShmEnd tx;
+    int fds[SHM_LINK_FDS];  // -1 : déjà fermé
+} ShmLink;
+
+// Serveur : crée la mémoire et les sonnettes, puis les transmet sur la socket de
+// rattachement. -1 en cas d'erreur (errno positionné).
+int shm_link_create(ShmLink *link);
+int shm_link_send(const ShmLink *link, int socket);
+
+// Client : reçoit les descripteurs et s'y attache ; -1 en cas d'erreur
+int shm_link_receive(ShmLink *link, int socket);
+
+// Marque le lien fermé et réveille l'autre côté avant de tout libérer
+void shm_link_destroy(ShmLink *link);
+
+// Côté lecture : au plus length octets ; côté écriture : tout ce qui tient.
+// Renvoient le nombre d'octets copiés, 0 si l'anneau est vide (plein).
+size_t shm_read(ShmEnd *rx, void *buffer, size_t length);
+size_t shm_write(ShmEnd *tx, const struct iovec *iov, int count);
+
+// Annonce l'attente d'une sonnette : 0 si l'appelant peut s'endormir sur end->bell,
+// 1 si l'anneau a changé entre-temps (il faut réessayer)
+int shm_arm_read(ShmEnd *rx);
+int shm_arm_write(ShmEnd *tx);
+
+// Remet une sonnette à zéro (non bloquant), ou la fait sonner
+void shm_bell_clear(int bell);
+void shm_bell_ring(int bell);
+
+// Le serveur a-t-il fermé la connexion ?
+int shm_closed(const ShmLink *link);
+
+#endif
@@ -0,0 +1,265 @@
+#include "slab.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "lockprof.h"
+
+#define CHUNK_SIZE (2 * 1024 * 1024)        // taille d'une page géante
+#define SLAB_HEADER 64
+#define SIZE_GRANULE 16
+#define CLASS_COUNT 56
+
+// 16 à 128 octets par pas de 16, puis huit classes par doublement : au plus
+// 12,5 % de perte par objet
+static uint32_t class_sizes[CLASS_COUNT];
+
+// Classe d'une taille, par tranche de SIZE_GRANULE octets
+static uint8_t class_index[SLAB_MAX_OBJECT / SIZE_GRANULE + 1];
+
+typedef struct FreeObject {
+    struct FreeObject *next;
+} FreeObject;
+
+typedef struct SlabCache SlabCache;
+
+// En-tête placé au début de chaque slab (aligné sur SLAB_SIZE) : on retrouve le
+// slab d'un objet en masquant son adresse
+typedef struct Slab {
+    SlabCache *owner;
+    uint32_t size_class;
+    struct Slab *next;          // slabs libres, pas encore attribués
+} Slab;
+
+struct SlabCache {
+    FreeObject *free[CLASS_COUNT];
+    _Atomic(FreeObject *) remote;           // objets libérés par d'autres threads
+    char pad[64 - sizeof(FreeObject *)];    // la pile distante sur sa propre ligne de cache
+    // Statistiques : écrites par le propriétaire seulement
+    size_t in_use[CLASS_COUNT];
+    size_t slabs[CLASS_COUNT];
+    SlabCache *next;
+};
+
+static _Thread_local SlabCache *local_cache = NULL;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int use_hugepages = 0;
+
+// Blocs et slabs libres, caches existants : chemin lent seulement
+static ProfMutex chunk_mutex = PROF_MUTEX_INITIALIZER("slab_chunks");
+static Slab *free_slabs = NULL;
+static SlabCache *caches = NULL;
+static _Atomic size_t reserved = 0;
+
+static void build_classes(void) {
+    uint32_t size = 0;
+    uint32_t step = SIZE_GRANULE;
+    for (int i = 0; i < CLASS_COUNT; ++i) {
+        if (size >= 128 && (size & (size - 1)) == 0) {
+            step = size / 8;
+        }
+        size += step;
+        class_sizes[i] = size;
+    }
+
+    unsigned size_class = 0;
+    for (size_t i = 0; i <= SLAB_MAX_OBJECT / SIZE_GRANULE; ++i) {
+        while (class_sizes[size_class] < i * SIZE_GRANULE) {
+            size_class++;
+        }
+        class_index[i] = (uint8_t)size_class;
+    }
+}
+
+void slab_init(const int hugepages) {
+    use_hugepages = hugepages;
+    pthread_once(&init_once, build_classes);
+}
+
+static void *chunk_map(void) {
+    void *chunk = MAP_FAILED;
+    if (use_hugepages) {
+        chunk = mmap(NULL, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (chunk != MAP_FAILED) {
+            return chunk;
+        }
+    }
+
+    // Pas de pages géantes réservées : bloc aligné sur 2 Mo, éligible aux pages
+    // géantes transparentes
+    char *raw = mmap(NULL, 2 * CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *aligned = (char *)(((uintptr_t)raw + CHUNK_SIZE - 1) & ~(uintptr_t)(CHUNK_SIZE - 1));
+    if (aligned > raw) {
+        munmap(raw, (size_t)(aligned - raw));
+    }
+    munmap(aligned + CHUNK_SIZE, (size_t)(raw + 2 * CHUNK_SIZE - (aligned + CHUNK_SIZE)));
+    if (use_hugepages) {
+        madvise(aligned, CHUNK_SIZE, MADV_HUGEPAGE);
+    }
+    return aligned;
+}
+
+static Slab *slab_take(void) {
+    prof_lock(&chunk_mutex);
+    if (!free_slabs) {
+        char *chunk = chunk_map();
+        if (!chunk) {
+            prof_unlock(&chunk_mutex);
+            return NULL;
+        }
+        atomic_fetch_add_explicit(&reserved, CHUNK_SIZE, memory_order_relaxed);
+        for (size_t offset = 0; offset < CHUNK_SIZE; offset += SLAB_SIZE) {
+            Slab *slab = (Slab *)(chunk + offset);
+            slab->next = free_slabs;
+            free_slabs = slab;
+        }
+    }
+    Slab *slab = free_slabs;
+    free_slabs = slab->next;
+    prof_unlock(&chunk_mutex);
+    return slab;
+}
+
+static SlabCache *cache_create(void) {
+    pthread_once(&init_once, build_classes);
+    // Un slab entier pour le cache : il est aligné et ne partage aucune ligne
+    SlabCache *cache = (SlabCache *)slab_take();
+    if (!cache) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(*cache));
+    prof_lock(&chunk_mutex);
+    cache->next = caches;
+    caches = cache;
+    prof_unlock(&chunk_mutex);
+    local_cache = cache;
+    return cache;
+}
+
+// Découpe un nouveau slab pour la classe
+static int cache_refill(SlabCache *cache, const unsigned size_class) {
+    Slab *slab = slab_take();
+    if (!slab) {
+        return -1;
+    }
+    slab->owner = cache;
+    slab->size_class = size_class;
+
+    const size_t size = class_sizes[size_class];
+    char *base = (char *)slab + SLAB_HEADER;
+    FreeObject *list = cache->free[size_class];
+    // Chaînés dans l'ordre des adresses : les premières allocations sont contiguës
+    for (size_t i = (SLAB_SIZE - SLAB_HEADER) / size; i-- > 0;) {
+        FreeObject *object = (FreeObject *)(base + i * size);
+        object->next = list;
+        list = object;
+    }
+    cache->free[size_class] = list;
+    cache->slabs[size_class]++;
+    return 0;
+}
+
+// Récupère en une fois les objets rendus par les autres threads
+static void cache_drain_remote(SlabCache *cache) {
+    FreeObject *object = atomic_exchange_explicit(&cache->remote, NULL, memory_order_acquire);
+    while (object) {
+        FreeObject *next = object->next;
+        const Slab *slab = (const Slab *)((uintptr_t)object & ~(uintptr_t)(SLAB_SIZE - 1));
+        object->next = cache->free[slab->size_class];
+        cache->free[slab->size_class] = object;
+        cache->in_use[slab->size_class]--;
+        object = next;
+    }
+}
+
+void *slab_alloc(const size_t size) {
+    if (size > SLAB_MAX_OBJECT) {
+        return NULL;
+    }
+    SlabCache *cache = local_cache ? local_cache : cache_create();
+    if (!cache) {
+        return NULL;
+    }
+    const unsigned size_class = class_index[(size + SIZE_GRANULE - 1) / SIZE_GRANULE];
+
+    FreeObject *object = cache->free[size_class];
+    if (!object) {
+        cache_drain_remote(cache);
+        if (!cache->free[size_class] && cache_refill(cache, size_class) < 0) {
+            return NULL;
+        }
+        object = cache->free[size_class];
+    }
+    cache->free[size_class] = object->next;
+    cache->in_use[size_class]++;
+    return object;
+}
+
+void *slab_calloc(const size_t size) {
+    void *ptr = slab_alloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void slab_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    FreeObject *object = ptr;
+    const Slab *slab = (const Slab *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+    SlabCache *owner = slab->owner;
+
+    if (owner == local_cache) {
+        object->next = owner->free[slab->size_class];
+        owner->free[slab->size_class] = object;
+        owner->in_use[slab->size_class]--;
+        return;
+    }
+
+    // Objet d'un autre thread : empilé sur sa pile distante (le propriétaire la vide
+    // d'un seul échange, donc pas de problème ABA)
+    FreeObject *head = atomic_load_explicit(&owner->remote, memory_order_relaxed);
+    do {
+        object->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote, &head, object,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+size_t slab_reserved(void) {
+    return atomic_load_explicit(&reserved, memory_order_relaxed);
+}
+
+void slab_dump(FILE *out) {
+    size_t slabs[CLASS_COUNT] = {0};
+    size_t in_use[CLASS_COUNT] = {0};
+
+    // Compteurs lus sans synchronisation avec leurs propriétaires : valeurs indicatives
+    prof_lock(&chunk_mutex);
+    for (const SlabCache *cache = caches; cache; cache = cache->next) {
+        for (int i = 0; i < CLASS_COUNT; ++i) {
+            slabs[i] += __atomic_load_n(&cache->slabs[i], __ATOMIC_RELAXED);
+            in_use[i] += __atomic_load_n(&cache->in_use[i], __ATOMIC_RELAXED);
+        }
+    }
+    prof_unlock(&chunk_mutex);
+
+    fprintf(out, "slab: %zu KB reserved%s\n", slab_reserved() >> 10, use_hugepages ? " (huge pages)" : "");
+    fprintf(out, "%8s %8s %10s %10s\n", "size", "slabs", "in use", "capacity");
+    for (int i = 0; i < CLASS_COUNT; ++i) {
+        if (slabs[i] == 0) {
+            continue;
+        }
+        // Les objets rendus par d'autres threads restent comptés jusqu'à leur récupération
+        fprintf(out, "%8u %8zu %10zu %10zu\n", class_sizes[i], slabs[i], in_use[i],
+                slabs[i] * ((SLAB_SIZE - SLAB_HEADER) / class_sizes[i]));
+    }
+}
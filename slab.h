@@ -0,0 +1,37 @@
+#ifndef CHAT_SLAB_H
+#define CHAT_SLAB_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Allocateur par classes de taille pour les objets du chemin critique
+// (connexions, trames, nœuds de file). Chaque thread possède son cache : une
+// allocation ou une libération locale n'est qu'un empilement/dépilement sans
+// verrou. Un objet libéré par un autre thread (trame diffusée relâchée par un
+// autre worker) est rendu à son propriétaire via une pile atomique.
+//
+// Les objets sont taillés dans des slabs de SLAB_SIZE octets alignés, eux-mêmes
+// découpés dans des blocs de 2 Mo obtenus par mmap (optionnellement en pages
+// géantes). La mémoire n'est jamais rendue au système.
+
+#define SLAB_SIZE (64 * 1024)
+#define SLAB_MAX_OBJECT 8192
+
+// À appeler avant la première allocation. hugepages : blocs en pages géantes
+// (MAP_HUGETLB si des pages sont réservées, sinon pages géantes transparentes).
+void slab_init(int hugepages);
+
+// size <= SLAB_MAX_OBJECT, sinon NULL
+void *slab_alloc(size_t size);
+void *slab_calloc(size_t size);
+
+// N'importe quel thread peut libérer un objet
+void slab_free(void *ptr);
+
+// Octets réservés auprès du système (blocs mmap)
+size_t slab_reserved(void);
+
+// Occupation par classe de taille
+void slab_dump(FILE *out);
+
+#endif
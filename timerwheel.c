@@ -0,0 +1,140 @@
+#include "timerwheel.h"
+
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * TIMER_SLOT_BITS)
+
+static void list_init(Timer *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_append(Timer *head, Timer *timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void list_unlink(Timer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+void timer_wheel_init(TimerWheel *wheel, const uint64_t now_ms) {
+    wheel->now = now_ms;
+    wheel->count = 0;
+    for (int level = 0; level < TIMER_LEVELS; ++level) {
+        for (int slot = 0; slot < TIMER_SLOTS; ++slot) {
+            list_init(&wheel->slots[level][slot]);
+        }
+    }
+}
+
+void timer_init(Timer *timer, const TimerCallback callback, void *arg) {
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+// Range la minuterie au niveau correspondant à la distance de son échéance
+static void place(TimerWheel *wheel, Timer *timer) {
+    uint64_t expires = timer->expires;
+    if (expires < wheel->now) {
+        expires = wheel->now;
+    }
+    const uint64_t delta = expires - wheel->now;
+
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1ull << LEVEL_SHIFT(level + 1))) {
+        level++;
+    }
+    if (delta >= (1ull << LEVEL_SHIFT(TIMER_LEVELS))) {
+        // Au-delà de la portée de la roue (~49 jours) : on plafonne
+        expires = wheel->now + (1ull << LEVEL_SHIFT(TIMER_LEVELS)) - 1;
+    }
+    list_append(&wheel->slots[level][(expires >> LEVEL_SHIFT(level)) & SLOT_MASK], timer);
+}
+
+void timer_schedule(TimerWheel *wheel, Timer *timer, const uint64_t delay_ms) {
+    if (timer_pending(timer)) {
+        list_unlink(timer);
+    } else {
+        wheel->count++;
+    }
+    timer->expires = wheel->now + (delay_ms ? delay_ms : 1);
+    place(wheel, timer);
+}
+
+void timer_cancel(TimerWheel *wheel, Timer *timer) {
+    if (!timer_pending(timer)) {
+        return;
+    }
+    list_unlink(timer);
+    wheel->count--;
+}
+
+// Redistribue une case d'un niveau supérieur ; renvoie l'indice de la case
+static int cascade(TimerWheel *wheel, const int level) {
+    const int index = (int)((wheel->now >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    Timer *head = &wheel->slots[level][index];
+    Timer pending;
+    list_init(&pending);
+    if (head->next != head) {
+        // On détache la liste entière avant de la replacer
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        list_init(head);
+    }
+    while (pending.next != &pending) {
+        Timer *timer = pending.next;
+        list_unlink(timer);
+        place(wheel, timer);
+    }
+    return index;
+}
+
+void timer_wheel_advance(TimerWheel *wheel, const uint64_t now_ms) {
+    // Roue vide : rien à déclencher ni à redescendre, on saute directement
+    if (wheel->count == 0 && wheel->now <= now_ms) {
+        wheel->now = now_ms + 1;
+        return;
+    }
+    while (wheel->now <= now_ms) {
+        const int index = (int)(wheel->now & SLOT_MASK);
+        if (index == 0) {
+            // Début d'un tour du niveau 0 : on descend les minuteries des niveaux supérieurs
+            for (int level = 1; level < TIMER_LEVELS && cascade(wheel, level) == 0; ++level) {
+            }
+        }
+
+        Timer *head = &wheel->slots[0][index];
+        while (head->next != head) {
+            Timer *timer = head->next;
+            list_unlink(timer);
+            wheel->count--;
+            timer->callback(timer, timer->arg);
+        }
+        wheel->now++;
+    }
+}
+
+int timer_wheel_timeout(const TimerWheel *wheel) {
+    if (wheel->count == 0) {
+        return -1;
+    }
+    // Première case non vide du niveau 0 avant la prochaine cascade
+    const int index = (int)(wheel->now & SLOT_MASK);
+    for (int offset = 0; offset < TIMER_SLOTS - index; ++offset) {
+        const Timer *head = &wheel->slots[0][index + offset];
+        if (head->next != head) {
+            return offset;
+        }
+    }
+    return TIMER_SLOTS - index;
+}
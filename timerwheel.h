@@ -0,0 +1,49 @@
+#ifndef CHAT_TIMERWHEEL_H
+#define CHAT_TIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Roue de temporisation hiérarchique (4 niveaux de 256 cases, granularité 1 ms).
+// Les minuteries sont intrusives : ajout et annulation en O(1), sans allocation.
+// Une roue appartient à un seul thread (pas de verrou).
+
+#define TIMER_LEVELS 4
+#define TIMER_SLOT_BITS 8
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+
+typedef struct Timer Timer;
+typedef void (*TimerCallback)(Timer *timer, void *arg);
+
+struct Timer {
+    Timer *next;
+    Timer *prev;
+    uint64_t expires;       // échéance en ms
+    TimerCallback callback;
+    void *arg;
+};
+
+typedef struct TimerWheel {
+    uint64_t now;           // prochaine milliseconde à traiter
+    size_t count;           // minuteries armées
+    Timer slots[TIMER_LEVELS][TIMER_SLOTS];     // têtes de listes circulaires
+} TimerWheel;
+
+void timer_wheel_init(TimerWheel *wheel, uint64_t now_ms);
+void timer_init(Timer *timer, TimerCallback callback, void *arg);
+
+// Arme (ou réarme) la minuterie pour dans delay_ms (au moins 1 ms)
+void timer_schedule(TimerWheel *wheel, Timer *timer, uint64_t delay_ms);
+void timer_cancel(TimerWheel *wheel, Timer *timer);
+
+static inline int timer_pending(const Timer *timer) {
+    return timer->next != NULL;
+}
+
+// Déclenche toutes les minuteries échues jusqu'à now_ms inclus
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now_ms);
+
+// Délai en ms avant la prochaine échéance (ou cascade), -1 si aucune minuterie
+int timer_wheel_timeout(const TimerWheel *wheel);
+
+#endif
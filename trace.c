@@ -0,0 +1,180 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRACE_BUFFER_SIZE (256 * 1024)
+#define TRACE_RING_SIZE 65536           // étapes en attente par thread (puissance de 2) : un envoi à 10k membres y tient
+#define TRACE_IDLE_SLEEP_NS 10000000    // 10 ms entre deux passes quand rien n'est à écrire
+
+const char *const trace_stage_names[TRACE_STAGE_COUNT] = {
+    "recv", "parse", "sequence", "enqueue", "write", "display",
+};
+
+typedef struct TraceEntry {
+    uint64_t trace_id;
+    uint64_t timestamp_ns;
+    int32_t peer;
+    uint32_t stage;
+} TraceEntry;
+
+// Anneau SPSC, comme ceux du journal : le thread qui trace produit, le thread
+// d'écriture consomme. Jamais libéré : un thread qui s'arrête le laisse aux suivants.
+typedef struct TraceRing {
+    _Atomic uint64_t head;
+    char pad1[64 - sizeof(uint64_t)];
+    _Atomic uint64_t tail;
+    char pad2[64 - sizeof(uint64_t)];
+    _Atomic int owned;
+    struct TraceRing *next;
+    TraceEntry entries[TRACE_RING_SIZE];
+} TraceRing;
+
+static FILE *trace_file = NULL;
+static unsigned trace_rate = 0;
+static _Atomic uint64_t trace_counter = 0;
+static _Atomic int trace_running = 0;
+static _Atomic unsigned long long dropped = 0;
+static pthread_t trace_thread;
+
+static _Atomic(TraceRing *) rings = NULL;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static _Thread_local TraceRing *thread_ring = NULL;
+
+static void release_ring(void *arg) {
+    TraceRing *ring = arg;
+    atomic_store_explicit(&ring->owned, 0, memory_order_release);
+}
+
+// Un anneau abandonné garde ses étapes : le thread d'écriture les videra quand même
+static TraceRing *acquire_ring(void) {
+    pthread_mutex_lock(&rings_mutex);
+    TraceRing *ring = atomic_load(&rings);
+    while (ring) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&ring->owned, &expected, 1)) {
+            break;
+        }
+        ring = ring->next;
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(TraceRing));
+        if (ring) {
+            atomic_store(&ring->owned, 1);
+            ring->next = atomic_load(&rings);
+            atomic_store_explicit(&rings, ring, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&rings_mutex);
+    if (ring) {
+        pthread_setspecific(ring_key, ring);
+    }
+    return ring;
+}
+
+static size_t drain_all(void) {
+    size_t count = 0;
+    for (TraceRing *ring = atomic_load_explicit(&rings, memory_order_acquire); ring; ring = ring->next) {
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        const uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; ++tail, ++count) {
+            const TraceEntry *entry = &ring->entries[tail & (TRACE_RING_SIZE - 1)];
+            fprintf(trace_file, "%llu %s %d %llu\n", (unsigned long long)entry->trace_id,
+                    trace_stage_names[entry->stage], entry->peer, (unsigned long long)entry->timestamp_ns);
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return count;
+}
+
+// Seul thread à écrire dans le fichier : les étapes ne prennent aucun verrou
+static void *trace_thread_main(void *arg) {
+    (void)arg;
+    const struct timespec idle = {0, TRACE_IDLE_SLEEP_NS};
+    while (1) {
+        const int running = atomic_load(&trace_running);
+        const size_t count = drain_all();
+        if (!running) {
+            break;
+        }
+        if (count == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+int trace_init(const char *path, const unsigned sample) {
+    trace_file = fopen(path, "w");
+    if (!trace_file) {
+        return -1;
+    }
+    // Gros tampon : les lignes ne sont écrites sur disque que par blocs
+    setvbuf(trace_file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+    trace_rate = sample ? sample : 1;
+    if (pthread_key_create(&ring_key, release_ring) != 0) {
+        fclose(trace_file);
+        trace_file = NULL;
+        return -1;
+    }
+    atomic_store(&trace_running, 1);
+    if (pthread_create(&trace_thread, NULL, trace_thread_main, NULL) != 0) {
+        atomic_store(&trace_running, 0);
+        fclose(trace_file);
+        trace_file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void trace_shutdown(void) {
+    if (!atomic_exchange(&trace_running, 0)) {
+        return;
+    }
+    // Le thread fait une dernière passe après avoir vu l'arrêt
+    pthread_join(trace_thread, NULL);
+    fclose(trace_file);
+}
+
+unsigned long long trace_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+uint64_t trace_sample(void) {
+    if (!atomic_load_explicit(&trace_running, memory_order_relaxed)) {
+        return 0;
+    }
+    const uint64_t n = atomic_fetch_add_explicit(&trace_counter, 1, memory_order_relaxed) + 1;
+    return n % trace_rate == 0 ? n : 0;
+}
+
+void trace_record(const uint64_t trace_id, const TraceStage stage, const int peer, const uint64_t timestamp_ns) {
+    if (stage >= TRACE_STAGE_COUNT || !atomic_load_explicit(&trace_running, memory_order_relaxed)) {
+        return;
+    }
+    TraceRing *ring = thread_ring;
+    if (!ring) {
+        ring = thread_ring = acquire_ring();
+        if (!ring) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == TRACE_RING_SIZE) {
+        // Anneau plein : l'étape est perdue plutôt que d'attendre le disque
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring->entries[head & (TRACE_RING_SIZE - 1)] = (TraceEntry){
+        .trace_id = trace_id,
+        .timestamp_ns = timestamp_ns,
+        .peer = peer,
+        .stage = (uint32_t)stage,
+    };
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
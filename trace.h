@@ -0,0 +1,41 @@
+#ifndef CHAT_TRACE_H
+#define CHAT_TRACE_H
+
+#include <stdint.h>
+
+// Traçage de bout en bout d'un échantillon de messages.
+// Chaque étape du pipeline produit une ligne « id étape destinataire horodatage_ns »
+// dans le fichier de trace ; trace_report reconstitue ensuite la latence par étape.
+// Une étape est déposée sans verrou dans un anneau propre au thread ; un thread
+// dédié les écrit, sans ordre entre threads.
+
+typedef enum TraceStage {
+    TRACE_RECV = 0,     // trame reçue du client émetteur
+    TRACE_PARSE,        // message formaté
+    TRACE_SEQUENCE,     // message stocké dans l'historique
+    TRACE_ENQUEUE,      // envoi commencé vers un destinataire
+    TRACE_WRITE,        // envoi terminé vers un destinataire
+    TRACE_DISPLAY,      // affichage confirmé par le client destinataire
+    TRACE_STAGE_COUNT,
+} TraceStage;
+
+extern const char *const trace_stage_names[TRACE_STAGE_COUNT];
+
+// Active le traçage d'un message sur sample vers path et démarre le thread
+// d'écriture ; renvoie -1 si le fichier ne peut pas être ouvert
+int trace_init(const char *path, unsigned sample);
+// Écrit les étapes en attente et ferme le fichier
+void trace_shutdown(void);
+
+// Étapes perdues, anneau de leur thread plein
+unsigned long long trace_dropped(void);
+
+// Renvoie un identifiant de trace non nul si le prochain message doit être tracé
+uint64_t trace_sample(void);
+
+// timestamp_ns : realtime_ns() (util.h), l'horloge des clients qui confirment
+// l'affichage. peer : socket du destinataire pour les étapes par destinataire, -1 sinon.
+// Ne bloque pas : une copie dans l'anneau du thread.
+void trace_record(uint64_t trace_id, TraceStage stage, int peer, uint64_t timestamp_ns);
+
+#endif
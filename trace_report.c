@@ -0,0 +1,185 @@
+// Reconstitue la latence par étape à partir d'un fichier produit par `server -t`.
+// Usage : trace_report <trace_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "trace.h"
+
+typedef struct TraceLine {
+    uint64_t id;
+    uint64_t timestamp_ns;
+    int peer;
+    int stage;
+} TraceLine;
+
+typedef enum Segment {
+    SEG_PARSE = 0,      // recv -> parse
+    SEG_SEQUENCE,       // parse -> sequence
+    SEG_FANOUT,         // sequence -> enqueue (attente du verrou et rang dans la diffusion)
+    SEG_WRITE,          // enqueue -> write
+    SEG_DELIVERY,       // write -> display (réseau, client, rendu)
+    SEG_SERVER,         // recv -> write
+    SEG_END_TO_END,     // recv -> display
+    SEG_COUNT,
+} Segment;
+
+static const char *segment_names[SEG_COUNT] = {
+    "recv->parse", "parse->sequence", "sequence->enqueue", "enqueue->write",
+    "write->display", "recv->write (server)", "recv->display (total)",
+};
+
+typedef struct Samples {
+    double *values;
+    size_t count;
+    size_t capacity;
+} Samples;
+
+static void add_sample(Samples *samples, const double value) {
+    if (samples->count == samples->capacity) {
+        samples->capacity = samples->capacity ? samples->capacity * 2 : 256;
+        samples->values = realloc(samples->values, samples->capacity * sizeof(double));
+        if (!samples->values) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    samples->values[samples->count++] = value;
+}
+
+static int compare_double(const void *lhs, const void *rhs) {
+    const double a = *(const double *)lhs;
+    const double b = *(const double *)rhs;
+    return (a > b) - (a < b);
+}
+
+static double percentile(const Samples *samples, const double p) {
+    size_t index = (size_t)(p * (double)(samples->count - 1) + 0.5);
+    return samples->values[index];
+}
+
+static int compare_line(const void *lhs, const void *rhs) {
+    const TraceLine *a = lhs;
+    const TraceLine *b = rhs;
+    if (a->id != b->id) return a->id < b->id ? -1 : 1;
+    if (a->peer != b->peer) return a->peer < b->peer ? -1 : 1;
+    return a->stage - b->stage;
+}
+
+static int stage_from_name(const char *name) {
+    for (int i = 0; i < TRACE_STAGE_COUNT; ++i) {
+        if (strcmp(name, trace_stage_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static double delta_us(const uint64_t from, const uint64_t to) {
+    return ((double)to - (double)from) / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace_file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *in = fopen(argv[1], "r");
+    if (!in) {
+        perror("Error opening the trace file");
+        return EXIT_FAILURE;
+    }
+
+    TraceLine *lines = NULL;
+    size_t count = 0, capacity = 0;
+    char stage_name[32];
+    unsigned long long id, timestamp;
+    int peer;
+    while (fscanf(in, "%llu %31s %d %llu", &id, stage_name, &peer, &timestamp) == 4) {
+        const int stage = stage_from_name(stage_name);
+        if (stage < 0) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            lines = realloc(lines, capacity * sizeof(TraceLine));
+            if (!lines) {
+                perror("realloc");
+                return EXIT_FAILURE;
+            }
+        }
+        lines[count++] = (TraceLine){id, timestamp, peer, stage};
+    }
+    fclose(in);
+
+    qsort(lines, count, sizeof(TraceLine), compare_line);
+
+    Samples samples[SEG_COUNT] = {0};
+    size_t messages = 0;
+    size_t i = 0;
+    while (i < count) {
+        // Étapes communes au message (recv/parse chez l'émetteur, sequence sans destinataire)
+        const uint64_t message_id = lines[i].id;
+        uint64_t stamps[TRACE_STAGE_COUNT] = {0};
+        size_t end = i;
+        while (end < count && lines[end].id == message_id) {
+            if (lines[end].stage <= TRACE_SEQUENCE) {
+                stamps[lines[end].stage] = lines[end].timestamp_ns;
+            }
+            end++;
+        }
+        messages++;
+        if (stamps[TRACE_RECV] && stamps[TRACE_PARSE]) {
+            add_sample(&samples[SEG_PARSE], delta_us(stamps[TRACE_RECV], stamps[TRACE_PARSE]));
+        }
+        if (stamps[TRACE_PARSE] && stamps[TRACE_SEQUENCE]) {
+            add_sample(&samples[SEG_SEQUENCE], delta_us(stamps[TRACE_PARSE], stamps[TRACE_SEQUENCE]));
+        }
+
+        // Étapes par destinataire
+        size_t j = i;
+        while (j < end) {
+            const int recipient = lines[j].peer;
+            uint64_t per_peer[TRACE_STAGE_COUNT] = {0};
+            while (j < end && lines[j].peer == recipient) {
+                if (lines[j].stage >= TRACE_ENQUEUE) {
+                    per_peer[lines[j].stage] = lines[j].timestamp_ns;
+                }
+                j++;
+            }
+            if (stamps[TRACE_SEQUENCE] && per_peer[TRACE_ENQUEUE]) {
+                add_sample(&samples[SEG_FANOUT], delta_us(stamps[TRACE_SEQUENCE], per_peer[TRACE_ENQUEUE]));
+            }
+            if (per_peer[TRACE_ENQUEUE] && per_peer[TRACE_WRITE]) {
+                add_sample(&samples[SEG_WRITE], delta_us(per_peer[TRACE_ENQUEUE], per_peer[TRACE_WRITE]));
+            }
+            if (per_peer[TRACE_WRITE] && per_peer[TRACE_DISPLAY]) {
+                add_sample(&samples[SEG_DELIVERY], delta_us(per_peer[TRACE_WRITE], per_peer[TRACE_DISPLAY]));
+            }
+            if (stamps[TRACE_RECV] && per_peer[TRACE_WRITE]) {
+                add_sample(&samples[SEG_SERVER], delta_us(stamps[TRACE_RECV], per_peer[TRACE_WRITE]));
+            }
+            if (stamps[TRACE_RECV] && per_peer[TRACE_DISPLAY]) {
+                add_sample(&samples[SEG_END_TO_END], delta_us(stamps[TRACE_RECV], per_peer[TRACE_DISPLAY]));
+            }
+        }
+        i = end;
+    }
+
+    printf("%zu traced messages, %zu records\n", messages, count);
+    printf("%-24s %8s %10s %10s %10s %10s %10s\n", "stage (us)", "count", "avg", "p50", "p90", "p99", "max");
+    for (int s = 0; s < SEG_COUNT; ++s) {
+        Samples *current = &samples[s];
+        if (current->count == 0) {
+            printf("%-24s %8d %10s %10s %10s %10s %10s\n", segment_names[s], 0, "-", "-", "-", "-", "-");
+            continue;
+        }
+        qsort(current->values, current->count, sizeof(double), compare_double);
+        double sum = 0;
+        for (size_t k = 0; k < current->count; ++k) sum += current->values[k];
+        printf("%-24s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", segment_names[s], current->count,
+               sum / (double)current->count, percentile(current, 0.50), percentile(current, 0.90),
+               percentile(current, 0.99), current->values[current->count - 1]);
+        free(current->values);
+    }
+    printf("(write->display compares client and server clocks: only exact on a single host)\n");
+    free(lines);
+    return EXIT_SUCCESS;
+}
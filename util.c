@@ -0,0 +1,142 @@
+#include "util.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int buffer_reserve(Buffer *buffer, const size_t length) {
+    if (buffer->length + length <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + length) {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity);
+    if (!data) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+int buffer_append(Buffer *buffer, const void *data, const size_t length) {
+    if (buffer_reserve(buffer, length) < 0) {
+        return -1;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return 0;
+}
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t monotonic_us(void) {
+    return monotonic_ns() / 1000;
+}
+
+uint64_t monotonic_ms(void) {
+    return monotonic_ns() / 1000000;
+}
+
+uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int origin_accept(OriginTable *table, const uint64_t id, const uint64_t seq, uint64_t *skipped) {
+    const uint64_t now_ms = monotonic_ms();
+    Origin *origin = NULL;
+    Origin *oldest = NULL;
+    if (skipped) {
+        *skipped = 0;
+    }
+    for (int i = 0; i < table->count; ++i) {
+        if (table->origins[i].id == id) {
+            origin = &table->origins[i];
+            break;
+        }
+        if (!oldest || table->origins[i].seen_ms < oldest->seen_ms) {
+            oldest = &table->origins[i];
+        }
+    }
+    if (!origin) {
+        // Première trame d'un serveur : on ne sait rien de ce qui a précédé.
+        // Table pleine : on oublie l'origine la plus ancienne (serveur redémarré).
+        origin = table->count < ORIGIN_MAX ? &table->origins[table->count++] : oldest;
+        *origin = (Origin){.id = id, .last_seq = seq, .seen_ms = now_ms};
+        return 1;
+    }
+    origin->seen_ms = now_ms;
+    if (seq <= origin->last_seq) {
+        return 0;
+    }
+    if (skipped) {
+        *skipped = seq - origin->last_seq - 1;
+    }
+    origin->last_seq = seq;
+    return 1;
+}
+
+int parse_address(const char *text, struct sockaddr_in *address, char *name, const size_t name_len) {
+    char host[INET_ADDRSTRLEN] = "127.0.0.1";
+    const char *colon = strrchr(text, ':');
+    const char *port_text = text;
+    if (colon) {
+        const size_t host_len = (size_t)(colon - text);
+        if (host_len == 0 || host_len >= sizeof(host)) {
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(host, text, host_len);
+        host[host_len] = '\0';
+        port_text = colon + 1;
+    }
+    char *end;
+    const unsigned long port = strtoul(port_text, &end, 10);
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    if (*port_text == '\0' || *end != '\0' || port == 0 || port > 65535 ||
+        inet_pton(AF_INET, host, &address->sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    address->sin_port = htons((uint16_t)port);
+    snprintf(name, name_len, "%s:%lu", host, port);
+    return 0;
+}
+
+int parse_log_level(const char *name, LogLevel *level) {
+    static const char *names[] = {"debug", "info", "warn", "error"};
+    for (int i = 0; i < 4; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            *level = (LogLevel)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int parse_rate(const char *text, RateLimit *limit) {
+    char *end;
+    const unsigned long rate = strtoul(text, &end, 10);
+    unsigned long burst = rate * 2;
+    if (*end == ':') {
+        burst = strtoul(end + 1, &end, 10);
+    }
+    if (*end != '\0' || rate > UINT32_MAX || burst > UINT32_MAX || (rate && burst == 0)) {
+        return -1;
+    }
+    limit->rate = (uint32_t)rate;
+    limit->burst = (uint32_t)burst;
+    return 0;
+}
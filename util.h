@@ -0,0 +1,62 @@
+#ifndef CHAT_UTIL_H
+#define CHAT_UTIL_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "log.h"
+#include "ratelimit.h"
+
+// Outils partagés par le serveur, la fédération, la réplication et la passerelle :
+// tampons extensibles, horloges, dédoublonnage par origine et lecture des options.
+// Les horloges servent aussi au client, à la bibliothèque -S et aux modules de fond.
+
+#define ORIGIN_MAX 64
+
+// Tampon extensible (files d'envoi et de réception des liens)
+typedef struct Buffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+// Place pour length octets de plus ; -1 si l'allocation échoue (tampon inchangé)
+int buffer_reserve(Buffer *buffer, size_t length);
+int buffer_append(Buffer *buffer, const void *data, size_t length);
+
+// CLOCK_MONOTONIC : délais et durées mesurées
+uint64_t monotonic_ns(void);
+uint64_t monotonic_us(void);
+uint64_t monotonic_ms(void);
+
+// CLOCK_REALTIME : horodatage du journal et des traces, comparable à celui des clients
+uint64_t realtime_ns(void);
+
+// Dernier numéro reçu de chaque serveur d'origine d'un message relayé
+typedef struct Origin {
+    uint64_t id;
+    uint64_t last_seq;
+    uint64_t seen_ms;
+} Origin;
+
+typedef struct OriginTable {
+    Origin origins[ORIGIN_MAX];
+    int count;
+} OriginTable;
+
+// Numéro seq d'un message de l'origine id : 1 s'il est nouveau, 0 si déjà reçu.
+// *skipped (si non NULL) reçoit le nombre de numéros sautés depuis le précédent.
+int origin_accept(OriginTable *table, uint64_t id, uint64_t seq, uint64_t *skipped);
+
+// "host:port" (adresse IPv4) ou "port" (127.0.0.1). name reçoit "host:port".
+// -1 si l'adresse est invalide (errno = EINVAL).
+int parse_address(const char *text, struct sockaddr_in *address, char *name, size_t name_len);
+
+// Niveau de journalisation des options -l : debug, info, warn ou error
+int parse_log_level(const char *name, LogLevel *level);
+
+// Limite de débit des options -r, -R : « débit[:rafale] », rafale = 2 × débit par défaut
+int parse_rate(const char *text, RateLimit *limit);
+
+#endif